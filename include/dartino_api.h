@@ -6,6 +6,7 @@
 #define INCLUDE_DARTINO_API_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef _MSC_VER
 // TODO(herhut): Do we need a __declspec here for Windows?
@@ -27,9 +28,74 @@ typedef void (*PrintInterceptionFunction)(
     const char* message, int out, void* data);
 typedef void (*ProgramExitCallback)(DartinoProgram, int exitcode, void* data);
 
+// TODO: Keep these in sync with src/vm/latency_histogram.h:SchedulerLatency
+typedef enum {
+  // The time from a process being made ready until it starts running.
+  kDartinoLatencyReadyToRunning = 0,
+  // The duration of the slices in which a process runs uninterrupted.
+  kDartinoLatencySlice = 1,
+} DartinoLatencyKind;
+
+// A summary of scheduler latencies in microseconds. Percentiles are rounded up
+// and are accurate to within 1/8 of their value.
+typedef struct {
+  uint64_t count;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+  uint64_t max;
+} DartinoLatencySummary;
+
+// All counts are only collected when running with -Xlock_statistics.
+typedef struct {
+  // Number of lock acquisitions.
+  uint64_t acquisitions;
+  // Number of acquisitions that found the lock taken.
+  uint64_t contended;
+  // Number of contended acquisitions that had to put the thread to sleep.
+  uint64_t parked;
+} DartinoLockStatistics;
+
 // Setup must be called before using any of the other API methods.
 DARTINO_EXPORT void DartinoSetup(void);
 
+// Set the number of scheduler worker threads used to interpret separate
+// programs in parallel. A count of 0 means one worker per hardware thread.
+// Without parallel interpretation there is a single worker. Must be called
+// before DartinoSetup.
+DARTINO_EXPORT void DartinoSetWorkerThreadCount(int count);
+
+// Pin the VM threads to the given CPUs, e.g. "2,3,8-11". The event handler
+// thread, the GC thread and the worker threads are assigned CPUs from the
+// list in that order, wrapping around. Passing NULL disables pinning. Must be
+// called before DartinoSetup.
+DARTINO_EXPORT void DartinoSetCpuAffinity(const char* cpus);
+
+// Set the time slice, in milliseconds, after which an interpreting process is
+// preempted if other processes are waiting to run. The default is 100 ms.
+DARTINO_EXPORT void DartinoSetTimeSlice(int milliseconds);
+
+// Set the size, in kilobytes, the shared old space may grow to before it is
+// first collected, and the size it may never exceed. A maximum of 0 means no
+// limit. The VM exits with a fatal error if the live data does not fit in
+// the maximum. Takes effect at the next garbage collection.
+DARTINO_EXPORT void DartinoSetHeapSize(int minimum_kb, int maximum_kb);
+
+// Set the number of kilobytes allocated in the shared new space between
+// scavenges. The default of 0 makes it an eighth of the old space, or adapts
+// it to the pause target set with DartinoSetTargetPauseTime. Takes effect at
+// the next scavenge.
+DARTINO_EXPORT void DartinoSetYoungGenerationSize(int kilobytes);
+
+// Set the scavenge pause time, in milliseconds, that the new space size
+// adapts to: it shrinks after longer pauses and grows while many objects
+// survive. The default of 0 turns the adaptive size off.
+DARTINO_EXPORT void DartinoSetTargetPauseTime(int milliseconds);
+
+// Read the acquisition and contention counts of the VM's internal locks.
+DARTINO_EXPORT void DartinoGetLockStatistics(DartinoLockStatistics* stats);
+
 // TearDown should be called when an application is done using the
 // dartino API in order to free up resources.
 DARTINO_EXPORT void DartinoTearDown(void);
@@ -133,4 +199,28 @@ void DartinoFreezeProgramGroup(DartinoProgramGroup group);
 // Unfreezes a program group.
 void DartinoUnfreezeProgramGroup(DartinoProgramGroup group);
 
+// Enables or disables the recording of scheduler latencies. Can be called at
+// any time. Recording is disabled by default.
+DARTINO_EXPORT void DartinoSetSchedulerLatencyEnabled(bool enabled);
+
+// Fills in the summary of the scheduler latencies of [kind] recorded for all
+// processes of the program. Returns false if nothing was recorded.
+DARTINO_EXPORT bool DartinoGetProgramSchedulerLatency(
+    DartinoProgram program,
+    DartinoLatencyKind kind,
+    DartinoLatencySummary* summary);
+
+// Sets the relative share of CPU time the program gets when competing with
+// other programs. The default weight is 100, and the weight must be positive.
+void DartinoSetProgramCpuWeight(DartinoProgram program, int weight);
+
+// Sets the relative share of CPU time all programs of the group together get
+// when competing with other programs. The default weight is 100, and the
+// weight must be positive.
+void DartinoSetProgramGroupCpuWeight(DartinoProgramGroup group, int weight);
+
+// Returns the time spent interpreting processes of the program, in
+// microseconds.
+uint64_t DartinoGetProgramCpuTime(DartinoProgram program);
+
 #endif  // INCLUDE_DARTINO_API_H_
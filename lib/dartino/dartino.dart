@@ -262,6 +262,33 @@ enum DeathReason {
   Killed,
 }
 
+// TODO: Keep these in sync with src/vm/latency_histogram.h:SchedulerLatency
+enum SchedulerLatencyKind {
+  /// The time from a process being made ready until it starts running.
+  readyToRunning,
+  /// The duration of the slices in which a process runs uninterrupted.
+  slice,
+}
+
+/**
+ * A summary of scheduler latencies in microseconds. Percentiles are rounded
+ * up and are accurate to within 1/8 of their value.
+ */
+class SchedulerLatency {
+  final int count;
+  final int p50;
+  final int p90;
+  final int p99;
+  final int p999;
+  final int max;
+
+  const SchedulerLatency._(
+      this.count, this.p50, this.p90, this.p99, this.p999, this.max);
+
+  String toString() => "SchedulerLatency(count: $count, p50: $p50, "
+      "p90: $p90, p99: $p99, p99.9: $p999, max: $max)";
+}
+
 class Process {
   // This is the address of the native process/4 so that it fits in a Smi.
   final int _nativeProcessHandle;
@@ -310,7 +337,82 @@ class Process {
     throw dartino.nativeError;
   }
 
-  static Process spawn(Function fn, [argument]) {
+  // TODO: Keep these in sync with src/vm/process.h:Process::Priority
+  static const int lowPriority = 0;
+  static const int normalPriority = 1;
+  static const int highPriority = 2;
+
+  /**
+   * The scheduling priority of this process, or null if the process is dead.
+   * Ready processes with a higher priority are run first. Processes that have
+   * been waiting for long are given a higher priority, so low priority
+   * processes are not starved.
+   *
+   * A spawned process inherits the priority of its parent unless a priority
+   * is passed to [spawn] or [spawnDetached].
+   */
+  @dartino.native int get priority {
+    throw dartino.nativeError;
+  }
+
+  /**
+   * Changes the priority of this process. The new priority takes effect the
+   * next time the process becomes ready to run. Returns false if the process
+   * is dead.
+   */
+  bool setPriority(int priority) => _setPriority(priority);
+
+  @dartino.native bool _setPriority(int priority) {
+    switch (dartino.nativeError) {
+      case dartino.wrongArgumentType:
+        throw new ArgumentError.value(priority, "priority");
+      case dartino.indexOutOfBounds:
+        throw new RangeError.range(priority, lowPriority, highPriority);
+      default:
+        throw dartino.nativeError;
+    }
+  }
+
+  /**
+   * Enables or disables the recording of scheduler latencies for all
+   * processes. Recording is disabled by default.
+   */
+  static void set schedulerLatencyEnabled(bool enabled) {
+    _setLatencyEnabled(enabled);
+  }
+
+  /**
+   * Returns the recorded scheduler latencies of [kind] of this process, or of
+   * all processes of its program if [ofProgram] is true. Returns null if the
+   * process is dead or nothing was recorded.
+   */
+  SchedulerLatency schedulerLatency(SchedulerLatencyKind kind,
+                                    {bool ofProgram: false}) {
+    int index = kind.index;
+    int count = _latencyCount(index, ofProgram);
+    if (count == null) return null;
+    return new SchedulerLatency._(
+        count,
+        _latencyAt(index, ofProgram, 5000),
+        _latencyAt(index, ofProgram, 9000),
+        _latencyAt(index, ofProgram, 9900),
+        _latencyAt(index, ofProgram, 9990),
+        _latencyAt(index, ofProgram, 10000));
+  }
+
+  @dartino.native int _latencyCount(int kind, bool ofProgram) {
+    throw dartino.nativeError;
+  }
+
+  @dartino.native int _latencyAt(int kind, bool ofProgram, int permyriad) {
+    throw dartino.nativeError;
+  }
+
+  @dartino.native static void _setLatencyEnabled(bool enabled) {
+    throw dartino.nativeError;
+  }
+
+  static Process spawn(Function fn, [argument, int priority]) {
     if (!isImmutable(fn)) {
       throw new ArgumentError(
           'The closure passed to Process.spawn() must be immutable.');
@@ -321,16 +423,26 @@ class Process {
           'The optional argument passed to Process.spawn() must be immutable.');
     }
 
-    return _spawn(_entry, fn, argument, true, true, null);
+    _checkPriority(priority);
+    return _spawn(_entry, fn, argument, true, true, null, priority);
   }
 
-  static Process spawnDetached(Function fn, {Port monitor}) {
+  static Process spawnDetached(Function fn, {Port monitor, int priority}) {
     if (!isImmutable(fn)) {
       throw new ArgumentError(
           'The closure passed to Process.spawnDetached() must be immutable.');
     }
 
-    return _spawn(_entry, fn, null, true, false, monitor);
+    _checkPriority(priority);
+    return _spawn(_entry, fn, null, true, false, monitor, priority);
+  }
+
+  static void _checkPriority(int priority) {
+    if (priority == null) return;
+    if (priority < lowPriority || priority > highPriority) {
+      throw new RangeError.range(
+          priority, lowPriority, highPriority, "priority");
+    }
   }
 
   /**
@@ -414,7 +526,8 @@ class Process {
                                        argument,
                                        bool linkToChild,
                                        bool linkFromChild,
-                                       Port monitor) {
+                                       Port monitor,
+                                       int priority) {
     throw new ArgumentError();
   }
 
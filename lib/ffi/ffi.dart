@@ -54,6 +54,9 @@ abstract class Foreign {
   @dartino.native static int _errno() {
     throw new UnsupportedError('_errno');
   }
+  @dartino.native static void _setErrno(int value) {
+    throw new ArgumentError();
+  }
   @dartino.native static int _platform() {
     throw new UnsupportedError('_platform');
   }
@@ -70,6 +73,19 @@ class ForeignFunction extends Foreign {
   final ForeignLibrary _library;
   const ForeignFunction.fromAddress(this.address, [this._library = null]);
 
+  /// A view of this function where calls run on the blocking call pool of
+  /// the VM instead of on the thread interpreting the caller.
+  ///
+  /// Use this for functions that may block for a long time, such as `read`
+  /// on a pipe or a DNS lookup. The calling fiber waits for the result while
+  /// other processes keep running. The value of [Foreign.errno] after the
+  /// call is the one set by the function.
+  ForeignFunction get detached {
+    return new _DetachedForeignFunction(address, _library);
+  }
+
+  static final bool _detachAll = _detachAllCalls();
+
   /// Helper function for retrying functions that follow the POSIX-convention
   /// of returning `-1` and setting `errno` to `EINTR`.
   ///
@@ -282,6 +298,116 @@ class ForeignFunction extends Foreign {
   @dartino.native static int _Lcall$wLw(int address, a0, a1, a2) {
     throw new ArgumentError();
   }
+
+  @dartino.native static bool _detachAllCalls() {
+    throw new UnsupportedError('_detachAllCalls');
+  }
+
+  @dartino.native static void _detachedCall(int kind, int arity, int address,
+      Port port, a0, a1, a2, a3, a4, a5, a6) {
+    switch (dartino.nativeError) {
+      case dartino.wrongArgumentType:
+        throw new ArgumentError();
+      case dartino.indexOutOfBounds:
+        throw new RangeError.range(arity, 0, 7, 'arity');
+      default:
+        throw dartino.nativeError;
+    }
+  }
+}
+
+class _DetachedForeignFunction extends ForeignFunction {
+  // These constants must be in sync with the enum BlockingCall::Kind in
+  // src/vm/blocking_call_pool.h.
+  static const int _INT_CALL = 0;
+  static const int _POINTER_CALL = 1;
+  static const int _VOID_CALL = 2;
+  static const int _LONG_CALL_wLw = 3;
+
+  const _DetachedForeignFunction(int address, ForeignLibrary library)
+      : super.fromAddress(address, library);
+
+  ForeignFunction get detached => this;
+
+  // Run the call on the blocking call pool and wait for the result and the
+  // errno, which are delivered as two consecutive messages.
+  int _call(int kind, int arity,
+            [a0 = 0, a1 = 0, a2 = 0, a3 = 0, a4 = 0, a5 = 0, a6 = 0]) {
+    Channel channel = new Channel();
+    Port port = new Port(channel);
+    ForeignFunction._detachedCall(kind, arity, address, port, _convert(a0),
+        _convert(a1), _convert(a2), _convert(a3), _convert(a4), _convert(a5),
+        _convert(a6));
+    int result = channel.receive();
+    Foreign._setErrno(channel.receive());
+    return result;
+  }
+
+  int icall$0() => _call(_INT_CALL, 0);
+  int icall$1(a0) => _call(_INT_CALL, 1, a0);
+  int icall$2(a0, a1) => _call(_INT_CALL, 2, a0, a1);
+  int icall$3(a0, a1, a2) => _call(_INT_CALL, 3, a0, a1, a2);
+  int icall$4(a0, a1, a2, a3) => _call(_INT_CALL, 4, a0, a1, a2, a3);
+  int icall$5(a0, a1, a2, a3, a4) {
+    return _call(_INT_CALL, 5, a0, a1, a2, a3, a4);
+  }
+  int icall$6(a0, a1, a2, a3, a4, a5) {
+    return _call(_INT_CALL, 6, a0, a1, a2, a3, a4, a5);
+  }
+  int icall$7(a0, a1, a2, a3, a4, a5, a6) {
+    return _call(_INT_CALL, 7, a0, a1, a2, a3, a4, a5, a6);
+  }
+
+  ForeignPointer pcall$0() => new ForeignPointer(_call(_POINTER_CALL, 0));
+  ForeignPointer pcall$1(a0) {
+    return new ForeignPointer(_call(_POINTER_CALL, 1, a0));
+  }
+  ForeignPointer pcall$2(a0, a1) {
+    return new ForeignPointer(_call(_POINTER_CALL, 2, a0, a1));
+  }
+  ForeignPointer pcall$3(a0, a1, a2) {
+    return new ForeignPointer(_call(_POINTER_CALL, 3, a0, a1, a2));
+  }
+  ForeignPointer pcall$4(a0, a1, a2, a3) {
+    return new ForeignPointer(_call(_POINTER_CALL, 4, a0, a1, a2, a3));
+  }
+  ForeignPointer pcall$5(a0, a1, a2, a3, a4) {
+    return new ForeignPointer(_call(_POINTER_CALL, 5, a0, a1, a2, a3, a4));
+  }
+  ForeignPointer pcall$6(a0, a1, a2, a3, a4, a5) {
+    return new ForeignPointer(
+        _call(_POINTER_CALL, 6, a0, a1, a2, a3, a4, a5));
+  }
+
+  void vcall$0() {
+    _call(_VOID_CALL, 0);
+  }
+
+  void vcall$1(a0) {
+    _call(_VOID_CALL, 1, a0);
+  }
+
+  void vcall$2(a0, a1) {
+    _call(_VOID_CALL, 2, a0, a1);
+  }
+
+  void vcall$3(a0, a1, a2) {
+    _call(_VOID_CALL, 3, a0, a1, a2);
+  }
+
+  void vcall$4(a0, a1, a2, a3) {
+    _call(_VOID_CALL, 4, a0, a1, a2, a3);
+  }
+
+  void vcall$5(a0, a1, a2, a3, a4) {
+    _call(_VOID_CALL, 5, a0, a1, a2, a3, a4);
+  }
+
+  void vcall$6(a0, a1, a2, a3, a4, a5) {
+    _call(_VOID_CALL, 6, a0, a1, a2, a3, a4, a5);
+  }
+
+  int Lcall$wLw(a0, a1, a2) => _call(_LONG_CALL_wLw, 3, a0, a1, a2);
 }
 
 class ForeignPointer extends Foreign {
@@ -310,9 +436,15 @@ class ForeignLibrary extends ForeignPointer {
     return new ForeignLibrary.fromAddress(_lookupLibrary(name, global));
   }
 
+  /// Looks up the foreign function [name] in this library. When the VM runs
+  /// with `-Xdetach_foreign_calls` the function is [ForeignFunction.detached]
+  /// and every call to it runs on the blocking call pool.
   ForeignFunction lookup(String name) {
-    return new ForeignFunction.fromAddress(_lookupFunction(address, name),
-        this);
+    int function = _lookupFunction(address, name);
+    if (ForeignFunction._detachAll) {
+      return new _DetachedForeignFunction(function, this);
+    }
+    return new ForeignFunction.fromAddress(function, this);
   }
 
   ForeignPointer lookupVariable(String name) {
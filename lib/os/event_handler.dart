@@ -13,6 +13,22 @@ const int CLOSE_EVENT       = 1 << 2;
 // The event source signaled an error.
 const int ERROR_EVENT       = 1 << 3;
 
+// Read from the event source, see [EventHandler.submit].
+const int READ_OPERATION    = 0;
+// Write to the event source.
+const int WRITE_OPERATION   = 1;
+// Accept a connection on the event source.
+const int ACCEPT_OPERATION  = 2;
+
+// Results of [EventHandler.submit].
+// The operation was submitted and its result is sent to the port.
+const int SUBMITTED          = 0;
+// The operation could not be submitted right now, for example because the
+// submission queue is full.
+const int SUBMIT_DECLINED    = 1;
+// The event handler only reports readiness and never performs operations.
+const int SUBMIT_UNSUPPORTED = 2;
+
 class EventHandler {
   EventHandler._internal() {
     // The actual initialization is done in the VM.
@@ -43,6 +59,73 @@ class EventHandler {
     _eventHandlerAdd(id, port, mask);
   }
 
+  /**
+   * Register the port [port] to be notified about the event source [id] until
+   * [unregister] is called. Returns the registration, or `null` if the
+   * platform only supports [registerPortForNextEvent].
+   *
+   * The registration is edge-triggered: an event kind is reported once each
+   * time the event source becomes ready for it. Callers must read or write
+   * until the operation would block before they wait for that kind again.
+   * Use [waitForEvent] to wait for events.
+   *
+   * An [ArgumentError] is thrown if the event source is not supported.
+   * A [StateError] is thrown if the port could not be registered.
+   */
+  int registerPort(Object id, Port port) {
+    if (port is! Port) throw new ArgumentError(port);
+    return _eventHandlerRegister(id, port);
+  }
+
+  /**
+   * Wait for the events in [mask] on [registration].
+   *
+   * Returns the ready events if some of them are already known. Otherwise
+   * returns 0 and the ready events are sent to the port of the registration
+   * once they occur. [CLOSE_EVENT] and [ERROR_EVENT] are always reported.
+   */
+  int waitForEvent(int registration, int mask) {
+    if (mask is! int) throw new ArgumentError(mask);
+    return _eventHandlerWait(registration, mask);
+  }
+
+  /**
+   * Remove [registration]. Must be called before the event source is closed.
+   */
+  void unregister(int registration) {
+    _eventHandlerUnregister(registration);
+  }
+
+  /**
+   * Submit [operation] on the event source [id] and send its result to
+   * [port] when it completes. The result is the number of bytes read or
+   * written, or the accepted file descriptor, or a negative errno if the
+   * operation failed.
+   *
+   * [READ_OPERATION] and [WRITE_OPERATION] transfer [length] bytes at the
+   * foreign memory [address], which must stay valid until the result has
+   * been received, even if the operation is cancelled. Accepted file
+   * descriptors are non-blocking and close on exec.
+   *
+   * Returns [SUBMITTED] if the operation was submitted. Otherwise the caller
+   * has to perform the operation itself: [SUBMIT_DECLINED] only applies to
+   * this operation, while [SUBMIT_UNSUPPORTED] means the event handler never
+   * performs operations.
+   */
+  int submit(int operation, Object id, int address, int length, Port port) {
+    if (port is! Port) throw new ArgumentError(port);
+    return _eventHandlerSubmit(operation, id, address, length, port);
+  }
+
+  /**
+   * Cancel the operations submitted on the event source [id]. Their results
+   * are still sent, usually as `-ECANCELED`. Must be called before the event
+   * source is closed.
+   */
+  void cancel(Object id) {
+    _eventHandlerCancel(id);
+  }
+
   @dartino.native static void _eventHandlerAdd(Object id, Port port,
       int event_kinds) {
     switch (dartino.nativeError) {
@@ -60,6 +143,60 @@ class EventHandler {
         throw dartino.nativeError;
     }
   }
+
+  @dartino.native static int _eventHandlerRegister(Object id, Port port) {
+    switch (dartino.nativeError) {
+      case dartino.wrongArgumentType:
+        throw new ArgumentError(id);
+      case dartino.indexOutOfBounds:
+        throw new StateError("The port could not be registered.");
+      default:
+        throw dartino.nativeError;
+    }
+  }
+
+  @dartino.native static int _eventHandlerWait(int registration, int mask) {
+    switch (dartino.nativeError) {
+      case dartino.wrongArgumentType:
+        throw new ArgumentError(registration);
+      case dartino.illegalState:
+        throw new StateError("Operation not supported.");
+      default:
+        throw dartino.nativeError;
+    }
+  }
+
+  @dartino.native static int _eventHandlerSubmit(int operation, Object id,
+      int address, int length, Port port) {
+    switch (dartino.nativeError) {
+      case dartino.wrongArgumentType:
+        throw new ArgumentError();
+      case dartino.illegalState:
+        throw new StateError("Operation not supported.");
+      default:
+        throw dartino.nativeError;
+    }
+  }
+
+  @dartino.native static void _eventHandlerCancel(Object id) {
+    switch (dartino.nativeError) {
+      case dartino.wrongArgumentType:
+        throw new ArgumentError(id);
+      default:
+        throw dartino.nativeError;
+    }
+  }
+
+  @dartino.native static void _eventHandlerUnregister(int registration) {
+    switch (dartino.nativeError) {
+      case dartino.wrongArgumentType:
+        throw new ArgumentError(registration);
+      case dartino.illegalState:
+        throw new StateError("Operation not supported.");
+      default:
+        throw dartino.nativeError;
+    }
+  }
 }
 
 final EventHandler eventHandler = new EventHandler._internal();
@@ -101,7 +101,8 @@ abstract class PosixSystem implements System {
     // TODO(ajohnsen): Allow IPv6 results.
     hints.family = AF_INET;
     Struct result = new Struct(1);
-    int status = _getaddrinfo.icall$4Retry(
+    // A DNS lookup can take seconds, so keep it off the interpreter thread.
+    int status = _getaddrinfo.detached.icall$4Retry(
         node, ForeignPointer.NULL, hints, result);
     AddrInfo start = new AddrInfo.fromAddress(result.getField(0));
     AddrInfo info = start;
@@ -156,7 +157,8 @@ abstract class PosixSystem implements System {
     flags |= O_CLOEXEC;
     ForeignMemory cPath = new ForeignMemory.fromStringAsUTF8(path);
     int mode = 6 << 6 | 6 << 3 | 6; // octal 0666
-    int fd = _open.icall$3Retry(cPath, flags, mode);
+    // Opening a FIFO or a file on a network file system can block.
+    int fd = _open.detached.icall$3Retry(cPath, flags, mode);
     cPath.free();
     return fd;
   }
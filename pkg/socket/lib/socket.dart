@@ -18,18 +18,89 @@ import 'dart:dartino.ffi' show Struct32, ForeignMemory;
 import 'package:os/os.dart';
 
 class _SocketBase {
+  // Sent on [_channel] by [close] to wake a fiber waiting on the socket. It
+  // is neither an event mask nor an operation result.
+  static const Object _CLOSED = const Object();
+
   int _fd = -1;
   Channel _channel;
   Port _port;
 
+  // The persistent event handler registration of [_fd], if any. Falls back
+  // to one-shot registrations when the platform does not support it.
+  int _registration;
+  bool _oneShot = false;
+
+  // Whether reads, writes and accepts are submitted to the event handler.
+  // Cleared once the event handler reports that it does not perform
+  // operations.
+  bool _submitOperations = true;
+
   _SocketBase() {
     _channel = new Channel();
     _port = new Port(_channel);
   }
 
+  // Wait for the socket to become ready for the events in [mask]. Since
+  // persistent registrations are edge-triggered, callers only wait after an
+  // operation would have blocked.
   int _waitFor(int mask) {
-    os.eventHandler.registerPortForNextEvent(_fd, _port, mask);
-    return _channel.receive();
+    if (_registration == null && !_oneShot) {
+      _registration = os.eventHandler.registerPort(_fd, _port);
+      _oneShot = _registration == null;
+    }
+    if (_oneShot) {
+      os.eventHandler.registerPortForNextEvent(_fd, _port, mask);
+      return _receiveEvents();
+    }
+    int events = os.eventHandler.waitForEvent(_registration, mask);
+    if (events != 0) return events;
+    return _receiveEvents();
+  }
+
+  int _receiveEvents() {
+    var message = _channel.receive();
+    if (identical(message, _CLOSED)) return os.CLOSE_EVENT | os.ERROR_EVENT;
+    return message;
+  }
+
+  bool _wouldBlock(int result) {
+    return result == -1 && sys.errno() == errnos.EAGAIN;
+  }
+
+  // Perform [operation] through the event handler and wait for its result,
+  // which is negative errno on failure. Returns `null` if the event handler
+  // did not take the operation.
+  int _submit(int operation, int address, int length) {
+    if (!_submitOperations) return null;
+    int status = os.eventHandler.submit(operation, _fd, address, length, _port);
+    if (status == os.SUBMITTED) {
+      // Closing the socket cancels the operation, but the kernel may use the
+      // memory at [address] until its result arrives.
+      var result = _channel.receive();
+      while (identical(result, _CLOSED)) result = _channel.receive();
+      return result;
+    }
+    if (status == os.SUBMIT_UNSUPPORTED) _submitOperations = false;
+    return null;
+  }
+
+  static int _addressOf(ByteBuffer buffer, int offset) {
+    var b = buffer;
+    return b.getForeign().address + offset;
+  }
+
+  // Read or write through the event handler if possible and directly
+  // otherwise. Returns the number of bytes transferred or negative errno.
+  int _transfer(int operation, ByteBuffer buffer, int offset, int length) {
+    int result = _submit(operation, _addressOf(buffer, offset), length);
+    if (result != null) return result;
+    if (operation == os.READ_OPERATION) {
+      result = sys.read(_fd, buffer, offset, length);
+    } else {
+      result = sys.write(_fd, buffer, offset, length);
+    }
+    return result == -1 ? -sys.errno() : result;
   }
 
   /**
@@ -41,9 +112,14 @@ class _SocketBase {
       // If there is an error before we initialize the event handling,
       // [_port] and [_channel] are `null`.
       if (_port != null) {
-        _port.send(-1);
+        _channel.send(_CLOSED);
         _port = null;
       }
+      if (_submitOperations) os.eventHandler.cancel(_fd);
+      if (_registration != null) {
+        os.eventHandler.unregister(_registration);
+        _registration = null;
+      }
       sys.close(_fd);
       _fd = -1;
     }
@@ -58,9 +134,10 @@ class _SocketBase {
     return value;
   }
 
-  void _error(String message) {
+  void _error(String message, [int errno]) {
+    if (errno == null) errno = sys.errno();
     close();
-    throw new SocketException(message, sys.errno());
+    throw new SocketException(message, errno);
   }
 }
 
@@ -99,17 +176,18 @@ class Socket extends _SocketBase {
     ByteBuffer buffer = new Uint8List(bytes).buffer;
     int offset = 0;
     while (offset < bytes) {
-      int events = _waitFor(os.READ_EVENT);
-      int read = 0;
-      if ((events & os.READ_EVENT) != 0) {
-        read = sys.read(_fd, buffer, offset, bytes - offset);
-      }
-      if (read == 0 || (events & os.CLOSE_EVENT) != 0) {
-        if (offset + read < bytes) return null;
-      }
-      if (read < 0 || (events & os.ERROR_EVENT) != 0) {
-        _error("Failed to read from socket");
+      int read =
+          _transfer(os.READ_OPERATION, buffer, offset, bytes - offset);
+      if (read == -errnos.EAGAIN) {
+        int events = _waitFor(os.READ_EVENT);
+        if ((events & os.ERROR_EVENT) != 0) {
+          _error("Failed to read from socket");
+        }
+        // On close, the next read returns what is left and then 0.
+        continue;
       }
+      if (read == 0) return null;
+      if (read < 0) _error("Failed to read from socket", -read);
       offset += read;
     }
     return buffer;
@@ -121,22 +199,22 @@ class Socket extends _SocketBase {
    * Returns `null` if the socket was closed for reading.
    */
   ByteBuffer readNext([int max]) {
-    int events = _waitFor(os.READ_EVENT);
-    int read = 0;
-    ByteBuffer buffer;
-    if ((events & os.READ_EVENT) != 0) {
-      int available = this.available;
-      int maxRead = available;
-      if (max != null) {
-        maxRead = max < available ? max : available;
+    int available = this.available;
+    while (available == 0) {
+      int events = _waitFor(os.READ_EVENT);
+      if ((events & os.ERROR_EVENT) != 0) {
+        _error("Failed to read from socket");
       }
-      buffer = new Uint8List(maxRead).buffer;
-      read = sys.read(_fd, buffer, 0, maxRead);
+      available = this.available;
+      if (available == 0 && (events & os.CLOSE_EVENT) != 0) return null;
     }
-    if (read == 0 && (events & os.CLOSE_EVENT) != 0) return null;
-    if (read < 0 || (events & os.ERROR_EVENT) != 0) {
-      _error("Failed to read from socket");
+    int maxRead = available;
+    if (max != null) {
+      maxRead = max < available ? max : available;
     }
+    ByteBuffer buffer = new Uint8List(maxRead).buffer;
+    int read = sys.read(_fd, buffer, 0, maxRead);
+    if (read < 0) _error("Failed to read from socket");
     return buffer;
   }
 
@@ -147,9 +225,12 @@ class Socket extends _SocketBase {
     int offset = 0;
     int bytes = buffer.lengthInBytes;
     while (true) {
-      int wrote = sys.write(_fd, buffer, offset, bytes - offset);
-      if (wrote == -1) {
-        _error("Failed to write to socket");
+      int wrote =
+          _transfer(os.WRITE_OPERATION, buffer, offset, bytes - offset);
+      if (wrote == -errnos.EAGAIN) {
+        wrote = 0;
+      } else if (wrote < 0) {
+        _error("Failed to write to socket", -wrote);
       }
       offset += wrote;
       if (offset == bytes) return;
@@ -237,15 +318,29 @@ class ServerSocket extends _SocketBase {
   }
 
   int _accept() {
-    int events = _waitFor(os.READ_EVENT);
-    if (events != os.READ_EVENT) {
-      _error("Server socket closed while receiving socket");
+    while (true) {
+      int client = _submit(os.ACCEPT_OPERATION, 0, 0);
+      bool submitted = client != null;
+      if (!submitted) {
+        client = sys.accept(_fd);
+        if (client == -1) client = -sys.errno();
+      }
+      if (client == -errnos.EAGAIN) {
+        int events = _waitFor(os.READ_EVENT);
+        if (events != os.READ_EVENT) {
+          _error("Server socket closed while receiving socket");
+        }
+        continue;
+      }
+      if (client < 0) _error("Failed to accept socket", -client);
+      // Sockets accepted by the event handler are already non-blocking and
+      // close on exec.
+      if (!submitted) {
+        sys.setBlocking(client, false);
+        sys.setCloseOnExec(client, true);
+      }
+      return client;
     }
-    int client = sys.accept(_fd);
-    if (client == -1) _error("Failed to accept socket");
-    sys.setBlocking(client, false);
-    sys.setCloseOnExec(client, true);
-    return client;
   }
 }
 
@@ -271,8 +366,17 @@ class DatagramSocket extends _SocketBase {
   int get port => sys.port(_fd);
 
   Datagram receive() {
-    int events = _waitFor(os.READ_EVENT);
     int availableBytes = available;
+    // The registration can report a stale read event, so wait until a
+    // datagram has actually arrived.
+    while (availableBytes == 0) {
+      int events = _waitFor(os.READ_EVENT);
+      if ((events & os.ERROR_EVENT) != 0) {
+        _error("Failed to receive from socket");
+      }
+      availableBytes = available;
+      if (availableBytes == 0 && (events & os.CLOSE_EVENT) != 0) return null;
+    }
     ByteBuffer buffer = new Uint8List(availableBytes).buffer;
     PosixSockAddrIn sockaddr = sys.allocateSockAddrIn();
 
@@ -289,8 +393,12 @@ class DatagramSocket extends _SocketBase {
   }
 
   int send(InternetAddress target, int port, ByteBuffer data) {
-    _waitFor(os.WRITE_EVENT);
-    return sys.sendto(_fd, data, target, port);
+    int result = sys.sendto(_fd, data, target, port);
+    while (_wouldBlock(result)) {
+      _waitFor(os.WRITE_EVENT);
+      result = sys.sendto(_fd, data, target, port);
+    }
+    return result;
   }
 }
 
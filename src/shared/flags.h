@@ -48,6 +48,46 @@ namespace dartino {
   FLAG_BOOLEAN(debug, print_flags, false, "Print flags")                  \
   FLAG_INTEGER(release, profile_interval, 1000, "Profile interval in us") \
   FLAG_CSTRING(release, filter, NULL, "Filter string for unit testing")   \
+  FLAG_BOOLEAN(release, parallel_programs, false,                         \
+               "Interpret different programs on separate threads")        \
+  FLAG_BOOLEAN(release, scheduler_latency, false,                         \
+               "Record scheduler latency histograms")                     \
+  FLAG_INTEGER(release, time_slice, 100,                                  \
+               "Preemption time slice in milliseconds")                   \
+  FLAG_BOOLEAN(release, lock_statistics, false,                           \
+               "Count all spinlock acquisitions")                         \
+  FLAG_INTEGER(release, worker_threads, 0,                                \
+               "Workers for -Xparallel_programs (0: one per core)")       \
+  FLAG_CSTRING(release, cpu_affinity, NULL,                               \
+               "CPUs to pin VM threads to, e.g. \"2,3,8-11\"")            \
+  FLAG_INTEGER(release, gc_helper_threads, -1,                            \
+               "Threads helping to collect the heaps (-1: cores - 1)")    \
+  FLAG_BOOLEAN(release, concurrent_marking, false,                        \
+               "Mark the shared old space on the GC thread")              \
+  FLAG_BOOLEAN(release, concurrent_sweeping, false,                       \
+               "Sweep the shared old space on the GC thread")             \
+  FLAG_BOOLEAN(release, compaction, false,                                \
+               "Compact the shared old space when it is fragmented")      \
+  FLAG_BOOLEAN(release, pretenuring, false,                               \
+               "Allocate long-lived stacks and arrays in the old space")  \
+  FLAG_INTEGER(release, min_heap_size, 0,                                 \
+               "Shared old space size in KB reached before collecting")   \
+  FLAG_INTEGER(release, max_heap_size, 0,                                 \
+               "Maximum shared old space size in KB (0: unlimited)")      \
+  FLAG_INTEGER(release, heap_growth_percent, 100,                         \
+               "Old space growth before collection, in % of live data")   \
+  FLAG_INTEGER(release, young_generation_size, 0,                         \
+               "New space size in KB (0: an eighth of old space)")        \
+  FLAG_INTEGER(release, target_pause_time, 0,                             \
+               "Adapt new space to a scavenge pause in ms (0: off)")      \
+  FLAG_INTEGER(release, blocking_call_threads, 4,                         \
+               "Maximum number of threads running detached FFI calls")    \
+  FLAG_BOOLEAN(release, detach_foreign_calls, false,                      \
+               "Run every FFI call on the blocking call pool")            \
+  FLAG_BOOLEAN(release, event_handler_timerfd, false,                     \
+               "Fire event handler timeouts with a timerfd on Linux")     \
+  FLAG_BOOLEAN(release, event_handler_io_uring, false,                    \
+               "Use io_uring in the Linux event handler if available")    \
   FLAG_BOOLEAN(release, tick_sampler, false,                              \
                "Collect execution time sampels of the entire VM")         \
   FLAG_CSTRING(release, tick_file, "dartino.ticks",                        \
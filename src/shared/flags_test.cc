@@ -40,4 +40,35 @@ TEST_CASE(Arguments) {
   EXPECT(Flags::verbose);
 }
 
+static const int scheduler_argc = 3;
+static const char* scheduler_argv[scheduler_argc] = {
+    "dartino", "-Xworker_threads=3", "-Xcpu_affinity=2,3,8-11",
+};
+
+TEST_CASE(SchedulerArguments) {
+  int worker_threads = Flags::worker_threads;
+  const char* cpu_affinity = Flags::cpu_affinity;
+#ifdef USING_ADDRESS_SANITIZER
+  __lsan_disable();
+#endif
+  char** values =
+      reinterpret_cast<char**>(calloc(sizeof(char*), scheduler_argc));
+  for (int i = 0; i < scheduler_argc; i++) {
+    values[i] = reinterpret_cast<char*>(malloc(strlen(scheduler_argv[i]) + 1));
+    strcpy(values[i], scheduler_argv[i]);  // NOLINT
+  }
+#ifdef USING_ADDRESS_SANITIZER
+  __lsan_enable();
+#endif
+
+  int count = scheduler_argc;
+  Flags::ExtractFromCommandLine(&count, values);
+  EXPECT_EQ(1, count);
+  EXPECT_EQ(3, Flags::worker_threads);
+  EXPECT_STREQ("2,3,8-11", Flags::cpu_affinity);
+
+  Flags::worker_threads = worker_threads;
+  Flags::cpu_affinity = cpu_affinity;
+}
+
 }  // namespace dartino
@@ -151,6 +151,7 @@ namespace dartino {
                                                                              \
   N(ForeignBitsPerWord, "Foreign", "_bitsPerMachineWord", false)             \
   N(ForeignErrno, "Foreign", "_errno", false)                                \
+  N(ForeignSetErrno, "Foreign", "_setErrno", false)                          \
   N(ForeignPlatform, "Foreign", "_platform", false)                          \
   N(ForeignArchitecture, "Foreign", "_architecture", false)                  \
   N(ForeignConvertPort, "Foreign", "_convertPort", false)                    \
@@ -181,6 +182,8 @@ namespace dartino {
   N(ForeignVCall6, "ForeignFunction", "_vcall$6", true)                      \
                                                                              \
   N(ForeignLCallwLw, "ForeignFunction", "_Lcall$wLw", false)                 \
+  N(ForeignDetachedCall, "ForeignFunction", "_detachedCall", false)          \
+  N(ForeignDetachAllCalls, "ForeignFunction", "_detachAllCalls", false)      \
                                                                              \
   N(ForeignDecreaseMemoryUsage, "ForeignMemory", "_decreaseMemoryUsage",     \
     false)                                                                   \
@@ -241,12 +244,24 @@ namespace dartino {
   N(ProcessMonitor, "Process", "monitor", false)                             \
   N(ProcessUnmonitor, "Process", "unmonitor", false)                         \
   N(ProcessKill, "Process", "kill", false)                                   \
+  N(ProcessGetPriority, "Process", "priority", false)                        \
+  N(ProcessSetPriority, "Process", "_setPriority", false)                    \
+  N(ProcessLatencyCount, "Process", "_latencyCount", false)                  \
+  N(ProcessLatencyAt, "Process", "_latencyAt", false)                        \
+  N(ProcessSetLatencyEnabled, "Process", "_setLatencyEnabled", false)        \
                                                                              \
   N(PortCreate, "Port", "_create", false)                                    \
   N(PortSend, "Port", "send", false)                                         \
   N(PortSendExit, "Port", "_sendExit", false)                                \
                                                                              \
   N(SystemEventHandlerAdd, "EventHandler", "_eventHandlerAdd", false)        \
+  N(SystemEventHandlerRegister, "EventHandler", "_eventHandlerRegister",     \
+    false)                                                                   \
+  N(SystemEventHandlerUnregister, "EventHandler", "_eventHandlerUnregister", \
+    false)                                                                   \
+  N(SystemEventHandlerWait, "EventHandler", "_eventHandlerWait", false)      \
+  N(SystemEventHandlerSubmit, "EventHandler", "_eventHandlerSubmit", false)  \
+  N(SystemEventHandlerCancel, "EventHandler", "_eventHandlerCancel", false)  \
                                                                              \
   N(ServiceRegister, "<none>", "register", false)                            \
                                                                              \
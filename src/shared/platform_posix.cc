@@ -250,7 +250,7 @@ bool VirtualMemory::Commit(uword address, int size, bool executable) {
 
 bool VirtualMemory::Uncommit(uword address, int size) {
   return mmap(reinterpret_cast<void*>(address), size, PROT_NONE,
-              MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, kMmapFd,
+              MAP_PRIVATE | MAP_ANON | MAP_NORESERVE | MAP_FIXED, kMmapFd,
               kMmapFdOffset) != MAP_FAILED;
 }
 
@@ -231,6 +231,7 @@ class Assembler {
   INSTRUCTION_3(str, "str %r, %a%W", Register, const Address&, WriteBack);
   INSTRUCTION_3(str, "str %r, [%r], %i", Register, Register, const Immediate&);
   INSTRUCTION_3(str, "str%c %r, %a", Condition, Register, const Address&);
+  INSTRUCTION_2(strb, "strb %r, %a", Register, const Address&);
 
   INSTRUCTION_3(sub, "sub %r, %r, %i", Register, Register, const Immediate&);
   INSTRUCTION_3(sub, "sub %r, %r, %r", Register, Register, Register);
@@ -252,6 +252,8 @@ class Assembler {
   INSTRUCTION_2(movq, "movq %rq, %a", const Address&, Register);
   INSTRUCTION_2(movq, "movq %l, %a", const Address&, const Immediate&);
 
+  INSTRUCTION_2(movb, "movb %i, %a", const Address&, const Immediate&);
+
   INSTRUCTION_2(movzbq, "movzbq %a, %rq", Register, const Address&);
 
   INSTRUCTION_2(cmove, "cmove %rq, %rq", Register, Register);
@@ -241,6 +241,7 @@ class Assembler {
   INSTRUCTION_2(cmove, "cmove %rl, %rl", Register, Register);
 
   INSTRUCTION_2(leal, "leal %a, %rl", Register, const Address&);
+  INSTRUCTION_2(movb, "movb %i, %a", const Address&, const Immediate&);
   INSTRUCTION_2(movzbl, "movzbl %a, %rl", Register, const Address&);
 
   INSTRUCTION_2(cmpl, "cmpl %i, %rl", Register, const Immediate&);
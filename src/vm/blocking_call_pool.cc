@@ -0,0 +1,169 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/vm/blocking_call_pool.h"
+
+#include "src/shared/flags.h"
+#include "src/vm/port.h"
+#include "src/vm/process.h"
+#include "src/vm/scheduler.h"
+
+namespace dartino {
+
+BlockingCallPool* BlockingCallPool::blocking_call_pool_ = NULL;
+
+void BlockingCallPool::Setup() {
+  ASSERT(blocking_call_pool_ == NULL);
+  int max_threads = Flags::blocking_call_threads;
+  if (max_threads < 1) max_threads = 1;
+  blocking_call_pool_ = new BlockingCallPool(max_threads);
+}
+
+void BlockingCallPool::TearDown() {
+  ASSERT(blocking_call_pool_ != NULL);
+  delete blocking_call_pool_;
+  blocking_call_pool_ = NULL;
+}
+
+BlockingCallPool::BlockingCallPool(int max_threads)
+    : monitor_(Platform::CreateMonitor()),
+      thread_pool_(max_threads),
+      head_(NULL),
+      tail_(NULL),
+      pending_(0),
+      idle_threads_(0),
+      shutting_down_(false) {
+  thread_pool_.Start();
+}
+
+BlockingCallPool::~BlockingCallPool() {
+  {
+    ScopedMonitorLock locker(monitor_);
+    shutting_down_ = true;
+    monitor_->NotifyAll();
+  }
+  // NOTE: A foreign call that never returns will block the tear down, just
+  // like it would have blocked the worker thread running it.
+  thread_pool_.JoinAll();
+  ASSERT(head_ == NULL);
+  delete monitor_;
+}
+
+void BlockingCallPool::Run(BlockingCall* call) {
+  call->next = NULL;
+  bool start_thread;
+  {
+    ScopedMonitorLock locker(monitor_);
+    ASSERT(!shutting_down_);
+    if (tail_ == NULL) {
+      head_ = call;
+    } else {
+      tail_->next = call;
+    }
+    tail_ = call;
+    start_thread = ++pending_ > idle_threads_;
+    if (!start_thread) monitor_->Notify();
+  }
+  // If the pool is already at its maximum size, the call stays queued until
+  // one of the running threads is done with its current call.
+  if (start_thread) {
+    while (!thread_pool_.TryStartThread(RunThread, this)) {
+    }
+  }
+}
+
+void BlockingCallPool::RunThread(void* data) {
+  reinterpret_cast<BlockingCallPool*>(data)->ThreadLoop();
+}
+
+void BlockingCallPool::ThreadLoop() {
+  BlockingCall* call;
+  while ((call = WaitForCall()) != NULL) {
+    Platform::SetLastError(0);
+    int64 result = Invoke(call);
+    Deliver(call, result, Platform::GetLastError());
+  }
+}
+
+BlockingCall* BlockingCallPool::WaitForCall() {
+  ScopedMonitorLock locker(monitor_);
+  while (head_ == NULL) {
+    if (shutting_down_) return NULL;
+    idle_threads_++;
+    monitor_->Wait();
+    idle_threads_--;
+  }
+  BlockingCall* call = head_;
+  head_ = call->next;
+  if (head_ == NULL) tail_ = NULL;
+  pending_--;
+  return call;
+}
+
+void BlockingCallPool::Deliver(BlockingCall* call, int64 result, int error) {
+  Port* port = call->port;
+  port->Lock();
+  Process* process = port->process();
+  if (process != NULL) {
+    // The error code is sent after the result so the caller can restore it
+    // on whatever worker thread it is resumed on.
+    process->mailbox()->EnqueueLargeInteger(port, result);
+    process->mailbox()->EnqueueLargeInteger(port, error);
+    process->program()->scheduler()->ResumeProcess(process);
+  }
+  port->Unlock();
+  port->DecrementRef();
+  delete call;
+}
+
+template <typename R>
+static R InvokeWithReturnType(word address, int arity, const word* a) {
+  ASSERT(arity >= 0 && arity <= BlockingCall::kMaxArguments);
+  switch (arity) {
+    case 0:
+      return reinterpret_cast<R (*)()>(address)();
+    case 1:
+      return reinterpret_cast<R (*)(word)>(address)(a[0]);
+    case 2:
+      return reinterpret_cast<R (*)(word, word)>(address)(a[0], a[1]);
+    case 3:
+      return reinterpret_cast<R (*)(word, word, word)>(address)(
+          a[0], a[1], a[2]);
+    case 4:
+      return reinterpret_cast<R (*)(word, word, word, word)>(address)(
+          a[0], a[1], a[2], a[3]);
+    case 5:
+      return reinterpret_cast<R (*)(word, word, word, word, word)>(address)(
+          a[0], a[1], a[2], a[3], a[4]);
+    case 6:
+      return reinterpret_cast<R (*)(word, word, word, word, word, word)>(
+          address)(a[0], a[1], a[2], a[3], a[4], a[5]);
+  }
+  return reinterpret_cast<R (*)(word, word, word, word, word, word, word)>(
+      address)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+}
+
+int64 BlockingCallPool::Invoke(BlockingCall* call) {
+  switch (call->kind) {
+    case BlockingCall::kIntCall:
+      return InvokeWithReturnType<int>(
+          call->address, call->arity, call->arguments);
+    case BlockingCall::kPointerCall:
+      return InvokeWithReturnType<word>(
+          call->address, call->arity, call->arguments);
+    case BlockingCall::kVoidCall:
+      InvokeWithReturnType<void>(call->address, call->arity, call->arguments);
+      return 0;
+    case BlockingCall::kLongCallwLw: {
+      typedef int64 (*LwLw)(word, int64, word);
+      LwLw function = reinterpret_cast<LwLw>(call->address);
+      return function(call->arguments[0], call->long_argument,
+                      call->arguments[2]);
+    }
+  }
+  UNREACHABLE();
+  return 0;
+}
+
+}  // namespace dartino
@@ -0,0 +1,89 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#ifndef SRC_VM_BLOCKING_CALL_POOL_H_
+#define SRC_VM_BLOCKING_CALL_POOL_H_
+
+#include "src/shared/globals.h"
+#include "src/shared/platform.h"
+#include "src/vm/thread_pool.h"
+
+namespace dartino {
+
+class Port;
+
+// A foreign call that runs on a [BlockingCallPool] thread instead of on the
+// worker thread interpreting the calling process.
+struct BlockingCall {
+  // Keep in sync with lib/ffi/ffi.dart:_DetachedForeignFunction.
+  enum Kind {
+    kIntCall,
+    kPointerCall,
+    kVoidCall,
+    // int64 (*)(word, int64, word), the shape of ForeignFunction.Lcall$wLw.
+    kLongCallwLw,
+  };
+
+  static const int kMaxArguments = 7;
+
+  Kind kind;
+  int arity;
+  word address;
+  word arguments[kMaxArguments];
+
+  // The second argument of a kLongCallwLw call, which does not fit in a word
+  // on 32-bit platforms. arguments[1] is unused for such calls.
+  int64 long_argument;
+
+  // The port the result is sent to. The call holds a reference to the port
+  // until the result has been delivered.
+  Port* port;
+
+  BlockingCall* next;
+};
+
+// The blocking call pool runs detached foreign calls on a bounded set of
+// threads. The calling process waits on a channel while the call is running,
+// so a blocking call only parks that process and never the worker thread.
+// When the call returns, the result is enqueued on the port of the call and
+// the process is resumed through its scheduler.
+class BlockingCallPool {
+ public:
+  static void Setup();
+  static void TearDown();
+  static BlockingCallPool* GlobalInstance() { return blocking_call_pool_; }
+
+  explicit BlockingCallPool(int max_threads);
+  ~BlockingCallPool();
+
+  // Enqueue [call] and start a new pool thread if all running threads are
+  // busy. Takes ownership of [call].
+  void Run(BlockingCall* call);
+
+  // Invoke the foreign function of [call] on the current thread.
+  static int64 Invoke(BlockingCall* call);
+
+ private:
+  static BlockingCallPool* blocking_call_pool_;
+
+  Monitor* monitor_;
+  ThreadPool thread_pool_;
+
+  // Calls waiting for a thread, in FIFO order.
+  BlockingCall* head_;
+  BlockingCall* tail_;
+
+  int pending_;
+  int idle_threads_;
+  bool shutting_down_;
+
+  static void RunThread(void* data);
+  void ThreadLoop();
+  BlockingCall* WaitForCall();
+  static void Deliver(BlockingCall* call, int64 result, int error);
+};
+
+}  // namespace dartino
+
+#endif  // SRC_VM_BLOCKING_CALL_POOL_H_
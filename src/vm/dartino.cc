@@ -6,8 +6,10 @@
 
 #include "src/shared/platform.h"
 
+#include "src/vm/blocking_call_pool.h"
 #include "src/vm/event_handler.h"
 #include "src/vm/ffi.h"
+#include "src/vm/gc_helper_pool.h"
 #include "src/vm/object_memory.h"
 #include "src/vm/object.h"
 #include "src/vm/preempter.h"
@@ -23,6 +25,8 @@ void Dartino::Setup() {
   StaticClassStructures::Setup();
   ForeignFunctionInterface::Setup();
   EventHandler::Setup();
+  BlockingCallPool::Setup();
+  GCHelperPool::Setup();
   Scheduler::Setup();
   Preempter::Setup();
 }
@@ -31,6 +35,8 @@ void Dartino::TearDown() {
   Preempter::TearDown();
   Thread::TearDown();
   Scheduler::TearDown();
+  GCHelperPool::TearDown();
+  BlockingCallPool::TearDown();
   EventHandler::TearDown();
   ForeignFunctionInterface::TearDown();
   StaticClassStructures::TearDown();
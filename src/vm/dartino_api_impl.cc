@@ -3,6 +3,7 @@
 // BSD-style license that can be found in the LICENSE.md file.
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "src/vm/dartino_api_impl.h"
 
@@ -11,6 +12,7 @@
 #include "src/shared/connection.h"
 #endif
 #include "src/shared/dartino.h"
+#include "src/shared/flags.h"
 #include "src/shared/list.h"
 
 #include "src/vm/ffi.h"
@@ -20,6 +22,7 @@
 #include "src/vm/scheduler.h"
 #include "src/vm/session.h"
 #include "src/vm/snapshot.h"
+#include "src/vm/spinlock.h"
 
 namespace dartino {
 
@@ -115,6 +118,40 @@ void DartinoSetup() { dartino::Dartino::Setup(); }
 
 void DartinoTearDown() { dartino::Dartino::TearDown(); }
 
+void DartinoSetWorkerThreadCount(int count) {
+  dartino::Flags::worker_threads = count;
+}
+
+void DartinoSetCpuAffinity(const char* cpus) {
+  // The string is kept alive for the lifetime of the VM.
+  dartino::Flags::cpu_affinity = (cpus == NULL) ? NULL : strdup(cpus);
+}
+
+void DartinoSetTimeSlice(int milliseconds) {
+  dartino::Flags::time_slice = milliseconds;
+}
+
+void DartinoSetHeapSize(int minimum_kb, int maximum_kb) {
+  dartino::Flags::min_heap_size = minimum_kb;
+  dartino::Flags::max_heap_size = maximum_kb;
+}
+
+void DartinoSetYoungGenerationSize(int kilobytes) {
+  dartino::Flags::young_generation_size = kilobytes;
+}
+
+void DartinoSetTargetPauseTime(int milliseconds) {
+  dartino::Flags::target_pause_time = milliseconds;
+}
+
+void DartinoGetLockStatistics(DartinoLockStatistics* stats) {
+  dartino::Spinlock::Statistics statistics;
+  dartino::Spinlock::GetStatistics(&statistics);
+  stats->acquisitions = statistics.acquisitions;
+  stats->contended = statistics.contended;
+  stats->parked = statistics.parked;
+}
+
 void DartinoWaitForDebuggerConnection(int port) {
   dartino::WaitForDebuggerConnection(port);
 }
@@ -263,3 +300,40 @@ void DartinoUnfreezeProgramGroup(DartinoProgramGroup group) {
   auto dgroup = reinterpret_cast<dartino::ProgramGroup>(group);
   dartino::Scheduler::GlobalInstance()->UnFreezeProgramGroup(dgroup);
 }
+
+void DartinoSetProgramCpuWeight(DartinoProgram program, int weight) {
+  if (weight <= 0) FATAL("The CPU weight of a program must be positive.\n");
+  dartino::Scheduler::GlobalInstance()->SetProgramCpuWeight(
+      reinterpret_cast<dartino::Program*>(program), weight);
+}
+
+void DartinoSetProgramGroupCpuWeight(DartinoProgramGroup group, int weight) {
+  if (weight <= 0) FATAL("The CPU weight of a group must be positive.\n");
+  auto dgroup = reinterpret_cast<dartino::ProgramGroup>(group);
+  dartino::Scheduler::GlobalInstance()->SetProgramGroupCpuWeight(dgroup,
+                                                                 weight);
+}
+
+void DartinoSetSchedulerLatencyEnabled(bool enabled) {
+  dartino::SchedulerLatency::SetEnabled(enabled);
+}
+
+bool DartinoGetProgramSchedulerLatency(DartinoProgram raw_program,
+                                       DartinoLatencyKind kind,
+                                       DartinoLatencySummary* summary) {
+  dartino::Program* program = reinterpret_cast<dartino::Program*>(raw_program);
+  dartino::SchedulerLatency* latency = program->latency();
+  if (latency == NULL) return false;
+  dartino::LatencyHistogram* histogram = &latency->histograms[kind];
+  summary->count = histogram->count();
+  summary->p50 = histogram->ValueAtPermyriad(5000);
+  summary->p90 = histogram->ValueAtPermyriad(9000);
+  summary->p99 = histogram->ValueAtPermyriad(9900);
+  summary->p999 = histogram->ValueAtPermyriad(9990);
+  summary->max = histogram->max();
+  return true;
+}
+
+uint64_t DartinoGetProgramCpuTime(DartinoProgram program) {
+  return reinterpret_cast<dartino::Program*>(program)->cpu_time();
+}
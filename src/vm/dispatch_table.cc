@@ -21,6 +21,16 @@ void DispatchTable::ResetBreakpoints(
   }
   // Otherwise, clear and restore global and local breaks in the table.
   ClearAllBreakpoints();
+  AddBreakpoints(debug_info, program_breakpoints);
+}
+
+void DispatchTable::AddBreakpoints(
+    const DebugInfo* debug_info,
+    const Breakpoints* program_breakpoints) {
+  if (debug_info != NULL && debug_info->is_stepping()) {
+    SetStepping();
+    return;
+  }
   SetBreakpoints(program_breakpoints);
   if (debug_info != NULL) SetBreakpoints(debug_info->breakpoints());
 }
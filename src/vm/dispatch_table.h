@@ -22,6 +22,14 @@ class DispatchTable {
       const DebugInfo* debug_info,
       const Breakpoints* program_breakpoints);
 
+  // Like [ResetBreakpoints], but without clearing breakpoints already in the
+  // table.
+  void AddBreakpoints(
+      const DebugInfo* debug_info,
+      const Breakpoints* program_breakpoints);
+
+  void ClearAllBreakpoints();
+
  private:
   enum State {
     kClean,
@@ -31,7 +39,6 @@ class DispatchTable {
 
   void SetBreakpoints(const Breakpoints* breakpoints);
   void SetStepping();
-  void ClearAllBreakpoints();
 
   State state_;
 };
@@ -22,6 +22,10 @@ class DispatchTable {
   void ResetBreakpoints(
       const DebugInfo* debug_info,
       const Breakpoints* program_breakpoints) {}
+  void AddBreakpoints(
+      const DebugInfo* debug_info,
+      const Breakpoints* program_breakpoints) {}
+  void ClearAllBreakpoints() {}
 };
 
 }  // namespace dartino
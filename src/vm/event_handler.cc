@@ -31,7 +31,19 @@ EventHandler::EventHandler()
       data_(NULL),
       id_(-1),
       running_(true),
-      next_timeout_(INT64_MAX) {}
+      io_uring_(NULL),
+      timeouts_(Platform::GetMicroseconds() / 1000),
+      next_timeout_(INT64_MAX),
+      batch_size_(0),
+      operations_(NULL),
+      flush_pending_(false),
+      unregistered_(NULL)
+#ifdef TESTING
+      ,
+      resumed_processes_(0)
+#endif
+{
+}
 
 EventHandler::~EventHandler() {
   if (data_ != NULL) {
@@ -50,6 +62,7 @@ EventHandler::~EventHandler() {
     // handler are not associated with timeouts but rather file descriptors. The
     // EventHandler needs to deref them as well after the receiver dies.
   }
+  DeleteRegistrations(unregistered_.exchange(NULL));
 
   delete monitor_;
 }
@@ -65,11 +78,82 @@ void EventHandler::ReceiverForPortsDied(Port* ports) {
         port->DecrementRef();
       }
     }
+    // The kernel may still be using memory of the process, which is freed
+    // with its heap.
+    if (operations_ != NULL) CancelOperations(ports);
+  }
+}
+
+Object* EventHandler::WaitForEvent(Process* process, Object* registration,
+                                   int flags) {
+  if (!registration->IsSmi() && !registration->IsLargeInteger()) {
+    return Failure::wrong_argument_type();
+  }
+  if ((flags & ~(READ_EVENT | WRITE_EVENT)) != 0) {
+    return Failure::illegal_state();
+  }
+  Registration* entry =
+      reinterpret_cast<Registration*>(AsForeignWord(registration));
+  ScopedSpinlock locker(&entry->spinlock);
+  int ready = entry->ready & (flags | CLOSE_EVENT | ERROR_EVENT);
+  if (ready != 0) {
+    // Close and error events are sticky, the others are consumed.
+    entry->ready &= ~(ready & (READ_EVENT | WRITE_EVENT));
+    return Smi::FromWord(ready);
+  }
+  entry->waiting_for = flags;
+  return Smi::FromWord(0);
+}
+
+void EventHandler::PostReady(Registration* registration, int events) {
+  ScopedSpinlock locker(&registration->spinlock);
+  registration->ready |= events;
+  int waiting_for = registration->waiting_for;
+  if (waiting_for == 0) return;
+  int ready = registration->ready & (waiting_for | CLOSE_EVENT | ERROR_EVENT);
+  if (ready == 0) return;
+  registration->ready &= ~(ready & (READ_EVENT | WRITE_EVENT));
+  registration->waiting_for = 0;
+  // The registration holds a reference to the port until it is deleted,
+  // which happens after the batch has been flushed.
+  Post(registration->port, ready, false);
+}
+
+void EventHandler::DeleteRegistrations(Registration* registrations) {
+  while (registrations != NULL) {
+    Registration* next = registrations->next;
+    registrations->port->DecrementRef();
+    delete registrations;
+    registrations = next;
   }
 }
 
+#if !defined(DARTINO_TARGET_OS_LINUX)
+Object* EventHandler::Register(Process* process, Object* id, Port* port) {
+  return process->program()->null_object();
+}
+
+Object* EventHandler::Submit(Process* process, int operation, Object* id,
+                             word address, int length, Port* port) {
+  return Smi::FromWord(SUBMIT_UNSUPPORTED);
+}
+
+Object* EventHandler::Cancel(Process* process, Object* id) {
+  // There are no operations to cancel, see [Submit].
+  return process->program()->null_object();
+}
+
+Object* EventHandler::Unregister(Process* process, Object* registration) {
+  // There are no registrations to remove, see [Register].
+  return Failure::illegal_state();
+}
+
+void EventHandler::CancelOperations(Port* ports) { UNREACHABLE(); }
+#endif  // !defined(DARTINO_TARGET_OS_LINUX)
+
 void* EventHandler::RunEventHandler(void* peer) {
   EventHandler* event_handler = reinterpret_cast<EventHandler*>(peer);
+  Thread::ApplyCpuAffinity(Thread::kEventHandlerAffinityIndex);
   event_handler->Run();
   return NULL;
 }
@@ -102,36 +186,35 @@ void EventHandler::ScheduleTimeout(int64 timeout, Port* port) {
       return;
     }
   } else {
-    if (timeouts_.InsertOrChangePriority(timeout, port)) {
+    if (timeouts_.InsertOrChangeDeadline(timeout, port)) {
       port->IncrementRef();
     }
   }
 
-  next_timeout_ =
-      timeouts_.IsEmpty() ? INT64_MAX : timeouts_.Minimum().priority;
+  next_timeout_ = timeouts_.NextDeadline();
 
   Interrupt();
 }
 
-void EventHandler::HandleTimeouts() {
+int64 EventHandler::HandleTimeouts() {
   // Check timeouts.
   int64 current_time = Platform::GetMicroseconds() / 1000;
-
-  ScopedMonitorLock scoped_lock(monitor_);
-  if (next_timeout_ > current_time) return;
-
-  int64 next_timeout = INT64_MAX;
-  while (!timeouts_.IsEmpty()) {
-    auto minimum = timeouts_.Minimum();
-    if (minimum.priority <= current_time) {
-      Send(minimum.value, 0, true);
-      timeouts_.RemoveMinimum();
-    } else {
-      next_timeout = minimum.priority;
-      break;
+  int64 next_timeout;
+  {
+    ScopedMonitorLock scoped_lock(monitor_);
+    if (next_timeout_ <= current_time) {
+      // All timeouts that expired since the last call are collected in one
+      // pass over the wheel.
+      timeouts_.Advance(current_time);
+      while (timeouts_.HasExpired()) {
+        Post(timeouts_.RemoveExpired(), 0, true);
+      }
+      next_timeout_ = timeouts_.NextDeadline();
     }
+    next_timeout = next_timeout_;
   }
-  next_timeout_ = next_timeout;
+  FlushBatch();
+  return next_timeout;
 }
 
 void EventHandler::Send(Port* port, int64 value, bool release_port) {
@@ -145,4 +228,51 @@ void EventHandler::Send(Port* port, int64 value, bool release_port) {
   if (release_port) port->DecrementRef();
 }
 
+void EventHandler::Post(Port* port, int64 value, bool release_port) {
+  if (batch_size_ == kMaxBatchSize) FlushBatch();
+  PortMessage* message = &batch_[batch_size_++];
+  message->port = port;
+  message->value = value;
+  message->release_port = release_port;
+  message->delivered = false;
+}
+
+void EventHandler::FlushBatch() {
+  // Deliver the messages grouped by receiving process, so each process is
+  // resumed once per batch. Holding the lock of the first port of a group
+  // keeps its process alive while the rest of the group is delivered. The
+  // unlocked read of the process of a later port is only a hint and it is
+  // checked again while holding the lock of that port.
+  int size = batch_size_;
+  for (int i = 0; i < size; i++) {
+    if (batch_[i].delivered) continue;
+    Port* port = batch_[i].port;
+    port->Lock();
+    Process* port_process = port->process();
+    if (port_process != NULL) {
+      MessageMailbox* mailbox = port_process->mailbox();
+      mailbox->EnqueueLargeInteger(port, batch_[i].value);
+      for (int j = i + 1; j < size; j++) {
+        Port* other = batch_[j].port;
+        if (batch_[j].delivered || other->process() != port_process) continue;
+        if (other != port) other->Lock();
+        if (other->process() == port_process) {
+          mailbox->EnqueueLargeInteger(other, batch_[j].value);
+          batch_[j].delivered = true;
+        }
+        if (other != port) other->Unlock();
+      }
+      port_process->program()->scheduler()->ResumeProcess(port_process);
+#ifdef TESTING
+      resumed_processes_++;
+#endif
+    }
+    port->Unlock();
+  }
+  for (int i = 0; i < size; i++) {
+    if (batch_[i].release_port) batch_[i].port->DecrementRef();
+  }
+  batch_size_ = 0;
+}
+
 }  // namespace dartino
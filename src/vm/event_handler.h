@@ -6,11 +6,13 @@
 #define SRC_VM_EVENT_HANDLER_H_
 
 #include "src/shared/globals.h"
-#include "src/vm/priority_heap.h"
+#include "src/vm/spinlock.h"
 #include "src/vm/thread.h"
+#include "src/vm/timer_wheel.h"
 
 namespace dartino {
 
+class IoUring;
 class Monitor;
 class Port;
 class Object;
@@ -25,6 +27,24 @@ class EventHandler {
     ERROR_EVENT = 1 << 3,
   };
 
+  // Operations that can be submitted through [Submit]. Keep in sync with
+  // lib/os/event_handler.dart.
+  enum {
+    READ_OPERATION = 0,
+    WRITE_OPERATION = 1,
+    ACCEPT_OPERATION = 2,
+  };
+
+  // Results of [Submit]. Keep in sync with lib/os/event_handler.dart.
+  enum {
+    SUBMITTED = 0,
+    // The operation could not be submitted right now, for example because
+    // the submission queue is full. The caller does it itself this time.
+    SUBMIT_DECLINED = 1,
+    // The event handler only reports readiness.
+    SUBMIT_UNSUPPORTED = 2,
+  };
+
   static void Setup();
   static void TearDown();
   static EventHandler* GlobalInstance() { return event_handler_; }
@@ -34,13 +54,87 @@ class EventHandler {
 
   Object* Add(Process* process, Object* id, Port* port, int flags);
 
+  // Register [id] with [port] until it is unregistered. The registration is
+  // edge-triggered: readiness is recorded once per transition, and callers
+  // have to do I/O until it would block before waiting again. Returns the
+  // registration as an integer, or null if the platform only supports
+  // one-shot registration through [Add].
+  Object* Register(Process* process, Object* id, Port* port);
+  Object* Unregister(Process* process, Object* registration);
+
+  // Returns the ready events of [registration] matching [flags] if there are
+  // any. Otherwise returns 0 and sends the events to the port of the
+  // registration once they are ready. Close and error events are always
+  // reported and stay ready.
+  Object* WaitForEvent(Process* process, Object* registration, int flags);
+
+  // Perform [operation] on [id] without blocking the caller, and send the
+  // result or -errno to [port] once it completes. Reads and writes transfer
+  // [length] bytes at [address], which has to stay valid until the result
+  // is sent. If the process of [port] dies first, the operation is cancelled
+  // before its memory is freed. Returns one of the SUBMIT results; unless it
+  // is SUBMITTED the caller has to do the operation itself.
+  Object* Submit(Process* process, int operation, Object* id, word address,
+                 int length, Port* port);
+
+  // Cancel the operations submitted on [id]. Their results, usually
+  // -ECANCELED, are still sent once the kernel is done with them.
+  Object* Cancel(Process* process, Object* id);
+
   void ReceiverForPortsDied(Port* port_list);
 
   void ScheduleTimeout(int64 timeout, Port* port);
 
   Monitor* monitor() const { return monitor_; }
 
+  // The maximum number of port messages posted in one batch.
+  static const int kMaxBatchSize = 64;
+
+#ifdef TESTING
+  // The number of times [FlushBatch] has resumed a process.
+  int resumed_processes() const { return resumed_processes_; }
+#endif  // TESTING
+
  private:
+  // An operation submitted through [Submit] that has not completed yet. It
+  // holds a reference to its port until the result has been delivered.
+  struct Operation {
+    Operation(int fd, Port* port)
+        : fd(fd), port(port), cancelled(false), previous(NULL), next(NULL) {}
+
+    const int fd;
+    Port* const port;
+    // Whether a cancellation has been submitted for the operation.
+    bool cancelled;
+
+    // Links in the [operations_] list.
+    Operation* previous;
+    Operation* next;
+  };
+
+  struct PortMessage {
+    Port* port;
+    int64 value;
+    bool release_port;
+    bool delivered;
+  };
+
+  struct Registration {
+    Registration(int fd, Port* port)
+        : fd(fd), port(port), ready(0), waiting_for(0), next(NULL) {}
+
+    const int fd;
+    Port* const port;
+
+    // Guards [ready] and [waiting_for].
+    Spinlock spinlock;
+    int ready;
+    int waiting_for;
+
+    // Next registration in the [unregistered_] list.
+    Registration* next;
+  };
+
   // Global EventHandler instance.
   static EventHandler* event_handler_;
 
@@ -50,18 +144,73 @@ class EventHandler {
   bool running_;
   ThreadIdentifier thread_;
 
-  PriorityHeapWithValueIndex<int64, Port*> timeouts_;
+  // The io_uring instance if the event handler uses io_uring rather than
+  // readiness notifications. Only supported on Linux.
+  IoUring* io_uring_;
+
+  // Timeouts in milliseconds of [Platform::GetMicroseconds] / 1000.
+  TimerWheel<Port*> timeouts_;
+  // The earliest time at which a timeout may expire. The wheel only knows
+  // the exact deadline of timeouts in the next 256 milliseconds, so for
+  // later ones this is when they are moved closer.
   int64 next_timeout_;
 
+  // Port messages posted since the last flush. Only accessed by the event
+  // handler thread.
+  PortMessage batch_[kMaxBatchSize];
+  int batch_size_;
+
+  // The operations in flight, guarded by [monitor_].
+  Operation* operations_;
+
+  // Set when requests have been queued on [io_uring_] since the event
+  // handler last submitted them, see [FlushSubmissions].
+  Atomic<bool> flush_pending_;
+
+  // Registrations removed since the event handler last waited for events.
+  // They are deleted once no event returned by an earlier wait can refer
+  // to them.
+  Atomic<Registration*> unregistered_;
+
+#ifdef TESTING
+  Atomic<int> resumed_processes_;
+#endif  // TESTING
+
   static void* RunEventHandler(void* peer);
   void EnsureInitialized();
 
   void Create();
   void Run();
+  void RunIoUring();
   void Interrupt();
-  void HandleTimeouts();
+  // Post messages for the expired timeouts and flush the batch. Returns the
+  // time of the next timeout.
+  int64 HandleTimeouts();
 
   void Send(Port* port, int64 value, bool release_port);
+
+  // Add a message to the current batch. The batch is delivered by
+  // [FlushBatch], or when it is full.
+  void Post(Port* port, int64 value, bool release_port);
+  void FlushBatch();
+
+  // Make sure the event handler submits the requests queued on [io_uring_].
+  // Only the first request queued since its last wait interrupts it.
+  void FlushSubmissions();
+  void LinkOperation(Operation* operation);
+  void UnlinkOperation(Operation* operation);
+  // Post the [result] of [operation] and delete it.
+  void CompleteOperation(Operation* operation, int64 result);
+  // Queue the cancellation of [operation]. Returns false if the submission
+  // queue is full. Called with [monitor_] locked.
+  bool CancelOperation(Operation* operation);
+  // Cancel the operations posting to [ports] and wait until they have
+  // completed. Called with [monitor_] locked.
+  void CancelOperations(Port* ports);
+
+  // Record [events] for [registration] and post them if they are waited for.
+  void PostReady(Registration* registration, int events);
+  static void DeleteRegistrations(Registration* registrations);
 };
 
 }  // namespace dartino
@@ -7,13 +7,19 @@
 #include "src/vm/event_handler.h"
 
 #include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 
+#include "src/shared/flags.h"
 #include "src/shared/utils.h"
+#include "src/vm/io_uring_linux.h"
 #include "src/vm/thread.h"
 #include "src/vm/object.h"
+#include "src/vm/port.h"
 #include "src/vm/process.h"
 
 // Some versions of android sys/epoll does not define
@@ -25,13 +31,59 @@
 
 namespace dartino {
 
+// The epoll data of persistent registrations is tagged to tell them apart
+// from the ports of one-shot registrations.
+static const uword kRegistrationTag = 1;
+
+// The event handler data is the read and write end of the interrupt pipe,
+// followed by the timer fd or -1 if timeouts use the epoll_wait timeout.
+static const int kTimerFd = 2;
+
+// The user data of io_uring requests is an [Operation], a port of a one-shot
+// registration tagged with [kPollTag], or one of the internal values below.
+static const uint64 kPollTag = 1;
+static const uint64 kInternalTag = 2;
+static const uint64 kTagMask = 3;
+static const uint64 kInterruptData = kInternalTag;
+static const uint64 kIgnoredData = kInternalTag | (1 << 2);
+
+// The timeout request carries a generation, so the completion of a timeout
+// that has been replaced can be ignored.
+static uint64 TimeoutData(uint64 generation) {
+  return kInternalTag | (2 << 2) | (generation << 4);
+}
+
+static const int kIoUringEntries = 256;
+
+// Translate epoll or poll events to the event handler events.
+static int64 EventMask(int flags) {
+  int64 mask = 0;
+  if ((flags & EPOLLIN) != 0) mask |= EventHandler::READ_EVENT;
+  if ((flags & EPOLLOUT) != 0) mask |= EventHandler::WRITE_EVENT;
+  if ((flags & EPOLLRDHUP) != 0) mask |= EventHandler::CLOSE_EVENT;
+  if ((flags & EPOLLHUP) != 0) mask |= EventHandler::CLOSE_EVENT;
+  if ((flags & EPOLLERR) != 0) mask |= EventHandler::ERROR_EVENT;
+  return mask;
+}
+
 void EventHandler::Create() {
-  int* fds = new int[2];
+  int* fds = new int[3];
   if (pipe(fds) != 0) FATAL("Failed to start the event handler pipe\n");
   int status = fcntl(fds[0], F_SETFD, FD_CLOEXEC);
   if (status == -1) FATAL("Failed making read pipe close on exec.");
   status = fcntl(fds[1], F_SETFD, FD_CLOEXEC);
   if (status == -1) FATAL("Failed making write pipe close on exec.");
+  fds[kTimerFd] = -1;
+
+  if (Flags::event_handler_io_uring) {
+    // Fall back to epoll if the kernel does not support io_uring, or if it
+    // is disabled, e.g. by a seccomp filter.
+    io_uring_ = IoUring::TryCreate(kIoUringEntries);
+    if (io_uring_ != NULL) {
+      data_ = reinterpret_cast<void*>(fds);
+      return;
+    }
+  }
 
   id_ = epoll_create(1);
   if (id_ == -1) FATAL("Failed creating epoll instance.");
@@ -43,61 +95,235 @@ void EventHandler::Create() {
   event.data.fd = fds[0];
   epoll_ctl(id_, EPOLL_CTL_ADD, fds[0], &event);
 
+  if (Flags::event_handler_timerfd) {
+    // The timer uses the same clock as [Platform::GetMicroseconds], so it
+    // can be armed with the absolute time of the next timeout.
+    int timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) FATAL("Failed creating timer fd.");
+    event.events = EPOLLIN;
+    event.data.fd = timer_fd;
+    epoll_ctl(id_, EPOLL_CTL_ADD, timer_fd, &event);
+    fds[kTimerFd] = timer_fd;
+  }
+
   data_ = reinterpret_cast<void*>(fds);
 }
 
+// Arm [timer_fd] to expire at the absolute millisecond [timeout], or disarm it
+// if [timeout] is INT64_MAX.
+static void ArmTimer(int timer_fd, int64 timeout) {
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = 0;
+  spec.it_interval.tv_nsec = 0;
+  if (timeout == INT64_MAX) {
+    spec.it_value.tv_sec = 0;
+    spec.it_value.tv_nsec = 0;
+  } else {
+    // A zero value would disarm the timer instead.
+    if (timeout <= 0) timeout = 1;
+    spec.it_value.tv_sec = timeout / 1000;
+    spec.it_value.tv_nsec = (timeout % 1000) * 1000000;
+  }
+  if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+    FATAL("Failed arming timer fd.");
+  }
+}
+
+// The maximum number of events drained from epoll per wakeup.
+static const int kMaxEvents = EventHandler::kMaxBatchSize;
+
 void EventHandler::Run() {
+  if (io_uring_ != NULL) {
+    RunIoUring();
+    return;
+  }
+
   int* fds = reinterpret_cast<int*>(data_);
+  struct epoll_event events[kMaxEvents];
+  int timer_fd = fds[kTimerFd];
+  int64 next_timeout = HandleTimeouts();
+  int64 armed_timeout = INT64_MAX;
 
   while (true) {
-    int64 next_timeout;
-    {
-      ScopedMonitorLock locker(monitor_);
-      next_timeout = next_timeout_;
-    }
-
-    if (next_timeout == INT64_MAX) {
-      next_timeout = -1;
+    int timeout;
+    if (timer_fd != -1) {
+      // The timer fires at the deadline itself rather than after a delay
+      // rounded to milliseconds.
+      if (next_timeout != armed_timeout) {
+        ArmTimer(timer_fd, next_timeout);
+        armed_timeout = next_timeout;
+      }
+      timeout = -1;
+    } else if (next_timeout == INT64_MAX) {
+      timeout = -1;
     } else {
-      next_timeout -= Platform::GetMicroseconds() / 1000;
-      if (next_timeout < 0) next_timeout = 0;
+      int64 delay = next_timeout - Platform::GetMicroseconds() / 1000;
+      timeout = delay < 0 ? 0 : static_cast<int>(Utils::Minimum<int64>(
+          delay, INT32_MAX));
     }
 
-    struct epoll_event event;
-    int status = epoll_wait(id_, &event, 1, next_timeout);
+    // Registrations removed before this wait cannot show up in its events.
+    Registration* unregistered = unregistered_.exchange(NULL);
+    // Don't block, so they are deleted right after the wait.
+    if (unregistered != NULL) timeout = 0;
+    int status = epoll_wait(id_, events, kMaxEvents, timeout);
 
-    HandleTimeouts();
+    bool interrupted = false;
+    for (int i = 0; i < status; i++) {
+      struct epoll_event* event = &events[i];
+      if (event->data.fd == fds[0]) {
+        interrupted = true;
+        continue;
+      }
+      if (event->data.fd == timer_fd) {
+        // Consume the expiration; the timeouts are handled below.
+        uint64 expirations;
+        TEMP_FAILURE_RETRY(read(timer_fd, &expirations, sizeof(expirations)));
+        armed_timeout = INT64_MAX;
+        continue;
+      }
 
-    if (status != 1) continue;
+      int64 mask = EventMask(event->events);
+      uword data = reinterpret_cast<uword>(event->data.ptr);
+      if ((data & kRegistrationTag) != 0) {
+        PostReady(reinterpret_cast<Registration*>(data & ~kRegistrationTag),
+                  mask);
+      } else {
+        Post(reinterpret_cast<Port*>(data), mask, true);
+      }
+    }
 
-    int events = event.events;
+    // Delivers the messages posted for the fds together with the ones for
+    // the expired timeouts.
+    next_timeout = HandleTimeouts();
+    DeleteRegistrations(unregistered);
 
-    if (event.data.fd == fds[0]) {
+    if (interrupted) {
       if (!running_) {
         ScopedMonitorLock locker(monitor_);
         close(id_);
         close(fds[0]);
         close(fds[1]);
+        if (timer_fd != -1) close(timer_fd);
         delete[] fds;
         data_ = NULL;
         monitor_->Notify();
         return;
       }
 
-      char b;
-      TEMP_FAILURE_RETRY(read(fds[0], &b, 1));
-      continue;
+      // Drain several interrupts at once. The pipe has at least one byte, so
+      // the read does not block.
+      char buffer[16];
+      TEMP_FAILURE_RETRY(read(fds[0], buffer, sizeof(buffer)));
+    }
+  }
+}
+
+// Submit a request for the event handler's own use. Returns false if the
+// kernel cannot take requests right now, in which case the caller tries
+// again on its next iteration.
+static bool SubmitInternal(IoUring* io_uring, IoUring::Opcode opcode, int fd,
+                           uint64 address, uint32 length, uint32 op_flags,
+                           uint64 user_data) {
+  IoUring::Request request;
+  request.opcode = opcode;
+  request.fd = fd;
+  request.address = address;
+  request.length = length;
+  request.offset = 0;
+  request.op_flags = op_flags;
+  request.user_data = user_data;
+  return io_uring->SubmitReserved(request);
+}
+
+void EventHandler::RunIoUring() {
+  int* fds = reinterpret_cast<int*>(data_);
+  IoUring::Completion completions[kMaxEvents];
+
+  // The kernel reads the timeout when the request is submitted, which may
+  // be as late as the next wait.
+  IoUring::Timespec timeout;
+  uint64 timeout_generation = 0;
+  int64 armed_timeout = INT64_MAX;
+  int64 next_timeout = HandleTimeouts();
+  bool interrupt_armed = false;
+
+  while (true) {
+    if (!interrupt_armed) {
+      interrupt_armed = SubmitInternal(io_uring_, IoUring::kPollAdd, fds[0], 0,
+                                       0, POLLIN, kInterruptData);
+    }
+
+    if (next_timeout != armed_timeout) {
+      // A timeout that could not be removed fires with an old generation
+      // and is ignored.
+      if (armed_timeout != INT64_MAX) {
+        SubmitInternal(io_uring_, IoUring::kTimeoutRemove, -1,
+                       TimeoutData(timeout_generation), 0, 0, kIgnoredData);
+      }
+      armed_timeout = INT64_MAX;
+      if (next_timeout != INT64_MAX) {
+        int64 delay = next_timeout * 1000 - Platform::GetMicroseconds();
+        if (delay < 0) delay = 0;
+        timeout.seconds = delay / 1000000;
+        timeout.nanoseconds = (delay % 1000000) * 1000;
+        if (SubmitInternal(io_uring_, IoUring::kTimeout, -1,
+                           reinterpret_cast<uint64>(&timeout), 1, 0,
+                           TimeoutData(++timeout_generation))) {
+          armed_timeout = next_timeout;
+        }
+      }
+    }
+
+    // Requests queued from now on are submitted by the next iteration, so
+    // their submitters have to wake the event handler.
+    flush_pending_ = false;
+    int count = io_uring_->WaitForCompletions(completions, kMaxEvents);
+
+    bool interrupted = false;
+    for (int i = 0; i < count; i++) {
+      uint64 data = completions[i].user_data;
+      int32 result = completions[i].result;
+      switch (data & kTagMask) {
+        case 0:
+          CompleteOperation(reinterpret_cast<Operation*>(data), result);
+          break;
+        case kPollTag: {
+          int64 mask = ERROR_EVENT;
+          if (result >= 0) mask = EventMask(result);
+          Post(reinterpret_cast<Port*>(data & ~kTagMask), mask, true);
+          break;
+        }
+        default:
+          if (data == kInterruptData) {
+            interrupted = true;
+            interrupt_armed = false;
+          } else if (data == TimeoutData(timeout_generation)) {
+            // The current timeout fired.
+            armed_timeout = INT64_MAX;
+          }
+          break;
+      }
     }
 
-    int64 mask = 0;
-    if ((events & EPOLLIN) != 0) mask |= READ_EVENT;
-    if ((events & EPOLLOUT) != 0) mask |= WRITE_EVENT;
-    if ((events & EPOLLRDHUP) != 0) mask |= CLOSE_EVENT;
-    if ((events & EPOLLHUP) != 0) mask |= CLOSE_EVENT;
-    if ((events & EPOLLERR) != 0) mask |= ERROR_EVENT;
+    next_timeout = HandleTimeouts();
+
+    if (interrupted) {
+      if (!running_) {
+        ScopedMonitorLock locker(monitor_);
+        delete io_uring_;
+        io_uring_ = NULL;
+        close(fds[0]);
+        close(fds[1]);
+        delete[] fds;
+        data_ = NULL;
+        monitor_->Notify();
+        return;
+      }
 
-    Port* port = reinterpret_cast<Port*>(event.data.ptr);
-    Send(port, mask, true);
+      char buffer[16];
+      TEMP_FAILURE_RETRY(read(fds[0], buffer, sizeof(buffer)));
+    }
   }
 }
 
@@ -114,11 +340,34 @@ Object* EventHandler::Add(Process* process, Object* id, Port* port,
     return Failure::wrong_argument_type();
   }
 
-  struct epoll_event event;
-  event.events = EPOLLRDHUP | EPOLLHUP | EPOLLONESHOT;
   if ((flags & ~(READ_EVENT | WRITE_EVENT)) != 0) {
     return Failure::illegal_state();
   }
+
+  if (io_uring_ != NULL) {
+    uint32 events = POLLRDHUP;
+    if ((flags & READ_EVENT) != 0) events |= POLLIN;
+    if ((flags & WRITE_EVENT) != 0) events |= POLLOUT;
+    IoUring::Request request;
+    request.opcode = IoUring::kPollAdd;
+    request.fd = fd;
+    request.address = 0;
+    request.length = 0;
+    request.offset = 0;
+    request.op_flags = events;
+    request.user_data = reinterpret_cast<uint64>(port) | kPollTag;
+    // The reference has to be taken before the poll can complete.
+    port->IncrementRef();
+    if (!io_uring_->Submit(request)) {
+      port->DecrementRef();
+      return Failure::index_out_of_bounds();
+    }
+    FlushSubmissions();
+    return process->program()->null_object();
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLRDHUP | EPOLLHUP | EPOLLONESHOT;
   if ((flags & READ_EVENT) != 0) event.events |= EPOLLIN;
   if ((flags & WRITE_EVENT) != 0) event.events |= EPOLLOUT;
   event.data.ptr = port;
@@ -134,6 +383,230 @@ Object* EventHandler::Add(Process* process, Object* id, Port* port,
   return process->program()->null_object();
 }
 
+Object* EventHandler::Register(Process* process, Object* id, Port* port) {
+  EnsureInitialized();
+
+  // Readiness is only reported through one-shot polls with io_uring.
+  if (io_uring_ != NULL) return process->program()->null_object();
+
+  int fd;
+  if (id->IsSmi()) {
+    fd = Smi::cast(id)->value();
+  } else if (id->IsLargeInteger()) {
+    fd = LargeInteger::cast(id)->value();
+  } else {
+    return Failure::wrong_argument_type();
+  }
+
+  Registration* registration = new Registration(fd, port);
+  Object* result = process->ToInteger(reinterpret_cast<word>(registration));
+  if (result->IsRetryAfterGCFailure()) {
+    delete registration;
+    return result;
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.ptr = reinterpret_cast<void*>(
+      reinterpret_cast<uword>(registration) | kRegistrationTag);
+  int status = epoll_ctl(id_, EPOLL_CTL_ADD, fd, &event);
+  if (status == -1 && errno == EEXIST) {
+    // The fd was used with one-shot registrations before.
+    status = epoll_ctl(id_, EPOLL_CTL_MOD, fd, &event);
+  }
+  if (status == -1) {
+    delete registration;
+    return Failure::index_out_of_bounds();
+  }
+  port->IncrementRef();
+  return result;
+}
+
+Object* EventHandler::Submit(Process* process, int kind, Object* id,
+                             word address, int length, Port* port) {
+  EnsureInitialized();
+
+  int fd;
+  if (id->IsSmi()) {
+    fd = Smi::cast(id)->value();
+  } else if (id->IsLargeInteger()) {
+    fd = LargeInteger::cast(id)->value();
+  } else {
+    return Failure::wrong_argument_type();
+  }
+  if (kind < READ_OPERATION || kind > ACCEPT_OPERATION || length < 0) {
+    return Failure::illegal_state();
+  }
+  if (io_uring_ == NULL) return Smi::FromWord(SUBMIT_UNSUPPORTED);
+
+  // The kernel transfers the data at [address] directly.
+  Operation* operation = new Operation(fd, port);
+  IoUring::Request request;
+  request.fd = fd;
+  request.address = address;
+  request.length = length;
+  // Use the current file position, like read and write do.
+  request.offset = static_cast<uint64>(-1);
+  request.op_flags = 0;
+  request.user_data = reinterpret_cast<uint64>(operation);
+  switch (kind) {
+    case READ_OPERATION:
+      request.opcode = IoUring::kRead;
+      break;
+    case WRITE_OPERATION:
+      request.opcode = IoUring::kWrite;
+      break;
+    case ACCEPT_OPERATION:
+      request.opcode = IoUring::kAccept;
+      request.address = 0;
+      request.length = 0;
+      request.offset = 0;
+      request.op_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+      break;
+  }
+
+  port->IncrementRef();
+  {
+    // Linking and queueing the operation under the lock makes sure a
+    // cancellation is queued after the operation itself.
+    ScopedMonitorLock locker(monitor_);
+    LinkOperation(operation);
+    if (!io_uring_->Submit(request)) {
+      // The submission queue is full; the caller does the operation itself.
+      UnlinkOperation(operation);
+      port->DecrementRef();
+      delete operation;
+      return Smi::FromWord(SUBMIT_DECLINED);
+    }
+  }
+  FlushSubmissions();
+  return Smi::FromWord(SUBMITTED);
+}
+
+Object* EventHandler::Cancel(Process* process, Object* id) {
+  int fd;
+  if (id->IsSmi()) {
+    fd = Smi::cast(id)->value();
+  } else if (id->IsLargeInteger()) {
+    fd = LargeInteger::cast(id)->value();
+  } else {
+    return Failure::wrong_argument_type();
+  }
+  if (io_uring_ == NULL) return process->program()->null_object();
+
+  ScopedMonitorLock locker(monitor_);
+  bool queued = false;
+  for (Operation* operation = operations_; operation != NULL;
+       operation = operation->next) {
+    if (operation->fd != fd || operation->cancelled) continue;
+    // If the queue is full, the operation completes on its own instead.
+    if (!CancelOperation(operation)) break;
+    queued = true;
+  }
+  if (queued) FlushSubmissions();
+  return process->program()->null_object();
+}
+
+void EventHandler::FlushSubmissions() {
+  if (!flush_pending_.exchange(true)) Interrupt();
+}
+
+void EventHandler::LinkOperation(Operation* operation) {
+  operation->next = operations_;
+  if (operations_ != NULL) operations_->previous = operation;
+  operations_ = operation;
+}
+
+void EventHandler::UnlinkOperation(Operation* operation) {
+  if (operation->previous != NULL) {
+    operation->previous->next = operation->next;
+  } else {
+    operations_ = operation->next;
+  }
+  if (operation->next != NULL) operation->next->previous = operation->previous;
+}
+
+void EventHandler::CompleteOperation(Operation* operation, int64 result) {
+  {
+    ScopedMonitorLock locker(monitor_);
+    UnlinkOperation(operation);
+    // A dying process waits for its cancelled operations, see
+    // [CancelOperations].
+    if (operation->cancelled) monitor_->NotifyAll();
+  }
+  Post(operation->port, result, true);
+  delete operation;
+}
+
+bool EventHandler::CancelOperation(Operation* operation) {
+  // The cancellation is queued after the operation, so it cannot hit a
+  // later operation that reuses the address once this one has completed.
+  IoUring::Request request;
+  request.opcode = IoUring::kCancel;
+  request.fd = -1;
+  request.address = reinterpret_cast<uint64>(operation);
+  request.length = 0;
+  request.offset = 0;
+  request.op_flags = 0;
+  request.user_data = kIgnoredData;
+  if (!io_uring_->Submit(request)) return false;
+  operation->cancelled = true;
+  return true;
+}
+
+static bool ContainsPort(Port* ports, Port* port) {
+  for (Port* current = ports; current != NULL; current = current->next()) {
+    if (current == port) return true;
+  }
+  return false;
+}
+
+void EventHandler::CancelOperations(Port* ports) {
+  while (true) {
+    bool pending = false;
+    bool queued = false;
+    bool full = false;
+    for (Operation* operation = operations_; operation != NULL;
+         operation = operation->next) {
+      if (!ContainsPort(ports, operation->port)) continue;
+      pending = true;
+      if (operation->cancelled) continue;
+      if (CancelOperation(operation)) {
+        queued = true;
+      } else {
+        full = true;
+      }
+    }
+    if (!pending) return;
+    if (queued) FlushSubmissions();
+    // Try again shortly if the submission queue was full.
+    if (full) {
+      monitor_->Wait(1000);
+    } else {
+      monitor_->Wait();
+    }
+  }
+}
+
+Object* EventHandler::Unregister(Process* process, Object* id) {
+  if (!id->IsSmi() && !id->IsLargeInteger()) {
+    return Failure::wrong_argument_type();
+  }
+  Registration* registration =
+      reinterpret_cast<Registration*>(AsForeignWord(id));
+  epoll_ctl(id_, EPOLL_CTL_DEL, registration->fd, NULL);
+
+  // The event handler thread may still be looking at events for the
+  // registration, so it is deleted by that thread after its next wait.
+  Registration* head = unregistered_;
+  do {
+    registration->next = head;
+  } while (!unregistered_.compare_exchange_weak(head, registration));
+  // Wake the event handler, which may be idle for a long time otherwise.
+  Interrupt();
+  return process->program()->null_object();
+}
+
 }  // namespace dartino
 
 #endif  // defined(DARTINO_TARGET_OS_LINUX)
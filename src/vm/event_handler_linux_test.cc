@@ -0,0 +1,382 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/shared/assert.h"
+#include "src/shared/test_case.h"
+
+#if defined(DARTINO_TARGET_OS_LINUX)
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "src/shared/platform.h"
+#include "src/vm/event_handler.h"
+#include "src/vm/message_mailbox.h"
+#include "src/vm/object.h"
+#include "src/vm/port.h"
+#include "src/vm/process.h"
+#include "src/vm/program.h"
+#include "src/vm/scheduler.h"
+#include "src/vm/thread.h"
+
+namespace dartino {
+
+static const int64 kTimeoutMicros = 10 * 1000 * 1000;
+
+// A process that receives the messages of an event handler without being
+// interpreted. Its program is never started, so resuming the process only
+// adds it to the paused processes of the program.
+class TestProcess {
+ public:
+  TestProcess() : program_(new Program(Program::kBuiltViaSession)) {
+    program_->Initialize();
+    program_->set_static_fields(program_->empty_array());
+    program_->set_scheduler(Scheduler::GlobalInstance());
+    process_ = program_->SpawnProcess(NULL);
+    Thread::SetProcess(process_);
+  }
+
+  // The event handlers used by the test have to be gone by now.
+  ~TestProcess() {
+    ProcessQueueList* paused = program_->program_state()->paused_processes();
+    if (paused->IsInList(process_)) paused->Remove(process_);
+    process_->ChangeState(process_->state(), Process::kWaitingForChildren);
+    program_->ScheduleProcessForDeletion(process_, Signal::kTerminated);
+    Thread::SetProcess(NULL);
+    program_->set_scheduler(NULL);
+    delete program_;
+  }
+
+  Process* process() const { return process_; }
+
+  Port* NewPort() { return new Port(process_, NULL); }
+
+  // Wait for the next message and return its value, or -1 if there is
+  // none in time.
+  int64 NextMessage(Port** port = NULL) {
+    MessageMailbox* mailbox = process_->mailbox();
+    int64 start = Platform::GetMicroseconds();
+    Message* message;
+    while ((message = mailbox->CurrentMessage()) == NULL) {
+      if (Platform::GetMicroseconds() - start > kTimeoutMicros) {
+        EXPECT(message != NULL);
+        return -1;
+      }
+      Thread::YieldCurrentThread();
+    }
+    int64 value = message->value();
+    if (port != NULL) *port = message->port();
+    mailbox->AdvanceCurrentMessage();
+    return value;
+  }
+
+  // Drop the messages received so far.
+  void DropMessages() {
+    MessageMailbox* mailbox = process_->mailbox();
+    while (mailbox->CurrentMessage() != NULL) mailbox->AdvanceCurrentMessage();
+  }
+
+ private:
+  Program* const program_;
+  Process* process_;
+};
+
+// Wait for [flags] on [registration] the way the Dart side does: take the
+// ready events if there are any, and otherwise wait for the message the
+// event handler sends once they are ready.
+static int WaitFor(EventHandler* handler, TestProcess* test_process,
+                   Object* registration, int flags) {
+  Object* ready =
+      handler->WaitForEvent(test_process->process(), registration, flags);
+  int events = Smi::cast(ready)->value();
+  if (events != 0) return events;
+  return test_process->NextMessage();
+}
+
+static void WaitForRefCount(TestProcess* test_process, Port* port,
+                            int ref_count) {
+  int64 start = Platform::GetMicroseconds();
+  while (Platform::GetMicroseconds() - start < kTimeoutMicros) {
+    // Undelivered messages hold references too.
+    test_process->DropMessages();
+    if (port->ref_count() == ref_count) return;
+    Thread::YieldCurrentThread();
+  }
+  EXPECT_EQ(ref_count, port->ref_count());
+}
+
+// Wait until [handler] has resumed processes [count] times, and check that
+// it does not resume them more often.
+static void ExpectResumes(EventHandler* handler, int count) {
+  int64 start = Platform::GetMicroseconds();
+  while (handler->resumed_processes() < count &&
+         Platform::GetMicroseconds() - start < kTimeoutMicros) {
+    Thread::YieldCurrentThread();
+  }
+  EXPECT_EQ(count, handler->resumed_processes());
+}
+
+// Wait until the event handler is done with the batches it has started.
+// A timeout that expires right away is delivered in a batch of its own
+// after them.
+static void Sync(EventHandler* handler, TestProcess* test_process) {
+  Port* port = test_process->NewPort();
+  handler->ScheduleTimeout(Platform::GetMicroseconds() / 1000, port);
+  Port* received = NULL;
+  EXPECT_EQ(0, test_process->NextMessage(&received));
+  EXPECT(received == port);
+  port->DecrementRef();
+}
+
+static int IndexOf(Port** ports, int length, Port* port) {
+  for (int i = 0; i < length; i++) {
+    if (ports[i] == port) return i;
+  }
+  return -1;
+}
+
+static void WriteByte(int fd) {
+  char byte = 0;
+  EXPECT_EQ(1, write(fd, &byte, 1));
+}
+
+TEST_CASE(EventHandlerRegistrationReadWrite) {
+  TestProcess test_process;
+  Port* port = test_process.NewPort();
+  {
+    EventHandler handler;
+    int fds[2];
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    Object* registration =
+        handler.Register(test_process.process(), Smi::FromWord(fds[0]), port);
+    EXPECT(registration->IsSmi());
+
+    // A new socket is writable but has nothing to read.
+    EXPECT_EQ(EventHandler::WRITE_EVENT,
+              WaitFor(&handler, &test_process, registration,
+                      EventHandler::WRITE_EVENT));
+
+    // Read readiness is reported once per transition. Leaving the data
+    // unread does not report it again, new data does.
+    WriteByte(fds[1]);
+    EXPECT_EQ(EventHandler::READ_EVENT,
+              WaitFor(&handler, &test_process, registration,
+                      EventHandler::READ_EVENT));
+    EXPECT_EQ(0, Smi::cast(handler.WaitForEvent(test_process.process(),
+                                                registration,
+                                                EventHandler::READ_EVENT))
+                     ->value());
+    WriteByte(fds[1]);
+    EXPECT_EQ(EventHandler::READ_EVENT, test_process.NextMessage());
+
+    // Fill the socket. Write readiness recorded earlier may still be
+    // reported once, after which it takes the peer reading to report it.
+    char buffer[4096] = {0};
+    while (write(fds[0], buffer, sizeof(buffer)) > 0) {
+    }
+    EXPECT_EQ(EAGAIN, errno);
+    Object* ready = handler.WaitForEvent(test_process.process(), registration,
+                                         EventHandler::WRITE_EVENT);
+    if (Smi::cast(ready)->value() != 0) {
+      EXPECT_EQ(EventHandler::WRITE_EVENT, Smi::cast(ready)->value());
+      ready = handler.WaitForEvent(test_process.process(), registration,
+                                   EventHandler::WRITE_EVENT);
+    }
+    EXPECT_EQ(0, Smi::cast(ready)->value());
+    while (read(fds[1], buffer, sizeof(buffer)) > 0) {
+    }
+    EXPECT_EQ(EventHandler::WRITE_EVENT, test_process.NextMessage());
+
+    handler.Unregister(test_process.process(), registration);
+    close(fds[0]);
+    close(fds[1]);
+  }
+  port->DecrementRef();
+}
+
+TEST_CASE(EventHandlerRegistrationStickyEvents) {
+  TestProcess test_process;
+  Port* port = test_process.NewPort();
+  {
+    EventHandler handler;
+
+    // Closing the peer reports the close event for every later wait, along
+    // with the end of the data.
+    int fds[2];
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    Object* registration =
+        handler.Register(test_process.process(), Smi::FromWord(fds[0]), port);
+    EXPECT_EQ(EventHandler::WRITE_EVENT,
+              WaitFor(&handler, &test_process, registration,
+                      EventHandler::WRITE_EVENT));
+    close(fds[1]);
+    int events = WaitFor(&handler, &test_process, registration,
+                         EventHandler::READ_EVENT);
+    EXPECT_EQ(EventHandler::READ_EVENT | EventHandler::CLOSE_EVENT, events);
+    for (int i = 0; i < 2; i++) {
+      Object* ready = handler.WaitForEvent(test_process.process(),
+                                           registration,
+                                           EventHandler::READ_EVENT);
+      EXPECT_EQ(EventHandler::CLOSE_EVENT, Smi::cast(ready)->value());
+    }
+    handler.Unregister(test_process.process(), registration);
+    close(fds[0]);
+
+    // Writing to a pipe without a reader reports the error event, which
+    // also stays ready.
+    EXPECT_EQ(0, pipe(fds));
+    registration =
+        handler.Register(test_process.process(), Smi::FromWord(fds[1]), port);
+    EXPECT_EQ(EventHandler::WRITE_EVENT,
+              WaitFor(&handler, &test_process, registration,
+                      EventHandler::WRITE_EVENT));
+    close(fds[0]);
+    events = WaitFor(&handler, &test_process, registration,
+                     EventHandler::WRITE_EVENT);
+    EXPECT((events & EventHandler::ERROR_EVENT) != 0);
+    for (int i = 0; i < 2; i++) {
+      Object* ready = handler.WaitForEvent(test_process.process(),
+                                           registration,
+                                           EventHandler::READ_EVENT);
+      EXPECT((Smi::cast(ready)->value() & EventHandler::ERROR_EVENT) != 0);
+    }
+    handler.Unregister(test_process.process(), registration);
+    close(fds[1]);
+  }
+  port->DecrementRef();
+}
+
+TEST_CASE(EventHandlerUnregister) {
+  TestProcess test_process;
+  Port* port = test_process.NewPort();
+  {
+    EventHandler handler;
+    int fds[2];
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+
+    // The registration holds a reference to the port until it is deleted,
+    // which the event handler does without further events.
+    Object* registration =
+        handler.Register(test_process.process(), Smi::FromWord(fds[0]), port);
+    EXPECT_EQ(EventHandler::WRITE_EVENT,
+              WaitFor(&handler, &test_process, registration,
+                      EventHandler::WRITE_EVENT));
+    EXPECT_EQ(2, port->ref_count());
+    handler.Unregister(test_process.process(), registration);
+    WaitForRefCount(&test_process, port, 1);
+
+    // Unregister while the event handler may be handling an event for the
+    // registration.
+    for (int i = 0; i < 100; i++) {
+      registration = handler.Register(test_process.process(),
+                                      Smi::FromWord(fds[0]), port);
+      EXPECT_EQ(0, Smi::cast(handler.WaitForEvent(test_process.process(),
+                                                  registration,
+                                                  EventHandler::READ_EVENT))
+                       ->value());
+      WriteByte(fds[1]);
+      handler.Unregister(test_process.process(), registration);
+      WaitForRefCount(&test_process, port, 1);
+      char byte;
+      EXPECT_EQ(1, read(fds[0], &byte, 1));
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+  }
+  port->DecrementRef();
+}
+
+TEST_CASE(EventHandlerBatchesReadyFds) {
+  const int kFds = 16;
+  TestProcess test_process;
+  Port* ports[kFds];
+  {
+    EventHandler handler;
+    int fds[2];
+    EXPECT_EQ(0, pipe(fds));
+
+    // Duplicates of the read end all become ready with the same write.
+    int duplicates[kFds];
+    Object* registrations[kFds];
+    for (int i = 0; i < kFds; i++) {
+      duplicates[i] = dup(fds[0]);
+      ports[i] = test_process.NewPort();
+      registrations[i] = handler.Register(test_process.process(),
+                                          Smi::FromWord(duplicates[i]),
+                                          ports[i]);
+      EXPECT_EQ(0, Smi::cast(handler.WaitForEvent(test_process.process(),
+                                                  registrations[i],
+                                                  EventHandler::READ_EVENT))
+                       ->value());
+    }
+
+    // Hold the event handler after it has been woken by an unregistration,
+    // so the fds all become ready before its next wait.
+    Object* other = handler.Register(test_process.process(),
+                                     Smi::FromWord(fds[1]), ports[0]);
+    {
+      ScopedMonitorLock locker(handler.monitor());
+      handler.Unregister(test_process.process(), other);
+      usleep(50 * 1000);
+      WriteByte(fds[1]);
+    }
+
+    // Every registration gets its message, and the process is resumed once
+    // for all of them.
+    bool seen[kFds] = {false};
+    for (int i = 0; i < kFds; i++) {
+      Port* received = NULL;
+      EXPECT_EQ(EventHandler::READ_EVENT, test_process.NextMessage(&received));
+      int index = IndexOf(ports, kFds, received);
+      EXPECT(index != -1 && !seen[index]);
+      if (index != -1) seen[index] = true;
+    }
+    Sync(&handler, &test_process);
+    ExpectResumes(&handler, 2);
+
+    for (int i = 0; i < kFds; i++) {
+      handler.Unregister(test_process.process(), registrations[i]);
+      close(duplicates[i]);
+    }
+    close(fds[0]);
+    close(fds[1]);
+  }
+  for (int i = 0; i < kFds; i++) ports[i]->DecrementRef();
+}
+
+TEST_CASE(EventHandlerBatchOverflow) {
+  // More timeouts than fit in a batch expire in the same wakeup.
+  const int kTimeouts = EventHandler::kMaxBatchSize + 36;
+  TestProcess test_process;
+  Port* ports[kTimeouts];
+  {
+    EventHandler handler;
+    int64 deadline = Platform::GetMicroseconds() / 1000 + 20;
+    for (int i = 0; i < kTimeouts; i++) {
+      ports[i] = test_process.NewPort();
+      handler.ScheduleTimeout(deadline, ports[i]);
+    }
+
+    // The messages of the full batch are delivered before the batch is
+    // reused, and none of them are lost or repeated.
+    bool seen[kTimeouts] = {false};
+    for (int i = 0; i < kTimeouts; i++) {
+      Port* received = NULL;
+      EXPECT_EQ(0, test_process.NextMessage(&received));
+      int index = IndexOf(ports, kTimeouts, received);
+      EXPECT(index != -1 && !seen[index]);
+      if (index != -1) seen[index] = true;
+    }
+    Sync(&handler, &test_process);
+    // Once for each of the two batches, and once for the sync.
+    ExpectResumes(&handler, 3);
+  }
+  for (int i = 0; i < kTimeouts; i++) ports[i]->DecrementRef();
+}
+
+}  // namespace dartino
+
+#endif  // defined(DARTINO_TARGET_OS_LINUX)
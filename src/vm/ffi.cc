@@ -5,6 +5,8 @@
 #include "src/vm/ffi.h"
 
 #include "src/shared/asan_helper.h"
+#include "src/shared/flags.h"
+#include "src/vm/blocking_call_pool.h"
 #include "src/vm/natives.h"
 #include "src/vm/object.h"
 #include "src/vm/port.h"
@@ -63,6 +65,13 @@ BEGIN_NATIVE(ForeignMarkForFinalization) {
 }
 END_NATIVE()
 
+BEGIN_NATIVE(ForeignSetErrno) {
+  if (!arguments[0]->IsSmi()) return Failure::wrong_argument_type();
+  Platform::SetLastError(Smi::cast(arguments[0])->value());
+  return process->program()->null_object();
+}
+END_NATIVE()
+
 BEGIN_NATIVE(ForeignBitsPerWord) { return Smi::FromWord(kBitsPerWord); }
 END_NATIVE()
 
@@ -72,6 +81,13 @@ END_NATIVE()
 BEGIN_NATIVE(ForeignArchitecture) { return Smi::FromWord(Platform::Arch()); }
 END_NATIVE()
 
+BEGIN_NATIVE(ForeignDetachAllCalls) {
+  Program* program = process->program();
+  return Flags::detach_foreign_calls ? program->true_object()
+                                     : program->false_object();
+}
+END_NATIVE()
+
 BEGIN_NATIVE(ForeignConvertPort) {
   if (!arguments[0]->IsInstance()) return Smi::zero();
   Instance* instance = Instance::cast(arguments[0]);
@@ -366,6 +382,50 @@ BEGIN_NATIVE(ForeignLCallwLw) {
 }
 END_NATIVE()
 
+// Run a foreign call on the [BlockingCallPool]. The result and the errno of
+// the call are sent to the port given as the fourth argument.
+BEGIN_NATIVE(ForeignDetachedCall) {
+  if (!arguments[0]->IsSmi() || !arguments[1]->IsSmi()) {
+    return Failure::wrong_argument_type();
+  }
+  word kind = Smi::cast(arguments[0])->value();
+  word arity = Smi::cast(arguments[1])->value();
+  if (kind < BlockingCall::kIntCall || kind > BlockingCall::kLongCallwLw) {
+    return Failure::wrong_argument_type();
+  }
+  if (arity < 0 || arity > BlockingCall::kMaxArguments) {
+    return Failure::index_out_of_bounds();
+  }
+  if (kind == BlockingCall::kLongCallwLw) {
+    if (arity != 3) return Failure::index_out_of_bounds();
+    if (!arguments[5]->IsSmi() && !arguments[5]->IsLargeInteger()) {
+      return Failure::wrong_argument_type();
+    }
+  }
+  if (!arguments[3]->IsInstance() || !Instance::cast(arguments[3])->IsPort()) {
+    return Failure::wrong_argument_type();
+  }
+  Port* port = Port::FromDartObject(arguments[3]);
+  if (port == NULL) return Failure::wrong_argument_type();
+
+  BlockingCall* call = new BlockingCall();
+  call->kind = static_cast<BlockingCall::Kind>(kind);
+  call->arity = arity;
+  call->address = AsForeignWord(arguments[2]);
+  for (int i = 0; i < arity; i++) {
+    call->arguments[i] = AsForeignWord(arguments[4 + i]);
+  }
+  call->long_argument = 0;
+  if (call->kind == BlockingCall::kLongCallwLw) {
+    call->long_argument = AsInt64Value(arguments[5]);
+  }
+  port->IncrementRef();
+  call->port = port;
+  BlockingCallPool::GlobalInstance()->Run(call);
+  return process->program()->null_object();
+}
+END_NATIVE()
+
 #define DEFINE_FOREIGN_ACCESSORS_INTEGER(suffix, type)                    \
                                                                           \
   BEGIN_NATIVE(ForeignGet##suffix) {                                      \
@@ -0,0 +1,112 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/vm/gc_helper_pool.h"
+
+#include "src/shared/flags.h"
+#include "src/shared/utils.h"
+
+namespace dartino {
+
+GCHelperPool* GCHelperPool::gc_helper_pool_ = NULL;
+
+void GCHelperPool::Setup() {
+  ASSERT(gc_helper_pool_ == NULL);
+  int number_of_threads = Flags::gc_helper_threads;
+  if (number_of_threads < 0) {
+    // The thread running the collection takes part in it as well.
+    number_of_threads = Platform::GetNumberOfHardwareThreads() - 1;
+  }
+  gc_helper_pool_ = new GCHelperPool(number_of_threads);
+}
+
+void GCHelperPool::TearDown() {
+  ASSERT(gc_helper_pool_ != NULL);
+  delete gc_helper_pool_;
+  gc_helper_pool_ = NULL;
+}
+
+GCHelperPool::GCHelperPool(int number_of_threads)
+    : monitor_(Platform::CreateMonitor()),
+      thread_pool_(number_of_threads),
+      number_of_threads_(number_of_threads),
+      pending_tasks_(new GCHelperTask*[number_of_threads]),
+      pending_indices_(new int[number_of_threads]),
+      pending_(0),
+      idle_threads_(0),
+      reserved_(0),
+      shutting_down_(false) {
+  thread_pool_.Start();
+  for (int i = 0; i < number_of_threads; i++) {
+    while (!thread_pool_.TryStartThread(RunThread, this)) {
+    }
+  }
+}
+
+GCHelperPool::~GCHelperPool() {
+  {
+    ScopedMonitorLock locker(monitor_);
+    ASSERT(pending_ == 0 && reserved_ == 0);
+    shutting_down_ = true;
+    monitor_->NotifyAll();
+  }
+  thread_pool_.JoinAll();
+  delete[] pending_indices_;
+  delete[] pending_tasks_;
+  delete monitor_;
+}
+
+int GCHelperPool::Reserve(int count) {
+  if (count <= 0) return 0;
+  ScopedMonitorLock locker(monitor_);
+  int available = idle_threads_ - pending_ - reserved_;
+  int helpers = Utils::Minimum(count, available);
+  if (helpers <= 0) return 0;
+  reserved_ += helpers;
+  return helpers;
+}
+
+void GCHelperPool::Start(GCHelperTask* task, int helpers) {
+  if (helpers == 0) return;
+  ScopedMonitorLock locker(monitor_);
+  ASSERT(helpers <= reserved_);
+  reserved_ -= helpers;
+  task->running_helpers_ += helpers;
+  for (int i = 0; i < helpers; i++) {
+    ASSERT(pending_ < number_of_threads_);
+    pending_tasks_[pending_] = task;
+    pending_indices_[pending_] = i;
+    pending_++;
+  }
+  monitor_->NotifyAll();
+}
+
+void GCHelperPool::Join(GCHelperTask* task) {
+  ScopedMonitorLock locker(monitor_);
+  while (task->running_helpers_ > 0) monitor_->Wait();
+}
+
+void GCHelperPool::RunThread(void* data) {
+  reinterpret_cast<GCHelperPool*>(data)->ThreadLoop();
+}
+
+void GCHelperPool::ThreadLoop() {
+  ScopedMonitorLock locker(monitor_);
+  while (true) {
+    idle_threads_++;
+    while (pending_ == 0 && !shutting_down_) monitor_->Wait();
+    idle_threads_--;
+    if (pending_ == 0) return;
+
+    pending_--;
+    GCHelperTask* task = pending_tasks_[pending_];
+    int index = pending_indices_[pending_];
+    monitor_->Unlock();
+    task->RunHelper(index);
+    monitor_->Lock();
+    if (--task->running_helpers_ == 0) monitor_->NotifyAll();
+  }
+}
+
+}  // namespace dartino
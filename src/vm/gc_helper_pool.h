@@ -0,0 +1,78 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#ifndef SRC_VM_GC_HELPER_POOL_H_
+#define SRC_VM_GC_HELPER_POOL_H_
+
+#include "src/shared/globals.h"
+#include "src/shared/platform.h"
+#include "src/vm/thread_pool.h"
+
+namespace dartino {
+
+// Work that a collection shares with the threads of the [GCHelperPool].
+class GCHelperTask {
+ public:
+  GCHelperTask() : running_helpers_(0) {}
+  virtual ~GCHelperTask() {}
+
+  // Called on each helper thread the task was started on, with the index of
+  // the helper, concurrently with the thread that started the task.
+  virtual void RunHelper(int index) = 0;
+
+ private:
+  friend class GCHelperPool;
+
+  int running_helpers_;
+};
+
+// The GC helper pool keeps -Xgc_helper_threads threads around to help
+// collections mark and scavenge, so a collection does not have to start and
+// join threads of its own. Several collections can use the pool at the same
+// time, each getting the helpers that are idle when it starts.
+class GCHelperPool {
+ public:
+  static void Setup();
+  static void TearDown();
+  static GCHelperPool* GlobalInstance() { return gc_helper_pool_; }
+
+  explicit GCHelperPool(int number_of_threads);
+  ~GCHelperPool();
+
+  int number_of_threads() const { return number_of_threads_; }
+
+  // Reserves up to [count] idle helpers, and returns the number reserved.
+  // The reserved helpers must be handed a task with [Start].
+  int Reserve(int count);
+
+  // Runs [task] on [helpers] helpers reserved with [Reserve].
+  void Start(GCHelperTask* task, int helpers);
+
+  // Waits for all helpers running [task] to be done with it.
+  void Join(GCHelperTask* task);
+
+ private:
+  static GCHelperPool* gc_helper_pool_;
+
+  Monitor* monitor_;
+  ThreadPool thread_pool_;
+  const int number_of_threads_;
+
+  // The helpers handed out by [Start] which have not yet been picked up by a
+  // thread. At most [number_of_threads_] of them are pending.
+  GCHelperTask** pending_tasks_;
+  int* pending_indices_;
+  int pending_;
+
+  int idle_threads_;
+  int reserved_;
+  bool shutting_down_;
+
+  static void RunThread(void* data);
+  void ThreadLoop();
+};
+
+}  // namespace dartino
+
+#endif  // SRC_VM_GC_HELPER_POOL_H_
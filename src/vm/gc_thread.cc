@@ -7,6 +7,7 @@
 #include "src/vm/program.h"
 #include "src/vm/process.h"
 #include "src/vm/scheduler.h"
+#include "src/vm/thread.h"
 
 namespace dartino {
 
@@ -58,6 +59,30 @@ void GCThread::TriggerGC(Program* program) {
   gc_thread_monitor_->Notify();
 }
 
+void GCThread::TriggerConcurrentMarking(Program* program) {
+  ScopedMonitorLock lock(gc_thread_monitor_);
+  auto it = marking_count_.Find(program);
+  if (it == marking_count_.End()) {
+    marking_count_[program] = 1;
+  } else {
+    it->second++;
+  }
+
+  gc_thread_monitor_->Notify();
+}
+
+void GCThread::TriggerConcurrentSweeping(Program* program) {
+  ScopedMonitorLock lock(gc_thread_monitor_);
+  auto it = sweeping_count_.Find(program);
+  if (it == sweeping_count_.End()) {
+    sweeping_count_[program] = 1;
+  } else {
+    it->second++;
+  }
+
+  gc_thread_monitor_->Notify();
+}
+
 void GCThread::Pause() {
   // Tell thread it should pause.
   {
@@ -109,10 +134,16 @@ void GCThread::StopThread() {
 }
 
 void GCThread::MainLoop() {
+  Thread::ApplyCpuAffinity(Thread::kGCThreadAffinityIndex);
+
   // Handle gc and shutdown messages.
   while (true) {
     Program* program_to_gc = NULL;
     Program* shared_heap_to_gc = NULL;
+    Program* program_to_mark = NULL;
+    int marking_count = 0;
+    Program* program_to_sweep = NULL;
+    int sweeping_count = 0;
     bool do_pause = false;
     bool do_shutdown = false;
     {
@@ -120,6 +151,8 @@ void GCThread::MainLoop() {
         ScopedMonitorLock lock(gc_thread_monitor_);
         while (program_gc_count_.size() == 0 &&
                shared_gc_count_.size() == 0 &&
+               marking_count_.size() == 0 &&
+               sweeping_count_.size() == 0 &&
                pause_count_ == 0 &&
                !shutting_down_) {
           gc_thread_monitor_->Wait();
@@ -133,6 +166,16 @@ void GCThread::MainLoop() {
           program_to_gc = program_gc_count_.Begin()->first;
         }
 
+        if (marking_count_.size() > 0) {
+          program_to_mark = marking_count_.Begin()->first;
+          marking_count = marking_count_.Begin()->second;
+        }
+
+        if (sweeping_count_.size() > 0) {
+          program_to_sweep = sweeping_count_.Begin()->first;
+          sweeping_count = sweeping_count_.Begin()->second;
+        }
+
         do_shutdown = shutting_down_;
         do_pause = pause_count_ > 0;
 
@@ -202,6 +245,38 @@ void GCThread::MainLoop() {
       program_to_gc->scheduler()->FinishedGC(program_to_gc, count);
     }
 
+    if (program_to_mark != NULL) {
+      // Runs until the marking is done, or until the program finishes or
+      // aborts it.
+      program_to_mark->MarkConcurrently();
+
+      // A new marking may have been triggered in the meantime, in which
+      // case the program stays in the map.
+      {
+        ScopedMonitorLock lock(gc_thread_monitor_);
+        auto it = marking_count_.Find(program_to_mark);
+        it->second -= marking_count;
+        if (it->second == 0) marking_count_.Erase(it);
+      }
+      program_to_mark->scheduler()->FinishedGC(program_to_mark,
+                                               marking_count);
+    }
+
+    if (program_to_sweep != NULL) {
+      // Sweeps until all chunks are swept, or until a scavenge pauses the
+      // sweeping. The remaining chunks are then swept by the allocations.
+      program_to_sweep->SweepConcurrently();
+
+      {
+        ScopedMonitorLock lock(gc_thread_monitor_);
+        auto it = sweeping_count_.Find(program_to_sweep);
+        it->second -= sweeping_count;
+        if (it->second == 0) sweeping_count_.Erase(it);
+      }
+      program_to_sweep->scheduler()->FinishedGC(program_to_sweep,
+                                                sweeping_count);
+    }
+
     if (do_shutdown) {
       break;
     }
@@ -220,6 +295,18 @@ void GCThread::MainLoop() {
   }
   program_gc_count_.Clear();
 
+  for (auto& pair : marking_count_) {
+    Program* program = pair.first;
+    program->scheduler()->FinishedGC(program, pair.second);
+  }
+  marking_count_.Clear();
+
+  for (auto& pair : sweeping_count_) {
+    Program* program = pair.first;
+    program->scheduler()->FinishedGC(program, pair.second);
+  }
+  sweeping_count_.Clear();
+
   // Tell caller of GCThread.Shutdown() we're done.
   {
     ScopedMonitorLock lock(client_monitor_);
@@ -18,6 +18,8 @@ class GCThread {
   void StartThread();
   void TriggerSharedGC(Program* program);
   void TriggerGC(Program* program);
+  void TriggerConcurrentMarking(Program* program);
+  void TriggerConcurrentSweeping(Program* program);
   void Pause();
   void Resume();
   void StopThread();
@@ -33,6 +35,8 @@ class GCThread {
   // TODO(kustermann): We should use a priority datastructure here.
   HashMap<Program*, int> program_gc_count_;
   HashMap<Program*, int> shared_gc_count_;
+  HashMap<Program*, int> marking_count_;
+  HashMap<Program*, int> sweeping_count_;
   bool shutting_down_;
   int pause_count_;
 
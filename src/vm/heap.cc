@@ -12,13 +12,111 @@
 
 namespace dartino {
 
+TenuringPolicy::TenuringPolicy() : threshold_(kMaximumThreshold) {
+  for (int i = 0; i < NUMBER_OF_KINDS; i++) {
+    allocated_[i] = 0;
+    pretenured_[i] = false;
+  }
+}
+
+int TenuringPolicy::KindOf(InstanceFormat::Type type, int size) {
+  if (type == InstanceFormat::STACK_TYPE) return STACKS;
+  if (type == InstanceFormat::ARRAY_TYPE && size >= kLargeArraySize) {
+    return LARGE_ARRAYS;
+  }
+  return -1;
+}
+
+void TenuringPolicy::Update(int new_space_size, const int* survived,
+                            const int* survived_young) {
+  // Keep the youngest survivors in the new space, as long as they fit. The
+  // survivors older than the current threshold were not seen, so it grows
+  // by at most one.
+  int target = new_space_size / 100 * kTargetSurvivorPercent;
+  int kept = 0;
+  int threshold = 1;
+  while (threshold < kMaximumThreshold && threshold <= threshold_ &&
+         kept + survived[threshold] <= target) {
+    kept += survived[threshold];
+    threshold++;
+  }
+  threshold_ = threshold;
+
+  for (int i = 0; i < NUMBER_OF_KINDS; i++) {
+    if (Flags::pretenuring && allocated_[i] >= kMinimumPretenuringSample &&
+        survived_young[i] >=
+            allocated_[i] / 100 * kPretenuringSurvivalPercent) {
+      pretenured_[i] = true;
+    }
+    allocated_[i] = 0;
+  }
+}
+
+void TenuringPolicy::ResetPretenuring() {
+  for (int i = 0; i < NUMBER_OF_KINDS; i++) pretenured_[i] = false;
+}
+
+// Converts a size flag in KB to bytes. Sizes that do not fit in an int are
+// clamped, so a maximum heap size of 2GB or more means no limit in practice.
+static int FlagBytes(int kilobytes) {
+  int64 bytes = static_cast<int64>(kilobytes) * KB;
+  bytes = Utils::Minimum<int64>(bytes, INT32_MAX);
+  return static_cast<int>(Utils::Maximum<int64>(bytes, 0));
+}
+
+HeapSizingPolicy::HeapSizingPolicy() : young_size_(kMinimumYoungSize) {}
+
+int HeapSizingPolicy::young_size(int old_used) const {
+  if (Flags::young_generation_size > 0) {
+    return FlagBytes(Flags::young_generation_size);
+  }
+  if (Flags::target_pause_time <= 0) return old_used >> 3;
+  return young_size_;
+}
+
+void HeapSizingPolicy::RecordScavenge(int scavenged, int survived,
+                                      int64 pause) {
+  int64 target = static_cast<int64>(Flags::target_pause_time) * 1000;
+  if (scavenged <= 0 || target <= 0) return;
+  if (pause > target) {
+    // The pause grows with the survivors, which grow with the size.
+    int size = static_cast<int>(young_size_ * target / pause);
+    young_size_ = Utils::Maximum(size, young_size_ / 2);
+  } else if (survived >= scavenged / 100 * kHighSurvivalPercent &&
+             2 * pause <= target) {
+    young_size_ *= 2;
+  }
+  int maximum = kMaximumYoungSize;
+  if (Flags::max_heap_size > 0) {
+    maximum = Utils::Minimum(maximum, FlagBytes(Flags::max_heap_size / 4));
+  }
+  young_size_ = Utils::Maximum(Utils::Minimum(young_size_, maximum),
+                               kMinimumYoungSize);
+}
+
+int HeapSizingPolicy::OldSpaceBudget(int live) const {
+  int budget = static_cast<int>(static_cast<int64>(live) *
+                                Flags::heap_growth_percent / 100);
+  budget = Utils::Maximum(budget, FlagBytes(Flags::min_heap_size) - live);
+  if (Flags::max_heap_size > 0) {
+    int maximum = FlagBytes(Flags::max_heap_size);
+    if (live > maximum) {
+      FATAL1("Live data exceeds the maximum heap size of %d KB\n",
+             Flags::max_heap_size);
+    }
+    budget = Utils::Minimum(budget, maximum - live);
+  }
+  return budget;
+}
+
 Heap::Heap(RandomXorShift* random, int maximum_initial_size)
     : random_(random),
       space_(new SemiSpace(maximum_initial_size)),
       old_space_(new OldSpace(0)),
       weak_pointers_(NULL),
       foreign_memory_(0),
-      allocations_have_taken_place_(false) {
+      allocations_have_taken_place_(false),
+      large_object_space_(false) {
   AdjustAllocationBudget();
   AdjustOldAllocationBudget();
 }
@@ -28,7 +126,8 @@ Heap::Heap(SemiSpace* existing_space, WeakPointer* weak_pointers)
       space_(existing_space),
       weak_pointers_(weak_pointers),
       foreign_memory_(0),
-      allocations_have_taken_place_(false) {}
+      allocations_have_taken_place_(false),
+      large_object_space_(false) {}
 
 Heap::~Heap() {
   WeakPointer::ForceCallbacks(&weak_pointers_, this);
@@ -39,6 +138,10 @@ Heap::~Heap() {
 
 Object* Heap::Allocate(int size) {
   allocations_have_taken_place_ = true;
+  if (IsLargeObject(size)) {
+    uword result = old_space_->AllocateLargeObject(size);
+    if (result != 0) return AllocatedInOldSpace(result, size);
+  }
   uword result = space_->Allocate(size);
   if (result == 0) return Failure::retry_after_gc(size);
   return HeapObject::FromAddress(result);
@@ -46,11 +149,42 @@ Object* Heap::Allocate(int size) {
 
 Object* Heap::AllocateNonFatal(int size) {
   allocations_have_taken_place_ = true;
+  if (IsLargeObject(size)) {
+    uword result = old_space_->AllocateLargeObject(size);
+    if (result != 0) return AllocatedInOldSpace(result, size);
+  }
   uword result = space_->AllocateNonFatal(size);
   if (result == 0) return Failure::retry_after_gc(size);
   return HeapObject::FromAddress(result);
 }
 
+Object* Heap::AllocateOfKind(int kind, int size, bool fatal) {
+  // Large objects are allocated in the old space anyway.
+  if (tenuring_policy_.ShouldPretenure(kind) && !IsLargeObject(size)) {
+    uword result = old_space_->Allocate(size);
+    if (result != 0) {
+      allocations_have_taken_place_ = true;
+      return AllocatedInOldSpace(result, size);
+    }
+    // The old space needs a collection first.
+  }
+  Object* result = fatal ? Allocate(size) : AllocateNonFatal(size);
+  if (!result->IsFailure()) tenuring_policy_.RecordAllocation(kind, size);
+  return result;
+}
+
+Object* Heap::AllocatedInOldSpace(uword address, int size) {
+  // Objects allocated while the old space is marked are live.
+  if (old_space_->is_marking_concurrently() &&
+      ObjectMemory::TrySetMarkBit(address)) {
+    old_space_->AddPromotedLiveBytes(size);
+  }
+  // The object is initialized without a write barrier, so it is in the
+  // remembered set until the next scavenge.
+  ObjectMemory::DirtyCard(address);
+  return HeapObject::FromAddress(address);
+}
+
 void Heap::TryDealloc(Object* object, int size) {
   uword location = reinterpret_cast<uword>(object) + size - HeapObject::kTag;
   space_->TryDealloc(location, size);
@@ -73,7 +207,8 @@ Object* Heap::CreateInstance(Class* the_class, Object* init_value,
 Object* Heap::CreateArray(Class* the_class, int length, Object* init_value) {
   ASSERT(the_class->instance_format().type() == InstanceFormat::ARRAY_TYPE);
   int size = Array::AllocationSize(length);
-  Object* raw_result = Allocate(size);
+  int kind = TenuringPolicy::KindOf(InstanceFormat::ARRAY_TYPE, size);
+  Object* raw_result = AllocateOfKind(kind, size, true);
   if (raw_result->IsFailure()) return raw_result;
   Array* result = reinterpret_cast<Array*>(raw_result);
   result->set_class(the_class);
@@ -200,7 +335,8 @@ Object* Heap::CreateTwoByteStringUninitialized(Class* the_class, int length) {
 Object* Heap::CreateStack(Class* the_class, int length) {
   ASSERT(the_class->instance_format().type() == InstanceFormat::STACK_TYPE);
   int size = Stack::AllocationSize(length);
-  Object* raw_result = AllocateNonFatal(size);
+  int kind = TenuringPolicy::KindOf(InstanceFormat::STACK_TYPE, size);
+  Object* raw_result = AllocateOfKind(kind, size, false);
   if (raw_result->IsFailure()) return raw_result;
   Stack* result = reinterpret_cast<Stack*>(raw_result);
   result->set_class(the_class);
@@ -268,11 +404,7 @@ void Heap::ReplaceSpace(SemiSpace* space, OldSpace* old_space) {
   delete space_;
   space_ = space;
   if (old_space != NULL) {
-    // TODO(erikcorry): Fix this heuristic.
-    // Currently the new-space GC time is dependent on the size of old space
-    // because we have no remembered set.  Therefore we have to grow the new
-    // space as the old space grows to avoid going quadratic.
-    space->SetAllocationBudget(old_space->Used() >> 3);
+    space->SetAllocationBudget(sizing_policy_.young_size(old_space->Used()));
   } else {
     AdjustAllocationBudget();
   }
@@ -15,6 +15,105 @@ namespace dartino {
 
 class ExitReference;
 
+// Decides which survivors of a scavenge are promoted to the old space, and
+// which new objects are allocated in the old space right away.
+//
+// A survivor is promoted once it has survived [threshold] scavenges. After
+// each scavenge, the threshold is lowered to keep the survivors that stay in
+// the new space below a fraction of it, and raised by one if they fit.
+//
+// With -Xpretenuring, the stacks and the large arrays are allocated in the
+// old space while nearly all of those allocated between two scavenges
+// survive the second one. The decisions are dropped after each collection of
+// the old space, where the pretenured objects that died are not seen.
+class TenuringPolicy {
+ public:
+  static const int kMaximumThreshold = 4;
+  // Arrays of at least this size are candidates for pretenuring.
+  static const int kLargeArraySize = 2 * KB;
+
+  // The kinds of objects that can be pretenured.
+  enum Kind { STACKS, LARGE_ARRAYS, NUMBER_OF_KINDS };
+
+  TenuringPolicy();
+
+  int threshold() const { return threshold_; }
+
+  // Returns the kind of an object of [type] and [size], or -1 if it is
+  // never pretenured.
+  static int KindOf(InstanceFormat::Type type, int size);
+
+  bool ShouldPretenure(int kind) const {
+    return kind >= 0 && pretenured_[kind];
+  }
+
+  void RecordAllocation(int kind, int size) {
+    if (kind >= 0) allocated_[kind] += size;
+  }
+
+  // Called after a scavenge of [new_space_size] bytes. [survived] holds the
+  // bytes of the survivors by their new age, up to the threshold, and
+  // [survived_young] the bytes of each kind that survived their first
+  // scavenge.
+  void Update(int new_space_size, const int* survived,
+              const int* survived_young);
+
+  void ResetPretenuring();
+
+ private:
+  // The survivors staying in the new space should take up at most this
+  // much of it.
+  static const int kTargetSurvivorPercent = 25;
+  // Objects are pretenured when this many of them survive, measured on
+  // at least [kMinimumPretenuringSample] bytes.
+  static const int kPretenuringSurvivalPercent = 90;
+  static const int kMinimumPretenuringSample = 64 * KB;
+
+  int threshold_;
+  int allocated_[NUMBER_OF_KINDS];
+  bool pretenured_[NUMBER_OF_KINDS];
+};
+
+// Sizes the generations of a heap whose old space is collected.
+//
+// After a collection, the old space may grow by -Xheap_growth_percent of the
+// live data before it is collected again. It may always grow to
+// -Xmin_heap_size, and never beyond -Xmax_heap_size. It is a fatal error if
+// the live data alone exceeds -Xmax_heap_size.
+//
+// The new space is scavenged after -Xyoung_generation_size bytes are
+// allocated in it. If the flag is not given, it is an eighth of the old
+// space. With -Xtarget_pause_time the size adapts to the scavenges instead:
+// it shrinks when a pause exceeds the target, and doubles when many objects
+// survive, as they were not given the time to die, unless the pauses would
+// then exceed the target.
+class HeapSizingPolicy {
+ public:
+  static const int kMinimumYoungSize = 32 * KB;
+  static const int kMaximumYoungSize = 16 * MB;
+
+  HeapSizingPolicy();
+
+  // The number of bytes allocated in the new space between scavenges, when
+  // [old_used] bytes are used in the old space.
+  int young_size(int old_used) const;
+
+  // Called after a scavenge of [scavenged] bytes, of which [survived] bytes
+  // were kept or promoted, that took [pause] microseconds. Only adapts the
+  // size when there is a pause target.
+  void RecordScavenge(int scavenged, int survived, int64 pause);
+
+  // Returns the number of bytes that can be allocated in the old space
+  // after a collection that left [live] bytes in it.
+  int OldSpaceBudget(int live) const;
+
+ private:
+  // Survival rates above this grow the new space.
+  static const int kHighSurvivalPercent = 25;
+
+  int young_size_;
+};
+
 // Heap represents the container for all HeapObjects.
 class Heap {
  public:
@@ -89,8 +188,10 @@ class Heap {
 
   void FreedForeignMemory(int size);
 
-  // Iterate over all objects in the heap.
+  // Iterate over all objects in the heap. The dead objects of the old space
+  // are swept first.
   void IterateObjects(HeapObjectVisitor* visitor) {
+    old_space_->CompleteSweeping();
     space_->IterateObjects(visitor);
     old_space_->IterateObjects(visitor);
   }
@@ -111,6 +212,9 @@ class Heap {
   SemiSpace* space() { return space_; }
   OldSpace* old_space() { return old_space_; }
 
+  TenuringPolicy* tenuring_policy() { return &tenuring_policy_; }
+  HeapSizingPolicy* sizing_policy() { return &sizing_policy_; }
+
   void ReplaceSpace(SemiSpace* space, OldSpace* old_space = NULL);
   SemiSpace* TakeSpace();
   WeakPointer* TakeWeakPointers();
@@ -122,6 +226,11 @@ class Heap {
 
   bool allocations_have_taken_place() { return allocations_have_taken_place_; }
 
+  // Allocate the objects of at least OldSpace::kLargeObjectSize bytes in
+  // chunks of their own in the old space, so they are never copied. Only for
+  // heaps whose old space is collected.
+  void EnableLargeObjectSpace() { large_object_space_ = true; }
+
   RandomXorShift* random() { return random_; }
 
   int used_foreign_memory() { return foreign_memory_; }
@@ -155,11 +264,24 @@ class Heap {
 
   Object* AllocateRawClass(int size);
 
+  // Allocates an object of the given pretenuring kind, in the old space if
+  // the tenuring policy says so.
+  Object* AllocateOfKind(int kind, int size, bool fatal);
+
+  bool IsLargeObject(int size) {
+    return large_object_space_ && size >= OldSpace::kLargeObjectSize;
+  }
+
+  // Makes an object allocated in the old space by the mutator safe to
+  // initialize.
+  Object* AllocatedInOldSpace(uword address, int size);
+
   // Adjust the allocation budget based on the current heap size.
   void AdjustAllocationBudget() { space()->AdjustAllocationBudget(0); }
 
   void AdjustOldAllocationBudget() {
-    old_space()->AdjustAllocationBudget(foreign_memory_);
+    int live = old_space()->Used() + foreign_memory_;
+    old_space()->SetAllocationBudget(sizing_policy_.OldSpaceBudget(live));
   }
 
   void set_random(RandomXorShift* random) { random_ = random; }
@@ -173,6 +295,9 @@ class Heap {
   // The number of bytes of foreign memory heap objects are holding on to.
   int foreign_memory_;
   bool allocations_have_taken_place_;
+  bool large_object_space_;
+  TenuringPolicy tenuring_policy_;
+  HeapSizingPolicy sizing_policy_;
 };
 
 // Helper class for copying HeapObjects.
@@ -199,46 +324,6 @@ class ScavengeVisitor : public PointerVisitor {
   SemiSpace* to_;
 };
 
-// Helper class for copying HeapObjects.
-class GenerationalScavengeVisitor : public PointerVisitor {
- public:
-  GenerationalScavengeVisitor(SemiSpace* from, SemiSpace* to, OldSpace* old)
-      : from_(from), to_(to), old_(old), hacky_counter_(0) {}
-
-  virtual void VisitClass(Object** p) {}
-
-  virtual void Visit(Object** p) { VisitBlock(p, p + 1); }
-
-  virtual void VisitBlock(Object** start, Object** end) {
-    for (Object** p = start; p < end; p++) {
-      Object* object = *p;
-      if (!object->IsHeapObject()) continue;
-      if (!from_->Includes(reinterpret_cast<uword>(object))) {
-        // Optimization that mostly triggers on large arrays of 'null'.
-        while (p < end - 1 && p[1] == object) p++;
-        continue;
-      }
-      HeapObject* old_object = reinterpret_cast<HeapObject*>(object);
-      if (old_object->HasForwardingAddress()) {
-        *p = old_object->forwarding_address();
-      } else {
-        // TODO(erikcorry): We need a better heuristic than this.
-        if (hacky_counter_++ & 1) {
-          *p = old_object->CloneInToSpace(old_);
-        } else {
-          *p = old_object->CloneInToSpace(to_);
-        }
-      }
-    }
-  }
-
- private:
-  SemiSpace* from_;
-  SemiSpace* to_;
-  OldSpace* old_;
-  int hacky_counter_;
-};
-
 // Read [object] as an integer word value.
 //
 // [object] must be either a Smi or a LargeInteger.
@@ -157,6 +157,10 @@ void AddToStoreBufferSlow(Process* process, Object* object, Object* value) {
   }
 }
 
+void AddToMarkingStackSlow(Process* process, Object* old_value) {
+  process->RecordOverwrite(old_value);
+}
+
 Object* HandleAllocateBoxed(Process* process, Object* value) {
   Object* boxed = process->NewBoxed(value);
   if (boxed->IsFailure()) return boxed;
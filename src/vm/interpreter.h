@@ -103,6 +103,8 @@ extern "C" Object* HandleAllocate(Process* process, Class* clazz,
 extern "C" void AddToRememberedSetSlow(Process* process, Object* object,
                                        Object* value);
 
+extern "C" void AddToMarkingStackSlow(Process* process, Object* old_value);
+
 extern "C" Object* HandleAllocateBoxed(Process* process, Object* value);
 
 extern "C" Object* HandleObjectFromFailure(Process* process, Failure* failure);
@@ -264,6 +264,15 @@ class InterpreterGeneratorARM : public InterpreterGenerator {
   // This function changes caller-saved registers.
   void AddToRememberedSetSlow(Register object, Register value);
 
+  // Write barrier for concurrent marking. Records the overwritten value in
+  // [old_value] if the program is being marked. Changes caller-saved
+  // registers.
+  void AddToMarkingStackSlow(Register old_value);
+
+  // Intrinsics that store into objects leave it to the method while the
+  // program is being marked.
+  void JumpIfMarking(Register scratch, Label* label);
+
   void InvokeEq(const char* fallback);
   void InvokeLt(const char* fallback);
   void InvokeLe(const char* fallback);
@@ -589,9 +598,11 @@ void InterpreterGeneratorARM::DoStoreBoxed() {
   LoadLocal(R2, 0);
   __ ldrb(R0, Address(R5, 1));
   __ ldr(R1, Address(R6, Operand(R0, TIMES_WORD_SIZE)));
+  __ ldr(R7, Address(R1, Boxed::kValueOffset - HeapObject::kTag));
   __ str(R2, Address(R1, Boxed::kValueOffset - HeapObject::kTag));
 
   AddToRememberedSetSlow(R1, R2);
+  AddToMarkingStackSlow(R7);
 
   Dispatch(kStoreBoxedLength);
 }
@@ -601,9 +612,11 @@ void InterpreterGeneratorARM::DoStoreStatic() {
   __ ldr(R0, Address(R5, 1));
   __ ldr(R1, Address(R4, Process::kStaticsOffset));
   __ add(R3, R1, Immediate(Array::kSize - HeapObject::kTag));
+  __ ldr(R7, Address(R3, Operand(R0, TIMES_WORD_SIZE)));
   __ str(R2, Address(R3, Operand(R0, TIMES_WORD_SIZE)));
 
   AddToRememberedSetSlow(R1, R2);
+  AddToMarkingStackSlow(R7);
 
   Dispatch(kStoreStaticLength);
 }
@@ -613,10 +626,12 @@ void InterpreterGeneratorARM::DoStoreField() {
   LoadLocal(R2, 0);
   LoadLocal(R0, 1);
   __ add(R3, R0, Immediate(Instance::kSize - HeapObject::kTag));
+  __ ldr(R7, Address(R3, Operand(R1, TIMES_WORD_SIZE)));
   __ str(R2, Address(R3, Operand(R1, TIMES_WORD_SIZE)));
   DropNAndSetTop(1, R2);
 
   AddToRememberedSetSlow(R0, R2);
+  AddToMarkingStackSlow(R7);
 
   Dispatch(kStoreFieldLength);
 }
@@ -626,10 +641,12 @@ void InterpreterGeneratorARM::DoStoreFieldWide() {
   LoadLocal(R2, 0);
   LoadLocal(R0, 1);
   __ add(R3, R0, Immediate(Instance::kSize - HeapObject::kTag));
+  __ ldr(R7, Address(R3, Operand(R1, TIMES_WORD_SIZE)));
   __ str(R2, Address(R3, Operand(R1, TIMES_WORD_SIZE)));
   DropNAndSetTop(1, R2);
 
   AddToRememberedSetSlow(R0, R2);
+  AddToMarkingStackSlow(R7);
 
   Dispatch(kStoreFieldWideLength);
 }
@@ -1322,6 +1339,7 @@ void InterpreterGeneratorARM::DoIntrinsicGetField() {
 }
 
 void InterpreterGeneratorARM::DoIntrinsicSetField() {
+  JumpIfMarking(R3, &intrinsic_failure_);
   __ ldrb(R1, Address(R0, 3 + Function::kSize - HeapObject::kTag));
   LoadLocal(R7, 0);
   LoadLocal(R2, 1);
@@ -1365,6 +1383,7 @@ void InterpreterGeneratorARM::DoIntrinsicListIndexGet() {
 }
 
 void InterpreterGeneratorARM::DoIntrinsicListIndexSet() {
+  JumpIfMarking(R3, &intrinsic_failure_);
   LoadLocal(R1, 1);  // Index.
   LoadLocal(R2, 2);  // List.
 
@@ -1942,7 +1961,44 @@ void InterpreterGeneratorARM::Allocate(bool immutable) {
 
 void InterpreterGeneratorARM::AddToRememberedSetSlow(Register object,
                                                      Register value) {
-  // TODO(erikcorry): Implement remembered set.
+  ASSERT(object != R3 && object != IP && value != R3 && value != IP);
+  // Dirty the card holding the header of the object, found through the page
+  // tables. Storing a smi needs no remembering. The object register is
+  // clobbered.
+  Label done;
+  __ tst(value, Immediate(Smi::kTagMask));
+  __ b(EQ, &done);
+  __ ldr(R3, Address(R4, Process::kProgramOffset));
+  __ ldr(R3, Address(R3, Program::kPageDirectoriesOffset));
+  __ lsr(IP, object, Immediate(22));
+  __ ldr(R3, Address(R3, Operand(IP, TIMES_WORD_SIZE)));
+  __ add(R3, R3, Immediate(PageTable::kCardsOffset));
+  // The card index is in bits 9 to 21 of the address.
+  __ lsl(IP, object, Immediate(10));
+  __ lsr(IP, IP, Immediate(10 + ObjectMemory::kCardSizeLog2));
+  __ mov(object, Immediate(ObjectMemory::kDirtyCard));
+  __ strb(object, Address(R3, Operand(IP, TIMES_1)));
+  __ Bind(&done);
+}
+
+void InterpreterGeneratorARM::AddToMarkingStackSlow(Register old_value) {
+  ASSERT(old_value != R0);
+  Label done;
+  __ ldr(R0, Address(R4, Process::kProgramOffset));
+  __ ldr(R0, Address(R0, Program::kIsMarkingOffset));
+  __ cmp(R0, Immediate(0));
+  __ b(EQ, &done);
+  __ mov(R1, old_value);
+  __ mov(R0, R4);
+  __ bl("AddToMarkingStackSlow");
+  __ Bind(&done);
+}
+
+void InterpreterGeneratorARM::JumpIfMarking(Register scratch, Label* label) {
+  __ ldr(scratch, Address(R4, Process::kProgramOffset));
+  __ ldr(scratch, Address(scratch, Program::kIsMarkingOffset));
+  __ cmp(scratch, Immediate(0));
+  __ b(NE, label);
 }
 
 void InterpreterGeneratorARM::InvokeCompare(const char* fallback,
@@ -277,6 +277,15 @@ class InterpreterGeneratorX64 : public InterpreterGenerator {
   //   * changes caller-saved registers
   void AddToRememberedSetSlow(Register object, Register value);
 
+  // Write barrier for concurrent marking. Records the overwritten value in
+  // [old_value] if the program is being marked. Changes RDI, RSI and
+  // caller-saved registers.
+  void AddToMarkingStackSlow(Register old_value);
+
+  // Intrinsics that store into objects leave it to the method while the
+  // program is being marked.
+  void JumpIfMarking(Register scratch, Label* label);
+
   void InvokeMethodUnfold(bool test);
   void InvokeMethod(bool test);
 
@@ -603,9 +612,11 @@ void InterpreterGeneratorX64::DoStoreBoxed() {
   LoadLocal(RCX, 0);
   __ movzbq(RAX, Address(R13, 1));
   __ movq(RBX, Address(RSP, RAX, TIMES_WORD_SIZE));
+  __ movq(RDX, Address(RBX, Boxed::kValueOffset - HeapObject::kTag));
   __ movq(Address(RBX, Boxed::kValueOffset - HeapObject::kTag), RCX);
 
   AddToRememberedSetSlow(RBX, RCX);
+  AddToMarkingStackSlow(RDX);
 
   Dispatch(kStoreBoxedLength);
 }
@@ -614,10 +625,13 @@ void InterpreterGeneratorX64::DoStoreStatic() {
   LoadLocal(RCX, 0);
   __ movl(RAX, Address(R13, 1));
   LoadStaticsArray(RBX);
+  __ movq(RDX, Address(RBX, RAX, TIMES_WORD_SIZE,
+                       Array::kSize - HeapObject::kTag));
   __ movq(Address(RBX, RAX, TIMES_WORD_SIZE, Array::kSize - HeapObject::kTag),
           RCX);
 
   AddToRememberedSetSlow(RBX, RCX);
+  AddToMarkingStackSlow(RDX);
 
   Dispatch(kStoreStaticLength);
 }
@@ -626,6 +640,8 @@ void InterpreterGeneratorX64::DoStoreField() {
   __ movzbq(RBX, Address(R13, 1));
   LoadLocal(RCX, 0);
   LoadLocal(RAX, 1);
+  __ movq(RDX, Address(RAX, RBX, TIMES_WORD_SIZE,
+                       Instance::kSize - HeapObject::kTag));
   __ movq(
       Address(RAX, RBX, TIMES_WORD_SIZE, Instance::kSize - HeapObject::kTag),
       RCX);
@@ -633,6 +649,7 @@ void InterpreterGeneratorX64::DoStoreField() {
   Drop(1);
 
   AddToRememberedSetSlow(RAX, RCX);
+  AddToMarkingStackSlow(RDX);
 
   Dispatch(kStoreFieldLength);
 }
@@ -641,6 +658,8 @@ void InterpreterGeneratorX64::DoStoreFieldWide() {
   __ movl(RBX, Address(R13, 1));
   LoadLocal(RCX, 0);
   LoadLocal(RAX, 1);
+  __ movq(RDX, Address(RAX, RBX, TIMES_WORD_SIZE,
+                       Instance::kSize - HeapObject::kTag));
   __ movq(
       Address(RAX, RBX, TIMES_WORD_SIZE, Instance::kSize - HeapObject::kTag),
       RCX);
@@ -648,6 +667,7 @@ void InterpreterGeneratorX64::DoStoreFieldWide() {
   Drop(1);
 
   AddToRememberedSetSlow(RAX, RCX);
+  AddToMarkingStackSlow(RDX);
 
   Dispatch(kStoreFieldWideLength);
 }
@@ -1393,6 +1413,7 @@ void InterpreterGeneratorX64::DoIntrinsicGetField() {
 }
 
 void InterpreterGeneratorX64::DoIntrinsicSetField() {
+  JumpIfMarking(RDX, &intrinsic_failure_);
   __ movzbq(RAX, Address(RAX, 3 + Function::kSize - HeapObject::kTag));
   LoadLocal(RBX, 1);
   LoadLocal(RCX, 2);
@@ -1435,6 +1456,7 @@ void InterpreterGeneratorX64::DoIntrinsicListIndexGet() {
 }
 
 void InterpreterGeneratorX64::DoIntrinsicListIndexSet() {
+  JumpIfMarking(RDX, &intrinsic_failure_);
   LoadLocal(RBX, 2);  // Index.
   LoadLocal(RCX, 3);  // List.
 
@@ -1692,7 +1714,50 @@ void InterpreterGeneratorX64::Allocate(bool immutable) {
 
 void InterpreterGeneratorX64::AddToRememberedSetSlow(Register object,
                                                      Register value) {
-  // TODO(erikcorry): Implement remembered set.
+  ASSERT(object != RDI && object != RSI);
+  ASSERT(value != RDI && value != RSI);
+  // Dirty the card holding the header of the object, found through the page
+  // tables. Storing a smi needs no remembering.
+  Label done;
+  __ testq(value, Immediate(Smi::kTagMask));
+  __ j(ZERO, &done);
+  LoadProgram(RSI);
+  __ movq(RSI, Address(RSI, Program::kPageDirectoriesOffset));
+  __ movq(RDI, object);
+  __ shrq(RDI, Immediate(35));
+  __ movq(RSI, Address(RSI, RDI, TIMES_WORD_SIZE));
+  __ movq(RDI, object);
+  __ shrq(RDI, Immediate(22));
+  __ andq(RDI, Immediate(0x1fff));
+  __ movq(RSI, Address(RSI, RDI, TIMES_WORD_SIZE));
+  __ movq(RDI, object);
+  __ shrq(RDI, Immediate(ObjectMemory::kCardSizeLog2));
+  __ andq(RDI, Immediate(PageTable::kCardsPerTable - 1));
+  __ movb(Address(RSI, RDI, TIMES_1, PageTable::kCardsOffset),
+          Immediate(ObjectMemory::kDirtyCard));
+  __ Bind(&done);
+}
+
+void InterpreterGeneratorX64::AddToMarkingStackSlow(Register old_value) {
+  ASSERT(old_value != RDI && old_value != RSI);
+  Label done;
+  LoadProgram(RSI);
+  __ movq(RSI, Address(RSI, Program::kIsMarkingOffset));
+  __ testq(RSI, RSI);
+  __ j(ZERO, &done);
+  LoadProcess(RDI);
+  __ movq(RSI, old_value);
+  SwitchToCStack();
+  __ call("AddToMarkingStackSlow");
+  SwitchToDartStack();
+  __ Bind(&done);
+}
+
+void InterpreterGeneratorX64::JumpIfMarking(Register scratch, Label* label) {
+  LoadProgram(scratch);
+  __ movq(scratch, Address(scratch, Program::kIsMarkingOffset));
+  __ testq(scratch, scratch);
+  __ j(NOT_ZERO, label);
 }
 
 void InterpreterGeneratorX64::InvokeMethodUnfold(bool test) {
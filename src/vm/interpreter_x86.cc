@@ -275,6 +275,15 @@ class InterpreterGeneratorX86 : public InterpreterGenerator {
   void AddToRememberedSetSlow(Register object, Register value,
                               Register scratch);
 
+  // Write barrier for concurrent marking. Records the overwritten value in
+  // [old_value] if the program is being marked. Changes the first two stack
+  // slots and caller-saved registers.
+  void AddToMarkingStackSlow(Register old_value, Register scratch);
+
+  // Intrinsics that store into objects leave it to the method while the
+  // program is being marked.
+  void JumpIfMarking(Register scratch, Label* label);
+
   void InvokeMethodUnfold(bool test);
   void InvokeMethod(bool test);
 
@@ -591,9 +600,11 @@ void InterpreterGeneratorX86::DoStoreBoxed() {
   LoadLocal(ECX, 0);
   __ movzbl(EAX, Address(ESI, 1));
   __ movl(EBX, Address(ESP, EAX, TIMES_WORD_SIZE));
+  __ movl(EDX, Address(EBX, Boxed::kValueOffset - HeapObject::kTag));
   __ movl(Address(EBX, Boxed::kValueOffset - HeapObject::kTag), ECX);
 
   AddToRememberedSetSlow(EBX, ECX, EAX);
+  AddToMarkingStackSlow(EDX, EAX);
 
   Dispatch(kStoreBoxedLength);
 }
@@ -602,10 +613,13 @@ void InterpreterGeneratorX86::DoStoreStatic() {
   LoadLocal(ECX, 0);
   __ movl(EAX, Address(ESI, 1));
   LoadStaticsArray(EBX);
+  __ movl(EDX, Address(EBX, EAX, TIMES_WORD_SIZE,
+                       Array::kSize - HeapObject::kTag));
   __ movl(Address(EBX, EAX, TIMES_WORD_SIZE, Array::kSize - HeapObject::kTag),
           ECX);
 
   AddToRememberedSetSlow(EBX, ECX, EAX);
+  AddToMarkingStackSlow(EDX, EAX);
 
   Dispatch(kStoreStaticLength);
 }
@@ -614,6 +628,8 @@ void InterpreterGeneratorX86::DoStoreField() {
   __ movzbl(EBX, Address(ESI, 1));
   LoadLocal(ECX, 0);
   LoadLocal(EAX, 1);
+  __ movl(EDX, Address(EAX, EBX, TIMES_WORD_SIZE,
+                       Instance::kSize - HeapObject::kTag));
   __ movl(
       Address(EAX, EBX, TIMES_WORD_SIZE, Instance::kSize - HeapObject::kTag),
       ECX);
@@ -621,6 +637,7 @@ void InterpreterGeneratorX86::DoStoreField() {
   Drop(1);
 
   AddToRememberedSetSlow(EAX, ECX, EBX);
+  AddToMarkingStackSlow(EDX, EBX);
 
   Dispatch(kStoreFieldLength);
 }
@@ -629,6 +646,8 @@ void InterpreterGeneratorX86::DoStoreFieldWide() {
   __ movl(EBX, Address(ESI, 1));
   LoadLocal(ECX, 0);
   LoadLocal(EAX, 1);
+  __ movl(EDX, Address(EAX, EBX, TIMES_WORD_SIZE,
+                       Instance::kSize - HeapObject::kTag));
   __ movl(
       Address(EAX, EBX, TIMES_WORD_SIZE, Instance::kSize - HeapObject::kTag),
       ECX);
@@ -636,6 +655,7 @@ void InterpreterGeneratorX86::DoStoreFieldWide() {
   Drop(1);
 
   AddToRememberedSetSlow(EAX, ECX, EBX);
+  AddToMarkingStackSlow(EDX, EBX);
 
   Dispatch(kStoreFieldWideLength);
 }
@@ -1387,6 +1407,7 @@ void InterpreterGeneratorX86::DoIntrinsicGetField() {
 }
 
 void InterpreterGeneratorX86::DoIntrinsicSetField() {
+  JumpIfMarking(EDX, &intrinsic_failure_);
   __ movzbl(EAX, Address(EAX, 3 + Function::kSize - HeapObject::kTag));
   LoadLocal(EBX, 1);
   LoadLocal(ECX, 2);
@@ -1429,6 +1450,7 @@ void InterpreterGeneratorX86::DoIntrinsicListIndexGet() {
 }
 
 void InterpreterGeneratorX86::DoIntrinsicListIndexSet() {
+  JumpIfMarking(EDX, &intrinsic_failure_);
   LoadLocal(EBX, 2);  // Index.
   LoadLocal(ECX, 3);  // List.
 
@@ -1707,7 +1729,48 @@ void InterpreterGeneratorX86::Allocate(bool immutable) {
 void InterpreterGeneratorX86::AddToRememberedSetSlow(Register object,
                                                      Register value,
                                                      Register scratch) {
-  // TODO(erikcorry): Implement remembered set.
+  ASSERT(object != value && object != scratch && value != scratch);
+  ASSERT(object != ESI && value != ESI && scratch != ESI);
+  // Dirty the card holding the header of the object, found through the page
+  // tables. Storing a smi needs no remembering. The object register is
+  // clobbered, and the byte code pointer register is used as a second
+  // scratch register.
+  Label done;
+  __ testl(value, Immediate(Smi::kTagMask));
+  __ j(ZERO, &done);
+  StoreByteCodePointer();
+  LoadProgram(scratch);
+  __ movl(scratch, Address(scratch, Program::kPageDirectoriesOffset));
+  __ movl(ESI, object);
+  __ shrl(ESI, Immediate(22));
+  __ movl(scratch, Address(scratch, ESI, TIMES_WORD_SIZE));
+  __ shrl(object, Immediate(ObjectMemory::kCardSizeLog2));
+  __ andl(object, Immediate(PageTable::kCardsPerTable - 1));
+  __ movb(Address(scratch, object, TIMES_1, PageTable::kCardsOffset),
+          Immediate(ObjectMemory::kDirtyCard));
+  RestoreByteCodePointer();
+  __ Bind(&done);
+}
+
+void InterpreterGeneratorX86::AddToMarkingStackSlow(Register old_value,
+                                                    Register scratch) {
+  ASSERT(old_value != scratch);
+  Label done;
+  LoadProgram(scratch);
+  __ cmpl(Address(scratch, Program::kIsMarkingOffset), Immediate(0));
+  __ j(EQUAL, &done);
+  SwitchToCStack(scratch);
+  __ movl(Address(ESP, 0 * kWordSize), EDI);
+  __ movl(Address(ESP, 1 * kWordSize), old_value);
+  __ call("AddToMarkingStackSlow");
+  SwitchToDartStack();
+  __ Bind(&done);
+}
+
+void InterpreterGeneratorX86::JumpIfMarking(Register scratch, Label* label) {
+  LoadProgram(scratch);
+  __ cmpl(Address(scratch, Program::kIsMarkingOffset), Immediate(0));
+  __ j(NOT_EQUAL, label);
 }
 
 void InterpreterGeneratorX86::InvokeMethodUnfold(bool test) {
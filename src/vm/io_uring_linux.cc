@@ -0,0 +1,251 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#if defined(DARTINO_TARGET_OS_LINUX)
+
+#include "src/vm/io_uring_linux.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Older kernel headers do not have io_uring, in which case the event handler
+// always uses epoll.
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define DARTINO_HAS_IO_URING
+#endif
+#endif
+
+#include "src/shared/utils.h"
+
+namespace dartino {
+
+#if defined(DARTINO_HAS_IO_URING)
+
+static const uint8 kOpcodes[IoUring::kNumberOfOpcodes] = {
+    IORING_OP_READ,
+    IORING_OP_WRITE,
+    IORING_OP_ACCEPT,
+    IORING_OP_POLL_ADD,
+    IORING_OP_TIMEOUT,
+    IORING_OP_TIMEOUT_REMOVE,
+    IORING_OP_ASYNC_CANCEL,
+};
+
+static uint32 LoadAcquire(const uint32* address) {
+  return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+}
+
+static void StoreRelease(uint32* address, uint32 value) {
+  __atomic_store_n(address, value, __ATOMIC_RELEASE);
+}
+
+// Returns true if the kernel supports all operations in [kOpcodes].
+static bool SupportsOpcodes(int fd) {
+  const int kMaxOpcodes = 256;
+  uword size = sizeof(struct io_uring_probe) +
+               kMaxOpcodes * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe =
+      reinterpret_cast<struct io_uring_probe*>(calloc(1, size));
+  bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+                           probe, kMaxOpcodes) == 0;
+  for (int i = 0; supported && i < IoUring::kNumberOfOpcodes; i++) {
+    uint8 opcode = kOpcodes[i];
+    supported = opcode <= probe->last_op &&
+                (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+  }
+  free(probe);
+  return supported;
+}
+
+IoUring* IoUring::TryCreate(int entries) {
+  ASSERT(static_cast<uint32>(entries) > kReservedEntries);
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd == -1) return NULL;
+
+  // Without these features completions could be dropped, and the rings
+  // would need separate mappings.
+  const uint32 kRequiredFeatures = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP;
+  if ((params.features & kRequiredFeatures) != kRequiredFeatures ||
+      !SupportsOpcodes(fd)) {
+    close(fd);
+    return NULL;
+  }
+
+  uword sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32);
+  uword cq_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  uword ring_size = Utils::Maximum(sq_size, cq_size);
+  void* ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  uword sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    munmap(ring, ring_size);
+    close(fd);
+    return NULL;
+  }
+
+  IoUring* io_uring = new IoUring(fd);
+  uint8* base = reinterpret_cast<uint8*>(ring);
+  io_uring->ring_ = ring;
+  io_uring->ring_size_ = ring_size;
+  io_uring->sqes_ = sqes;
+  io_uring->sqes_size_ = sqes_size;
+  io_uring->sq_head_ = reinterpret_cast<uint32*>(base + params.sq_off.head);
+  io_uring->sq_tail_ = reinterpret_cast<uint32*>(base + params.sq_off.tail);
+  io_uring->sq_mask_ =
+      *reinterpret_cast<uint32*>(base + params.sq_off.ring_mask);
+  io_uring->sq_entries_ = params.sq_entries;
+  io_uring->sq_array_ = reinterpret_cast<uint32*>(base + params.sq_off.array);
+  io_uring->cq_head_ = reinterpret_cast<uint32*>(base + params.cq_off.head);
+  io_uring->cq_tail_ = reinterpret_cast<uint32*>(base + params.cq_off.tail);
+  io_uring->cq_mask_ =
+      *reinterpret_cast<uint32*>(base + params.cq_off.ring_mask);
+  io_uring->cqes_ = base + params.cq_off.cqes;
+  return io_uring;
+}
+
+IoUring::IoUring(int fd)
+    : fd_(fd),
+      submit_mutex_(Platform::CreateMutex()),
+      ring_(NULL),
+      ring_size_(0),
+      sqes_(NULL),
+      sqes_size_(0),
+      sq_head_(NULL),
+      sq_tail_(NULL),
+      sq_mask_(0),
+      sq_entries_(0),
+      sq_array_(NULL),
+      cq_head_(NULL),
+      cq_tail_(NULL),
+      cq_mask_(0),
+      cqes_(NULL) {}
+
+IoUring::~IoUring() {
+  // Closing the ring cancels the requests that are still in flight.
+  munmap(sqes_, sqes_size_);
+  munmap(ring_, ring_size_);
+  close(fd_);
+  delete submit_mutex_;
+}
+
+int IoUring::Enter(uint32 to_submit, uint32 min_complete, uint32 flags) {
+  int result;
+  do {
+    result = syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags,
+                     NULL, 0);
+  } while (result == -1 && errno == EINTR);
+  return result;
+}
+
+uint32 IoUring::QueuedRequests() const {
+  return LoadAcquire(sq_tail_) - LoadAcquire(sq_head_);
+}
+
+bool IoUring::Submit(const Request& request) {
+  return SubmitWithLimit(request, sq_entries_ - kReservedEntries);
+}
+
+bool IoUring::SubmitReserved(const Request& request) {
+  return SubmitWithLimit(request, sq_entries_);
+}
+
+bool IoUring::SubmitWithLimit(const Request& request, uint32 limit) {
+  ScopedLock locker(submit_mutex_);
+  uint32 tail = *sq_tail_;
+  if (tail - LoadAcquire(sq_head_) >= limit) {
+    Enter(tail - LoadAcquire(sq_head_), 0, 0);
+    if (tail - LoadAcquire(sq_head_) >= limit) return false;
+  }
+
+  uint32 index = tail & sq_mask_;
+  struct io_uring_sqe* sqe =
+      reinterpret_cast<struct io_uring_sqe*>(sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = kOpcodes[request.opcode];
+  sqe->fd = request.fd;
+  sqe->addr = request.address;
+  sqe->len = request.length;
+  sqe->off = request.offset;
+  // The per-operation flags share a union.
+  sqe->rw_flags = request.op_flags;
+  sqe->user_data = request.user_data;
+  sq_array_[index] = index;
+  StoreRelease(sq_tail_, tail + 1);
+  return true;
+}
+
+void IoUring::Flush() {
+  // If the kernel cannot take the requests right now, they stay queued and
+  // are submitted by the next call to [Enter].
+  uint32 queued = QueuedRequests();
+  if (queued != 0) Enter(queued, 0, 0);
+}
+
+int IoUring::WaitForCompletions(Completion* completions, int max) {
+  uint32 head = *cq_head_;
+  uint32 tail = LoadAcquire(cq_tail_);
+  if (head == tail) {
+    int result = Enter(QueuedRequests(), 1, IORING_ENTER_GETEVENTS);
+    if (result == -1 && errno != EBUSY) {
+      FATAL1("Failed waiting for io_uring completions: %d\n", errno);
+    }
+    tail = LoadAcquire(cq_tail_);
+  } else {
+    Flush();
+  }
+  int count = 0;
+  struct io_uring_cqe* cqes = reinterpret_cast<struct io_uring_cqe*>(cqes_);
+  while (head != tail && count < max) {
+    struct io_uring_cqe* cqe = &cqes[head & cq_mask_];
+    completions[count].user_data = cqe->user_data;
+    completions[count].result = cqe->res;
+    count++;
+    head++;
+  }
+  StoreRelease(cq_head_, head);
+  return count;
+}
+
+#else  // defined(DARTINO_HAS_IO_URING)
+
+IoUring* IoUring::TryCreate(int entries) { return NULL; }
+
+IoUring::~IoUring() { UNREACHABLE(); }
+
+bool IoUring::Submit(const Request& request) {
+  UNREACHABLE();
+  return false;
+}
+
+bool IoUring::SubmitReserved(const Request& request) {
+  UNREACHABLE();
+  return false;
+}
+
+void IoUring::Flush() { UNREACHABLE(); }
+
+int IoUring::WaitForCompletions(Completion* completions, int max) {
+  UNREACHABLE();
+  return 0;
+}
+
+#endif  // defined(DARTINO_HAS_IO_URING)
+
+}  // namespace dartino
+
+#endif  // defined(DARTINO_TARGET_OS_LINUX)
@@ -0,0 +1,117 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#ifndef SRC_VM_IO_URING_LINUX_H_
+#define SRC_VM_IO_URING_LINUX_H_
+
+#if defined(DARTINO_TARGET_OS_LINUX)
+
+#include "src/shared/globals.h"
+#include "src/shared/platform.h"
+
+namespace dartino {
+
+// A minimal io_uring instance driven through the raw system calls. Any thread
+// can submit requests, but only one thread may wait for completions.
+class IoUring {
+ public:
+  // The operations used by the VM.
+  enum Opcode {
+    kRead,
+    kWrite,
+    kAccept,
+    kPollAdd,
+    kTimeout,
+    kTimeoutRemove,
+    // Cancels the request whose user data is the address of the request.
+    kCancel,
+    kNumberOfOpcodes,
+  };
+
+  // Same layout as struct __kernel_timespec.
+  struct Timespec {
+    int64 seconds;
+    int64 nanoseconds;
+  };
+
+  // A submission queue entry. [op_flags] are the accept flags, the poll mask
+  // or the timeout flags, depending on [opcode].
+  struct Request {
+    Opcode opcode;
+    int fd;
+    uint64 address;
+    uint32 length;
+    uint64 offset;
+    uint32 op_flags;
+    uint64 user_data;
+  };
+
+  struct Completion {
+    uint64 user_data;
+    // The result of the operation, or -errno if it failed.
+    int32 result;
+  };
+
+  static const uint32 kReservedEntries = 4;
+
+  // Returns NULL if the kernel does not support io_uring or one of the
+  // operations in [Opcode].
+  static IoUring* TryCreate(int entries);
+  ~IoUring();
+
+  // Queue [request]. Queued requests are passed to the kernel by [Flush] or
+  // [WaitForCompletions], so a batch of them takes one system call. If the
+  // submission queue is full, the queued requests are flushed first. Returns
+  // false if there is still no room.
+  // Submit leaves the last [kReservedEntries] slots of the submission queue
+  // free.
+  bool Submit(const Request& request);
+
+  // Like [Submit], but may use the reserved slots. The waiting thread uses
+  // them for its own requests, so a burst of requests from other threads
+  // cannot leave it without room.
+  bool SubmitReserved(const Request& request);
+
+  // Submit the queued requests without waiting for completions.
+  void Flush();
+
+  // Submit the queued requests, wait until there is at least one completion,
+  // and copy up to [max] completions to [completions]. Returns the number of
+  // completions copied.
+  int WaitForCompletions(Completion* completions, int max);
+
+ private:
+  explicit IoUring(int fd);
+
+  int Enter(uint32 to_submit, uint32 min_complete, uint32 flags);
+  uint32 QueuedRequests() const;
+  bool SubmitWithLimit(const Request& request, uint32 limit);
+
+  const int fd_;
+  Mutex* const submit_mutex_;
+
+  void* ring_;
+  uword ring_size_;
+  void* sqes_;
+  uword sqes_size_;
+
+  uint32* sq_head_;
+  uint32* sq_tail_;
+  uint32 sq_mask_;
+  uint32 sq_entries_;
+  uint32* sq_array_;
+
+  uint32* cq_head_;
+  uint32* cq_tail_;
+  uint32 cq_mask_;
+  void* cqes_;
+
+  DISALLOW_COPY_AND_ASSIGN(IoUring);
+};
+
+}  // namespace dartino
+
+#endif  // defined(DARTINO_TARGET_OS_LINUX)
+
+#endif  // SRC_VM_IO_URING_LINUX_H_
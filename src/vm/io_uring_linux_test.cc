@@ -0,0 +1,151 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/shared/assert.h"
+#include "src/shared/test_case.h"
+
+#if defined(DARTINO_TARGET_OS_LINUX)
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/vm/io_uring_linux.h"
+
+namespace dartino {
+
+static IoUring::Request MakeRequest(IoUring::Opcode opcode, int fd,
+                                    uint64 address, uint32 length,
+                                    uint64 user_data) {
+  IoUring::Request request;
+  request.opcode = opcode;
+  request.fd = fd;
+  request.address = address;
+  request.length = length;
+  request.offset = static_cast<uint64>(-1);
+  request.op_flags = 0;
+  request.user_data = user_data;
+  return request;
+}
+
+static IoUring::Completion WaitForOne(IoUring* io_uring) {
+  IoUring::Completion completion;
+  while (io_uring->WaitForCompletions(&completion, 1) == 0) {
+  }
+  return completion;
+}
+
+TEST_CASE(IO_URING__READ_WRITE) {
+  IoUring* io_uring = IoUring::TryCreate(8);
+  // The kernel may not support io_uring, or it may be disabled.
+  if (io_uring == NULL) return;
+
+  int fds[2];
+  EXPECT_EQ(0, pipe(fds));
+  char buffer[6];
+  EXPECT(io_uring->Submit(MakeRequest(IoUring::kRead, fds[0],
+                                      reinterpret_cast<uint64>(buffer),
+                                      sizeof(buffer), 1)));
+  const char* data = "dartino";
+  EXPECT(io_uring->Submit(MakeRequest(IoUring::kWrite, fds[1],
+                                      reinterpret_cast<uint64>(data), 7, 2)));
+
+  bool read = false;
+  bool wrote = false;
+  for (int i = 0; i < 2; i++) {
+    IoUring::Completion completion = WaitForOne(io_uring);
+    if (completion.user_data == 1) {
+      EXPECT_EQ(6, completion.result);
+      EXPECT(memcmp(buffer, "dartin", 6) == 0);
+      read = true;
+    } else {
+      EXPECT_EQ(2, static_cast<int>(completion.user_data));
+      EXPECT_EQ(7, completion.result);
+      wrote = true;
+    }
+  }
+  EXPECT(read && wrote);
+
+  IoUring::Request request = MakeRequest(IoUring::kPollAdd, fds[0], 0, 0, 3);
+  request.offset = 0;
+  request.op_flags = POLLIN;
+  EXPECT(io_uring->Submit(request));
+  IoUring::Completion completion = WaitForOne(io_uring);
+  EXPECT_EQ(3, static_cast<int>(completion.user_data));
+  EXPECT((completion.result & POLLIN) != 0);
+
+  close(fds[0]);
+  close(fds[1]);
+  delete io_uring;
+}
+
+TEST_CASE(IO_URING__TIMEOUT) {
+  IoUring* io_uring = IoUring::TryCreate(8);
+  if (io_uring == NULL) return;
+
+  // The offset of a timeout is the number of completions to wait for.
+  IoUring::Timespec timeout = {0, 1000000};
+  IoUring::Request request = MakeRequest(
+      IoUring::kTimeout, -1, reinterpret_cast<uint64>(&timeout), 1, 1);
+  request.offset = 0;
+  EXPECT(io_uring->Submit(request));
+  IoUring::Completion completion = WaitForOne(io_uring);
+  EXPECT_EQ(1, static_cast<int>(completion.user_data));
+  EXPECT_EQ(-ETIME, completion.result);
+
+  // Removing a timeout completes both requests.
+  timeout.seconds = 60;
+  request = MakeRequest(
+      IoUring::kTimeout, -1, reinterpret_cast<uint64>(&timeout), 1, 2);
+  request.offset = 0;
+  EXPECT(io_uring->Submit(request));
+  request = MakeRequest(IoUring::kTimeoutRemove, -1, 2, 0, 3);
+  request.offset = 0;
+  EXPECT(io_uring->Submit(request));
+  for (int i = 0; i < 2; i++) {
+    completion = WaitForOne(io_uring);
+    if (completion.user_data == 2) {
+      EXPECT_EQ(-ECANCELED, completion.result);
+    } else {
+      EXPECT_EQ(3, static_cast<int>(completion.user_data));
+      EXPECT_EQ(0, completion.result);
+    }
+  }
+  delete io_uring;
+}
+
+TEST_CASE(IO_URING__CANCEL) {
+  IoUring* io_uring = IoUring::TryCreate(8);
+  if (io_uring == NULL) return;
+
+  // Nothing is written to the pipe, so the read stays in flight until it is
+  // cancelled. Both requests are submitted by the same wait.
+  int fds[2];
+  EXPECT_EQ(0, pipe(fds));
+  char buffer[4];
+  EXPECT(io_uring->Submit(MakeRequest(IoUring::kRead, fds[0],
+                                      reinterpret_cast<uint64>(buffer),
+                                      sizeof(buffer), 1)));
+  IoUring::Request request = MakeRequest(IoUring::kCancel, -1, 1, 0, 2);
+  request.offset = 0;
+  EXPECT(io_uring->Submit(request));
+  for (int i = 0; i < 2; i++) {
+    IoUring::Completion completion = WaitForOne(io_uring);
+    if (completion.user_data == 1) {
+      EXPECT_EQ(-ECANCELED, completion.result);
+    } else {
+      EXPECT_EQ(2, static_cast<int>(completion.user_data));
+      EXPECT_EQ(0, completion.result);
+    }
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+  delete io_uring;
+}
+
+}  // namespace dartino
+
+#endif  // defined(DARTINO_TARGET_OS_LINUX)
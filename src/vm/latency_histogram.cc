@@ -0,0 +1,62 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/vm/latency_histogram.h"
+
+#include <string.h>
+
+#include "src/shared/assert.h"
+#include "src/shared/utils.h"
+
+namespace dartino {
+
+Atomic<bool> SchedulerLatency::enabled_(false);
+
+int LatencyHistogram::BucketIndex(uint64 value) {
+  if (value < static_cast<uint64>(kSubBucketCount)) return value;
+  int bit = Utils::HighestBit(value);
+  if (bit >= kMaxBits) return kBucketCount - 1;
+  // Keep the highest [kSubBucketBits] + 1 bits of the value.
+  int shift = bit - kSubBucketBits;
+  int sub_bucket = (value >> shift) - kSubBucketCount;
+  return (shift + 1) * kSubBucketCount + sub_bucket;
+}
+
+uint64 LatencyHistogram::BucketUpperBound(int index) {
+  ASSERT(index >= 0 && index < kBucketCount);
+  if (index < kSubBucketCount) return index;
+  int shift = index / kSubBucketCount - 1;
+  uint64 sub_bucket = index % kSubBucketCount;
+  uint64 lower = (kSubBucketCount + sub_bucket) << shift;
+  return lower + (static_cast<uint64>(1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64 value) {
+  counts_[BucketIndex(value)]++;
+  count_++;
+  if (value > max_) max_ = value;
+}
+
+void LatencyHistogram::Reset() {
+  memset(counts_, 0, sizeof(counts_));
+  count_ = 0;
+  max_ = 0;
+}
+
+uint64 LatencyHistogram::ValueAtPermyriad(int permyriad) const {
+  ASSERT(permyriad >= 0 && permyriad <= 10000);
+  uint64 total = count_;
+  if (total == 0) return 0;
+  // The number of values that have to be at or below the result, rounded up.
+  uint64 target = (total * permyriad + 9999) / 10000;
+  if (target == 0) target = 1;
+  uint64 seen = 0;
+  for (int i = 0; i < kBucketCount; i++) {
+    seen += counts_[i];
+    if (seen >= target) return Utils::Minimum(BucketUpperBound(i), max_);
+  }
+  return max_;
+}
+
+}  // namespace dartino
@@ -0,0 +1,73 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#ifndef SRC_VM_LATENCY_HISTOGRAM_H_
+#define SRC_VM_LATENCY_HISTOGRAM_H_
+
+#include "src/shared/atomic.h"
+#include "src/shared/globals.h"
+
+namespace dartino {
+
+// A histogram of latencies in microseconds with logarithmic buckets, each of
+// which is split into [kSubBucketCount] linear sub-buckets (like an HDR
+// histogram). Values are recorded with a relative error of at most 1/8, in
+// constant time and without allocation.
+//
+// A histogram is only written by one thread at a time. Readers on other
+// threads may see slightly inconsistent counts.
+class LatencyHistogram {
+ public:
+  static const int kSubBucketBits = 3;
+  static const int kSubBucketCount = 1 << kSubBucketBits;
+  // Values of 2^kMaxBits microseconds (about 12 days) and more are recorded
+  // in the last bucket.
+  static const int kMaxBits = 40;
+  static const int kBucketCount =
+      (kMaxBits - kSubBucketBits + 1) * kSubBucketCount;
+
+  LatencyHistogram() { Reset(); }
+
+  void Record(uint64 value);
+  void Reset();
+
+  uint64 count() const { return count_; }
+  uint64 max() const { return max_; }
+
+  // Returns the smallest recorded value (rounded up to the bucket bound) such
+  // that at least [permyriad] / 10000 of the values are smaller or equal.
+  uint64 ValueAtPermyriad(int permyriad) const;
+
+  static int BucketIndex(uint64 value);
+  static uint64 BucketUpperBound(int index);
+
+ private:
+  uint32 counts_[kBucketCount];
+  uint64 count_;
+  uint64 max_;
+};
+
+// The scheduler latencies of a process or of all processes of a program.
+struct SchedulerLatency {
+  enum Kind {
+    // The time from a process being made ready until it starts running.
+    kReadyToRunning,
+    // The duration of a single interpretation slice.
+    kSlice,
+    kNumberOfKinds,
+  };
+
+  LatencyHistogram histograms[kNumberOfKinds];
+
+  // Whether latencies are recorded at all. Can be changed at any time.
+  static bool IsEnabled() { return enabled_.load(kRelaxed); }
+  static void SetEnabled(bool enabled) { enabled_.store(enabled, kRelaxed); }
+
+ private:
+  static Atomic<bool> enabled_;
+};
+
+}  // namespace dartino
+
+#endif  // SRC_VM_LATENCY_HISTOGRAM_H_
@@ -0,0 +1,55 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/shared/assert.h"
+#include "src/shared/test_case.h"
+
+#include "src/vm/latency_histogram.h"
+
+namespace dartino {
+
+TEST_CASE(LatencyHistogramBuckets) {
+  // Small values have a bucket of their own.
+  for (int i = 0; i < LatencyHistogram::kSubBucketCount; i++) {
+    EXPECT_EQ(i, LatencyHistogram::BucketIndex(i));
+    EXPECT_EQ(i, static_cast<int>(LatencyHistogram::BucketUpperBound(i)));
+  }
+
+  // Buckets are contiguous and every value falls within the bounds of its
+  // bucket.
+  for (int i = 1; i < LatencyHistogram::kBucketCount; i++) {
+    uint64 lower = LatencyHistogram::BucketUpperBound(i - 1) + 1;
+    uint64 upper = LatencyHistogram::BucketUpperBound(i);
+    EXPECT(lower <= upper);
+    EXPECT_EQ(i, LatencyHistogram::BucketIndex(lower));
+    EXPECT_EQ(i, LatencyHistogram::BucketIndex(upper));
+    // The relative error is at most 1/8.
+    EXPECT((upper - lower) * LatencyHistogram::kSubBucketCount <= lower);
+  }
+
+  uint64 huge = static_cast<uint64>(1) << 62;
+  EXPECT_EQ(LatencyHistogram::kBucketCount - 1,
+            LatencyHistogram::BucketIndex(huge));
+}
+
+TEST_CASE(LatencyHistogramPercentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, static_cast<int>(histogram.ValueAtPermyriad(5000)));
+
+  for (int i = 1; i <= 1000; i++) histogram.Record(i);
+  EXPECT_EQ(1000, static_cast<int>(histogram.count()));
+  EXPECT_EQ(1000, static_cast<int>(histogram.max()));
+
+  uint64 median = histogram.ValueAtPermyriad(5000);
+  EXPECT(median >= 500 && median <= 500 + 500 / 8);
+  uint64 p99 = histogram.ValueAtPermyriad(9900);
+  EXPECT(p99 >= 990 && p99 <= 1000);
+  EXPECT_EQ(1000, static_cast<int>(histogram.ValueAtPermyriad(10000)));
+  EXPECT_EQ(1, static_cast<int>(histogram.ValueAtPermyriad(0)));
+
+  histogram.Reset();
+  EXPECT_EQ(0, static_cast<int>(histogram.count()));
+}
+
+}  // namespace dartino
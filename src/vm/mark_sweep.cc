@@ -0,0 +1,265 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/vm/mark_sweep.h"
+
+#include "src/shared/flags.h"
+
+namespace dartino {
+
+MarkingWorkList::MarkingWorkList(int number_of_markers)
+    : monitor_(Platform::CreateMonitor()),
+      number_of_markers_(number_of_markers),
+      chunks_(NULL),
+      idle_markers_(0),
+      waiting_markers_(0) {}
+
+MarkingWorkList::~MarkingWorkList() {
+  ASSERT(chunks_ == NULL);
+  delete monitor_;
+}
+
+void MarkingWorkList::Publish(MarkingStackChunk* chunk) {
+  ASSERT(chunk->next_chunk_ == NULL);
+  ScopedMonitorLock locker(monitor_);
+  chunk->next_chunk_ = chunks_;
+  chunks_ = chunk;
+  if (waiting_markers_ > 0) monitor_->Notify();
+}
+
+MarkingStackChunk* MarkingWorkList::Take() {
+  ScopedMonitorLock locker(monitor_);
+  idle_markers_++;
+  while (chunks_ == NULL) {
+    // Only markers that are not idle publish work, so marking is done when
+    // all of them are idle.
+    if (idle_markers_ == number_of_markers_) {
+      if (waiting_markers_ > 0) monitor_->NotifyAll();
+      return NULL;
+    }
+    waiting_markers_++;
+    monitor_->Wait();
+    waiting_markers_--;
+  }
+  idle_markers_--;
+  MarkingStackChunk* chunk = chunks_;
+  chunks_ = chunk->next_chunk_;
+  chunk->next_chunk_ = NULL;
+  return chunk;
+}
+
+ParallelMarker::ParallelMarker(SemiSpace* new_space, OldSpace* old_space,
+                               Stack** stack_chain)
+    : new_space_(new_space),
+      old_space_(old_space),
+      stack_chain_(stack_chain),
+      work_list_(1),
+      stack_(&work_list_),
+      visitor_(new_space, old_space, &stack_, stack_chain),
+      helpers_(NULL),
+      number_of_stacks_(0),
+      live_bytes_(0) {
+  new_space->ClearMarkBits();
+  if (old_space != NULL) {
+    ASSERT(!old_space->is_sweeping());
+    old_space->ClearMarkBits();
+  }
+}
+
+void ParallelMarker::Process() {
+  GCHelperPool* pool = GCHelperPool::GlobalInstance();
+  int number_of_helpers = pool->Reserve(pool->number_of_threads());
+  if (number_of_helpers > 0) {
+    work_list_.set_number_of_markers(number_of_helpers + 1);
+    helpers_ = new Helper[number_of_helpers];
+    for (int i = 0; i < number_of_helpers; i++) {
+      helpers_[i].stack_chain = NULL;
+      helpers_[i].number_of_stacks = 0;
+      helpers_[i].live_bytes = 0;
+    }
+    // Let the helpers start on the objects marked from the roots.
+    stack_.Share();
+    pool->Start(this, number_of_helpers);
+  }
+
+  stack_.Process(&visitor_);
+  pool->Join(this);
+
+  number_of_stacks_ = visitor_.number_of_stacks();
+  live_bytes_ = visitor_.live_bytes();
+  for (int i = 0; i < number_of_helpers; i++) {
+    Helper* helper = &helpers_[i];
+    number_of_stacks_ += helper->number_of_stacks;
+    live_bytes_ += helper->live_bytes;
+    Stack* stack = helper->stack_chain;
+    if (stack == NULL) continue;
+    // Append the chain of the main marker to the chain of the helper.
+    while (stack->next() != Smi::zero()) stack = Stack::cast(stack->next());
+    stack->set_next(*stack_chain_);
+    *stack_chain_ = helper->stack_chain;
+  }
+  delete[] helpers_;
+  helpers_ = NULL;
+}
+
+void ParallelMarker::RunHelper(int index) {
+  Helper* helper = &helpers_[index];
+  MarkingStack stack(&work_list_);
+  Stack** stack_chain = stack_chain_ != NULL ? &helper->stack_chain : NULL;
+  MarkingVisitor visitor(new_space_, old_space_, &stack, stack_chain);
+  stack.Process(&visitor);
+  helper->number_of_stacks = visitor.number_of_stacks();
+  helper->live_bytes = visitor.live_bytes();
+}
+
+ConcurrentMarker::ConcurrentMarker(OldSpace* old_space)
+    : old_space_(old_space),
+      used_limit_(0),
+      mutex_(Platform::CreateMutex()),
+      barrier_mutex_(Platform::CreateMutex()),
+      monitor_(Platform::CreateMonitor()),
+      running_(false),
+      stop_(true),
+      done_(false),
+      live_bytes_(0),
+      visitor_(old_space, &stack_) {}
+
+ConcurrentMarker::~ConcurrentMarker() {
+  ASSERT(!running_);
+  stack_.Clear();
+  barrier_stack_.Clear();
+  deferred_stacks_.Clear();
+  delete mutex_;
+  delete barrier_mutex_;
+  delete monitor_;
+}
+
+void ConcurrentMarker::Start() {
+  ScopedMonitorLock locker(monitor_);
+  ASSERT(!running_);
+  // Let the old space grow by half while marking before forcing the final
+  // pause.
+  int used = old_space_->Used();
+  used_limit_ = used + used / 2;
+  stop_ = false;
+  done_ = false;
+  live_bytes_ = 0;
+}
+
+void ConcurrentMarker::RecordOverwrite(Object* old_value) {
+  if (!old_value->IsHeapObject()) return;
+  HeapObject* object = HeapObject::cast(old_value);
+  uword address = object->address();
+  if (!old_space_->Includes(address)) return;
+  if (!ObjectMemory::TrySetMarkBit(address)) return;
+  ScopedLock locker(barrier_mutex_);
+  barrier_stack_.Push(object);
+}
+
+void ConcurrentMarker::ScanStack(Stack* stack) {
+  // Stacks in the new space were scanned with the rest of the new space when
+  // marking started.
+  uword address = stack->address();
+  if (!old_space_->Includes(address)) return;
+  // The second word of a stack is never the start of an object, so its mark
+  // bit is used to record that the stack has been scanned.
+  if (!ObjectMemory::TrySetMarkBit(address + kPointerSize)) return;
+  MarkingStack marked;
+  ConcurrentMarkingVisitor visitor(old_space_, &marked);
+  Object* stack_object = stack;
+  visitor.Visit(&stack_object);
+  stack->IteratePointers(&visitor);
+  ScopedLock locker(barrier_mutex_);
+  for (HeapObject* object = marked.Pop(); object != NULL;
+       object = marked.Pop()) {
+    barrier_stack_.Push(object);
+  }
+}
+
+void ConcurrentMarker::ScanCoroutine(Coroutine* coroutine) {
+  RecordOverwrite(coroutine);
+  ScanStack(coroutine->stack());
+}
+
+void ConcurrentMarker::Run() {
+  {
+    ScopedMonitorLock locker(monitor_);
+    // The marking may have been finished or aborted before the GC thread
+    // got to it.
+    if (stop_) return;
+    running_ = true;
+  }
+  while (!stop_) {
+    ScopedLock locker(mutex_);
+    if (!Step()) {
+      done_ = true;
+      break;
+    }
+  }
+  ScopedMonitorLock locker(monitor_);
+  running_ = false;
+  monitor_->NotifyAll();
+}
+
+bool ConcurrentMarker::ShouldFinish() {
+  return done_ || old_space_->Used() > used_limit_;
+}
+
+void ConcurrentMarker::Finish() {
+  StopGCThread();
+  TakeBarrierWork();
+  // The mutators are stopped, so stacks can be traced now.
+  while (true) {
+    HeapObject* object = stack_.Pop();
+    if (object != NULL) {
+      live_bytes_ += object->Size();
+    } else {
+      // Deferred stacks were counted when they were deferred.
+      object = deferred_stacks_.Pop();
+      if (object == NULL) break;
+    }
+    object->IteratePointers(&visitor_);
+  }
+}
+
+void ConcurrentMarker::Abort() {
+  StopGCThread();
+  stack_.Clear();
+  barrier_stack_.Clear();
+  deferred_stacks_.Clear();
+}
+
+bool ConcurrentMarker::Step() {
+  for (int i = 0; i < kObjectsPerStep; i++) {
+    HeapObject* object = stack_.Pop();
+    if (object == NULL) {
+      TakeBarrierWork();
+      object = stack_.Pop();
+      if (object == NULL) return false;
+    }
+    live_bytes_ += object->Size();
+    if (object->format().type() == InstanceFormat::STACK_TYPE) {
+      deferred_stacks_.Push(object);
+    } else {
+      object->IteratePointers(&visitor_);
+    }
+  }
+  return true;
+}
+
+void ConcurrentMarker::TakeBarrierWork() {
+  ScopedLock locker(barrier_mutex_);
+  for (HeapObject* object = barrier_stack_.Pop(); object != NULL;
+       object = barrier_stack_.Pop()) {
+    stack_.Push(object);
+  }
+}
+
+void ConcurrentMarker::StopGCThread() {
+  ScopedMonitorLock locker(monitor_);
+  stop_ = true;
+  while (running_) monitor_->Wait();
+}
+
+}  // namespace dartino
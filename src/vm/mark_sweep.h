@@ -5,7 +5,10 @@
 #ifndef SRC_VM_MARK_SWEEP_H_
 #define SRC_VM_MARK_SWEEP_H_
 
+#include "src/shared/platform.h"
+#include "src/vm/gc_helper_pool.h"
 #include "src/vm/object.h"
+#include "src/vm/object_memory.h"
 #include "src/vm/program.h"
 #include "src/vm/process.h"
 
@@ -19,9 +22,10 @@ class MarkingStackChunk {
   ~MarkingStackChunk() { ASSERT(next_chunk_ == NULL); }
 
   bool IsEmpty() { return next_ == &backing_[0]; }
+  bool IsFull() { return next_ == limit_; }
 
   void Push(HeapObject* object, MarkingStackChunk** chunk_list) {
-    ASSERT(object->IsMarked());
+    ASSERT(ObjectMemory::IsMarkBitSet(object->address()));
     if (next_ < limit_) {
       *(next_++) = object;
     } else {
@@ -59,23 +63,94 @@ class MarkingStackChunk {
     new_chunk->Push(object, chunk_list);
   }
 
+  friend class MarkingStack;
+  friend class MarkingWorkList;
+
   MarkingStackChunk* next_chunk_;
   HeapObject** next_;
   HeapObject** limit_;
   HeapObject* backing_[kChunkSize];
 };
 
+// Full marking stack chunks shared by the threads of a parallel marking.
+// Threads publish their chunks as they fill up, and threads that run out of
+// work take chunks published by the others.
+class MarkingWorkList {
+ public:
+  explicit MarkingWorkList(int number_of_markers);
+  ~MarkingWorkList();
+
+  int number_of_markers() const { return number_of_markers_; }
+
+  // Must be called before any of the markers takes work.
+  void set_number_of_markers(int value) { number_of_markers_ = value; }
+
+  void Publish(MarkingStackChunk* chunk);
+
+  // Returns a chunk of work. Blocks while other markers may still publish
+  // work, and returns NULL once all markers have run out of work.
+  MarkingStackChunk* Take();
+
+ private:
+  Monitor* monitor_;
+  int number_of_markers_;
+  MarkingStackChunk* chunks_;
+  int idle_markers_;
+  int waiting_markers_;
+};
+
 class MarkingStack {
  public:
-  MarkingStack() : current_chunk_(new MarkingStackChunk()) {}
+  // If [work_list] is not NULL, full chunks are shared through it, and
+  // [Process] also processes chunks shared by other marking threads.
+  explicit MarkingStack(MarkingWorkList* work_list = NULL)
+      : current_chunk_(new MarkingStackChunk()), work_list_(work_list) {}
 
   ~MarkingStack() { delete current_chunk_; }
 
   void Push(HeapObject* object) {
+    if (work_list_ != NULL && current_chunk_->IsFull()) {
+      work_list_->Publish(current_chunk_);
+      current_chunk_ = new MarkingStackChunk();
+    }
     current_chunk_->Push(object, &current_chunk_);
   }
 
+  bool IsEmpty() {
+    return current_chunk_->IsEmpty() && current_chunk_->next_chunk_ == NULL;
+  }
+
+  // Returns NULL if the stack is empty.
+  HeapObject* Pop() {
+    if (current_chunk_->IsEmpty()) {
+      MarkingStackChunk* next = current_chunk_->next_chunk_;
+      if (next == NULL) return NULL;
+      current_chunk_->next_chunk_ = NULL;
+      delete current_chunk_;
+      current_chunk_ = next;
+    }
+    return current_chunk_->Pop();
+  }
+
+  // Removes all objects without processing them.
+  void Clear() {
+    while (Pop() != NULL) {
+    }
+  }
+
+  // Make the objects pushed so far available to other marking threads.
+  void Share() {
+    ASSERT(work_list_ != NULL);
+    if (current_chunk_->IsEmpty()) return;
+    work_list_->Publish(current_chunk_);
+    current_chunk_ = new MarkingStackChunk();
+  }
+
   void Process(PointerVisitor* visitor) {
+    if (work_list_ != NULL) {
+      ProcessShared(visitor);
+      return;
+    }
     for (MarkingStackChunk* chunk = current_chunk_->TakeChunk(&current_chunk_);
          chunk != NULL; chunk = current_chunk_->TakeChunk(&current_chunk_)) {
       while (!chunk->IsEmpty()) {
@@ -87,9 +162,25 @@ class MarkingStack {
   }
 
  private:
+  void ProcessShared(PointerVisitor* visitor) {
+    while (true) {
+      while (!current_chunk_->IsEmpty()) {
+        HeapObject* object = current_chunk_->Pop();
+        object->IteratePointers(visitor);
+      }
+      MarkingStackChunk* chunk = work_list_->Take();
+      if (chunk == NULL) return;
+      delete current_chunk_;
+      current_chunk_ = chunk;
+    }
+  }
+
   MarkingStackChunk* current_chunk_;
+  MarkingWorkList* work_list_;
 };
 
+// Marks objects in the side mark bits of their chunks, so the mutators and
+// the other markers can keep reading class words.
 class MarkingVisitor : public PointerVisitor {
  public:
   MarkingVisitor(SemiSpace* new_space, OldSpace* old_space,
@@ -98,17 +189,13 @@ class MarkingVisitor : public PointerVisitor {
         new_space_(new_space),
         old_space_(old_space),
         marking_stack_(marking_stack),
-        number_of_stacks_(0) {}
+        number_of_stacks_(0),
+        live_bytes_(0) {}
 
   virtual void Visit(Object** p) { MarkPointer(*p); }
 
-  virtual void VisitClass(Object** p) {
-    // The class pointer is used for the mark bit. Therefore,
-    // the actual class pointer is obtained by clearing the
-    // mark bit.
-    uword klass = reinterpret_cast<uword>(*p);
-    MarkPointer(reinterpret_cast<Object*>(klass & ~HeapObject::kMarkBit));
-  }
+  // Classes live in the program heap.
+  virtual void VisitClass(Object** p) {}
 
   virtual void VisitBlock(Object** start, Object** end) {
     // Mark live all HeapObjects pointed to by pointers in [start, end)
@@ -117,6 +204,9 @@ class MarkingVisitor : public PointerVisitor {
 
   int number_of_stacks() const { return number_of_stacks_; }
 
+  // The size of the old-space objects marked by this visitor.
+  int live_bytes() const { return live_bytes_; }
+
  private:
   void ChainStack(Stack* stack) {
     number_of_stacks_++;
@@ -126,19 +216,22 @@ class MarkingVisitor : public PointerVisitor {
 
   void MarkPointer(Object* object) {
     if (!object->IsHeapObject()) return;
-    uword address = reinterpret_cast<uword>(object);
-    if (!new_space_->Includes(address) &&
-        (old_space_ == NULL || !old_space_->Includes(address))) {
+    HeapObject* heap_object = HeapObject::cast(object);
+    uword address = heap_object->address();
+    bool in_old_space = old_space_ != NULL && old_space_->Includes(address);
+    if (!in_old_space && !new_space_->Includes(address)) return;
+    // Other threads may be marking the same objects, so only the thread
+    // that sets the mark bit pushes the object.
+    if (ObjectMemory::IsMarkBitSet(address) ||
+        !ObjectMemory::TrySetMarkBit(address)) {
       return;
     }
-    HeapObject* heap_object = HeapObject::cast(object);
-    if (!heap_object->IsMarked()) {
-      if (stack_chain_ != NULL && heap_object->IsStack()) {
-        ChainStack(Stack::cast(heap_object));
-      }
-      heap_object->SetMark();
-      marking_stack_->Push(heap_object);
+    if (in_old_space) live_bytes_ += heap_object->Size();
+    if (stack_chain_ != NULL &&
+        heap_object->format().type() == InstanceFormat::STACK_TYPE) {
+      ChainStack(Stack::cast(heap_object));
     }
+    marking_stack_->Push(heap_object);
   }
 
   Stack** stack_chain_;
@@ -146,18 +239,176 @@ class MarkingVisitor : public PointerVisitor {
   OldSpace* old_space_;
   MarkingStack* marking_stack_;
   int number_of_stacks_;
+  int live_bytes_;
 };
 
-class FreeList {
+// Marks everything reachable from the roots visited by [root_visitor] on the
+// calling thread and the idle threads of the [GCHelperPool]. The helpers are
+// started by [Process], after the roots have been marked. The mark bits of
+// both spaces are cleared when the marker is created, so the old space must
+// not have unswept chunks.
+class ParallelMarker : public GCHelperTask {
  public:
-#if defined(_MSC_VER)
-  // Work around Visual Studo 2013 bug 802058
-  FreeList(void) {
-    memset(buckets_, 0, kNumberOfBuckets * sizeof(FreeListChunk*));
+  // If [stack_chain] is not NULL, all marked stacks are chained into it.
+  ParallelMarker(SemiSpace* new_space, OldSpace* old_space,
+                 Stack** stack_chain = NULL);
+
+  PointerVisitor* root_visitor() { return &visitor_; }
+
+  void Process();
+
+  int number_of_stacks() const { return number_of_stacks_; }
+
+  // The size of the marked old-space objects.
+  int live_bytes() const { return live_bytes_; }
+
+  virtual void RunHelper(int index);
+
+ private:
+  struct Helper {
+    Stack* stack_chain;
+    int number_of_stacks;
+    int live_bytes;
+  };
+
+  SemiSpace* const new_space_;
+  OldSpace* const old_space_;
+  Stack** const stack_chain_;
+  MarkingWorkList work_list_;
+  MarkingStack stack_;
+  MarkingVisitor visitor_;
+  Helper* helpers_;
+  int number_of_stacks_;
+  int live_bytes_;
+};
+
+// Marks the old-space objects it visits in the side mark bits. Pointers into
+// other spaces are ignored: the new space is scanned when a concurrent
+// marking starts, and the program heap is not collected by it.
+class ConcurrentMarkingVisitor : public PointerVisitor {
+ public:
+  ConcurrentMarkingVisitor(OldSpace* old_space, MarkingStack* marking_stack)
+      : old_space_(old_space), marking_stack_(marking_stack) {}
+
+  virtual void Visit(Object** p) { MarkPointer(*p); }
+
+  // Classes live in the program heap.
+  virtual void VisitClass(Object** p) {}
+
+  virtual void VisitBlock(Object** start, Object** end) {
+    for (Object** p = start; p < end; p++) MarkPointer(*p);
+  }
+
+ private:
+  void MarkPointer(Object* object) {
+    if (!object->IsHeapObject()) return;
+    HeapObject* heap_object = HeapObject::cast(object);
+    uword address = heap_object->address();
+    if (!old_space_->Includes(address)) return;
+    if (ObjectMemory::TrySetMarkBit(address)) {
+      marking_stack_->Push(heap_object);
+    }
   }
-#endif
+
+  OldSpace* const old_space_;
+  MarkingStack* const marking_stack_;
+};
+
+// Marks the old space on the GC thread while the mutators keep running.
+//
+// The marking finds everything that was reachable when it started
+// (snapshot-at-the-beginning): the roots and the new space are scanned when
+// it starts, the mutators report the old value of every field they
+// overwrite (see [RecordOverwrite]), and stacks, which are changed without a
+// write barrier, are scanned before they run (see [ScanStack]). Objects
+// promoted while marking are marked when they are promoted. The GC thread
+// does not trace the stacks it finds, but leaves them to [Finish], which
+// runs while the mutators are stopped.
+class ConcurrentMarker {
+ public:
+  explicit ConcurrentMarker(OldSpace* old_space);
+  ~ConcurrentMarker();
+
+  // Marks the objects it visits. Only used while the GC thread is not
+  // running, i.e. before [Start].
+  PointerVisitor* root_visitor() { return &visitor_; }
+
+  // Lets the GC thread mark from the objects marked so far.
+  void Start();
+
+  // Write barrier. Marks the old value of an overwritten field.
+  void RecordOverwrite(Object* old_value);
+
+  // Scans [stack] unless it has been scanned since marking started.
+  void ScanStack(Stack* stack);
+
+  // Marks [coroutine] and scans its stack before it becomes current.
+  void ScanCoroutine(Coroutine* coroutine);
+
+  // Called on the GC thread. Marks until there is no more work, or until
+  // the mutator stops it.
+  void Run();
+
+  // The GC thread does not mark while paused, so the mutator can scavenge.
+  void Pause() { mutex_->Lock(); }
+  void Resume() { mutex_->Unlock(); }
+
+  // Returns true if the GC thread is done, or if the old space has grown so
+  // much that the marking should be finished anyway.
+  bool ShouldFinish();
+
+  // Stops the GC thread and marks the rest of the live objects. Must be
+  // called while all processes of the program are stopped.
+  void Finish();
+
+  // Stops the GC thread and drops the remaining work.
+  void Abort();
+
+  // The size of the old-space objects traced so far. Objects promoted while
+  // marking are not included.
+  int live_bytes() const { return live_bytes_; }
+
+ private:
+  static const int kObjectsPerStep = 256;
+
+  // Called with [mutex_] held. Returns false if there is no work left.
+  bool Step();
+  void TakeBarrierWork();
+  void StopGCThread();
+
+  OldSpace* const old_space_;
+  int used_limit_;
+
+  // Held by the GC thread while marking, and by the mutator while paused.
+  Mutex* const mutex_;
+  // Protects [barrier_stack_].
+  Mutex* const barrier_mutex_;
+  // Protects [running_] and the start of [Run].
+  Monitor* const monitor_;
+  bool running_;
+  Atomic<bool> stop_;
+  Atomic<bool> done_;
+  int live_bytes_;
+
+  MarkingStack stack_;
+  MarkingStack barrier_stack_;
+  MarkingStack deferred_stacks_;
+  ConcurrentMarkingVisitor visitor_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConcurrentMarker);
+};
+
+// Free memory is kept in exact size classes for small chunks, and in
+// buckets of similar sizes for the rest. Small requests take the best fitting
+// small chunk, and otherwise the smallest large one, which the old space then
+// uses for bump allocation. Large requests take the best fit among the first
+// chunks of their bucket, or the first chunk of the next non-empty bucket.
+class FreeList {
+ public:
+  FreeList() { Clear(); }
 
   void AddChunk(uword free_start, uword free_size) {
+    ObjectMemory::RecordFreeMemory(free_start, free_size);
     // If the chunk is too small to be turned into an actual
     // free list chunk we turn it into fillers to be coalesced
     // with other free chunks later.
@@ -174,110 +425,178 @@ class FreeList {
         reinterpret_cast<FreeListChunk*>(HeapObject::FromAddress(free_start));
     result->set_class(StaticClassStructures::free_list_chunk_class());
     result->set_size(free_size);
-    int bucket = Utils::HighestBit(free_size) - 1;
-    if (bucket >= kNumberOfBuckets) bucket = kNumberOfBuckets - 1;
-    result->set_next_chunk(buckets_[bucket]);
-    buckets_[bucket] = result;
+    int list = ListFor(free_size);
+    result->set_next_chunk(lists_[list]);
+    lists_[list] = result;
+    non_empty_[list / 64] |= ListBit(list);
   }
 
   FreeListChunk* GetChunk(uword min_size) {
-    int smallest_bucket = Utils::HighestBit(min_size);
-    ASSERT(smallest_bucket > 0);
-
-    // Locate largest chunk in free list guaranteed to satisfy the
-    // allocation.
-    for (int i = kNumberOfBuckets - 1; i >= smallest_bucket; i--) {
-      FreeListChunk* result = buckets_[i];
-      if (result != NULL) {
-        ASSERT(result->size() >= min_size);
-        FreeListChunk* next_chunk =
-            reinterpret_cast<FreeListChunk*>(result->next_chunk());
-        result->set_next_chunk(NULL);
-        buckets_[i] = next_chunk;
-        return result;
-      }
+    ASSERT(min_size >= static_cast<uword>(FreeListChunk::kSize));
+    int list = ListFor(min_size);
+    if (list >= kNumberOfSizeClasses) {
+      // The chunks in the buckets above are all large enough.
+      FreeListChunk* result = TakeBestFit(list, min_size);
+      if (result != NULL) return result;
+      list++;
     }
-
-    // Search the bucket containing chunks that could, but are not
-    // guaranteed to, satisfy the allocation.
-    if (smallest_bucket > kNumberOfBuckets) smallest_bucket = kNumberOfBuckets;
-    FreeListChunk* previous = reinterpret_cast<FreeListChunk*>(NULL);
-    FreeListChunk* current = buckets_[smallest_bucket - 1];
-    while (current != NULL) {
-      if (current->size() >= min_size) {
-        if (previous != NULL) {
-          previous->set_next_chunk(current->next_chunk());
-        } else {
-          buckets_[smallest_bucket - 1] =
-              reinterpret_cast<FreeListChunk*>(current->next_chunk());
-        }
-        current->set_next_chunk(NULL);
-        return current;
-      }
-      previous = current;
-      current = reinterpret_cast<FreeListChunk*>(current->next_chunk());
-    }
-
-    return NULL;
+    list = NextNonEmpty(list);
+    return list < 0 ? NULL : Take(list, NULL, lists_[list]);
   }
 
   void Clear() {
-    for (int i = 0; i < kNumberOfBuckets; i++) {
-      buckets_[i] = NULL;
+    for (int i = 0; i < kNumberOfLists; i++) {
+      lists_[i] = NULL;
     }
+    non_empty_[0] = non_empty_[1] = 0;
   }
 
+  bool IsEmpty() { return (non_empty_[0] | non_empty_[1]) == 0; }
+
   void Merge(FreeList* other) {
-    for (int i = 0; i < kNumberOfBuckets; i++) {
-      FreeListChunk* chunk = other->buckets_[i];
+    for (int i = 0; i < kNumberOfLists; i++) {
+      FreeListChunk* chunk = other->lists_[i];
       if (chunk != NULL) {
         FreeListChunk* last_chunk = chunk;
         while (last_chunk->next_chunk() != NULL) {
           last_chunk = FreeListChunk::cast(last_chunk->next_chunk());
         }
-        last_chunk->set_next_chunk(buckets_[i]);
-        buckets_[i] = chunk;
+        last_chunk->set_next_chunk(lists_[i]);
+        lists_[i] = chunk;
+      }
+    }
+    non_empty_[0] |= other->non_empty_[0];
+    non_empty_[1] |= other->non_empty_[1];
+  }
+
+ private:
+  // The first lists are size classes. Size class i contains the chunks of i
+  // words.
+  static const int kNumberOfSizeClasses = 64;
+  static const uword kSmallLimit = kNumberOfSizeClasses * kPointerSize;
+  // The other lists are buckets, splitting each power of two above
+  // kSmallLimit in four. The last one also contains all larger chunks.
+  static const int kBucketsPerPowerOfTwoLog2 = 2;
+  static const int kNumberOfBuckets = 64;
+  static const int kNumberOfLists = kNumberOfSizeClasses + kNumberOfBuckets;
+  // The number of chunks of a bucket looked at for the best fit.
+  static const int kBestFitSearchLimit = 8;
+
+  static int ListFor(uword size) {
+    if (size < kSmallLimit) return size >> kPointerSizeLog2;
+    int bit = Utils::HighestBit(size);
+    int quarter = (size >> (bit - kBucketsPerPowerOfTwoLog2)) &
+                  ((1 << kBucketsPerPowerOfTwoLog2) - 1);
+    int bucket = ((bit - Utils::HighestBit(kSmallLimit))
+                  << kBucketsPerPowerOfTwoLog2) + quarter;
+    if (bucket >= kNumberOfBuckets) bucket = kNumberOfBuckets - 1;
+    return kNumberOfSizeClasses + bucket;
+  }
+
+  static uint64 ListBit(int list) {
+    return static_cast<uint64>(1) << (list % 64);
+  }
+
+  // Returns the first non-empty list from [list], or -1.
+  int NextNonEmpty(int list) {
+    for (int i = list / 64; i < 2; i++) {
+      uint64 bits = non_empty_[i];
+      if (i == list / 64) bits &= ~(ListBit(list) - 1);
+      if (bits == 0) continue;
+      int result = i * 64;
+      while ((bits & 1) == 0) {
+        bits >>= 1;
+        result++;
+      }
+      return result;
+    }
+    return -1;
+  }
+
+  FreeListChunk* TakeBestFit(int list, uword min_size) {
+    FreeListChunk* best_previous = NULL;
+    FreeListChunk* best = NULL;
+    FreeListChunk* previous = NULL;
+    int remaining = kBestFitSearchLimit;
+    for (FreeListChunk* current = lists_[list]; current != NULL;
+         current = reinterpret_cast<FreeListChunk*>(current->next_chunk())) {
+      uword size = current->size();
+      if (size >= min_size && (best == NULL || size < best->size())) {
+        best_previous = previous;
+        best = current;
+        if (size == min_size) break;
+      }
+      if (--remaining == 0) break;
+      previous = current;
+    }
+    return best == NULL ? NULL : Take(list, best_previous, best);
+  }
+
+  // Unlinks [chunk] from [list], where it follows [previous].
+  FreeListChunk* Take(int list, FreeListChunk* previous,
+                      FreeListChunk* chunk) {
+    Object* next = chunk->next_chunk();
+    if (previous != NULL) {
+      previous->set_next_chunk(next);
+    } else {
+      lists_[list] = reinterpret_cast<FreeListChunk*>(next);
+      if (next == NULL) non_empty_[list / 64] &= ~ListBit(list);
+    }
+    chunk->set_next_chunk(NULL);
+    return chunk;
+  }
+
+  FreeListChunk* lists_[kNumberOfLists];
+  // Bit i is set if list i is not empty.
+  uint64 non_empty_[kNumberOfLists / 64];
+};
+
+// Updates the pointers to the old-space objects moved by a compaction.
+class ForwardingPointerVisitor : public PointerVisitor {
+ public:
+  explicit ForwardingPointerVisitor(OldSpace* old_space)
+      : old_space_(old_space) {}
+
+  virtual void VisitClass(Object** p) {}
+
+  virtual void Visit(Object** p) { VisitBlock(p, p + 1); }
+
+  virtual void VisitBlock(Object** start, Object** end) {
+    for (Object** p = start; p < end; p++) {
+      Object* object = *p;
+      if (!object->IsHeapObject()) continue;
+      HeapObject* heap_object = HeapObject::cast(object);
+      if (old_space_->Includes(heap_object->address()) &&
+          heap_object->HasForwardingAddress()) {
+        *p = heap_object->forwarding_address();
       }
     }
   }
 
  private:
-  // Buckets of power of two sized free lists chunks. Bucket i
-  // contains chunks of size larger than 2 ** (i + 1).
-  static const int kNumberOfBuckets = 12;
-#if defined(_MSC_VER)
-  // Work around Visual Studo 2013 bug 802058
-  FreeListChunk* buckets_[kNumberOfBuckets];
-#else
-  FreeListChunk* buckets_[kNumberOfBuckets] = {NULL};
-#endif
+  OldSpace* const old_space_;
 };
 
+// Adds the memory of the unmarked objects it visits to a free list,
+// coalescing adjacent dead objects.
 class SweepingVisitor : public HeapObjectVisitor {
  public:
   explicit SweepingVisitor(FreeList* free_list)
-      : free_list_(free_list), free_start_(0), used_(0) {
-    // Clear the free list. It will be rebuilt during sweeping.
-    if (free_list_ != NULL) free_list_->Clear();
-  }
+      : free_list_(free_list), free_start_(0), free_bytes_(0) {}
 
   void AddFreeListChunk(uword free_end_) {
     if (free_start_ != 0) {
       uword free_size = free_end_ - free_start_;
-      // When sweeping the new space we just remove mark bits, but don't build
-      // free lists, since it is GCed by scavenge instead.
-      if (free_list_ != NULL) free_list_->AddChunk(free_start_, free_size);
+      free_list_->AddChunk(free_start_, free_size);
+      free_bytes_ += free_size;
       free_start_ = 0;
     }
   }
 
   virtual int Visit(HeapObject* object) {
-    if (object->IsMarked()) {
+    if (ObjectMemory::IsMarkBitSet(object->address())) {
       AddFreeListChunk(object->address());
-      object->ClearMark();
-      int size = object->Size();
-      used_ += size;
-      return size;
+      return object->Size();
     }
     int size = object->Size();
     if (free_start_ == 0) free_start_ = object->address();
@@ -286,12 +605,12 @@ class SweepingVisitor : public HeapObjectVisitor {
 
   virtual void ChunkEnd(uword end) { AddFreeListChunk(end); }
 
-  int used() const { return used_; }
+  int free_bytes() const { return free_bytes_; }
 
  private:
   FreeList* free_list_;
   uword free_start_;
-  int used_;
+  int free_bytes_;
 };
 
 }  // namespace dartino
@@ -0,0 +1,302 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include <string.h>
+
+#include "src/shared/assert.h"
+#include "src/shared/flags.h"
+#include "src/shared/random.h"
+#include "src/shared/test_case.h"
+#include "src/vm/gc_helper_pool.h"
+#include "src/vm/heap.h"
+#include "src/vm/interpreter.h"
+#include "src/vm/mark_sweep.h"
+#include "src/vm/natives.h"
+#include "src/vm/object.h"
+#include "src/vm/object_memory.h"
+#include "src/vm/process.h"
+#include "src/vm/program.h"
+#include "src/vm/scheduler.h"
+#include "src/vm/thread.h"
+
+namespace dartino {
+
+static const int kWidth = 200;
+static const int kLeaves = 50;
+
+// Records the addresses of the marked objects in the order they are visited.
+class MarkedObjectsVisitor : public HeapObjectVisitor {
+ public:
+  explicit MarkedObjectsVisitor(uword* marked) : marked_(marked), count_(0) {}
+
+  virtual int Visit(HeapObject* object) {
+    if (ObjectMemory::IsMarkBitSet(object->address())) {
+      marked_[count_++] = object->address();
+    }
+    return object->Size();
+  }
+
+  int count() const { return count_; }
+
+ private:
+  uword* const marked_;
+  int count_;
+};
+
+// Copies the new-space [object] into the old space. The copy must not point
+// into the new space.
+static HeapObject* CopyToOldSpace(OldSpace* old, Object* object) {
+  HeapObject* heap_object = HeapObject::cast(object);
+  NoAllocationFailureScope scope(old);
+  uword address = old->Allocate(heap_object->Size());
+  memcpy(reinterpret_cast<void*>(address),
+         reinterpret_cast<void*>(heap_object->address()), heap_object->Size());
+  return HeapObject::FromAddress(address);
+}
+
+// Copies a new array of [length] elements into the old space.
+static Array* CreateOldArray(Heap* heap, Class* array_class, int length) {
+  NoAllocationFailureScope scope(heap->space());
+  Object* array = heap->CreateArray(array_class, length, Smi::zero());
+  return Array::cast(CopyToOldSpace(heap->old_space(), array));
+}
+
+// Marks from [root] with the helpers of the global GC helper pool, and
+// records the marked old-space objects in [marked]. Returns their number.
+static int MarkFrom(Heap* heap, Array* root, uword* marked, int* live_bytes) {
+  ParallelMarker marker(heap->space(), heap->old_space());
+  Object* pointer = root;
+  marker.root_visitor()->Visit(&pointer);
+  marker.Process();
+  *live_bytes = marker.live_bytes();
+  MarkedObjectsVisitor visitor(marked);
+  heap->old_space()->IterateObjects(&visitor);
+  return visitor.count();
+}
+
+TEST_CASE(ParallelMarkerMarksSameObjects) {
+  RandomXorShift random;
+  Heap program_heap(&random, 4 * KB);
+  Class* meta_class = Class::cast(program_heap.CreateMetaClass());
+  Class* array_class = Class::cast(program_heap.CreateClass(
+      InstanceFormat::array_format(), meta_class, NULL));
+
+  // A wide tree behind a single root, so the helpers only get work that is
+  // shared with them. Every other leaf is garbage.
+  Heap heap(&random, 4 * KB);
+  Array* root = CreateOldArray(&heap, array_class, 1);
+  Array* tree = CreateOldArray(&heap, array_class, kWidth);
+  root->set(0, tree);
+  for (int i = 0; i < kWidth; i++) {
+    Array* node = CreateOldArray(&heap, array_class, kLeaves);
+    for (int j = 0; j < kLeaves; j++) {
+      Array* leaf = CreateOldArray(&heap, array_class, 1);
+      if (j % 2 == 0) node->set(j, leaf);
+    }
+    tree->set(i, node);
+  }
+  heap.old_space()->Flush();
+  heap.space()->Flush();
+
+  static const int kLive = 2 + kWidth + kWidth * kLeaves / 2;
+  static const int kObjects = 2 + kWidth + kWidth * kLeaves;
+  uword* single = new uword[kObjects];
+  uword* parallel = new uword[kObjects];
+
+  int gc_helper_threads = Flags::gc_helper_threads;
+  GCHelperPool::TearDown();
+  Flags::gc_helper_threads = 0;
+  GCHelperPool::Setup();
+  int single_bytes;
+  int single_count = MarkFrom(&heap, root, single, &single_bytes);
+  EXPECT_EQ(kLive, single_count);
+
+  GCHelperPool::TearDown();
+  Flags::gc_helper_threads = 4;
+  GCHelperPool::Setup();
+  for (int run = 0; run < 10; run++) {
+    int parallel_bytes;
+    int parallel_count = MarkFrom(&heap, root, parallel, &parallel_bytes);
+    EXPECT_EQ(single_count, parallel_count);
+    EXPECT_EQ(single_bytes, parallel_bytes);
+    if (parallel_count == single_count) {
+      EXPECT(memcmp(single, parallel, single_count * sizeof(uword)) == 0);
+    }
+  }
+
+  GCHelperPool::TearDown();
+  Flags::gc_helper_threads = gc_helper_threads;
+  GCHelperPool::Setup();
+  heap.old_space()->ClearMarkBits();
+  delete[] single;
+  delete[] parallel;
+}
+
+// Sets up [stack] with a single frame holding [local], the way the
+// interpreter leaves the stack of a coroutine that is not running.
+static void PushFrame(Stack* stack, Object* local) {
+  word top = stack->length();
+  stack->set(--top, NULL);
+  stack->set(--top, NULL);
+  Object** frame_pointer = stack->Pointer(top);
+  // The bytecode pointer, the local, and the return address.
+  stack->set(--top, NULL);
+  stack->set(--top, local);
+  stack->set(--top, NULL);
+  stack->set(--top, reinterpret_cast<Object*>(frame_pointer));
+  stack->set_top(top);
+}
+
+static Object* FrameLocal(Stack* stack) {
+  return stack->get(stack->top() + 2);
+}
+
+static void ClearFrameLocal(Stack* stack) {
+  stack->set(stack->top() + 2, Smi::zero());
+}
+
+// Moves the leaves of the nodes [from] to [to] of [tree] into [moved], an
+// array the marking does not see, with the write barrier of the interpreter
+// or with the list native.
+static void MoveLeaves(Process* process, Array* tree, Array* moved, int from,
+                       int to) {
+  for (int i = from; i < to; i++) {
+    Object* element = tree->get(i);
+    for (int j = 0; j < kLeaves; j++) {
+      int index = i * kLeaves + j;
+      if (i % 2 == 0) {
+        Array* node = Array::cast(element);
+        moved->set(index, node->get(j));
+        AddToMarkingStackSlow(process, node->get(j));
+        node->set(j, Smi::zero());
+      } else {
+        Array* node = Array::cast(Instance::cast(element)->GetInstanceField(0));
+        moved->set(index, node->get(j));
+        Object* arguments[] = {Smi::zero(), Smi::FromWord(j), element};
+        Native_ListIndexSet(process, Arguments(&arguments[2]));
+      }
+    }
+  }
+}
+
+// Returns once the GC thread is done with the tasks it has picked up. It
+// picks up its next tasks before it pauses.
+static void WaitForGCThread(Scheduler* scheduler) {
+  for (int i = 0; i < 2; i++) {
+    StoppedGcThreadScope scope(scheduler);
+  }
+}
+
+TEST_CASE(ConcurrentMarkingKeepsMovedObjects) {
+  bool concurrent_marking = Flags::concurrent_marking;
+  Flags::concurrent_marking = true;
+  Program* program = new Program(Program::kBuiltViaSession);
+  program->Initialize();
+  {
+    NoAllocationFailureScope scope(program->heap()->space());
+    program->set_static_fields(Array::cast(program->CreateArray(1)));
+  }
+  Scheduler* scheduler = Scheduler::GlobalInstance();
+  program->set_scheduler(scheduler);
+  // Keeps the GC thread from finishing the program when it is done marking.
+  program->program_state()->Retain();
+  Process* process = program->SpawnProcess(NULL);
+  Thread::SetProcess(process);
+  Heap* heap = program->process_heap();
+  OldSpace* old = heap->old_space();
+  {
+    NoAllocationFailureScope scope(heap->space());
+    process->SetupExecutionStack();
+  }
+  Class* array_class = program->array_class();
+
+  // A wide tree gives the GC thread something to mark while its leaves are
+  // moved. Every other node is wrapped in a list, whose elements are set by
+  // a native. The coroutines each hold a leaf on their stack.
+  static const int kCoroutines = 16;
+  static const int kStackLength = 8;
+  Array* root = CreateOldArray(heap, array_class, kCoroutines + 1);
+  Array* tree = CreateOldArray(heap, array_class, kWidth);
+  for (int i = 0; i < kCoroutines; i++) {
+    NoAllocationFailureScope scope(heap->space());
+    Stack* stack = Stack::cast(CopyToOldSpace(
+        old, heap->CreateStack(program->stack_class(), kStackLength)));
+    Array* leaf = CreateOldArray(heap, array_class, 1);
+    leaf->set(0, Smi::FromWord(kWidth * kLeaves + i));
+    PushFrame(stack, leaf);
+    Coroutine* coroutine = Coroutine::cast(CopyToOldSpace(
+        old, heap->CreateInstance(program->coroutine_class(),
+                                  program->null_object(), false)));
+    coroutine->set_stack(stack);
+    root->set(i, coroutine);
+  }
+  root->set(kCoroutines, tree);
+  for (int i = 0; i < kWidth; i++) {
+    Array* node = CreateOldArray(heap, array_class, kLeaves);
+    for (int j = 0; j < kLeaves; j++) {
+      Array* leaf = CreateOldArray(heap, array_class, 1);
+      leaf->set(0, Smi::FromWord(i * kLeaves + j));
+      node->set(j, leaf);
+    }
+    if (i % 2 == 0) {
+      tree->set(i, node);
+    } else {
+      NoAllocationFailureScope scope(heap->space());
+      Instance* list = Instance::cast(CopyToOldSpace(
+          old, heap->CreateInstance(program->constant_list_class(),
+                                    program->null_object(), false)));
+      list->SetInstanceField(0, node);
+      tree->set(i, list);
+    }
+  }
+  Array* dead = CreateOldArray(heap, array_class, 1);
+  process->statics()->set(0, root);
+
+  static const int kMoved = kWidth * kLeaves + kCoroutines;
+  Array* moved;
+  {
+    // The GC thread only starts marking once the leaves of the first half
+    // of the tree have been moved. The rest are moved while it marks.
+    StoppedGcThreadScope scope(scheduler);
+    // The scavenge starts the marking once the old space is out of budget.
+    old->SetAllocationBudget(0);
+    old->DecreaseAllocationBudget(Space::kDefaultMinimumChunkSize);
+    program->CollectNewSpace();
+    EXPECT(program->is_marking());
+    NoAllocationFailureScope allocation_scope(heap->space());
+    moved = Array::cast(process->NewArray(kMoved));
+    MoveLeaves(process, tree, moved, 0, kWidth / 2);
+  }
+  MoveLeaves(process, tree, moved, kWidth / 2, kWidth);
+  for (int i = 0; i < kCoroutines; i++) {
+    Coroutine* coroutine = Coroutine::cast(root->get(i));
+    program->RecordActivation(coroutine);
+    moved->set(kWidth * kLeaves + i, FrameLocal(coroutine->stack()));
+    ClearFrameLocal(coroutine->stack());
+  }
+
+  program->CollectSharedGarbage();
+  EXPECT(!program->is_marking());
+  old->CompleteSweeping();
+  for (int i = 0; i < kMoved; i++) {
+    HeapObject* leaf = HeapObject::cast(moved->get(i));
+    EXPECT(ObjectMemory::IsMarkBitSet(leaf->address()));
+    EXPECT(leaf->get_class() == array_class);
+    if (leaf->get_class() == array_class) {
+      EXPECT_EQ(i, Smi::cast(Array::cast(leaf)->get(0))->value());
+    }
+  }
+  EXPECT(!ObjectMemory::IsMarkBitSet(dead->address()));
+
+  WaitForGCThread(scheduler);
+  EXPECT(program->program_state()->Release());
+  process->ChangeState(process->state(), Process::kWaitingForChildren);
+  program->ScheduleProcessForDeletion(process, Signal::kTerminated);
+  Thread::SetProcess(NULL);
+  program->set_scheduler(NULL);
+  delete program;
+  Flags::concurrent_marking = concurrent_marking;
+}
+
+}  // namespace dartino
@@ -939,6 +939,7 @@ BEGIN_NATIVE(ListIndexSet) {
     return Failure::index_out_of_bounds();
   }
   Object* value = arguments[2];
+  process->RecordOverwrite(array->get(index));
   array->set(index, value);
   process->RecordStore(array, value);
   return value;
@@ -1035,6 +1036,16 @@ BEGIN_NATIVE(ProcessSpawn) {
     }
     monitor_port = Port::FromDartObject(dart_monitor_port);
   }
+  Object* dart_priority = arguments[6];
+  Process::Priority priority = process->priority();
+  if (!dart_priority->IsNull()) {
+    if (!dart_priority->IsSmi()) return Failure::wrong_argument_type();
+    word value = Smi::cast(dart_priority)->value();
+    if (value < 0 || value >= Process::kNumberOfPriorities) {
+      return Failure::wrong_argument_type();
+    }
+    priority = static_cast<Process::Priority>(value);
+  }
 
   if (!closure->IsImmutable()) {
     // TODO(kasperl): Return a proper failure.
@@ -1057,6 +1068,7 @@ BEGIN_NATIVE(ProcessSpawn) {
 
   Process* child =
       SpawnProcessInternal(program, process, entrypoint, closure, argument);
+  child->set_priority(priority);
 
   ProcessHandle* handle = child->process_handle();
   handle->IncrementRef();
@@ -1098,7 +1110,7 @@ BEGIN_NATIVE(CoroutineCurrent) { return process->coroutine(); }
 END_NATIVE()
 
 BEGIN_NATIVE(CoroutineNewStack) {
-  Object* object = process->NewStack(256);
+  Object* object = process->NewStack(Process::kInitialStackLength);
   if (object->IsFailure()) return object;
   Instance* coroutine = Instance::cast(arguments[0]);
   Instance* entry = Instance::cast(arguments[1]);
@@ -1492,6 +1504,51 @@ BEGIN_NATIVE(SystemEventHandlerAdd) {
 }
 END_NATIVE()
 
+BEGIN_NATIVE(SystemEventHandlerRegister) {
+  Object* port_arg = arguments[1];
+  if (!port_arg->IsPort()) return Failure::wrong_argument_type();
+  Port* port = Port::FromDartObject(port_arg);
+  return EventHandler::GlobalInstance()->Register(process, arguments[0], port);
+}
+END_NATIVE()
+
+BEGIN_NATIVE(SystemEventHandlerUnregister) {
+  return EventHandler::GlobalInstance()->Unregister(process, arguments[0]);
+}
+END_NATIVE()
+
+BEGIN_NATIVE(SystemEventHandlerWait) {
+  Object* flags_arg = arguments[1];
+  if (!flags_arg->IsSmi()) return Failure::wrong_argument_type();
+  int flags = Smi::cast(flags_arg)->value();
+  return EventHandler::GlobalInstance()->WaitForEvent(process, arguments[0],
+                                                      flags);
+}
+END_NATIVE()
+
+BEGIN_NATIVE(SystemEventHandlerSubmit) {
+  Object* operation = arguments[0];
+  if (!operation->IsSmi()) return Failure::wrong_argument_type();
+  Object* address = arguments[2];
+  if (!address->IsSmi() && !address->IsLargeInteger()) {
+    return Failure::wrong_argument_type();
+  }
+  Object* length = arguments[3];
+  if (!length->IsSmi()) return Failure::wrong_argument_type();
+  Object* port_arg = arguments[4];
+  if (!port_arg->IsPort()) return Failure::wrong_argument_type();
+  Port* port = Port::FromDartObject(port_arg);
+  return EventHandler::GlobalInstance()->Submit(
+      process, Smi::cast(operation)->value(), arguments[1],
+      AsForeignWord(address), Smi::cast(length)->value(), port);
+}
+END_NATIVE()
+
+BEGIN_NATIVE(SystemEventHandlerCancel) {
+  return EventHandler::GlobalInstance()->Cancel(process, arguments[0]);
+}
+END_NATIVE()
+
 BEGIN_NATIVE(IsImmutable) {
   Object* o = arguments[0];
   return ToBool(process, o->IsImmutable());
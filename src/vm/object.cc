@@ -24,8 +24,6 @@ uword StaticClassStructures::free_list_chunk_class_storage[Class::kSize
     / sizeof(uword)];
 uword StaticClassStructures::one_word_filler_class_storage[Class::kSize
     / sizeof(uword)];
-uword StaticClassStructures::promoted_track_class_storage[Class::kSize
-    / sizeof(uword)];
 
 static void CopyBlock(Object** dst, Object** src, int byte_size) {
   ASSERT(byte_size > 0);
@@ -47,34 +45,38 @@ static void CopyBlock(Object** dst, Object** src, int byte_size) {
 }
 
 int HeapObject::Size() {
-  // Fast check for non-variable length types.
   ASSERT(!HasForwardingAddress());
-  InstanceFormat format = raw_class()->instance_format();
+  return SizeForFormat(raw_class()->instance_format());
+}
+
+int HeapObject::SizeForFormat(InstanceFormat format) {
+  // Fast check for non-variable length types.
   if (!format.has_variable_part()) return format.fixed_size();
+  // We do not use the cast methods because the class pointer may have been
+  // replaced by a forwarding address on another thread.
   int type = format.type();
   switch (type) {
     case InstanceFormat::ONE_BYTE_STRING_TYPE:
-      return OneByteString::cast(this)->StringSize();
+      return reinterpret_cast<OneByteString*>(this)->StringSize();
     case InstanceFormat::TWO_BYTE_STRING_TYPE:
-      return TwoByteString::cast(this)->StringSize();
+      return reinterpret_cast<TwoByteString*>(this)->StringSize();
     case InstanceFormat::ARRAY_TYPE:
-      return Array::cast(this)->ArraySize();
+      return reinterpret_cast<Array*>(this)->ArraySize();
     case InstanceFormat::BYTE_ARRAY_TYPE:
-      return ByteArray::cast(this)->ByteArraySize();
+      return reinterpret_cast<ByteArray*>(this)->ByteArraySize();
     case InstanceFormat::FUNCTION_TYPE:
-      return Function::cast(this)->FunctionSize();
+      return reinterpret_cast<Function*>(this)->FunctionSize();
     case InstanceFormat::STACK_TYPE:
-      return Stack::cast(this)->StackSize();
+      return reinterpret_cast<Stack*>(this)->StackSize();
     case InstanceFormat::DOUBLE_TYPE:
-      return Double::cast(this)->DoubleSize();
+      return reinterpret_cast<Double*>(this)->DoubleSize();
     case InstanceFormat::LARGE_INTEGER_TYPE:
-      return LargeInteger::cast(this)->LargeIntegerSize();
+      return reinterpret_cast<LargeInteger*>(this)->LargeIntegerSize();
     case InstanceFormat::DISPATCH_TABLE_ENTRY_TYPE:
-      return DispatchTableEntry::cast(this)->DispatchTableEntrySize();
+      return reinterpret_cast<DispatchTableEntry*>(this)
+          ->DispatchTableEntrySize();
     case InstanceFormat::FREE_LIST_CHUNK_TYPE:
-      return FreeListChunk::cast(this)->size();
-    case InstanceFormat::PROMOTED_TRACK_TYPE:
-      return PromotedTrack::cast(this)->size();
+      return reinterpret_cast<FreeListChunk*>(this)->size();
   }
   UNREACHABLE();
   return 0;
@@ -512,9 +514,7 @@ InstanceFormat HeapObject::IteratePointers(PointerVisitor* visitor) {
   ASSERT(!HasForwardingAddress());
 
   visitor->VisitClass(reinterpret_cast<Object**>(address()));
-  uword raw = reinterpret_cast<uword>(raw_class());
-  Class* klass = reinterpret_cast<Class*>(raw & ~HeapObject::kMarkBit);
-  InstanceFormat format = klass->instance_format();
+  InstanceFormat format = FormatIgnoringMark();
   // Fast case for fixed size object with all pointers.
   if (format.only_pointers_in_fixed_part()) {
     visitor->VisitBlock(
@@ -590,9 +590,8 @@ void Stack::UpdateFramePointers(Stack* old_stack) {
   }
 }
 
-// Explicit instantiation of just these two types.
+// Explicit instantiation for the semispaces.
 template HeapObject* HeapObject::CloneInToSpace<SemiSpace>(SemiSpace* s);
-template HeapObject* HeapObject::CloneInToSpace<OldSpace>(OldSpace* s);
 
 template <class SomeSpace>
 HeapObject* HeapObject::CloneInToSpace(SomeSpace* to) {
@@ -734,14 +733,4 @@ int CookedHeapObjectPointerVisitor::Visit(HeapObject* object) {
   return size;
 }
 
-PromotedTrack* PromotedTrack::Initialize(PromotedTrack* next, uword location,
-                                         uword end) {
-  PromotedTrack* self =
-      reinterpret_cast<PromotedTrack*>(HeapObject::FromAddress(location));
-  self->set_class(StaticClassStructures::promoted_track_class());
-  self->set_next(next);
-  self->set_end(end);
-  return self;
-}
-
 }  // namespace dartino
@@ -27,7 +27,6 @@ namespace dartino {
 //     HeapObject
 //       FreeListChunk
 //       OneWordFiller
-//       PromotedTrack
 //       Boxed
 //       Class
 //       Double
@@ -116,7 +115,6 @@ class Object {
   inline bool IsStack();
   inline bool IsCoroutine();
   inline bool IsPort();
-  inline bool IsPromotedTrack();
 
   // - based on marker field in class.
   inline bool IsNull();
@@ -214,7 +212,6 @@ class InstanceFormat {
     DISPATCH_TABLE_ENTRY_TYPE = 12,
     FREE_LIST_CHUNK_TYPE = 13,
     ONE_WORD_FILLER_TYPE = 14,
-    PROMOTED_TRACK_TYPE = 15,
     IMMEDIATE_TYPE = 31  // No instances.
   };
 
@@ -256,7 +253,6 @@ class InstanceFormat {
   inline static const InstanceFormat boxed_format();
   inline static const InstanceFormat free_list_chunk_format();
   inline static const InstanceFormat one_word_filler_format();
-  inline static const InstanceFormat promoted_track_format();
   inline static const InstanceFormat stack_format();
   inline static const InstanceFormat initializer_format();
   inline static const InstanceFormat dispatch_table_entry_format();
@@ -345,6 +341,10 @@ class HeapObject : public Object {
     return (klass & kMarkBit) != 0;
   }
 
+  // Retrieve the object format from the class, ignoring the mark bit. Can be
+  // used while other threads are marking.
+  inline InstanceFormat FormatIgnoringMark();
+
   // Retrieve the object format from the class.
   inline InstanceFormat format();
 
@@ -383,6 +383,9 @@ class HeapObject : public Object {
   // Sizing.
   int FixedSize();
   int Size();
+  // The size of an object with the given format, read without looking at
+  // the class pointer of the object.
+  int SizeForFormat(InstanceFormat format);
 
   // Printing.
   void HeapObjectPrint();
@@ -1130,8 +1133,6 @@ class StaticClassStructures {
                InstanceFormat::free_list_chunk_format());
     SetupClass(one_word_filler_class_storage,
                InstanceFormat::one_word_filler_format());
-    SetupClass(promoted_track_class_storage,
-               InstanceFormat::promoted_track_format());
   }
 
   static void TearDown() {}
@@ -1151,11 +1152,6 @@ class StaticClassStructures {
     return Class::cast(HeapObject::FromAddress(address));
   }
 
-  static Class* promoted_track_class() {
-    uword address = reinterpret_cast<uword>(promoted_track_class_storage);
-    return Class::cast(HeapObject::FromAddress(address));
-  }
-
   static bool IsStaticClass(HeapObject* object) {
     return (object == meta_class() || object == free_list_chunk_class() ||
             object == one_word_filler_class());
@@ -1165,7 +1161,6 @@ class StaticClassStructures {
   static uword meta_class_storage[Class::kSize / sizeof(uword)];
   static uword free_list_chunk_class_storage[Class::kSize / sizeof(uword)];
   static uword one_word_filler_class_storage[Class::kSize / sizeof(uword)];
-  static uword promoted_track_class_storage[Class::kSize / sizeof(uword)];
 
   static void SetupMetaClass() {
     Class* meta = reinterpret_cast<Class*>(
@@ -1344,39 +1339,6 @@ class CookedHeapObjectPointerVisitor : public HeapObjectVisitor {
   PointerVisitor* visitor_;
 };
 
-// These are chained up to track the areas where we have allocated objects for
-// promoted objects that we found while scavenging.  Only used for 2-generation
-// configurations.
-class PromotedTrack : public HeapObject {
- public:
-  // Returns newly initialized PromotedTrack object.
-  // Writes the class field too.
-  static PromotedTrack* Initialize(PromotedTrack* next, uword location,
-                                   uword end);
-
-  // Field access.
-  inline void set_next(PromotedTrack* next);
-  inline PromotedTrack* next();
-  inline void set_end(uword end);
-  inline uword end();
-
-  static inline PromotedTrack* cast(Object* o);
-
-  inline uword size();
-
-  uword start() { return address() + kHeaderSize; }
-
-  void Zap(Class* filler) {
-    set_class(filler);
-    set_next(reinterpret_cast<PromotedTrack*>(filler));
-    set_end(reinterpret_cast<uword>(filler));
-  }
-
-  static const int kNextPromotedTrackOffset = HeapObject::kSize;
-  static const int kEndOffset = kNextPromotedTrackOffset + kPointerSize;
-  static const int kHeaderSize = kEndOffset + kPointerSize;
-};
-
 // Inlined InstanceFormat functions.
 
 InstanceFormat::InstanceFormat(Type type, int fixed_size,
@@ -1445,11 +1407,6 @@ const InstanceFormat InstanceFormat::one_word_filler_format() {
                         NEVER_IMMUTABLE);
 }
 
-const InstanceFormat InstanceFormat::promoted_track_format() {
-  return InstanceFormat(PROMOTED_TRACK_TYPE, kPointerSize, HAS_VARIABLE_PART,
-                        ONLY_POINTERS_IN_FIXED_PART, NEVER_IMMUTABLE);
-}
-
 const InstanceFormat InstanceFormat::function_format() {
   return InstanceFormat(FUNCTION_TYPE, Function::kSize, HAS_VARIABLE_PART,
                         MAY_HAVE_POINTERS_IN_VARIABLE_PART, ALWAYS_IMMUTABLE);
@@ -1596,13 +1553,6 @@ bool Object::IsFiller() {
   return c == StaticClassStructures::one_word_filler_class();
 }
 
-bool Object::IsPromotedTrack() {
-  if (IsSmi()) return false;
-  HeapObject* h = HeapObject::cast(this);
-  Class* c = h->raw_class();
-  return c == StaticClassStructures::promoted_track_class();
-}
-
 bool Object::IsByteArray() {
   if (IsSmi()) return false;
   HeapObject* h = HeapObject::cast(this);
@@ -1718,6 +1668,11 @@ HeapObject* HeapObject::FromAddress(uword raw_address) {
 
 InstanceFormat HeapObject::format() { return raw_class()->instance_format(); }
 
+InstanceFormat HeapObject::FormatIgnoringMark() {
+  uword klass = reinterpret_cast<uword>(raw_class());
+  return reinterpret_cast<Class*>(klass & ~kMarkBit)->instance_format();
+}
+
 void HeapObject::at_put(int offset, Object* value) {
   *reinterpret_cast<Object**>(address() + offset) = value;
 }
@@ -2177,28 +2132,6 @@ FreeListChunk* FreeListChunk::cast(Object* object) {
   return reinterpret_cast<FreeListChunk*>(object);
 }
 
-// Inlined PromotedTrack functions.
-void PromotedTrack::set_next(PromotedTrack* next) {
-  at_put(kNextPromotedTrackOffset, next);
-}
-
-PromotedTrack* PromotedTrack::next() {
-  return reinterpret_cast<PromotedTrack*>(at(kNextPromotedTrackOffset));
-}
-
-void PromotedTrack::set_end(uword end) {
-  at_put(kEndOffset, reinterpret_cast<Object*>(end));
-}
-
-uword PromotedTrack::end() { return reinterpret_cast<uword>(at(kEndOffset)); }
-
-PromotedTrack* PromotedTrack::cast(Object* object) {
-  ASSERT(object->IsPromotedTrack());
-  return reinterpret_cast<PromotedTrack*>(object);
-}
-
-uword PromotedTrack::size() { return end() - address(); }
-
 // Inlined LargeInteger functions.
 
 int64 LargeInteger::value() {
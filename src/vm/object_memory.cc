@@ -37,9 +37,14 @@ static bool HasSentinelAt(uword address) {
 }
 
 Chunk::~Chunk() {
+  delete[] mark_bits_;
   // If the memory for this chunk is external we leave it alone
   // and let the embedder deallocate it.
-  if (is_external()) return;
+  if (is_external() || pooled_) return;
+  if (memory_ != NULL) {
+    delete memory_;
+    return;
+  }
 #if defined(DARTINO_TARGET_OS_CMSIS) || defined(DARTINO_TARGET_OS_LK)
   page_free(reinterpret_cast<void*>(base()), size() >> PAGE_SIZE_SHIFT);
 #elif defined(DARTINO_TARGET_OS_WIN)
@@ -96,6 +101,12 @@ void Space::SetAllocationBudget(int new_budget) {
   allocation_budget_ = Utils::Maximum(DefaultChunkSize(new_budget), new_budget);
 }
 
+void Space::ClearMarkBits() {
+  for (Chunk* chunk = first(); chunk != NULL; chunk = chunk->next()) {
+    ObjectMemory::ClearMarkBits(chunk);
+  }
+}
+
 void Space::IterateObjects(HeapObjectVisitor* visitor) {
   if (is_empty()) return;
   Flush();
@@ -165,10 +176,19 @@ PageDirectory ObjectMemory::page_directory_;
 PageDirectory* ObjectMemory::page_directories_[1 << 13];
 #endif
 Atomic<uword> ObjectMemory::allocated_;
+ChunkPool* ObjectMemory::chunk_pool_;
 
 void ObjectMemory::Setup() {
   mutex_ = Platform::CreateMutex();
   allocated_ = 0;
+  chunk_pool_ = NULL;
+#if defined(DARTINO64) && defined(DARTINO_TARGET_OS_POSIX)
+  chunk_pool_ = new ChunkPool(kChunkReservationSize, kMaximumPooledSize);
+  if (!chunk_pool_->IsReserved()) {
+    delete chunk_pool_;
+    chunk_pool_ = NULL;
+  }
+#endif
 #ifdef DARTINO32
   page_directory_.Clear();
 #else
@@ -188,9 +208,98 @@ void ObjectMemory::TearDown() {
     delete directory;
   }
 #endif
+  delete chunk_pool_;
+  chunk_pool_ = NULL;
   delete mutex_;
 }
 
+ChunkPool::ChunkPool(int reservation_size, int pooled_limit)
+    : reservation_(reservation_size),
+      pooled_limit_(pooled_limit),
+      top_(0),
+      pooled_size_(0) {}
+
+uword ChunkPool::Allocate(int size) {
+  uword base = 0;
+  {
+    ScopedSpinlock locker(&lock_);
+    for (int i = pooled_.size() - 1; i >= 0; i--) {
+      if (pooled_[i].size != static_cast<uword>(size)) continue;
+      base = pooled_[i].base;
+      pooled_.Remove(i);
+      pooled_size_ -= size;
+      return base;
+    }
+    for (unsigned i = 0; i < free_.size(); i++) {
+      Range* range = &free_[i];
+      if (range->size < static_cast<uword>(size)) continue;
+      base = range->base;
+      range->base += size;
+      range->size -= size;
+      if (range->size == 0) free_.Remove(i);
+      break;
+    }
+    if (base == 0) {
+      if (reservation_.size() - top_ < static_cast<uword>(size)) return 0;
+      base = reservation_.address() + top_;
+      top_ += size;
+    }
+  }
+  // The range is ours now, so it is committed outside the lock.
+  if (!reservation_.Commit(base, size, false)) {
+    ScopedSpinlock locker(&lock_);
+    Range range = {base, static_cast<uword>(size)};
+    AddFreeRange(range);
+    return 0;
+  }
+  return base;
+}
+
+void ChunkPool::Free(uword base, int size) {
+  Vector<Range> evicted;
+  {
+    ScopedSpinlock locker(&lock_);
+    Range freed = {base, static_cast<uword>(size)};
+    pooled_.PushBack(freed);
+    pooled_size_ += size;
+    while (pooled_size_ > pooled_limit_) {
+      evicted.PushBack(pooled_[0]);
+      pooled_size_ -= pooled_[0].size;
+      pooled_.Remove(0);
+    }
+  }
+  if (evicted.IsEmpty()) return;
+  // The evicted ranges are ours until they are added to the free ranges, so
+  // they are decommitted outside the lock, like Allocate commits.
+  for (unsigned i = 0; i < evicted.size(); i++) {
+    reservation_.Uncommit(evicted[i].base, evicted[i].size);
+  }
+  ScopedSpinlock locker(&lock_);
+  for (unsigned i = 0; i < evicted.size(); i++) AddFreeRange(evicted[i]);
+}
+
+void ChunkPool::AddFreeRange(Range range) {
+  unsigned index = 0;
+  while (index < free_.size() && free_[index].base < range.base) index++;
+  if (index > 0) {
+    Range* previous = &free_[index - 1];
+    if (previous->base + previous->size == range.base) {
+      range.base = previous->base;
+      range.size += previous->size;
+      free_.Remove(--index);
+    }
+  }
+  if (index < free_.size() && range.base + range.size == free_[index].base) {
+    range.size += free_[index].size;
+    free_.Remove(index);
+  }
+  if (index < free_.size()) {
+    free_.Insert(index, range);
+  } else {
+    free_.PushBack(range);
+  }
+}
+
 #ifdef DEBUG
 void Chunk::Scramble() {
   void* p = reinterpret_cast<void*>(base());
@@ -216,23 +325,30 @@ Chunk* ObjectMemory::AllocateChunk(Space* owner, int size) {
   ASSERT(owner != NULL);
 
   size = Utils::RoundUp(size, kPageSize);
-  void* memory;
+  void* memory = NULL;
+  if (chunk_pool_ != NULL) {
+    memory = reinterpret_cast<void*>(chunk_pool_->Allocate(size));
+  }
+  bool pooled = memory != NULL;
+  if (!pooled) {
 #if defined(__ANDROID__)
-  // posix_memalign doesn't exist on Android. We fallback to
-  // memalign.
-  memory = memalign(kPageSize, size);
+    // posix_memalign doesn't exist on Android. We fallback to
+    // memalign.
+    memory = memalign(kPageSize, size);
 #elif defined(DARTINO_TARGET_OS_WIN)
-  memory = _aligned_malloc(size, kPageSize);
+    memory = _aligned_malloc(size, kPageSize);
 #elif defined(DARTINO_TARGET_OS_LK) || defined(DARTINO_TARGET_OS_CMSIS)
-  size = Utils::RoundUp(size, PAGE_SIZE);
-  memory = page_alloc(size >> PAGE_SIZE_SHIFT);
+    size = Utils::RoundUp(size, PAGE_SIZE);
+    memory = page_alloc(size >> PAGE_SIZE_SHIFT);
 #else
-  if (posix_memalign(&memory, kPageSize, size) != 0) return NULL;
+    if (posix_memalign(&memory, kPageSize, size) != 0) return NULL;
 #endif
+  }
   if (memory == NULL) return NULL;
 
   uword base = reinterpret_cast<uword>(memory);
   Chunk* chunk = new Chunk(owner, base, size);
+  chunk->pooled_ = pooled;
 
   ASSERT(base == Utils::RoundUp(base, kPageSize));
   ASSERT(size == Utils::RoundUp(size, kPageSize));
@@ -245,6 +361,33 @@ Chunk* ObjectMemory::AllocateChunk(Space* owner, int size) {
   return chunk;
 }
 
+Chunk* ObjectMemory::AllocateMappedChunk(Space* owner, int size) {
+#if defined(DARTINO_TARGET_OS_POSIX)
+  ASSERT(owner != NULL);
+
+  size = Utils::RoundUp(size, kPageSize);
+  VirtualMemory* memory = new VirtualMemory(size);
+  if (!memory->IsReserved() ||
+      !memory->Commit(memory->address(), size, false)) {
+    delete memory;
+    return NULL;
+  }
+
+  Chunk* chunk = new Chunk(owner, memory->address(), size);
+  chunk->memory_ = memory;
+  ASSERT(chunk->base() == Utils::RoundUp(chunk->base(), kPageSize));
+
+#ifdef DEBUG
+  chunk->Scramble();
+#endif
+  SetSpaceForPages(chunk->base(), chunk->limit(), owner);
+  allocated_ += size;
+  return chunk;
+#else
+  return AllocateChunk(owner, size);
+#endif
+}
+
 Chunk* ObjectMemory::CreateFlashChunk(Space* owner, void* memory, int size) {
   ASSERT(owner != NULL);
   ASSERT(size == Utils::RoundUp(size, kPageSize));
@@ -263,10 +406,137 @@ void ObjectMemory::FreeChunk(Chunk* chunk) {
   if (!chunk->is_external()) chunk->Scramble();
 #endif
   SetSpaceForPages(chunk->base(), chunk->limit(), NULL);
+  if (chunk->mark_bits_ != NULL) SetMarkBitsForPages(chunk, NULL);
   allocated_ -= chunk->size();
+  if (chunk->pooled_) chunk_pool_->Free(chunk->base(), chunk->size());
   delete chunk;
 }
 
+// The number of mark bit words covering a page.
+static const int kMarkBitWordsPerPage =
+    (kPageSize >> kPointerSizeLog2) / kBitsPerWord;
+
+void ObjectMemory::AllocateMarkBits(Chunk* chunk) {
+  ASSERT(chunk->mark_bits_ == NULL);
+  uword words = (chunk->size() / kPageSize) * kMarkBitWordsPerPage;
+  chunk->mark_bits_ = new uword[words];
+  memset(chunk->mark_bits_, 0, words * kWordSize);
+  SetMarkBitsForPages(chunk, chunk->mark_bits_);
+}
+
+void ObjectMemory::ClearMarkBits(Chunk* chunk) {
+  if (chunk->mark_bits_ == NULL) {
+    AllocateMarkBits(chunk);
+    return;
+  }
+  uword words = (chunk->size() / kPageSize) * kMarkBitWordsPerPage;
+  memset(chunk->mark_bits_, 0, words * kWordSize);
+}
+
+bool ObjectMemory::IsMarkBitSet(uword address) {
+  uword mask;
+  uword* word = GetMarkBitWord(address, &mask);
+  return (*word & mask) != 0;
+}
+
+bool ObjectMemory::TrySetMarkBit(uword address) {
+  uword mask;
+  Atomic<uword>* word =
+      reinterpret_cast<Atomic<uword>*>(GetMarkBitWord(address, &mask));
+  uword bits = word->load(kRelaxed);
+  while ((bits & mask) == 0) {
+    if (word->compare_exchange_weak(bits, bits | mask, kRelaxed)) return true;
+  }
+  return false;
+}
+
+void ObjectMemory::SetMarkBitsForPages(Chunk* chunk, uword* bits) {
+  for (uword address = chunk->base(); address < chunk->limit();
+       address += kPageSize) {
+    GetPageTable(address)->SetMarkBits((address >> 12) & 0x3ff, bits);
+    if (bits != NULL) bits += kMarkBitWordsPerPage;
+  }
+}
+
+uword* ObjectMemory::GetMarkBitWord(uword address, uword* mask) {
+  PageTable* table = GetPageTable(address);
+  ASSERT(table != NULL);
+  uword* bits = table->GetMarkBits((address >> 12) & 0x3ff);
+  ASSERT(bits != NULL);
+  uword index = (address & (kPageSize - 1)) >> kPointerSizeLog2;
+  *mask = static_cast<uword>(1) << (index % kBitsPerWord);
+  return bits + index / kBitsPerWord;
+}
+
+// Recorded for the cards in which no object starts.
+static const uint8 kNoObjectStart = 0xff;
+
+static int CardIndex(uword address) {
+  return (address >> ObjectMemory::kCardSizeLog2) &
+         (PageTable::kCardsPerTable - 1);
+}
+
+static uint8 CardOffset(uword address) {
+  return (address & (ObjectMemory::kCardSize - 1)) >> kPointerSizeLog2;
+}
+
+uint8* ObjectMemory::GetCard(uword address) {
+  PageTable* table = GetPageTable(address);
+  ASSERT(table != NULL);
+  return table->GetCard(CardIndex(address));
+}
+
+void ObjectMemory::RecordObjectStart(uword address) {
+  // The threads of a parallel scavenge can promote into the same card.
+  Atomic<uint8>* start = reinterpret_cast<Atomic<uint8>*>(
+      GetPageTable(address)->GetObjectStart(CardIndex(address)));
+  uint8 offset = CardOffset(address);
+  uint8 current = start->load(kRelaxed);
+  while (offset < current) {
+    if (start->compare_exchange_weak(current, offset, kRelaxed)) return;
+  }
+}
+
+void ObjectMemory::RecordFreeMemory(uword address, uword size) {
+  RecordObjectStart(address);
+  uword end = address + size;
+  uword card = Utils::RoundDown(address, kCardSize) + kCardSize;
+  for (; card + kCardSize <= end; card += kCardSize) {
+    *GetPageTable(card)->GetObjectStart(CardIndex(card)) = kNoObjectStart;
+  }
+  // The object following the free memory is the first one in its card.
+  if (card < end) {
+    *GetPageTable(end)->GetObjectStart(CardIndex(end)) = CardOffset(end);
+  }
+}
+
+uword ObjectMemory::FindFirstObjectStart(uword card) {
+  ASSERT(Utils::IsAligned(card, kCardSize));
+  uint8 offset = *GetPageTable(card)->GetObjectStart(CardIndex(card));
+  if (offset == kNoObjectStart) return 0;
+  return card + (offset << kPointerSizeLog2);
+}
+
+int ObjectMemory::GetAge(uword address) {
+  return *GetPageTable(address)->GetAge(CardIndex(address));
+}
+
+void ObjectMemory::SetAge(uword start, uword end, int age) {
+  ASSERT(Utils::IsAligned(start, kCardSize));
+  ASSERT(Utils::IsAligned(end, kCardSize));
+  for (uword card = start; card < end; card += kCardSize) {
+    *GetPageTable(card)->GetAge(CardIndex(card)) = age;
+  }
+}
+
+void* ObjectMemory::page_directories() {
+#ifdef DARTINO32
+  return &page_directory_;
+#else
+  return page_directories_;
+#endif
+}
+
 bool ObjectMemory::IsAddressInSpace(uword address, const Space* space) {
   PageTable* table = GetPageTable(address);
   return (table != NULL) ? table->Get((address >> 12) & 0x3ff) == space : false;
@@ -335,6 +605,12 @@ void OldSpace::RebuildAfterTransformations() {
         current += object->Size();
       }
     }
+    // The pointers to the transformed instances were updated without the
+    // write barrier.
+    for (uword card = chunk->base(); card < chunk->limit();
+         card += ObjectMemory::kCardSize) {
+      ObjectMemory::DirtyCard(card);
+    }
   }
 }
 
@@ -8,6 +8,8 @@
 #include "src/shared/globals.h"
 #include "src/shared/platform.h"
 #include "src/shared/utils.h"
+#include "src/vm/spinlock.h"
+#include "src/vm/vector.h"
 
 namespace dartino {
 
@@ -17,8 +19,10 @@ class HeapObject;
 class HeapObjectVisitor;
 class PointerVisitor;
 class ProgramHeapRelocator;
-class PromotedTrack;
 class Space;
+class VirtualMemory;
+template <typename T>
+class Vector;
 
 const int kPageSize = 4 * KB;
 
@@ -43,18 +47,14 @@ class Chunk {
   // Is the chunk externally allocated by the embedder.
   bool is_external() const { return external_; }
 
+  // Does the chunk hold a single large object of the old space.
+  bool is_large_object() const { return large_object_; }
+
   // Test for inclusion.
   bool Includes(uword address) const {
     return (address >= base()) && (address < limit());
   }
 
-  void set_scavenge_pointer(uword p) {
-    ASSERT(p >= base_);
-    ASSERT(p <= limit_);
-    scavenge_pointer_ = p;
-  }
-  uword scavenge_pointer() const { return scavenge_pointer_; }
-
 #ifdef DEBUG
   // Fill the space with garbage.
   void Scramble();
@@ -68,17 +68,31 @@ class Chunk {
   const uword base_;
   const uword limit_;
   const bool external_;
-  uword scavenge_pointer_;
+
+  bool large_object_;
 
   Chunk* next_;
 
+  // Side mark bits, one bit per word. Only allocated for old-space chunks.
+  uword* mark_bits_;
+
+  // The mapping holding the memory, if the chunk has one of its own.
+  VirtualMemory* memory_;
+
+  // Is the memory from the chunk pool, which takes it back when the chunk is
+  // freed.
+  bool pooled_;
+
   Chunk(Space* owner, uword base, uword size, bool external = false)
       : owner_(owner),
         base_(base),
         limit_(base + size),
         external_(external),
-        scavenge_pointer_(base_),
-        next_(NULL) {}
+        large_object_(false),
+        next_(NULL),
+        mark_bits_(NULL),
+        memory_(NULL),
+        pooled_(false) {}
 
   ~Chunk();
 
@@ -86,6 +100,7 @@ class Chunk {
   void set_owner(Space* value) { owner_ = value; }
 
   friend class ObjectMemory;
+  friend class OldSpace;
   friend class PageTable;
   friend class Space;
   friend class SemiSpace;
@@ -131,6 +146,9 @@ class Space {
   // Iterate over all objects in this space.
   void IterateObjects(HeapObjectVisitor* visitor);
 
+  // Clear the side mark bits of all chunks before a marking.
+  void ClearMarkBits();
+
   // Schema change support.
   void CompleteTransformations(PointerVisitor* visitor);
 
@@ -229,14 +247,18 @@ class SemiSpace : public Space {
   // allocation top.
   void TryDealloc(uword location, int size);
 
+  // Gives back memory that was allocated but not used for objects. Unless
+  // it is at the allocation top, it is left as a filler object.
+  void Deallocate(uword location, int size);
+
+  // Leaves unused memory as a filler object, so the space can still be
+  // iterated.
+  static void Fill(uword location, int size);
+
   // For the program semispaces.  There is no other space into which we
   // promote, so it does all work in one go.
   void CompleteScavenge(PointerVisitor* visitor);
 
-  // For the mutable heap.
-  void StartScavenge();
-  bool CompleteScavengeGenerational(PointerVisitor* visitor);
-
   void UpdateBaseAndLimit(Chunk* chunk, uword top);
 
   virtual void Append(Chunk* chunk);
@@ -259,7 +281,8 @@ class OldSpace : public Space {
 
   virtual bool IsAlive(HeapObject* old_location);
 
-  // OldSpace is currently non-moving, so it returns old_location.
+  // Only a compaction moves objects, so it returns old_location unless it
+  // has a forwarding address.
   virtual HeapObject* NewLocation(HeapObject* old_location);
 
   virtual int Used();
@@ -278,19 +301,95 @@ class OldSpace : public Space {
   // there is no room to allocate the object.
   uword Allocate(int size);
 
+  // Objects of this size or larger can be allocated in chunks of their own,
+  // which are never swept or compacted. The chunk is freed when a marking
+  // finds the object dead.
+  static const int kLargeObjectSize = 64 * KB;
+
+  // Allocate raw object in a chunk of its own. Returns 0 if a garbage
+  // collection is needed or if there is no memory for the chunk.
+  uword AllocateLargeObject(int size);
+
+  // Gives back memory that was allocated but not used for objects to the
+  // free list.
+  void Deallocate(uword location, int size);
+
   FreeList* free_list() const { return free_list_; }
 
-  // Find pointers to young-space.
-  void VisitRememberedSet(PointerVisitor* visitor);
+  // Cleans the dirty cards and adds the objects starting in them to
+  // [objects]. Used by the scavenger, which visits the objects while
+  // objects are promoted into the space.
+  void TakeRememberedSet(Vector<HeapObject*>* objects);
+
+  // While the old space is marked concurrently, objects promoted in the
+  // meantime are marked live.
+  void StartConcurrentMarking();
+  void EndConcurrentMarking();
+  bool is_marking_concurrently() const { return marking_concurrently_; }
+
+  // The size of the objects promoted while marking concurrently.
+  int promoted_live_bytes() const { return promoted_live_bytes_; }
+  void AddPromotedLiveBytes(int size) { promoted_live_bytes_ += size; }
+
+  // After a marking, the chunks are swept lazily: by the allocation slow
+  // path, and on the GC thread if -Xconcurrent_sweeping is set. Until a
+  // chunk is swept, its dead objects are only told apart by the mark bits.
+  void StartSweeping();
+
+  // Sweeps the next unswept chunk. Returns false if there is none, or if
+  // sweeping is paused. Can be called on any thread.
+  bool SweepNextChunk();
 
-  // For the objects promoted to the old space during scavenge.
-  void StartScavenge();
-  bool CompleteScavengeGenerational(PointerVisitor* visitor);
-  void EndScavenge();
+  // Sweeps the remaining chunks on the calling thread. Must be called before
+  // the mark bits are reused, and before dead objects would be visited.
+  void CompleteSweeping();
+
+  // Keeps the GC thread from sweeping while the space is scavenged.
+  void PauseSweeping();
+  void ResumeSweeping();
+
+  // True from [StartSweeping] until [CompleteSweeping].
+  bool is_sweeping() const { return sweeping_; }
+
+  // Set when a sweeping finds much of the space in chunks that are mostly
+  // free, and -Xcompaction is given.
+  bool needs_compaction() const { return needs_compaction_; }
+
+  // Moves the live objects out of the chunks that are mostly free into new
+  // chunks, and leaves forwarding addresses behind. Must be called between
+  // marking and sweeping. Returns false if no chunk was evacuated. Otherwise
+  // the pointers to the moved objects must be updated before the evacuated
+  // chunks are released with [ReleaseEvacuatedChunks].
+  bool EvacuateSparseChunks();
+  void ReleaseEvacuatedChunks();
+
+  // Visits the marked objects. Only used between marking and sweeping.
+  void IterateLiveObjects(HeapObjectVisitor* visitor);
 
  private:
+  // A chunk is sparse if at least this much of it is free.
+  static const int kSparseChunkFreePercent = 50;
+  // The space is compacted if this much of it is in sparse chunks.
+  static const int kCompactionSparsePercent = 25;
+
   Chunk* AllocateAndUseChunk(size_t size);
 
+  // Frees the chunks of the large objects that were not marked.
+  void ReleaseDeadLargeObjects();
+
+  bool IsSparse(Chunk* chunk);
+  void MoveObject(HeapObject* object, int size);
+
+  // Cleans the dirty cards and visits the objects starting in them.
+  void IterateRememberedSet(HeapObjectVisitor* visitor);
+
+  // Returns the number of free bytes found.
+  int SweepChunk(Chunk* chunk, FreeList* free_list);
+
+  // Makes the memory swept so far available for allocation, sweeping a chunk
+  // if needed. Returns false if there is no more memory to be found.
+  bool SweepForAllocation();
+
   void SetAllocationPointForPrepend(SemiSpace* space);
 
   uword AllocateInNewChunk(int size);
@@ -298,8 +397,26 @@ class OldSpace : public Space {
   uword AllocateFromFreeList(int size);
 
   FreeList* free_list_;  // Free list structure.
-  bool tracking_allocations_;
-  PromotedTrack* promoted_track_;
+  bool marking_concurrently_;
+  int promoted_live_bytes_;
+  bool sweeping_;
+
+  // Protects the sweeping state below. The chunks from [unswept_] to
+  // [last_unswept_] have not been swept yet. The free memory found by
+  // sweeping is collected in [swept_free_list_] until the allocator takes
+  // it.
+  Monitor* const sweep_monitor_;
+  Chunk* unswept_;
+  Chunk* last_unswept_;
+  FreeList* swept_free_list_;
+  int sweeping_threads_;
+  bool sweeping_paused_;
+
+  // The sizes of the chunks swept so far, and of those that were sparse.
+  int swept_size_;
+  int sparse_size_;
+  bool needs_compaction_;
+  Chunk* evacuated_;
 };
 
 class NoAllocationFailureScope {
@@ -316,8 +433,18 @@ class NoAllocationFailureScope {
 
 class PageTable {
  public:
+  // The cards of the pages in a table, indexed by address bits 9 to 21.
+  static const int kCardsPerTable = 1 << 13;
+  // The cards are dirtied by the write barrier in the generated interpreter.
+  static const int kCardsOffset = 2 * (1 << 10) * kPointerSize;
+
   explicit PageTable(uword base) : base_(base) {
+    static_assert(kCardsOffset == offsetof(PageTable, cards_), "cards");
     memset(spaces_, 0, kPointerSize * ARRAY_SIZE(spaces_));
+    memset(mark_bits_, 0, kPointerSize * ARRAY_SIZE(mark_bits_));
+    memset(cards_, 0, sizeof(cards_));
+    memset(object_starts_, 0, sizeof(object_starts_));
+    memset(ages_, 0, sizeof(ages_));
   }
 
   uword base() const { return base_; }
@@ -325,8 +452,23 @@ class PageTable {
   Space* Get(int index) const { return spaces_[index]; }
   void Set(int index, Space* space) { spaces_[index] = space; }
 
+  uword* GetMarkBits(int index) const { return mark_bits_[index]; }
+  void SetMarkBits(int index, uword* bits) { mark_bits_[index] = bits; }
+
+  uint8* GetCard(int index) { return &cards_[index]; }
+  uint8* GetObjectStart(int index) { return &object_starts_[index]; }
+  uint8* GetAge(int index) { return &ages_[index]; }
+
  private:
   Space* spaces_[1 << 10];
+  uword* mark_bits_[1 << 10];
+  uint8 cards_[kCardsPerTable];
+  // For each card, the offset in words of the first object starting in the
+  // card.
+  uint8 object_starts_[kCardsPerTable];
+  // For each card of the new space, the number of scavenges its objects
+  // have survived.
+  uint8 ages_[kCardsPerTable];
   uword base_;
 };
 
@@ -346,6 +488,52 @@ class PageDirectory {
 #endif
 };
 
+// Hands out page-aligned memory for chunks from one reserved range of
+// address space. Freed memory stays committed, up to a limit, and is reused
+// by the next allocation of the same size, so the new space that is replaced
+// on every scavenge doesn't go through malloc. Beyond the limit, the memory
+// is decommitted and its address space reused.
+class ChunkPool {
+ public:
+  ChunkPool(int reservation_size, int pooled_limit);
+
+  bool IsReserved() const { return reservation_.IsReserved(); }
+
+  bool Includes(uword address) const {
+    return IsReserved() && address >= reservation_.address() &&
+           address < reservation_.address() + reservation_.size();
+  }
+
+  // Returns the base of [size] committed bytes, or 0 if the reservation is
+  // exhausted.
+  uword Allocate(int size);
+  void Free(uword base, int size);
+
+  // The bytes of freed memory kept committed.
+  uword pooled_size() const { return pooled_size_; }
+
+ private:
+  struct Range {
+    uword base;
+    uword size;
+  };
+
+  // Adds the decommitted [range] to the sorted free ranges, merging it with
+  // its neighbors.
+  void AddFreeRange(Range range);
+
+  Spinlock lock_;
+  VirtualMemory reservation_;
+  const uword pooled_limit_;
+  // The offset of the address space never handed out.
+  uword top_;
+  // Committed, oldest first.
+  Vector<Range> pooled_;
+  uword pooled_size_;
+  // Decommitted, sorted by address.
+  Vector<Range> free_;
+};
+
 // ObjectMemory controls all memory used by object heaps.
 class ObjectMemory {
  public:
@@ -354,6 +542,11 @@ class ObjectMemory {
   // to a page boundary.
   static Chunk* AllocateChunk(Space* space, int size);
 
+  // Allocate a chunk in a mapping of its own, which is unmapped when the
+  // chunk is freed. Falls back to AllocateChunk where mappings are not
+  // supported.
+  static Chunk* AllocateMappedChunk(Space* space, int size);
+
   // Create a chunk for a piece of external memory (usually in flash). Since
   // this memory is external and potentially read-only, we will not free
   // nor write to it when deleting the space it belongs to.
@@ -390,6 +583,46 @@ class ObjectMemory {
   // 64-bit: [ 16: zeros | 13: directory | 13: table | 10 space | 12: zeros ]
   static bool IsAddressInSpace(uword address, const Space* space);
 
+  // Side mark bits for the objects in a chunk. The bit for an object is
+  // found through the page tables, like its space.
+  static void AllocateMarkBits(Chunk* chunk);
+  // Allocates the mark bits if the chunk does not have any yet.
+  static void ClearMarkBits(Chunk* chunk);
+  static bool IsMarkBitSet(uword address);
+  // Atomically sets the mark bit for [address]. Returns false if it was
+  // already set.
+  static bool TrySetMarkBit(uword address);
+
+  // Card marking for the remembered set. The write barrier dirties the card
+  // holding the header of an object when a heap object is stored in it, and
+  // a scavenge only visits the old-space objects starting in dirty cards.
+  static const int kCardSizeLog2 = 9;
+  static const int kCardSize = 1 << kCardSizeLog2;
+  static const uint8 kCleanCard = 0;
+  static const uint8 kDirtyCard = 1;
+
+  static uint8* GetCard(uword address);
+  static void DirtyCard(uword address) { *GetCard(address) = kDirtyCard; }
+
+  // To find the objects of a card, the old space records where objects
+  // start. Memory that becomes free no longer has the objects that started
+  // in it, so the free block is recorded instead.
+  static void RecordObjectStart(uword address);
+  static void RecordFreeMemory(uword address, uword size);
+
+  // Returns the first object starting in [card], or 0 if there is none.
+  static uword FindFirstObjectStart(uword card);
+
+  // The age of a new-space object is the number of scavenges it has
+  // survived. It is kept per card: the scavenger copies the survivors of
+  // each age into cards of their own, and the cards of new chunks are age 0.
+  static int GetAge(uword address);
+  // Sets the age of the cards in [start, end), which must be card aligned.
+  static void SetAge(uword start, uword end, int age);
+
+  // The root of the page tables, read by the generated interpreter.
+  static void* page_directories();
+
   // Setup and tear-down support.
   static void Setup();
   static void TearDown();
@@ -405,6 +638,9 @@ class ObjectMemory {
   // Associate a range of pages with a given space.
   static void SetSpaceForPages(uword base, uword limit, Space* space);
 
+  static void SetMarkBitsForPages(Chunk* chunk, uword* bits);
+  static uword* GetMarkBitWord(uword address, uword* mask);
+
 #ifdef DARTINO32
   static PageDirectory page_directory_;
 #else
@@ -412,6 +648,12 @@ class ObjectMemory {
 #endif
   static Mutex* mutex_;  // Mutex used for synchronized chunk allocation.
 
+  // The chunk memory is taken from the pool when there is one, which is on
+  // 64-bit POSIX systems.
+  static const int kChunkReservationSize = 1 << 30;
+  static const int kMaximumPooledSize = 8 * MB;
+  static ChunkPool* chunk_pool_;
+
   static Atomic<uword> allocated_;
 
   friend class Space;
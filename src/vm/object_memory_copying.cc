@@ -34,6 +34,7 @@ SemiSpace::SemiSpace(int maximum_initial_size) : Space(maximum_initial_size) {
     int size = Utils::Minimum(maximum_initial_size, kDefaultMaximumChunkSize);
     Chunk* chunk = ObjectMemory::AllocateChunk(this, size);
     if (chunk == NULL) FATAL1("Failed to allocate %d bytes.\n", size);
+    ObjectMemory::SetAge(chunk->base(), chunk->limit(), 0);
     Append(chunk);
     UpdateBaseAndLimit(chunk, chunk->base());
   }
@@ -121,6 +122,8 @@ uword SemiSpace::AllocateInNewChunk(int size, bool fatal) {
 
   Chunk* chunk = ObjectMemory::AllocateChunk(this, chunk_size);
   if (chunk != NULL) {
+    // The memory may have held survivors when it was last used.
+    ObjectMemory::SetAge(chunk->base(), chunk->limit(), 0);
     // Link it into the space.
     Append(chunk);
 
@@ -153,30 +156,35 @@ void SemiSpace::TryDealloc(uword location, int size) {
   if (top_ == location) top_ -= size;
 }
 
-int SemiSpace::Used() {
-  if (is_empty()) return used_;
-  return used_ + (top() - last()->base());
+void SemiSpace::Deallocate(uword location, int size) {
+  if (size == 0) return;
+  if (location + size == top_) {
+    top_ = location;
+    WriteSentinelAt(top_);
+    return;
+  }
+  Fill(location, size);
 }
 
-// Called multiple times until there is no more work.  Finds objects moved to
-// the to-space and traverses them to find and fix more new-space pointers.
-bool SemiSpace::CompleteScavengeGenerational(PointerVisitor* visitor) {
-  bool found_work = false;
-
-  for (Chunk* chunk = first(); chunk != NULL; chunk = chunk->next()) {
-    uword current = chunk->scavenge_pointer();
-    while (!HasSentinelAt(current)) {
-      found_work = true;
-      HeapObject* object = HeapObject::FromAddress(current);
-      object->IteratePointers(visitor);
-
-      current += object->Size();
+void SemiSpace::Fill(uword location, int size) {
+  if (size == 0) return;
+  if (size < FreeListChunk::kSize) {
+    Object** filler = reinterpret_cast<Object**>(location);
+    for (int i = 0; i * kPointerSize < size; i++) {
+      filler[i] = StaticClassStructures::one_word_filler_class();
     }
-    // Set up the already-scanned pointer for next round.
-    chunk->set_scavenge_pointer(current);
+    return;
   }
+  FreeListChunk* filler =
+      reinterpret_cast<FreeListChunk*>(HeapObject::FromAddress(location));
+  filler->set_class(StaticClassStructures::free_list_chunk_class());
+  filler->set_size(size);
+  filler->set_next_chunk(NULL);
+}
 
-  return found_work;
+int SemiSpace::Used() {
+  if (is_empty()) return used_;
+  return used_ + (top() - last()->base());
 }
 
 }  // namespace dartino
@@ -2,18 +2,26 @@
 // for details. All rights reserved. Use of this source code is governed by a
 // BSD-style license that can be found in the LICENSE.md file.
 // Mark-sweep old-space.
-// * Uses worst-fit free-list allocation to get big chunks for fast bump
-//   allocation.
-// * Non-moving for now.
-// * Has on-heap chained data structure keeping track of
-//   promoted-and-not-yet-scanned areas.  This is called PromotedTrack.
-// * No remembered set yet.  When scavenging we have to scan all of old space.
-//   We skip PromotedTrack areas because we know we will get to them later and
-//   they contain uninitialized memory.
+// * Bump allocates in free-list chunks. Small chunks are kept in exact size
+//   classes and large ones are allocated best-fit, so allocating rarely
+//   splits a large chunk.
+// * Non-moving, except for an optional compaction that evacuates the chunks
+//   that are mostly free after sweeping.
+// * Large objects get chunks of their own, which are freed as soon as the
+//   objects are found dead instead of being swept.
+// * The remembered set is a card table.  When scavenging we scan the objects
+//   starting in dirty cards.  They are collected before anything is promoted,
+//   so the promoted objects are only scanned by the scavenger that copied
+//   them.
 
+#include <string.h>
+
+#include "src/shared/flags.h"
+#include "src/vm/heap.h"
 #include "src/vm/mark_sweep.h"
 #include "src/vm/object_memory.h"
 #include "src/vm/object.h"
+#include "src/vm/vector.h"
 
 namespace dartino {
 
@@ -28,8 +36,19 @@ static bool HasSentinelAt(uword address) {
 OldSpace::OldSpace(int maximum_initial_size)
     : Space(maximum_initial_size),
       free_list_(new FreeList()),
-      tracking_allocations_(false),
-      promoted_track_(NULL) {
+      marking_concurrently_(false),
+      promoted_live_bytes_(0),
+      sweeping_(false),
+      sweep_monitor_(Platform::CreateMonitor()),
+      unswept_(NULL),
+      last_unswept_(NULL),
+      swept_free_list_(new FreeList()),
+      sweeping_threads_(0),
+      sweeping_paused_(false),
+      swept_size_(0),
+      sparse_size_(0),
+      needs_compaction_(false),
+      evacuated_(NULL) {
   if (maximum_initial_size > 0) {
     int size = Utils::Minimum(maximum_initial_size, kDefaultMaximumChunkSize);
     Chunk* chunk = AllocateAndUseChunk(size);
@@ -37,20 +56,18 @@ OldSpace::OldSpace(int maximum_initial_size)
   }
 }
 
-OldSpace::~OldSpace() { delete free_list_; }
+OldSpace::~OldSpace() {
+  ASSERT(sweeping_threads_ == 0);
+  ASSERT(evacuated_ == NULL);
+  delete free_list_;
+  delete swept_free_list_;
+  delete sweep_monitor_;
+}
 
 void OldSpace::Flush() {
   if (top_ != 0) {
     uword free_size = limit_ - top_;
     free_list_->AddChunk(top_, free_size);
-    if (tracking_allocations_ && promoted_track_ != NULL) {
-      // The latest promoted_track_ entry is set to cover the entire
-      // current allocation area, so that we skip it when traversing the
-      // stack.  Reset it to cover only the bit we actually used.
-      ASSERT(promoted_track_ != NULL);
-      ASSERT(promoted_track_->end() >= top_);
-      promoted_track_->set_end(top_);
-    }
     top_ = 0;
     limit_ = 0;
     used_ -= free_size;
@@ -60,28 +77,29 @@ void OldSpace::Flush() {
 
 HeapObject* OldSpace::NewLocation(HeapObject* old_location) {
   ASSERT(Includes(old_location->address()));
-  ASSERT(old_location->IsMarked());
+  ASSERT(IsAlive(old_location));
+  if (old_location->HasForwardingAddress()) {
+    return old_location->forwarding_address();
+  }
   return old_location;
 }
 
 bool OldSpace::IsAlive(HeapObject* old_location) {
   ASSERT(Includes(old_location->address()));
-  return old_location->IsMarked();
+  return ObjectMemory::IsMarkBitSet(old_location->address());
 }
 
 Chunk* OldSpace::AllocateAndUseChunk(size_t size) {
   Chunk* chunk = ObjectMemory::AllocateChunk(this, size);
   if (chunk != NULL) {
+    ObjectMemory::AllocateMarkBits(chunk);
+    // Forget the objects recorded when the memory was last used.
+    ObjectMemory::RecordFreeMemory(chunk->base(), chunk->size());
     // Link it into the space.
     Append(chunk);
     top_ = chunk->base();
     limit_ = top_ + chunk->size() - kPointerSize;
     *reinterpret_cast<Object**>(limit_) = chunk_end_sentinel();
-    if (tracking_allocations_) {
-      promoted_track_ =
-          PromotedTrack::Initialize(promoted_track_, top_, limit_);
-      top_ += PromotedTrack::kHeaderSize;
-    }
     // Account all of the chunk memory as used for now. When the
     // rest of the freelist chunk is flushed into the freelist we
     // decrement used_ by the amount still left unused. used_
@@ -95,12 +113,10 @@ Chunk* OldSpace::AllocateAndUseChunk(size_t size) {
 uword OldSpace::AllocateInNewChunk(int size) {
   ASSERT(top_ == 0);  // Space is flushed.
   // Allocate new chunk that is big enough to fit the object.
-  int tracking_size = tracking_allocations_ ? 0 : PromotedTrack::kHeaderSize;
   int default_chunk_size = DefaultChunkSize(Used());
-  int chunk_size =
-      (size + tracking_size + kPointerSize >= default_chunk_size)
-          ? (size + tracking_size + kPointerSize)  // Make room for sentinel.
-          : default_chunk_size;
+  int chunk_size = (size + kPointerSize >= default_chunk_size)
+                       ? (size + kPointerSize)  // Make room for sentinel.
+                       : default_chunk_size;
 
   Chunk* chunk = AllocateAndUseChunk(chunk_size);
   if (chunk != NULL) {
@@ -115,8 +131,10 @@ uword OldSpace::AllocateFromFreeList(int size) {
   // Flush the rest of the active chunk into the free list.
   Flush();
 
-  FreeListChunk* chunk = free_list_->GetChunk(
-      tracking_allocations_ ? size + PromotedTrack::kHeaderSize : size);
+  FreeListChunk* chunk = free_list_->GetChunk(size);
+  while (chunk == NULL && SweepForAllocation()) {
+    chunk = free_list_->GetChunk(size);
+  }
   if (chunk != NULL) {
     top_ = chunk->address();
     limit_ = top_ + chunk->size();
@@ -124,14 +142,8 @@ uword OldSpace::AllocateFromFreeList(int size) {
     // rest of the freelist chunk is flushed into the freelist we
     // decrement used_ by the amount still left unused. used_
     // therefore reflects actual memory usage after Flush has been
-    // called.  (Do this before the tracking info below overwrites
-    // the free chunk's data.)
+    // called.
     used_ += chunk->size();
-    if (tracking_allocations_) {
-      promoted_track_ =
-          PromotedTrack::Initialize(promoted_track_, top_, limit_);
-      top_ += PromotedTrack::kHeaderSize;
-    }
     ASSERT(static_cast<unsigned>(size) <= limit_ - top_);
     return Allocate(size);
   } else {
@@ -154,6 +166,7 @@ uword OldSpace::Allocate(int size) {
     uword result = top_;
     top_ += size;
     allocation_budget_ -= size;
+    ObjectMemory::RecordObjectStart(result);
     return result;
   }
 
@@ -161,76 +174,296 @@ uword OldSpace::Allocate(int size) {
   return AllocateFromFreeList(size);
 }
 
-int OldSpace::Used() { return used_; }
+uword OldSpace::AllocateLargeObject(int size) {
+  ASSERT(size >= kLargeObjectSize);
+  ASSERT(Utils::IsAligned(size, kPointerSize));
+  if (!in_no_allocation_failure_scope() && needs_garbage_collection()) {
+    return 0;
+  }
 
-void OldSpace::StartScavenge() {
-  Flush();
-  ASSERT(!tracking_allocations_);
-  ASSERT(promoted_track_ == NULL);
-  tracking_allocations_ = true;
+  // Make room for the sentinel.
+  Chunk* chunk = ObjectMemory::AllocateMappedChunk(this, size + kPointerSize);
+  if (chunk == NULL) return 0;
+  chunk->large_object_ = true;
+  ObjectMemory::AllocateMarkBits(chunk);
+  ObjectMemory::RecordFreeMemory(chunk->base(), chunk->size());
+  uword result = chunk->base();
+  *reinterpret_cast<Object**>(result + size) = chunk_end_sentinel();
+  Append(chunk);
+  used_ += size;
+  allocation_budget_ -= size;
+  ObjectMemory::RecordObjectStart(result);
+  return result;
 }
 
-void OldSpace::EndScavenge() {
-  ASSERT(tracking_allocations_);
-  ASSERT(promoted_track_ == NULL);
-  tracking_allocations_ = false;
+int OldSpace::Used() { return used_; }
+
+void OldSpace::Deallocate(uword location, int size) {
+  if (size == 0) return;
+  free_list_->AddChunk(location, size);
+  used_ -= size;
+  allocation_budget_ += size;
 }
 
-// Currently there is no remembered set, so we scan the entire old space,
-// skipping only the areas where newly promoted objects are.
-void OldSpace::VisitRememberedSet(PointerVisitor* visitor) {
+// Skips the dead objects in chunks that have not been swept yet.
+void OldSpace::IterateRememberedSet(HeapObjectVisitor* visitor) {
   Flush();
+  ASSERT(sweeping_paused_ && sweeping_threads_ == 0);
+  const int kCardsPerPage = kPageSize / ObjectMemory::kCardSize;
+  static_assert(kCardsPerPage == sizeof(uint64), "cards per page");
+  bool in_unswept_chunk = false;
   for (Chunk* chunk = first(); chunk != NULL; chunk = chunk->next()) {
-    uword current = chunk->base();
-    while (!HasSentinelAt(current)) {
-      HeapObject* object = HeapObject::FromAddress(current);
-      // Newly promoted objects are automatically skipped, because they
-      // are protected by a PromotedTrack object.
-      InstanceFormat format = object->IteratePointers(visitor);
-      if (!format.has_variable_part()) {
-        current += format.fixed_size();
-      } else {
-        current += object->Size();
+    if (chunk == unswept_) in_unswept_chunk = true;
+    for (uword page = chunk->base(); page < chunk->limit();
+         page += kPageSize) {
+      // The cards of a page are consecutive, so clean pages are skipped
+      // with a single load.
+      uint8* cards = ObjectMemory::GetCard(page);
+      if (*reinterpret_cast<uint64*>(cards) == 0) continue;
+      for (int i = 0; i < kCardsPerPage; i++) {
+        if (cards[i] == ObjectMemory::kCleanCard) continue;
+        cards[i] = ObjectMemory::kCleanCard;
+        uword card = page + i * ObjectMemory::kCardSize;
+        uword current = ObjectMemory::FindFirstObjectStart(card);
+        if (current == 0) continue;
+        uword card_end = card + ObjectMemory::kCardSize;
+        while (current < card_end && !HasSentinelAt(current)) {
+          HeapObject* object = HeapObject::FromAddress(current);
+          // The pointers in dead objects may point to new-space objects that
+          // are gone.
+          if (!in_unswept_chunk || ObjectMemory::IsMarkBitSet(current)) {
+            current += visitor->Visit(object);
+          } else {
+            current += object->Size();
+          }
+        }
       }
     }
+    if (chunk == last_unswept_) in_unswept_chunk = false;
   }
 }
 
-// Called multiple times until there is no more work.  Finds objects moved to
-// the old-space and traverses them to find and fix more new-space pointers.
-bool OldSpace::CompleteScavengeGenerational(PointerVisitor* visitor) {
-  Flush();
-  ASSERT(tracking_allocations_);
-
-  bool found_work = false;
-  PromotedTrack* promoted = promoted_track_;
-  // Unlink the promoted tracking list.  Any new promotions go on a new chain,
-  // from now on, which will be handled in the next round.
-  promoted_track_ = NULL;
-
-  while (promoted) {
-    uword traverse = promoted->start();
-    uword end = promoted->end();
-    if (traverse != end) {
-      found_work = true;
+class RememberedSetCollector : public HeapObjectVisitor {
+ public:
+  explicit RememberedSetCollector(Vector<HeapObject*>* objects)
+      : objects_(objects) {}
+
+  virtual int Visit(HeapObject* object) {
+    // Free memory may be allocated by the time the objects are visited.
+    int type = object->format().type();
+    if (type != InstanceFormat::FREE_LIST_CHUNK_TYPE &&
+        type != InstanceFormat::ONE_WORD_FILLER_TYPE) {
+      objects_->PushBack(object);
     }
-    for (HeapObject *obj = HeapObject::FromAddress(traverse); traverse != end;
-         traverse += obj->Size(), obj = HeapObject::FromAddress(traverse)) {
-      obj->IteratePointers(visitor);
+    return object->Size();
+  }
+
+ private:
+  Vector<HeapObject*>* objects_;
+};
+
+void OldSpace::TakeRememberedSet(Vector<HeapObject*>* objects) {
+  RememberedSetCollector collector(objects);
+  IterateRememberedSet(&collector);
+}
+
+void OldSpace::StartConcurrentMarking() {
+  ASSERT(!marking_concurrently_);
+  ASSERT(!is_sweeping());
+  ClearMarkBits();
+  promoted_live_bytes_ = 0;
+  marking_concurrently_ = true;
+}
+
+void OldSpace::EndConcurrentMarking() {
+  ASSERT(marking_concurrently_);
+  marking_concurrently_ = false;
+}
+
+void OldSpace::StartSweeping() {
+  ASSERT(!is_sweeping());
+  ReleaseDeadLargeObjects();
+  // All free memory is found again by sweeping.
+  Flush();
+  free_list_->Clear();
+  sweeping_ = true;
+  ScopedMonitorLock locker(sweep_monitor_);
+  ASSERT(sweeping_threads_ == 0);
+  swept_free_list_->Clear();
+  unswept_ = first();
+  last_unswept_ = last();
+  swept_size_ = 0;
+  sparse_size_ = 0;
+}
+
+bool OldSpace::SweepNextChunk() {
+  Chunk* chunk;
+  {
+    ScopedMonitorLock locker(sweep_monitor_);
+    if (sweeping_paused_ || unswept_ == NULL) return false;
+    chunk = unswept_;
+    unswept_ = (chunk == last_unswept_) ? NULL : chunk->next();
+    sweeping_threads_++;
+  }
+  FreeList free_list;
+  int free_bytes = SweepChunk(chunk, &free_list);
+  ScopedMonitorLock locker(sweep_monitor_);
+  swept_free_list_->Merge(&free_list);
+  int size = chunk->size();
+  swept_size_ += size;
+  if (free_bytes >= size / 100 * kSparseChunkFreePercent) sparse_size_ += size;
+  if (--sweeping_threads_ == 0) sweep_monitor_->NotifyAll();
+  return true;
+}
+
+void OldSpace::CompleteSweeping() {
+  if (!sweeping_) return;
+  ASSERT(!sweeping_paused_);
+  while (SweepNextChunk()) {
+  }
+  ScopedMonitorLock locker(sweep_monitor_);
+  while (sweeping_threads_ > 0) sweep_monitor_->Wait();
+  free_list_->Merge(swept_free_list_);
+  swept_free_list_->Clear();
+  sweeping_ = false;
+  needs_compaction_ =
+      Flags::compaction &&
+      sparse_size_ >= swept_size_ / 100 * kCompactionSparsePercent &&
+      sparse_size_ > 0;
+}
+
+void OldSpace::PauseSweeping() {
+  ScopedMonitorLock locker(sweep_monitor_);
+  sweeping_paused_ = true;
+  while (sweeping_threads_ > 0) sweep_monitor_->Wait();
+}
+
+void OldSpace::ResumeSweeping() {
+  ScopedMonitorLock locker(sweep_monitor_);
+  sweeping_paused_ = false;
+}
+
+int OldSpace::SweepChunk(Chunk* chunk, FreeList* free_list) {
+  SweepingVisitor visitor(free_list);
+  uword current = chunk->base();
+  while (!HasSentinelAt(current)) {
+    current += visitor.Visit(HeapObject::FromAddress(current));
+  }
+  visitor.ChunkEnd(current);
+  return visitor.free_bytes();
+}
+
+void OldSpace::ReleaseDeadLargeObjects() {
+  Chunk* chunk = first();
+  first_ = last_ = NULL;
+  while (chunk != NULL) {
+    Chunk* next = chunk->next();
+    if (chunk->is_large_object() &&
+        !ObjectMemory::IsMarkBitSet(chunk->base())) {
+      ObjectMemory::FreeChunk(chunk);
+    } else {
+      Append(chunk);
     }
-    PromotedTrack* previous = promoted;
-    promoted = promoted->next();
-    previous->Zap(StaticClassStructures::one_word_filler_class());
+    chunk = next;
   }
-  return found_work;
 }
 
-void SemiSpace::StartScavenge() {
+bool OldSpace::IsSparse(Chunk* chunk) {
+  uword live = 0;
+  uword current = chunk->base();
+  while (!HasSentinelAt(current)) {
+    int size = HeapObject::FromAddress(current)->Size();
+    if (ObjectMemory::IsMarkBitSet(current)) live += size;
+    current += size;
+  }
+  return live <= chunk->size() / 100 * (100 - kSparseChunkFreePercent);
+}
+
+bool OldSpace::EvacuateSparseChunks() {
+  ASSERT(!is_sweeping());
+  ASSERT(evacuated_ == NULL);
+  needs_compaction_ = false;
+  Flush();
+  Chunk* chunk = first();
+  first_ = last_ = NULL;
+  while (chunk != NULL) {
+    Chunk* next = chunk->next();
+    if (!chunk->is_large_object() && IsSparse(chunk)) {
+      chunk->set_next(evacuated_);
+      evacuated_ = chunk;
+    } else {
+      Append(chunk);
+    }
+    chunk = next;
+  }
+  if (evacuated_ == NULL) return false;
+
+  // The free lists hold memory in the evacuated chunks, so the objects are
+  // moved to new chunks. The free memory of the other chunks is found again
+  // by the sweeping that follows.
+  free_list_->Clear();
+  NoAllocationFailureScope scope(this);
+  for (chunk = evacuated_; chunk != NULL; chunk = chunk->next()) {
+    uword current = chunk->base();
+    while (!HasSentinelAt(current)) {
+      HeapObject* object = HeapObject::FromAddress(current);
+      int size = object->Size();
+      if (ObjectMemory::IsMarkBitSet(current)) MoveObject(object, size);
+      current += size;
+    }
+  }
   Flush();
+  return true;
+}
+
+void OldSpace::MoveObject(HeapObject* object, int size) {
+  uword target = Allocate(size);
+  memcpy(reinterpret_cast<void*>(target),
+         reinterpret_cast<void*>(object->address()), size);
+  HeapObject* copy = HeapObject::FromAddress(target);
+  // The copy is swept like the objects that were not moved.
+  ObjectMemory::TrySetMarkBit(target);
+  // The current stack is kept in the remembered set.
+  if (object->IsStack()) {
+    Stack::cast(copy)->UpdateFramePointers(Stack::cast(object));
+    ObjectMemory::DirtyCard(target);
+  } else if (*ObjectMemory::GetCard(object->address()) ==
+             ObjectMemory::kDirtyCard) {
+    ObjectMemory::DirtyCard(target);
+  }
+  object->set_forwarding_address(copy);
+}
 
+void OldSpace::ReleaseEvacuatedChunks() {
+  while (evacuated_ != NULL) {
+    Chunk* next = evacuated_->next();
+    ObjectMemory::FreeChunk(evacuated_);
+    evacuated_ = next;
+  }
+}
+
+void OldSpace::IterateLiveObjects(HeapObjectVisitor* visitor) {
+  Flush();
   for (Chunk* chunk = first(); chunk != NULL; chunk = chunk->next()) {
-    chunk->set_scavenge_pointer(chunk->base());
+    uword current = chunk->base();
+    while (!HasSentinelAt(current)) {
+      HeapObject* object = HeapObject::FromAddress(current);
+      if (ObjectMemory::IsMarkBitSet(current)) {
+        current += visitor->Visit(object);
+      } else {
+        current += object->Size();
+      }
+    }
   }
 }
 
+bool OldSpace::SweepForAllocation() {
+  bool swept = SweepNextChunk();
+  ScopedMonitorLock locker(sweep_monitor_);
+  if (swept_free_list_->IsEmpty()) return swept;
+  free_list_->Merge(swept_free_list_);
+  swept_free_list_->Clear();
+  return true;
+}
+
 }  // namespace dartino
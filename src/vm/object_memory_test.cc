@@ -3,7 +3,9 @@
 // BSD-style license that can be found in the LICENSE.md file.
 
 #include "src/shared/assert.h"
+#include "src/shared/flags.h"
 #include "src/vm/heap.h"
+#include "src/vm/mark_sweep.h"
 #include "src/vm/object_memory.h"
 #include "src/shared/test_case.h"
 
@@ -38,4 +40,249 @@ TEST_CASE(ObjectMemory) {
   ObjectMemory::FreeChunk(second);
 }
 
+TEST_CASE(ObjectMemoryMarkBits) {
+  OldSpace space;
+  Chunk* chunk = ObjectMemory::AllocateChunk(&space, 3 * kPageSize);
+  ObjectMemory::AllocateMarkBits(chunk);
+
+  // Every word has its own mark bit, also across pages.
+  uword last = chunk->limit() - kPointerSize;
+  uword addresses[] = {chunk->base(), chunk->base() + kPointerSize,
+                       chunk->base() + kPageSize - kPointerSize,
+                       chunk->base() + kPageSize, last};
+  for (unsigned i = 0; i < ARRAY_SIZE(addresses); i++) {
+    EXPECT(!ObjectMemory::IsMarkBitSet(addresses[i]));
+    EXPECT(ObjectMemory::TrySetMarkBit(addresses[i]));
+    EXPECT(ObjectMemory::IsMarkBitSet(addresses[i]));
+    EXPECT(!ObjectMemory::TrySetMarkBit(addresses[i]));
+  }
+  EXPECT(!ObjectMemory::IsMarkBitSet(chunk->base() + 2 * kPointerSize));
+  EXPECT(!ObjectMemory::IsMarkBitSet(last - kPointerSize));
+
+  ObjectMemory::ClearMarkBits(chunk);
+  for (unsigned i = 0; i < ARRAY_SIZE(addresses); i++) {
+    EXPECT(!ObjectMemory::IsMarkBitSet(addresses[i]));
+  }
+
+  ObjectMemory::FreeChunk(chunk);
+}
+
+TEST_CASE(ObjectMemoryFreeList) {
+  OldSpace space;
+  Chunk* chunk = ObjectMemory::AllocateChunk(&space, 16 * KB);
+  FreeList free_list;
+  EXPECT(free_list.IsEmpty());
+  const uword kSizes[] = {4 * kPointerSize, 6 * kPointerSize, 600, 1 * KB,
+                          2 * KB};
+  uword chunks[ARRAY_SIZE(kSizes)];
+  uword current = chunk->base();
+  for (unsigned i = 0; i < ARRAY_SIZE(kSizes); i++) {
+    chunks[i] = current;
+    free_list.AddChunk(current, kSizes[i]);
+    current += kSizes[i];
+  }
+
+  // Small requests take the best fitting small chunk, and then the smallest
+  // large one. Large requests take the best fit.
+  EXPECT_EQ(chunks[0], free_list.GetChunk(4 * kPointerSize)->address());
+  EXPECT_EQ(chunks[1], free_list.GetChunk(5 * kPointerSize)->address());
+  EXPECT_EQ(chunks[2], free_list.GetChunk(5 * kPointerSize)->address());
+  EXPECT(free_list.GetChunk(4 * KB) == NULL);
+  EXPECT_EQ(chunks[3], free_list.GetChunk(700)->address());
+  EXPECT_EQ(chunks[4], free_list.GetChunk(1 * KB)->address());
+  EXPECT(free_list.IsEmpty());
+
+  ObjectMemory::FreeChunk(chunk);
+}
+
+static void InitializeFreeListChunk(uword address, int size) {
+  FreeListChunk* object =
+      reinterpret_cast<FreeListChunk*>(HeapObject::FromAddress(address));
+  object->set_class(StaticClassStructures::free_list_chunk_class());
+  object->set_size(size);
+}
+
+// Fills the first chunk of [space] with objects of [size] bytes and returns
+// their number.
+static int FillOldSpace(OldSpace* space, uword* objects, int size) {
+  int count = (Space::kDefaultMinimumChunkSize - kPointerSize) / size;
+  for (int i = 0; i < count; i++) {
+    objects[i] = space->Allocate(size);
+    InitializeFreeListChunk(objects[i], size);
+    if (i > 0) EXPECT_EQ(objects[i - 1] + size, objects[i]);
+  }
+  return count;
+}
+
+TEST_CASE(ObjectMemoryLazySweeping) {
+  OldSpace space;
+  NoAllocationFailureScope scope(&space);
+  const int kObjectSize = 4 * kPointerSize;
+  uword objects[Space::kDefaultMinimumChunkSize / kObjectSize];
+  int count = FillOldSpace(&space, objects, kObjectSize);
+
+  // Everything but ten objects in the middle survives the marking.
+  for (int i = 0; i < count; i++) {
+    if (i < 10 || i >= 20) EXPECT(ObjectMemory::TrySetMarkBit(objects[i]));
+  }
+  space.StartSweeping();
+  EXPECT(space.is_sweeping());
+
+  // Scavenges keep the allocations from sweeping.
+  space.PauseSweeping();
+  EXPECT(!space.SweepNextChunk());
+  space.ResumeSweeping();
+
+  // The allocation sweeps the chunk and reuses the dead objects.
+  EXPECT_EQ(objects[10], space.Allocate(10 * kObjectSize));
+  EXPECT(space.is_sweeping());
+  EXPECT(!space.SweepNextChunk());
+  space.CompleteSweeping();
+  EXPECT(!space.is_sweeping());
+}
+
+TEST_CASE(ObjectMemoryCardMarking) {
+  OldSpace space;
+  NoAllocationFailureScope scope(&space);
+  const int kCardSize = ObjectMemory::kCardSize;
+  // Objects of three quarters of a card start at varying offsets in them.
+  const int kObjectSize = 3 * kCardSize / 4;
+  uword objects[Space::kDefaultMinimumChunkSize / kObjectSize];
+  int count = FillOldSpace(&space, objects, kObjectSize);
+  EXPECT(count >= 9);
+  uword base = objects[0];
+  EXPECT(Utils::IsAligned(base, kCardSize));
+
+  for (int card = 0; card < 7; card++) {
+    uword start = base + card * kCardSize;
+    int index = (card * kCardSize + kObjectSize - 1) / kObjectSize;
+    EXPECT_EQ(objects[index], ObjectMemory::FindFirstObjectStart(start));
+  }
+
+  // The write barrier dirties the card of the object header only.
+  uword header = objects[3];
+  uword card = Utils::RoundDown(header, kCardSize);
+  *ObjectMemory::GetCard(card) = ObjectMemory::kCleanCard;
+  *ObjectMemory::GetCard(card + kCardSize) = ObjectMemory::kCleanCard;
+  ObjectMemory::DirtyCard(header);
+  EXPECT(*ObjectMemory::GetCard(card) == ObjectMemory::kDirtyCard);
+  EXPECT(*ObjectMemory::GetCard(card + kCardSize) == ObjectMemory::kCleanCard);
+
+  // The dead objects in the second to fourth card are swept into one free
+  // block. The cards inside it have no objects, and the card holding its end
+  // starts with the next live object.
+  for (int i = 0; i < count; i++) {
+    if (i < 2 || i >= 6) EXPECT(ObjectMemory::TrySetMarkBit(objects[i]));
+  }
+  space.StartSweeping();
+  space.CompleteSweeping();
+  EXPECT_EQ(objects[2], ObjectMemory::FindFirstObjectStart(base + kCardSize));
+  EXPECT(ObjectMemory::FindFirstObjectStart(base + 2 * kCardSize) == 0);
+  EXPECT(ObjectMemory::FindFirstObjectStart(base + 3 * kCardSize) == 0);
+  EXPECT_EQ(objects[6],
+            ObjectMemory::FindFirstObjectStart(base + 4 * kCardSize));
+}
+
+TEST_CASE(ObjectMemoryLargeObjects) {
+  OldSpace space;
+  NoAllocationFailureScope scope(&space);
+  const int kSize = OldSpace::kLargeObjectSize + 3 * kPointerSize;
+  uword live = space.AllocateLargeObject(kSize);
+  uword dead = space.AllocateLargeObject(kSize);
+  InitializeFreeListChunk(live, kSize);
+  InitializeFreeListChunk(dead, kSize);
+  EXPECT(Utils::IsAligned(live, kPageSize));
+  EXPECT(space.Includes(live + kSize - kPointerSize));
+  EXPECT_EQ(2 * kSize, space.Used());
+
+  // The chunk of the dead object is freed right away, and the live one is
+  // not swept into the free list.
+  EXPECT(ObjectMemory::TrySetMarkBit(live));
+  space.StartSweeping();
+  EXPECT(!space.Includes(dead));
+  space.CompleteSweeping();
+  uword small = space.Allocate(4 * kPointerSize);
+  EXPECT(small < live || small >= live + kSize);
+
+  RandomXorShift random;
+  Heap heap(&random, 4 * KB);
+  heap.EnableLargeObjectSpace();
+  Object* object = heap.Allocate(OldSpace::kLargeObjectSize);
+  EXPECT(heap.old_space()->Includes(HeapObject::cast(object)->address()));
+  object = heap.Allocate(OldSpace::kLargeObjectSize - kPointerSize);
+  EXPECT(heap.space()->Includes(HeapObject::cast(object)->address()));
+}
+
+TEST_CASE(ObjectMemoryCompaction) {
+  bool compaction = Flags::compaction;
+  Flags::compaction = true;
+  OldSpace space;
+  NoAllocationFailureScope scope(&space);
+  const int kObjectSize = 4 * kPointerSize;
+  uword objects[Space::kDefaultMinimumChunkSize / kObjectSize];
+  int count = FillOldSpace(&space, objects, kObjectSize);
+
+  // A sweeping that finds a mostly free chunk asks for a compaction.
+  for (int i = 0; i < count; i += 4) {
+    EXPECT(ObjectMemory::TrySetMarkBit(objects[i]));
+  }
+  space.StartSweeping();
+  space.CompleteSweeping();
+  EXPECT(space.needs_compaction());
+
+  // The marked objects are moved out of the chunk, and marked again.
+  space.ClearMarkBits();
+  for (int i = 0; i < count; i += 8) {
+    EXPECT(ObjectMemory::TrySetMarkBit(objects[i]));
+  }
+  EXPECT(space.EvacuateSparseChunks());
+  EXPECT(!space.needs_compaction());
+  for (int i = 0; i < count; i += 8) {
+    HeapObject* object = HeapObject::FromAddress(objects[i]);
+    EXPECT(object->HasForwardingAddress());
+    HeapObject* copy = object->forwarding_address();
+    EXPECT(space.Includes(copy->address()));
+    EXPECT(copy->address() < objects[0] ||
+           copy->address() >= objects[count - 1]);
+    EXPECT(ObjectMemory::IsMarkBitSet(copy->address()));
+    EXPECT_EQ(kObjectSize, copy->Size());
+  }
+  space.ReleaseEvacuatedChunks();
+  EXPECT(!space.Includes(objects[0]));
+  space.StartSweeping();
+  space.CompleteSweeping();
+  Flags::compaction = compaction;
+}
+
+#if defined(DARTINO_TARGET_OS_POSIX)
+TEST_CASE(ObjectMemoryChunkPool) {
+  ChunkPool pool(1 * MB, 2 * kPageSize);
+  EXPECT(pool.IsReserved());
+  uword first = pool.Allocate(kPageSize);
+  uword second = pool.Allocate(2 * kPageSize);
+  EXPECT(pool.Includes(first) && pool.Includes(second));
+  memset(reinterpret_cast<void*>(second), 0, 2 * kPageSize);
+
+  // Freed memory is reused by allocations of the same size.
+  pool.Free(first, kPageSize);
+  EXPECT(pool.pooled_size() == kPageSize);
+  EXPECT_EQ(first, pool.Allocate(kPageSize));
+  EXPECT(pool.pooled_size() == 0);
+
+  // Beyond the limit, the oldest memory is decommitted. Its address space is
+  // merged with its neighbors and reused.
+  pool.Free(first, kPageSize);
+  pool.Free(second, 2 * kPageSize);
+  EXPECT(pool.pooled_size() == 2 * kPageSize);
+  uword third = pool.Allocate(3 * kPageSize);
+  EXPECT(third > second);
+  pool.Free(third, 3 * kPageSize);
+  EXPECT(pool.pooled_size() == 0);
+  EXPECT_EQ(first, pool.Allocate(6 * kPageSize));
+
+  // Allocations fail when the reservation is used up.
+  EXPECT(pool.Allocate(1 * MB) == 0);
+}
+#endif
+
 }  // namespace dartino
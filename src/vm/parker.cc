@@ -0,0 +1,65 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/vm/parker.h"
+
+#if defined(DARTINO_TARGET_OS_LINUX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dartino {
+
+#if defined(DARTINO_TARGET_OS_LINUX)
+
+Parker::Parker() : state_(kEmpty) {}
+
+Parker::~Parker() {}
+
+void Parker::Park() {
+  int expected = kPermit;
+  if (state_.compare_exchange_strong(expected, kEmpty, kAcquire)) return;
+
+  expected = kEmpty;
+  if (state_.compare_exchange_strong(expected, kParked)) {
+    int* address = reinterpret_cast<int*>(&state_);
+    while (state_.load(kAcquire) == kParked) {
+      syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, kParked, NULL, NULL, 0);
+    }
+  }
+
+  // Consume the permit of the [Unpark] that woke us up.
+  ASSERT(state_ == kPermit);
+  state_.store(kEmpty, kRelaxed);
+}
+
+void Parker::Unpark() {
+  if (state_.exchange(kPermit, kRelease) == kParked) {
+    int* address = reinterpret_cast<int*>(&state_);
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+#else  // defined(DARTINO_TARGET_OS_LINUX)
+
+Parker::Parker() : monitor_(Platform::CreateMonitor()), permit_(false) {}
+
+Parker::~Parker() { delete monitor_; }
+
+void Parker::Park() {
+  ScopedMonitorLock locker(monitor_);
+  while (!permit_) monitor_->Wait();
+  permit_ = false;
+}
+
+void Parker::Unpark() {
+  ScopedMonitorLock locker(monitor_);
+  permit_ = true;
+  monitor_->Notify();
+}
+
+#endif  // defined(DARTINO_TARGET_OS_LINUX)
+
+}  // namespace dartino
@@ -0,0 +1,42 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#ifndef SRC_VM_PARKER_H_
+#define SRC_VM_PARKER_H_
+
+#include "src/shared/atomic.h"
+#include "src/shared/platform.h"
+
+namespace dartino {
+
+// Blocks a single thread until another thread unparks it. An [Unpark] that
+// happens before the [Park] is remembered, so wakeups are never lost. Only
+// the owning thread may call [Park].
+//
+// On Linux this is a futex, so [Unpark] only makes a system call if the
+// thread is actually parked.
+class Parker {
+ public:
+  Parker();
+  ~Parker();
+
+  // Blocks until [Unpark] is called, unless it has been called since the last
+  // [Park] returned.
+  void Park();
+
+  void Unpark();
+
+ private:
+#if defined(DARTINO_TARGET_OS_LINUX)
+  enum { kEmpty = 0, kPermit = 1, kParked = 2 };
+  Atomic<int> state_;
+#else
+  Monitor* monitor_;
+  bool permit_;
+#endif
+};
+
+}  // namespace dartino
+
+#endif  // SRC_VM_PARKER_H_
@@ -0,0 +1,56 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/shared/assert.h"
+#include "src/shared/test_case.h"
+
+#include "src/vm/parker.h"
+#include "src/vm/thread.h"
+
+namespace dartino {
+
+static const int kRounds = 10000;
+
+struct ParkerTestData {
+  Parker ping;
+  Parker pong;
+  int counter;
+};
+
+// Counts every ping and answers it with a pong.
+static void* AnswerPings(void* arg) {
+  ParkerTestData* data = reinterpret_cast<ParkerTestData*>(arg);
+  for (int i = 0; i < kRounds; i++) {
+    data->ping.Park();
+    data->counter++;
+    data->pong.Unpark();
+  }
+  return NULL;
+}
+
+TEST_CASE(ParkerRemembersUnpark) {
+  Parker parker;
+  // Neither of these blocks, as each is preceded by an unpark.
+  parker.Unpark();
+  parker.Park();
+  parker.Unpark();
+  parker.Unpark();
+  parker.Park();
+}
+
+// Depending on how the threads are scheduled, either side may unpark the
+// other before or after it parks.
+TEST_CASE(ParkerPingPong) {
+  ParkerTestData data;
+  data.counter = 0;
+  ThreadIdentifier thread = Thread::Run(AnswerPings, &data);
+  for (int i = 0; i < kRounds; i++) {
+    data.ping.Unpark();
+    data.pong.Park();
+    EXPECT_EQ(i + 1, data.counter);
+  }
+  thread.Join();
+}
+
+}  // namespace dartino
@@ -3,9 +3,12 @@
 // BSD-style license that can be found in the LICENSE.md file.
 
 #include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
 #include <unistd.h>
 
 #include "src/shared/assert.h"
+#include "src/shared/flags.h"
 #include "src/shared/platform.h"
 #include "src/shared/test_case.h"
 
@@ -56,4 +59,58 @@ TEST_CASE(Mutex) {
   delete mutex;
 }
 
+#if defined(DARTINO_TARGET_OS_LINUX)
+
+struct PinnedThread {
+  int index;
+  int cpu;
+};
+
+// Applies the CPU affinity of [PinnedThread::index] and records the only CPU
+// the thread may then run on, or -1.
+static void* RunPinnedThread(void* arg) {
+  PinnedThread* thread = static_cast<PinnedThread*>(arg);
+  Thread::ApplyCpuAffinity(thread->index);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+  thread->cpu = -1;
+  if (CPU_COUNT(&set) != 1) return NULL;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set)) thread->cpu = cpu;
+  }
+  return NULL;
+}
+
+TEST_CASE(ApplyCpuAffinity) {
+  // List the first and last CPU this test may run on, the first one as a
+  // range, so the threads are pinned to either of them round-robin.
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+  int first = -1;
+  int last = -1;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) continue;
+    if (first < 0) first = cpu;
+    last = cpu;
+  }
+  char list[32];
+  snprintf(list, sizeof(list), "%d,%d-%d", last, first, first);
+  const char* cpu_affinity = Flags::cpu_affinity;
+  Flags::cpu_affinity = list;
+
+  static const int kThreads = 3;
+  const int expected[kThreads] = {last, first, last};
+  for (int i = 0; i < kThreads; i++) {
+    PinnedThread thread = {i, -1};
+    Thread::Run(RunPinnedThread, &thread).Join();
+    EXPECT_EQ(expected[i], thread.cpu);
+  }
+
+  Flags::cpu_affinity = cpu_affinity;
+}
+
+#endif  // defined(DARTINO_TARGET_OS_LINUX)
+
 }  // namespace dartino
@@ -52,6 +52,10 @@ class Port {
 
   static void WeakCallback(HeapObject* port, Heap* heap);
 
+#ifdef TESTING
+  int ref_count() const { return ref_count_.load(); }
+#endif  // TESTING
+
  private:
   friend class Process;
 
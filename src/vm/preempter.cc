@@ -4,6 +4,9 @@
 
 #include "src/vm/preempter.h"
 
+#include "src/shared/flags.h"
+#include "src/shared/utils.h"
+
 namespace dartino {
 
 // Global instance of preempter & preempter thread.
@@ -34,7 +37,8 @@ void Preempter::TearDown() {
 Preempter::Preempter(Scheduler* scheduler)
     : preempt_monitor_(Platform::CreateMonitor()),
       state_(Preempter::kAllocated),
-      scheduler_(scheduler) {
+      scheduler_(scheduler),
+      suspended_(false) {
 }
 
 Preempter::~Preempter() {
@@ -73,10 +77,24 @@ void Preempter::Run() {
 
   uint64 next_timeout = GetNextPreemptTime();
   while (state_ != Preempter::kFinishing) {
+    if (suspended_) {
+      preempt_monitor_->Wait();
+      // The process that resumed us gets a full time slice.
+      next_timeout = GetNextPreemptTime();
+      continue;
+    }
+
     // If we didn't time out, we were interrupted. In that case, continue.
     if (!preempt_monitor_->WaitUntil(next_timeout)) continue;
 
-    scheduler_->PreemptionTick();
+    if (!scheduler_->PreemptionTick()) {
+      // Nothing is waiting to run, so there is no need to wake up until a
+      // process is enqueued. Suspending before checking the ready queues
+      // again ensures that a concurrent [ProcessEnqueued] either sees the
+      // suspension or its process is found by the check.
+      suspended_ = true;
+      if (scheduler_->HasReadyProcess()) suspended_ = false;
+    }
     next_timeout = GetNextPreemptTime();
   }
 
@@ -84,10 +102,18 @@ void Preempter::Run() {
   preempt_monitor_->NotifyAll();
 }
 
+void Preempter::Resume() {
+  ScopedMonitorLock locker(preempt_monitor_);
+  if (suspended_) {
+    suspended_ = false;
+    preempt_monitor_->NotifyAll();
+  }
+}
+
 uint64 Preempter::GetNextPreemptTime() {
-  // Wait 100 ms.
+  int time_slice = Utils::Maximum(Flags::time_slice, 1);
   uint64 now = Platform::GetMicroseconds();
-  return now + 100 * 1000L;
+  return now + time_slice * 1000L;
 }
 
 
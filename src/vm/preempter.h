@@ -32,6 +32,14 @@ class Preempter {
 
   void Run();
 
+  // Must be called after a process has been added to a ready queue. Resumes
+  // the preemption ticks if they were suspended because no process was
+  // waiting to run.
+  static void ProcessEnqueued() {
+    Preempter* preempter = preempter_;
+    if (preempter != NULL && preempter->suspended_) preempter->Resume();
+  }
+
  private:
   // Global instance of preempter
   static Preempter* preempter_;
@@ -41,6 +49,11 @@ class Preempter {
   Atomic<State> state_;
   Scheduler* scheduler_;
 
+  // Whether the ticks are suspended until the next process is enqueued.
+  Atomic<bool> suspended_;
+
+  void Resume();
+
   uint64 GetNextPreemptTime();
 };
 
@@ -39,6 +39,12 @@ Process::Process(Program* program, Process* parent)
       primary_lookup_cache_(NULL),
       random_(program->random()->NextUInt32() + 1),
       state_(kSleeping),
+      ready_queue_(NULL),
+      priority_(parent != NULL ? parent->priority() : kNormalPriority),
+      queued_priority_(kNormalPriority),
+      queued_at_(0),
+      ready_since_(0),
+      latency_(NULL),
       signal_(NULL),
       process_handle_(NULL),
       ports_(NULL),
@@ -95,6 +101,7 @@ Process::~Process() {
   if (signal != NULL) Signal::DecrementRef(signal);
 
   delete debug_info_;
+  delete latency_.load();
   for (int i = 0; i < arguments_.length(); i++) {
     arguments_[i].Delete();
   }
@@ -123,7 +130,7 @@ void Process::Cleanup(Signal::Kind kind) {
 
 void Process::SetupExecutionStack() {
   ASSERT(coroutine_ == NULL);
-  Stack* stack = Stack::cast(NewStack(256));
+  Stack* stack = Stack::cast(NewStack(kInitialStackLength));
   stack->set(0, NULL);
   Coroutine* coroutine =
       Coroutine::cast(NewInstance(program()->coroutine_class()));
@@ -133,6 +140,7 @@ void Process::SetupExecutionStack() {
 
 void Process::UpdateCoroutine(Coroutine* coroutine) {
   ASSERT(coroutine->has_stack());
+  program_->RecordActivation(coroutine);
   coroutine_ = coroutine;
   UpdateStackLimit();
   remembered_set_.Insert(coroutine->stack());
@@ -182,6 +190,7 @@ Process::StackCheckResult Process::HandleStackOverflow(int addition) {
   new_stack->UpdateFramePointers(stack());
   ASSERT(coroutine_->has_stack());
   coroutine_->set_stack(new_stack);
+  RecordStore(coroutine_, new_stack);
   remembered_set_.Insert(coroutine_->stack());
   UpdateStackLimit();
   return kStackCheckContinue;
@@ -661,7 +670,10 @@ BEGIN_NATIVE(ProcessQueueSetupProcessDeath) {
   ProcessHandle* handle = signal->handle();
   handle->IncrementRef();
   handle->InitializeDartObject(dart_process);
-  Instance::cast(arguments[0])->SetInstanceField(0, dart_process);
+  Instance* result = Instance::cast(arguments[0]);
+  process->RecordOverwrite(result->GetInstanceField(0));
+  result->SetInstanceField(0, dart_process);
+  process->RecordStore(result, dart_process);
 
   process->RegisterFinalizer(HeapObject::cast(dart_process),
                              Process::FinalizeProcess);
@@ -10,6 +10,7 @@
 
 #include "src/vm/debug_info.h"
 #include "src/vm/heap.h"
+#include "src/vm/latency_histogram.h"
 #include "src/vm/links.h"
 #include "src/vm/lookup_cache.h"
 #include "src/vm/message_mailbox.h"
@@ -44,6 +45,14 @@ class Process : public ProcessList::Entry, public ProcessQueueList::Entry {
     kWaitingForChildren,
   };
 
+  // TODO: Keep these in sync with lib/dartino/dartino.dart:Process.
+  enum Priority {
+    kLowPriority,
+    kNormalPriority,
+    kHighPriority,
+    kNumberOfPriorities,
+  };
+
   enum StackCheckResult {
     // Stack check handled (most likely by growing the stack) and
     // execution can continue.
@@ -112,6 +121,9 @@ class Process : public ProcessList::Entry, public ProcessQueueList::Entry {
   Object* NewBoxed(Object* value);
   Object* NewStack(int length);
 
+  // The length of the stack of a new process or coroutine.
+  static const int kInitialStackLength = 256;
+
   Object* NewInstance(Class* klass, bool immutable = false);
 
   // Returns either a Smi or a LargeInteger.
@@ -155,6 +167,16 @@ class Process : public ProcessList::Entry, public ProcessQueueList::Entry {
   inline bool ChangeState(State from, State to);
   State state() const { return state_; }
 
+  ProcessQueue* ready_queue() const { return ready_queue_; }
+
+  // The priority is inherited from the parent on spawn. Changing it takes
+  // effect the next time the process is enqueued in a ready queue.
+  Priority priority() const { return priority_; }
+  void set_priority(Priority priority) { priority_ = priority; }
+
+  // The scheduler latencies of this process, or NULL if none were recorded.
+  SchedulerLatency* latency() const { return latency_; }
+
   void RegisterFinalizer(HeapObject* object, WeakPointerCallback callback);
   void UnregisterFinalizer(HeapObject* object);
 
@@ -190,6 +212,11 @@ class Process : public ProcessList::Entry, public ProcessQueueList::Entry {
 
   Signal* signal() { return signal_.load(); }
 
+  // Must be called before a field holding [old_value] is overwritten.
+  void RecordOverwrite(Object* old_value) {
+    program()->RecordOverwrite(old_value);
+  }
+
   void RecordStore(HeapObject* object, Object* value) {
     if (value->IsHeapObject()) {
       ASSERT(!program()->heap()->space()->Includes(object->address()));
@@ -218,6 +245,8 @@ class Process : public ProcessList::Entry, public ProcessQueueList::Entry {
   friend class Interpreter;
   friend class Engine;
   friend class Program;
+  friend class ProcessQueue;
+  friend class Scheduler;
 
   // Creation and deletion of processes is managed by a [Program].
   Process(Program* program, Process* parent);
@@ -253,6 +282,22 @@ class Process : public ProcessList::Entry, public ProcessQueueList::Entry {
 
   Atomic<State> state_;
 
+  // The ready queue this process is currently enqueued in, if any. Only
+  // updated by [ProcessQueue] while holding the lock of the queue.
+  Atomic<ProcessQueue*> ready_queue_;
+
+  Atomic<Priority> priority_;
+
+  // The priority and the dequeue count of the [ProcessQueue] at the time this
+  // process was enqueued, used for aging. Guarded by the lock of the queue.
+  Priority queued_priority_;
+  uword queued_at_;
+
+  // The time at which the process was made ready, or 0 if it is not ready or
+  // latencies were not recorded at the time.
+  uint64 ready_since_;
+  Atomic<SchedulerLatency*> latency_;
+
   Atomic<Signal*> signal_;
   MessageMailbox mailbox_;
 
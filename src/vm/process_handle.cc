@@ -115,4 +115,99 @@ BEGIN_NATIVE(ProcessKill) {
 }
 END_NATIVE()
 
+BEGIN_NATIVE(ProcessGetPriority) {
+  ProcessHandle* handle = ProcessHandle::FromDartObject(arguments[0]);
+  {
+    ScopedSpinlock locker(handle->lock());
+    Process* handle_process = handle->process();
+    if (handle_process != NULL) {
+      return Smi::FromWord(handle_process->priority());
+    }
+  }
+  return process->program()->null_object();
+}
+END_NATIVE()
+
+BEGIN_NATIVE(ProcessSetPriority) {
+  ProcessHandle* handle = ProcessHandle::FromDartObject(arguments[0]);
+  Object* dart_priority = arguments[1];
+  if (!dart_priority->IsSmi()) return Failure::wrong_argument_type();
+  word value = Smi::cast(dart_priority)->value();
+  if (value < 0 || value >= Process::kNumberOfPriorities) {
+    return Failure::index_out_of_bounds();
+  }
+
+  {
+    ScopedSpinlock locker(handle->lock());
+    Process* handle_process = handle->process();
+    if (handle_process != NULL) {
+      handle_process->set_priority(static_cast<Process::Priority>(value));
+      return process->program()->true_object();
+    }
+  }
+  return process->program()->false_object();
+}
+END_NATIVE()
+
+// Returns the histogram of [kind] of the process or program of [handle], or
+// NULL if the process is dead or no latencies were recorded.
+static LatencyHistogram* LatencyHistogramOf(ProcessHandle* handle,
+                                            Object* kind, bool of_program) {
+  ASSERT(handle->lock()->IsLocked());
+  Process* process = handle->process();
+  if (process == NULL) return NULL;
+  SchedulerLatency* latency =
+      of_program ? process->program()->latency() : process->latency();
+  if (latency == NULL) return NULL;
+  return &latency->histograms[Smi::cast(kind)->value()];
+}
+
+static bool IsValidLatencyKind(Object* kind) {
+  if (!kind->IsSmi()) return false;
+  word value = Smi::cast(kind)->value();
+  return value >= 0 && value < SchedulerLatency::kNumberOfKinds;
+}
+
+BEGIN_NATIVE(ProcessLatencyCount) {
+  ProcessHandle* handle = ProcessHandle::FromDartObject(arguments[0]);
+  if (!IsValidLatencyKind(arguments[1])) return Failure::wrong_argument_type();
+  bool of_program = arguments[2] == process->program()->true_object();
+  {
+    ScopedSpinlock locker(handle->lock());
+    LatencyHistogram* histogram =
+        LatencyHistogramOf(handle, arguments[1], of_program);
+    if (histogram != NULL) return process->ToInteger(histogram->count());
+  }
+  return process->program()->null_object();
+}
+END_NATIVE()
+
+BEGIN_NATIVE(ProcessLatencyAt) {
+  ProcessHandle* handle = ProcessHandle::FromDartObject(arguments[0]);
+  if (!IsValidLatencyKind(arguments[1])) return Failure::wrong_argument_type();
+  bool of_program = arguments[2] == process->program()->true_object();
+  if (!arguments[3]->IsSmi()) return Failure::wrong_argument_type();
+  word permyriad = Smi::cast(arguments[3])->value();
+  if (permyriad < 0 || permyriad > 10000) {
+    return Failure::index_out_of_bounds();
+  }
+  {
+    ScopedSpinlock locker(handle->lock());
+    LatencyHistogram* histogram =
+        LatencyHistogramOf(handle, arguments[1], of_program);
+    if (histogram != NULL) {
+      return process->ToInteger(histogram->ValueAtPermyriad(permyriad));
+    }
+  }
+  return process->program()->null_object();
+}
+END_NATIVE()
+
+BEGIN_NATIVE(ProcessSetLatencyEnabled) {
+  Program* program = process->program();
+  SchedulerLatency::SetEnabled(arguments[0] == program->true_object());
+  return program->null_object();
+}
+END_NATIVE()
+
 }  // namespace dartino
@@ -6,23 +6,43 @@
 #define SRC_VM_PROCESS_QUEUE_H_
 
 #include "src/shared/assert.h"
+#include "src/shared/platform.h"
+#include "src/shared/utils.h"
 
+#include "src/vm/latency_histogram.h"
 #include "src/vm/process.h"
 #include "src/vm/program.h"
 #include "src/vm/spinlock.h"
+#include "src/vm/vector.h"
 
 namespace dartino {
 
 class ThreadState;
 
+// A ready queue with one FIFO list per [Process::Priority]. Higher priorities
+// are served first, but a process gains one priority level for every
+// [kAgingDequeues] processes dequeued while it waits, so low priority
+// processes are never starved.
 class ProcessQueue {
  public:
+  static const uword kAgingDequeues = 16;
+
+  ProcessQueue() : dequeue_count_(0) {}
+
   // Enqueues [entry] to the queue and returns whether it was empty.
   bool Enqueue(Process* entry) {
+    uint64 now = SchedulerLatency::IsEnabled() ? Platform::GetMicroseconds() : 0;
     ScopedSpinlock locker(&spinlock_);
-    ASSERT(!ready_.IsInList(entry));
-    bool was_empty = ready_.IsEmpty();
-    ready_.Append(entry);
+    // Processes which are re-enqueued after their program was paused keep
+    // the time they were first made ready.
+    if (entry->ready_since_ == 0) entry->ready_since_ = now;
+    Process::Priority priority = entry->priority();
+    ASSERT(!ready_[priority].IsInList(entry));
+    bool was_empty = IsEmptyLocked();
+    entry->queued_priority_ = priority;
+    entry->queued_at_ = dequeue_count_;
+    ready_[priority].Append(entry);
+    entry->ready_queue_ = this;
     if (!entry->ChangeState(Process::kEnqueuing, Process::kReady)) {
       UNREACHABLE();
     }
@@ -33,22 +53,30 @@ class ProcessQueue {
   bool TryDequeue(Process** entry) {
     ScopedSpinlock locker(&spinlock_);
 
-    if (ready_.IsEmpty()) return false;
+    Process* best = NULL;
+    for (int i = Process::kNumberOfPriorities - 1; i >= 0; i--) {
+      if (ready_[i].IsEmpty()) continue;
+      Process* process = ready_[i].First();
+      if (best == NULL || Rank(process) > Rank(best)) best = process;
+    }
+    if (best == NULL) return false;
 
-    Process* process = ready_.RemoveFirst();
-    if (!process->ChangeState(Process::kReady, Process::kRunning)) {
+    RemoveLocked(best);
+    if (!best->ChangeState(Process::kReady, Process::kRunning)) {
       UNREACHABLE();
     }
-    *entry = process;
+    *entry = best;
     return true;
   }
 
   // Dequeue [entry] from the ready queue and returns whether it was successful.
+  // Fails if [entry] is not enqueued in this queue.
   bool TryDequeueEntry(Process* entry) {
     ScopedSpinlock locker(&spinlock_);
 
+    if (entry->ready_queue_ != this) return false;
     if (entry->ChangeState(Process::kReady, Process::kRunning)) {
-      ready_.Remove(entry);
+      RemoveLocked(entry);
       return true;
     }
     return false;
@@ -58,7 +86,7 @@ class ProcessQueue {
   // enqueued more. The caller is responsible for guarding against that!
   bool IsEmpty() {
     ScopedSpinlock locker(&spinlock_);
-    return ready_.IsEmpty();
+    return IsEmptyLocked();
   }
 
   void PauseAllProcessesOfProgram(Program* program) {
@@ -66,24 +94,299 @@ class ProcessQueue {
 
     ProgramState* state = program->program_state();
 
-    auto it = ready_.Begin();
-    while (it != ready_.End()) {
-      Process* process = *it;
-      if (process->program() == program) {
-        it = ready_.Erase(it);
-        if (!process->ChangeState(Process::kReady, Process::kEnqueuing)) {
-          UNREACHABLE();
+    for (int i = 0; i < Process::kNumberOfPriorities; i++) {
+      ProcessQueueList* list = &ready_[i];
+      auto it = list->Begin();
+      while (it != list->End()) {
+        Process* process = *it;
+        if (process->program() == program) {
+          it = list->Erase(it);
+          process->ready_queue_ = NULL;
+          if (!process->ChangeState(Process::kReady, Process::kEnqueuing)) {
+            UNREACHABLE();
+          }
+          state->AddPausedProcess(process);
+        } else {
+          ++it;
+        }
+      }
+    }
+  }
+
+ private:
+  bool IsEmptyLocked() {
+    for (int i = 0; i < Process::kNumberOfPriorities; i++) {
+      if (!ready_[i].IsEmpty()) return false;
+    }
+    return true;
+  }
+
+  // The priority of [process] including the levels gained by waiting. Ties
+  // are broken in favor of the process with the higher base priority, since
+  // the lists are scanned from the highest priority down.
+  uword Rank(Process* process) {
+    uword waited = dequeue_count_ - process->queued_at_;
+    return process->queued_priority_ + waited / kAgingDequeues;
+  }
+
+  void RemoveLocked(Process* process) {
+    ready_[process->queued_priority_].Remove(process);
+    process->ready_queue_ = NULL;
+    dequeue_count_++;
+  }
+
+  Spinlock spinlock_;
+  ProcessQueueList ready_[Process::kNumberOfPriorities];
+  uword dequeue_count_;
+};
+
+// The ready processes of the programs sharing a ready queue, in one
+// [ProcessQueue] per program. The next process is taken from the program with
+// the smallest virtual time (CPU time divided by weight), so programs get CPU
+// time in proportion to their weights. It only costs a look at each program
+// of the queue rather than at each process.
+class FairShareQueue {
+ public:
+  // The amount of virtual time, in microseconds, that a program which has
+  // been idle may lag behind the programs that kept running. This bounds the
+  // burst such a program gets when it becomes ready again.
+  static const uint64 kFairShareSlack = 50 * 1000;
+
+  FairShareQueue() : virtual_clock_(0) {}
+
+  ~FairShareQueue() {
+    for (unsigned i = 0; i < queues_.size(); i++) {
+      ASSERT(queues_[i].queue->IsEmpty());
+      delete queues_[i].queue;
+    }
+  }
+
+  // Enqueues [entry] on the queue of its program and returns whether that
+  // queue was empty.
+  bool Enqueue(Process* entry) {
+    ScopedSpinlock locker(&spinlock_);
+    return QueueOf(entry->program())->Enqueue(entry);
+  }
+
+  // Try to dequeue a process of the program furthest behind its share, and
+  // returns if it was successful. The [filter] must provide
+  // `bool Accept(Program*)`, `bool Claim(Program*)`, `void Unclaim(Program*)`
+  // and `uint64 VirtualTime(Program*)` methods, which are called while the
+  // queue is locked. Only processes of accepted programs are dequeued, and
+  // only once `Claim()` succeeds for their program.
+  template <typename Filter>
+  bool TryDequeue(Process** entry, Filter* filter) {
+    ScopedSpinlock locker(&spinlock_);
+
+    while (true) {
+      int best = -1;
+      uint64 best_time = 0;
+      for (unsigned i = 0; i < queues_.size(); i++) {
+        Program* program = queues_[i].program;
+        if (queues_[i].queue->IsEmpty() || !filter->Accept(program)) continue;
+        uint64 time = filter->VirtualTime(program);
+        if (virtual_clock_ > kFairShareSlack) {
+          time = Utils::Maximum(time, virtual_clock_ - kFairShareSlack);
         }
-        state->AddPausedProcess(process);
-      } else {
-        ++it;
+        if (best < 0 || time < best_time) {
+          best = i;
+          best_time = time;
+        }
+      }
+      if (best < 0) return false;
+
+      // Another queue may have handed out a process of the same program
+      // since it was accepted, in which case it is no longer accepted. Its
+      // processes may also have been dequeued directly from its queue.
+      Program* program = queues_[best].program;
+      if (!filter->Claim(program)) continue;
+      if (queues_[best].queue->TryDequeue(entry)) {
+        if (best_time > virtual_clock_) virtual_clock_ = best_time;
+        return true;
       }
+      filter->Unclaim(program);
     }
   }
 
+  // Returns whether the queue has an entry accepted by [filter]. Notice that
+  // by the return of the call, the result may already be outdated.
+  template <typename Filter>
+  bool HasEntry(Filter* filter) {
+    ScopedSpinlock locker(&spinlock_);
+    for (unsigned i = 0; i < queues_.size(); i++) {
+      if (queues_[i].queue->IsEmpty()) continue;
+      if (filter->Accept(queues_[i].program)) return true;
+    }
+    return false;
+  }
+
+  // Notice that by the return of the call, another thread might have already
+  // enqueued more. The caller is responsible for guarding against that!
+  bool IsEmpty() {
+    ScopedSpinlock locker(&spinlock_);
+    for (unsigned i = 0; i < queues_.size(); i++) {
+      if (!queues_[i].queue->IsEmpty()) return false;
+    }
+    return true;
+  }
+
+  void PauseAllProcessesOfProgram(Program* program) {
+    ScopedSpinlock locker(&spinlock_);
+    int index = IndexOf(program);
+    if (index >= 0) queues_[index].queue->PauseAllProcessesOfProgram(program);
+  }
+
+  // Forget [program], which must not have any ready processes.
+  void RemoveProgram(Program* program) {
+    ScopedSpinlock locker(&spinlock_);
+    int index = IndexOf(program);
+    if (index < 0) return;
+    ASSERT(queues_[index].queue->IsEmpty());
+    delete queues_[index].queue;
+    queues_.Remove(index);
+  }
+
  private:
+  struct ProgramQueue {
+    Program* program;
+    ProcessQueue* queue;
+  };
+
+  int IndexOf(Program* program) {
+    for (unsigned i = 0; i < queues_.size(); i++) {
+      if (queues_[i].program == program) return i;
+    }
+    return -1;
+  }
+
+  ProcessQueue* QueueOf(Program* program) {
+    int index = IndexOf(program);
+    if (index >= 0) return queues_[index].queue;
+    ProgramQueue program_queue = {program, new ProcessQueue()};
+    queues_.PushBack(program_queue);
+    return program_queue.queue;
+  }
+
   Spinlock spinlock_;
-  ProcessQueueList ready_;
+  // The queues of the programs which had processes in this queue. A queue is
+  // kept until its program is removed, since processes are also dequeued
+  // directly from it.
+  Vector<ProgramQueue> queues_;
+  // The largest virtual time of the programs dequeued so far.
+  uint64 virtual_clock_;
+};
+
+// The ready queues of the scheduler: a global queue, and one queue for the
+// processes made ready by each worker if there are several workers. A worker
+// takes processes from its own queue first, and steals from the queues of the
+// other workers when it runs out of work.
+class ReadyQueues {
+ public:
+  // Passed as the worker to enqueue processes on the global queue.
+  static const int kGlobalQueue = -1;
+
+  // A worker looks at the global queue before its own queue once this many
+  // microseconds have passed since it last looked at it.
+  static const uint64 kGlobalQueueInterval = 1000;
+
+  explicit ReadyQueues(int worker_count)
+      : worker_count_(worker_count),
+        worker_queues_(new WorkerQueue*[worker_count]) {
+    for (int i = 0; i < worker_count; i++) {
+      worker_queues_[i] = new WorkerQueue();
+    }
+  }
+
+  ~ReadyQueues() {
+    for (int i = 0; i < worker_count_; i++) delete worker_queues_[i];
+    delete[] worker_queues_;
+  }
+
+  bool has_worker_queues() const { return worker_count_ > 0; }
+
+  // Enqueues [entry] on the queue of [worker], or on the global queue if
+  // there are no worker queues. Returns whether the queue of its program was
+  // empty.
+  bool Enqueue(Process* entry, int worker) {
+    return QueueOf(worker)->Enqueue(entry);
+  }
+
+  // Dequeue a process for [worker] at time [now], in microseconds, and
+  // returns if it was successful. Processes that keep the queue of [worker]
+  // busy cannot starve the global queue for more than [kGlobalQueueInterval],
+  // and the queues of the other workers are served by their own workers. The
+  // [filter] is passed on to [FairShareQueue::TryDequeue].
+  template <typename Filter>
+  bool TryDequeue(Process** entry, int worker, uint64 now, Filter* filter) {
+    if (worker_count_ == 0) return global_queue_.TryDequeue(entry, filter);
+
+    WorkerQueue* local = worker_queues_[worker];
+    bool global_first = now - local->global_checked_at >= kGlobalQueueInterval;
+    if (!global_first && local->queue.TryDequeue(entry, filter)) return true;
+    local->global_checked_at = now;
+    if (global_queue_.TryDequeue(entry, filter)) return true;
+    if (global_first && local->queue.TryDequeue(entry, filter)) return true;
+    for (int i = 1; i < worker_count_; i++) {
+      FairShareQueue* victim = QueueOf((worker + i) % worker_count_);
+      if (victim->TryDequeue(entry, filter)) return true;
+    }
+    return false;
+  }
+
+  // Returns whether any queue has an entry accepted by [filter]. Notice that
+  // by the return of the call, the result may already be outdated.
+  template <typename Filter>
+  bool HasEntry(Filter* filter) {
+    if (global_queue_.HasEntry(filter)) return true;
+    for (int i = 0; i < worker_count_; i++) {
+      if (worker_queues_[i]->queue.HasEntry(filter)) return true;
+    }
+    return false;
+  }
+
+  // Notice that by the return of the call, the result may already be
+  // outdated.
+  bool IsEmpty() {
+    if (!global_queue_.IsEmpty()) return false;
+    for (int i = 0; i < worker_count_; i++) {
+      if (!worker_queues_[i]->queue.IsEmpty()) return false;
+    }
+    return true;
+  }
+
+  void PauseAllProcessesOfProgram(Program* program) {
+    global_queue_.PauseAllProcessesOfProgram(program);
+    for (int i = 0; i < worker_count_; i++) {
+      worker_queues_[i]->queue.PauseAllProcessesOfProgram(program);
+    }
+  }
+
+  // Forget [program], which must not have any ready processes.
+  void RemoveProgram(Program* program) {
+    global_queue_.RemoveProgram(program);
+    for (int i = 0; i < worker_count_; i++) {
+      worker_queues_[i]->queue.RemoveProgram(program);
+    }
+  }
+
+ private:
+  struct WorkerQueue {
+    WorkerQueue() : global_checked_at(0) {}
+
+    FairShareQueue queue;
+    // The time the worker last looked at the global queue. Only used by the
+    // worker.
+    uint64 global_checked_at;
+  };
+
+  FairShareQueue* QueueOf(int worker) {
+    if (worker == kGlobalQueue || worker_count_ == 0) return &global_queue_;
+    return &worker_queues_[worker]->queue;
+  }
+
+  const int worker_count_;
+  FairShareQueue global_queue_;
+  WorkerQueue** worker_queues_;
 };
 
 }  // namespace dartino
@@ -0,0 +1,188 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/shared/assert.h"
+#include "src/shared/test_case.h"
+
+#include "src/vm/process.h"
+#include "src/vm/process_queue.h"
+#include "src/vm/program.h"
+#include "src/vm/scheduler.h"
+
+namespace dartino {
+
+// The simulated length of a slice of CPU time, in microseconds.
+static const uint64 kSlice = 100;
+
+// A program whose processes are only moved between ready queues, and never
+// interpreted.
+class TestProgram {
+ public:
+  explicit TestProgram(int count)
+      : program_(new Program(Program::kBuiltViaSession)),
+        count_(count),
+        processes_(new Process*[count]) {
+    program_->Initialize();
+    program_->set_static_fields(program_->empty_array());
+    program_->set_scheduler(Scheduler::GlobalInstance());
+    for (int i = 0; i < count; i++) {
+      processes_[i] = program_->SpawnProcess(NULL);
+      processes_[i]->ChangeState(Process::kSleeping, Process::kEnqueuing);
+    }
+  }
+
+  // The processes must not be in a ready queue by now.
+  ~TestProgram() {
+    for (int i = 0; i < count_; i++) {
+      Process* process = processes_[i];
+      process->ChangeState(process->state(), Process::kWaitingForChildren);
+      program_->ScheduleProcessForDeletion(process, Signal::kTerminated);
+    }
+    program_->set_scheduler(NULL);
+    delete program_;
+    delete[] processes_;
+  }
+
+  Program* program() const { return program_; }
+  Process* process(int index) const { return processes_[index]; }
+
+ private:
+  Program* const program_;
+  const int count_;
+  Process** const processes_;
+};
+
+// Accepts all programs, and weighs them like the scheduler does for programs
+// outside of groups.
+class TestFilter {
+ public:
+  bool Accept(Program* program) { return true; }
+  bool Claim(Program* program) { return true; }
+  void Unclaim(Program* program) {}
+  uint64 VirtualTime(Program* program) { return program->virtual_time(); }
+};
+
+// Charges [process] a slice of CPU time and makes it ready again on the queue
+// of [worker], like a worker does with a process that yields.
+static void RunSlice(ReadyQueues* queues, Process* process, int worker) {
+  process->program()->AddCpuTime(kSlice);
+  process->ChangeState(Process::kRunning, Process::kEnqueuing);
+  queues->Enqueue(process, worker);
+}
+
+// Dequeues the processes left in [queues].
+static void Drain(ReadyQueues* queues, TestFilter* filter) {
+  Process* process;
+  while (queues->TryDequeue(&process, 0, 0, filter)) {
+    process->ChangeState(Process::kRunning, Process::kEnqueuing);
+  }
+  EXPECT(queues->IsEmpty());
+}
+
+TEST_CASE(ReadyQueuesShareCpuByWeight) {
+  static const int kSlices = 400;
+  TestProgram light(2);
+  TestProgram heavy(2);
+  heavy.program()->set_cpu_weight(3 * Program::kDefaultCpuWeight);
+  TestFilter filter;
+  ReadyQueues queues(2);
+
+  // The processes of both programs are made ready by the same worker, and
+  // stay on its queue.
+  for (int i = 0; i < 2; i++) {
+    queues.Enqueue(light.process(i), 0);
+    queues.Enqueue(heavy.process(i), 0);
+  }
+  int light_slices = 0;
+  for (int i = 0; i < kSlices; i++) {
+    Process* process;
+    EXPECT(queues.TryDequeue(&process, 0, i * kSlice, &filter));
+    if (process->program() == light.program()) light_slices++;
+    RunSlice(&queues, process, 0);
+  }
+  EXPECT(light_slices >= kSlices / 4 - 1);
+  EXPECT(light_slices <= kSlices / 4 + 1);
+  EXPECT_EQ(kSlices * kSlice,
+            light.program()->cpu_time() + heavy.program()->cpu_time());
+
+  Drain(&queues, &filter);
+}
+
+TEST_CASE(ReadyQueuesStealWhenIdle) {
+  TestProgram program(2);
+  TestFilter filter;
+  ReadyQueues queues(2);
+  queues.Enqueue(program.process(0), 0);
+  queues.Enqueue(program.process(1), 0);
+
+  // The second worker has nothing to do, so it steals the process that was
+  // made ready first, and the first worker keeps the other one.
+  Process* process;
+  EXPECT(queues.TryDequeue(&process, 1, 0, &filter));
+  EXPECT(process == program.process(0));
+  EXPECT(queues.TryDequeue(&process, 0, 0, &filter));
+  EXPECT(process == program.process(1));
+  EXPECT(!queues.TryDequeue(&process, 1, 0, &filter));
+}
+
+TEST_CASE(ReadyQueuesDoNotStarve) {
+  static const int kRounds = 100;
+  static const int kProcesses = 5;
+  TestProgram program(kProcesses);
+  TestFilter filter;
+  ReadyQueues queues(2);
+
+  // Each worker keeps two processes of its own queue busy, while the last
+  // process waits on the global queue.
+  for (int i = 0; i < kProcesses - 1; i++) {
+    queues.Enqueue(program.process(i), i % 2);
+  }
+  Process* waiting = program.process(kProcesses - 1);
+  queues.Enqueue(waiting, ReadyQueues::kGlobalQueue);
+
+  int slices[kProcesses] = {0};
+  int waited = -1;
+  for (int round = 0; round < kRounds; round++) {
+    for (int worker = 0; worker < 2; worker++) {
+      Process* process;
+      EXPECT(queues.TryDequeue(&process, worker, round * kSlice, &filter));
+      for (int i = 0; i < kProcesses; i++) {
+        if (process == program.process(i)) slices[i]++;
+      }
+      if (process == waiting) {
+        waited = round;
+      } else {
+        RunSlice(&queues, process, worker);
+      }
+    }
+  }
+  EXPECT(waited >= 0);
+  EXPECT(waited * kSlice <= ReadyQueues::kGlobalQueueInterval);
+  EXPECT_EQ(1, slices[kProcesses - 1]);
+  for (int i = 0; i < kProcesses - 1; i++) {
+    EXPECT(slices[i] >= kRounds / 2 - 1);
+  }
+
+  Drain(&queues, &filter);
+}
+
+TEST_CASE(ReadyQueuesWithoutWorkerQueues) {
+  TestProgram program(2);
+  TestFilter filter;
+  ReadyQueues queues(0);
+  EXPECT(!queues.has_worker_queues());
+
+  // With a single interpreter, the processes made ready by a worker go to the
+  // global queue like all others.
+  queues.Enqueue(program.process(0), 3);
+  queues.Enqueue(program.process(1), ReadyQueues::kGlobalQueue);
+  Process* process;
+  EXPECT(queues.TryDequeue(&process, 1, 0, &filter));
+  EXPECT(process == program.process(0));
+  EXPECT(queues.TryDequeue(&process, 2, 0, &filter));
+  EXPECT(process == program.process(1));
+  EXPECT(queues.IsEmpty());
+}
+
+}  // namespace dartino
@@ -22,6 +22,8 @@
 #include "src/vm/object.h"
 #include "src/vm/port.h"
 #include "src/vm/process.h"
+#include "src/vm/scavenger.h"
+#include "src/vm/scheduler.h"
 #include "src/vm/session.h"
 
 namespace dartino {
@@ -39,11 +41,14 @@ Program::Program(ProgramSource source, int hashtag)
 #define CONSTRUCTOR_NULL(type, name, CamelName) name##_(NULL),
       ROOTS_DO(CONSTRUCTOR_NULL)
 #undef CONSTRUCTOR_NULL
+      is_marking_(0),
+      page_directories_(ObjectMemory::page_directories()),
       process_list_mutex_(Platform::CreateMutex()),
       random_(0),
       heap_(&random_),
       process_heap_(NULL, 4 * KB),
       scheduler_(NULL),
+      interpreter_(NULL),
       session_(NULL),
       entry_(NULL),
       loaded_from_snapshot_(source == Program::kLoadedFromSnapshot),
@@ -53,7 +58,13 @@ Program::Program(ProgramSource source, int hashtag)
       hashtag_(hashtag),
       stack_chain_(NULL),
       cache_(NULL),
-      group_mask_(0) {
+      concurrent_marker_(NULL),
+      group_mask_(0),
+      cpu_weight_(kDefaultCpuWeight),
+      cpu_time_(0),
+      virtual_time_(0),
+      latency_(NULL) {
+  process_heap_.EnableLargeObjectSpace();
 // These asserts need to hold when running on the target, but they don't need
 // to hold on the host (the build machine, where the interpreter-generating
 // program runs).  We put these asserts here on the assumption that the
@@ -62,11 +73,17 @@ Program::Program(ProgramSource source, int hashtag)
   static_assert(k##CamelName##Offset == offsetof(Program, name##_), #name);
   ROOTS_DO(ASSERT_OFFSET)
 #undef ASSERT_OFFSET
+  static_assert(kIsMarkingOffset == offsetof(Program, is_marking_),
+                "is_marking");
+  static_assert(kPageDirectoriesOffset == offsetof(Program, page_directories_),
+                "page_directories");
 }
 
 Program::~Program() {
   delete process_list_mutex_;
   delete cache_;
+  delete concurrent_marker_;
+  delete latency_.load();
   ASSERT(process_list_.IsEmpty());
 }
 
@@ -480,7 +497,13 @@ void Program::CollectSharedGarbage() {
     GetSharedHeapUsage(process_heap(), &usage_before);
   }
 
-  PerformSharedGarbageCollection();
+  if (is_marking()) {
+    FinishConcurrentMarking();
+  } else {
+    PerformSharedGarbageCollection();
+  }
+  // The pretenured objects that died were not seen by the scavenges.
+  process_heap()->tenuring_policy()->ResetPretenuring();
 
   if (Flags::print_heap_statistics) {
     SharedHeapUsage usage_after;
@@ -495,38 +518,135 @@ void Program::CollectSharedGarbage() {
 
 void Program::PerformSharedGarbageCollection() {
   // Mark all reachable objects.  We mark all live objects in new-space too, to
-  // detect liveness paths that go through new-space, but we just clear the
-  // mark bits afterwards.  Dead objects in new-space are only cleared in a
+  // detect liveness paths that go through new-space, but the mark bits are
+  // just ignored afterwards.  Dead objects in new-space are only cleared in a
   // new-space GC (scavenge).
+  AbortConcurrentMarking();
   Heap* heap = process_heap();
   OldSpace* old_space = heap->old_space();
   SemiSpace* new_space = heap->space();
-  MarkingStack stack;
-  MarkingVisitor marking_visitor(new_space, old_space, &stack);
+  old_space->CompleteSweeping();
+  ParallelMarker marker(new_space, old_space);
   for (auto process : process_list_) {
-    process->IterateRoots(&marking_visitor);
+    process->IterateRoots(marker.root_visitor());
   }
-  stack.Process(&marking_visitor);
+  marker.Process();
+  bool compacted = CompactOldSpace();
   heap->ProcessWeakPointers(old_space);
 
   for (auto process : process_list_) {
     process->set_ports(Port::CleanupPorts(old_space, process->ports()));
   }
+  if (compacted) old_space->ReleaseEvacuatedChunks();
+
+  // The free list is rebuilt as the old space is swept.
+  old_space->StartSweeping();
+
+  for (auto process : process_list_) process->UpdateStackLimit();
+
+  old_space->set_used(marker.live_bytes());
+  heap->AdjustOldAllocationBudget();
+  TriggerConcurrentSweeping();
+}
 
-  // Sweep over the old-space and rebuild the freelist.
-  SweepingVisitor sweeping_visitor(old_space->free_list());
-  old_space->IterateObjects(&sweeping_visitor);
+void Program::StartConcurrentMarking() {
+  ASSERT(!is_marking());
+  Heap* heap = process_heap();
+  OldSpace* old_space = heap->old_space();
+  SemiSpace* new_space = heap->space();
+  if (concurrent_marker_ == NULL) {
+    concurrent_marker_ = new ConcurrentMarker(old_space);
+  }
+  old_space->CompleteSweeping();
+  old_space->StartConcurrentMarking();
 
+  // Objects referenced from the new space are kept alive by it, so the new
+  // space is scanned along with the roots. The current stacks are scanned
+  // before they change.
+  PointerVisitor* visitor = concurrent_marker_->root_visitor();
+  for (auto process : process_list_) {
+    process->IterateRoots(visitor);
+    if (process->coroutine() != NULL) {
+      concurrent_marker_->ScanStack(process->stack());
+    }
+  }
   new_space->Flush();
-  // We don't pass a free list so this visitor just clears the mark bits
-  // without making free list entries.
-  SweepingVisitor newspace_visitor(NULL);
-  new_space->IterateObjects(&newspace_visitor);
+  HeapObjectPointerVisitor new_space_visitor(visitor);
+  new_space->IterateObjects(&new_space_visitor);
 
-  for (auto process : process_list_) process->UpdateStackLimit();
+  is_marking_ = 1;
+  concurrent_marker_->Start();
+  scheduler_->TriggerConcurrentMarking(this);
+}
+
+void Program::MarkConcurrently() { concurrent_marker_->Run(); }
+
+void Program::SweepConcurrently() {
+  OldSpace* old_space = process_heap()->old_space();
+  while (old_space->SweepNextChunk()) {
+  }
+}
+
+void Program::TriggerConcurrentSweeping() {
+  if (Flags::concurrent_sweeping && scheduler_ != NULL) {
+    scheduler_->TriggerConcurrentSweeping(this);
+  }
+}
+
+void Program::FinishConcurrentMarking() {
+  ASSERT(is_marking());
+  Heap* heap = process_heap();
+  OldSpace* old_space = heap->old_space();
+  concurrent_marker_->Finish();
+  bool compacted = CompactOldSpace();
+  heap->ProcessWeakPointers(old_space);
+
+  for (auto process : process_list_) {
+    process->set_ports(Port::CleanupPorts(old_space, process->ports()));
+  }
+  if (compacted) old_space->ReleaseEvacuatedChunks();
+
+  old_space->EndConcurrentMarking();
+  is_marking_ = 0;
+  old_space->StartSweeping();
+
+  UpdateStackLimits();
 
-  old_space->set_used(sweeping_visitor.used());
+  old_space->set_used(concurrent_marker_->live_bytes() +
+                      old_space->promoted_live_bytes());
   heap->AdjustOldAllocationBudget();
+  TriggerConcurrentSweeping();
+}
+
+bool Program::CompactOldSpace() {
+  Heap* heap = process_heap();
+  OldSpace* old_space = heap->old_space();
+  if (!old_space->needs_compaction()) return false;
+  if (!old_space->EvacuateSparseChunks()) return false;
+
+  // The weak pointers and the ports find the moved objects through their
+  // forwarding addresses when they are processed.
+  ForwardingPointerVisitor visitor(old_space);
+  for (auto process : process_list_) process->IterateRoots(&visitor);
+  HeapObjectPointerVisitor object_visitor(&visitor);
+  heap->space()->IterateObjects(&object_visitor);
+  old_space->IterateLiveObjects(&object_visitor);
+  return true;
+}
+
+void Program::AbortConcurrentMarking() {
+  if (!is_marking()) return;
+  concurrent_marker_->Abort();
+  process_heap()->old_space()->EndConcurrentMarking();
+  is_marking_ = 0;
+}
+
+void Program::RecordOverwriteSlow(Object* old_value) {
+  concurrent_marker_->RecordOverwrite(old_value);
+}
+
+void Program::RecordActivationSlow(Coroutine* coroutine) {
+  concurrent_marker_->ScanCoroutine(coroutine);
 }
 
 class StatisticsVisitor : public HeapObjectVisitor {
@@ -997,6 +1117,16 @@ void Program::CollectNewSpace() {
     return;
   }
 
+  uint64 start = Platform::GetMicroseconds();
+
+  // The GC thread cannot mark while objects are promoted and the pointers
+  // in the old space are updated.
+  bool is_marking = this->is_marking();
+  if (is_marking) concurrent_marker_->Pause();
+  // The old space is not swept while it is walked, neither by the GC thread
+  // nor by the allocations done while promoting.
+  old->PauseSweeping();
+
   old->Flush();
   from->Flush();
 
@@ -1004,27 +1134,20 @@ void Program::CollectNewSpace() {
     GetHeapUsage(data_heap, &usage_before);
   }
 
-  SemiSpace* to = new SemiSpace(from->Used() / 10);
+  int scavenged = from->Used();
+  int old_used = old->Used();
+  SemiSpace* to = new SemiSpace(scavenged / 10);
 
   // While garbage collecting, do not fail allocations. Instead grow
   // the to-space as needed.
   NoAllocationFailureScope scope(to);
   NoAllocationFailureScope scope2(old);
 
-  GenerationalScavengeVisitor visitor(from, to, old);
-  to->StartScavenge();
-  old->StartScavenge();
-
-  for (auto process : process_list_) process->IterateRoots(&visitor);
-
-  old->VisitRememberedSet(&visitor);
-
-  bool work_found = true;
-  while (work_found) {
-    work_found = to->CompleteScavengeGenerational(&visitor);
-    work_found |= old->CompleteScavengeGenerational(&visitor);
+  {
+    ParallelScavenger scavenger(from, to, old, data_heap->tenuring_policy());
+    for (auto process : process_list_) scavenger.AddProcess(process);
+    scavenger.Scavenge(ParallelScavenger::NumberOfScavengers(from));
   }
-  old->EndScavenge();
 
   data_heap->ProcessWeakPointers(from);
 
@@ -1032,17 +1155,32 @@ void Program::CollectNewSpace() {
     process->set_ports(Port::CleanupPorts(from, process->ports()));
   }
 
+  // The promoted bytes are only counted once the old space is flushed.
+  old->Flush();
+  int survived = to->Used() + old->Used() - old_used;
+  int64 pause = Platform::GetMicroseconds() - start;
+  data_heap->sizing_policy()->RecordScavenge(scavenged, survived, pause);
+
   // Second space argument is used to size the new-space.
   data_heap->ReplaceSpace(to, old);
 
+  old->ResumeSweeping();
+  if (is_marking) concurrent_marker_->Resume();
+
   if (Flags::print_heap_statistics) {
     HeapUsage usage_after;
     GetHeapUsage(data_heap, &usage_after);
     PrintProcessGCInfo(&usage_before, &usage_after);
   }
 
-  if (old->needs_garbage_collection()) {
-    CollectSharedGarbage();
+  if (is_marking) {
+    if (concurrent_marker_->ShouldFinish()) CollectSharedGarbage();
+  } else if (old->needs_garbage_collection()) {
+    if (Flags::concurrent_marking && scheduler_ != NULL) {
+      StartConcurrentMarking();
+    } else {
+      CollectSharedGarbage();
+    }
   }
 
   UpdateStackLimits();
@@ -1053,19 +1191,22 @@ void Program::UpdateStackLimits() {
 }
 
 int Program::CollectMutableGarbageAndChainStacks() {
+  AbortConcurrentMarking();
+
   // Mark all reachable objects.
   OldSpace* old_space = process_heap()->old_space();
   SemiSpace* new_space = process_heap()->space();
-  MarkingStack marking_stack;
   ASSERT(stack_chain_ == NULL);
-  MarkingVisitor marking_visitor(new_space, old_space, &marking_stack,
-                                 &stack_chain_);
+  old_space->CompleteSweeping();
+  ParallelMarker marker(new_space, old_space, &stack_chain_);
 
   // All processes share the same heap, so we need to iterate all roots from
   // all processes.
-  for (auto process : process_list_) process->IterateRoots(&marking_visitor);
+  for (auto process : process_list_) {
+    process->IterateRoots(marker.root_visitor());
+  }
 
-  marking_stack.Process(&marking_visitor);
+  marker.Process();
 
   // Weak processing.
   process_heap()->ProcessWeakPointers(old_space);
@@ -1073,19 +1214,13 @@ int Program::CollectMutableGarbageAndChainStacks() {
     process->set_ports(Port::CleanupPorts(old_space, process->ports()));
   }
 
-  // Flush outstanding free_list chunks into the free list. Then sweep
-  // over the heap and rebuild the freelist.
-  old_space->Flush();
-  SweepingVisitor sweeping_visitor(old_space->free_list());
-  old_space->IterateObjects(&sweeping_visitor);
-
-  // TODO(erikcorry): Find a better way to delete the mark bits on the new
-  // space.
-  SweepingVisitor new_space_sweeper(NULL);
-  new_space->IterateObjects(&new_space_sweeper);
+  // The program GC visits all objects in the heap, so the old space is
+  // swept right away.
+  old_space->StartSweeping();
+  old_space->CompleteSweeping();
 
   UpdateStackLimits();
-  return marking_visitor.number_of_stacks();
+  return marker.number_of_stacks();
 }
 
 void Program::CookStacks(int number_of_stacks) {
@@ -10,6 +10,7 @@
 #include "src/vm/debug_info.h"
 #include "src/vm/double_list.h"
 #include "src/vm/heap.h"
+#include "src/vm/latency_histogram.h"
 #include "src/vm/lookup_cache.h"
 #include "src/vm/links.h"
 #include "src/vm/program_folder.h"
@@ -20,6 +21,7 @@ namespace dartino {
 typedef void (*ProgramExitListener)(Program*, int exitcode, void* data);
 
 class Class;
+class ConcurrentMarker;
 class Function;
 class Method;
 class Process;
@@ -27,6 +29,7 @@ class ProcessVisitor;
 class ProgramTableRewriter;
 class Scheduler;
 class Session;
+class WorkerThread;
 
 // Defines all the roots in the program heap.
 #define ROOTS_DO(V)                                             \
@@ -196,6 +199,21 @@ class Program : public ProgramList::Entry {
     scheduler_ = scheduler;
   }
 
+  // The scheduler worker interpreting processes of this program, if any.
+  WorkerThread* interpreter() const { return interpreter_; }
+
+  // Makes [worker] the only worker interpreting this program. Fails if
+  // another worker already is.
+  bool TryClaimInterpreter(WorkerThread* worker) {
+    WorkerThread* expected = NULL;
+    return interpreter_.compare_exchange_strong(expected, worker);
+  }
+
+  void ReleaseInterpreter(WorkerThread* worker) {
+    ASSERT(interpreter_ == worker);
+    interpreter_ = NULL;
+  }
+
   void SetProgramExitListener(ProgramExitListener listener, void* data) {
     program_exit_listener_ = listener;
     program_exit_listener_data_ = data;
@@ -213,6 +231,35 @@ class Program : public ProgramList::Entry {
 
   ProgramState* program_state() { return &program_state_; }
 
+  static const int kDefaultCpuWeight = 100;
+
+  // The relative share of CPU time this program gets when competing with
+  // other programs for the interpreter.
+  int cpu_weight() const { return cpu_weight_; }
+  void set_cpu_weight(int weight) {
+    ASSERT(weight > 0);
+    cpu_weight_ = weight;
+  }
+
+  // The time spent interpreting processes of this program, in microseconds.
+  uint64 cpu_time() const { return cpu_time_; }
+
+  // The CPU time of this program scaled by the inverse of its weight.
+  uint64 virtual_time() const { return virtual_time_; }
+
+  // Only called by the worker thread interpreting this program.
+  void AddCpuTime(uint64 microseconds) {
+    cpu_time_ += microseconds;
+    virtual_time_ += microseconds * kDefaultCpuWeight / cpu_weight_;
+  }
+
+  uword group_mask() const { return group_mask_; }
+
+  // The scheduler latencies of all processes of this program, or NULL if none
+  // were recorded. Only the worker interpreting the program records them.
+  SchedulerLatency* latency() const { return latency_; }
+  void set_latency(SchedulerLatency* latency) { latency_ = latency; }
+
   int hashtag() const { return hashtag_; }
   void set_hashtag(int value) { hashtag_ = value; }
 
@@ -293,6 +340,29 @@ class Program : public ProgramList::Entry {
   void CollectNewSpace();
   void PerformSharedGarbageCollection();
 
+  // Concurrent marking of the shared heap, see [ConcurrentMarker]. It is
+  // started by [CollectNewSpace] when -Xconcurrent_marking is set and
+  // finished by [CollectSharedGarbage].
+  bool is_marking() const { return is_marking_ != 0; }
+  void AbortConcurrentMarking();
+
+  // Called on the GC thread.
+  void MarkConcurrently();
+  void SweepConcurrently();
+
+  // Write barrier for stores into heap objects that are not done by the
+  // generated interpreter. Must be called with the value about to be
+  // overwritten.
+  void RecordOverwrite(Object* old_value) {
+    if (is_marking_ != 0) RecordOverwriteSlow(old_value);
+  }
+
+  // Must be called before [coroutine] becomes the current coroutine of a
+  // process.
+  void RecordActivation(Coroutine* coroutine) {
+    if (is_marking_ != 0) RecordActivationSlow(coroutine);
+  }
+
   void PrintStatistics();
 
   // Iterates over all roots in the program.
@@ -320,6 +390,10 @@ class Program : public ProgramList::Entry {
   ROOTS_DO(ROOT_ACCESSOR)
 #undef ROOT_ACCESSOR
 
+  static const int kIsMarkingOffset =
+      kFirstRootOffset + sizeof(void*) * kNumberOfRoots;
+  static const int kPageDirectoriesOffset = kIsMarkingOffset + kWordSize;
+
   RandomXorShift* random() { return &random_; }
 
   void PrepareProgramGC();
@@ -370,6 +444,19 @@ class Program : public ProgramList::Entry {
 
   void ValidateGlobalHeapsAreConsistent();
 
+  void StartConcurrentMarking();
+  void FinishConcurrentMarking();
+  void TriggerConcurrentSweeping();
+
+  // Evacuates the sparse chunks of the old space if it needs compaction,
+  // and updates the pointers to the moved objects, except for the weak
+  // ones. Called after marking, before the weak pointers are processed.
+  // Returns true if chunks were evacuated, in which case they must be
+  // released once the weak pointers have been processed.
+  bool CompactOldSpace();
+  void RecordOverwriteSlow(Object* old_value);
+  void RecordActivationSlow(Coroutine* coroutine);
+
   // Chaining of all processes of this program.
   void AddToProcessList(Process* process);
   void RemoveFromProcessList(Process* process);
@@ -378,6 +465,14 @@ class Program : public ProgramList::Entry {
   ROOTS_DO(ROOT_DECLARATION)
 #undef ROOT_DECLARATION
 
+  // Non-zero while the shared heap is marked concurrently. Read by the
+  // write barrier in the generated interpreter, so it follows the roots.
+  word is_marking_;
+
+  // The root of the page tables, read by the card-marking write barrier in
+  // the generated interpreter.
+  void* const page_directories_;
+
   // Chained doubly linked list of all processes protected by a lock.
   Mutex* process_list_mutex_;
   ProcessList process_list_;
@@ -388,6 +483,7 @@ class Program : public ProgramList::Entry {
   Heap process_heap_;
 
   Scheduler* scheduler_;
+  Atomic<WorkerThread*> interpreter_;
   ProgramState program_state_;
 
   // Session operating on this program.
@@ -411,9 +507,17 @@ class Program : public ProgramList::Entry {
 
   LookupCache* cache_;
 
+  ConcurrentMarker* concurrent_marker_;
+
   Breakpoints breakpoints_;
 
   uword group_mask_;
+
+  int cpu_weight_;
+  uint64 cpu_time_;
+  uint64 virtual_time_;
+
+  Atomic<SchedulerLatency*> latency_;
 };
 
 }  // namespace dartino
@@ -4,6 +4,8 @@
 
 #include "src/vm/program_groups.h"
 
+#include "src/shared/utils.h"
+
 namespace dartino {
 
 ProgramGroups::ProgramGroups() : used_group_mask_(0) {}
@@ -16,6 +18,8 @@ ProgramGroup ProgramGroups::Create(const char* name) {
     if ((used_group_mask_ >> bit) != 1) {
       used_group_mask_ |= 1 << bit;
       group_names_[bit] = name;
+      cpu_weights_[bit] = Program::kDefaultCpuWeight;
+      virtual_times_[bit] = 0;
       return bit + 1;
     }
   }
@@ -54,4 +58,29 @@ bool ProgramGroups::IsValidGroup(ProgramGroup group) {
   return (used_group_mask_ & (1 << bit)) != 0;
 }
 
+void ProgramGroups::SetCpuWeight(ProgramGroup group, int weight) {
+  ASSERT(IsValidGroup(group));
+  ASSERT(weight > 0);
+  uword bit = group - 1;
+  cpu_weights_[bit] = weight;
+}
+
+void ProgramGroups::AddCpuTime(uword group_mask, uint64 microseconds) {
+  ScopedSpinlock locker(&spinlock_);
+  for (uword bit = 0; bit < kNumberOfGroups; bit++) {
+    if ((group_mask & (1 << bit)) == 0) continue;
+    virtual_times_[bit] +=
+        microseconds * Program::kDefaultCpuWeight / cpu_weights_[bit];
+  }
+}
+
+uint64 ProgramGroups::VirtualTime(uword group_mask) {
+  uint64 result = 0;
+  for (uword bit = 0; bit < kNumberOfGroups; bit++) {
+    if ((group_mask & (1 << bit)) == 0) continue;
+    result = Utils::Maximum(result, virtual_times_[bit]);
+  }
+  return result;
+}
+
 }  // namespace dartino
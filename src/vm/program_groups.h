@@ -7,6 +7,7 @@
 
 #include "src/shared/globals.h"
 #include "src/vm/program.h"
+#include "src/vm/spinlock.h"
 
 namespace dartino {
 
@@ -26,9 +27,25 @@ class ProgramGroups {
   bool ContainsProgram(ProgramGroup group, Program* program);
   bool IsValidGroup(ProgramGroup group);
 
+  // The relative share of CPU time all programs of [group] together get when
+  // competing with other programs.
+  void SetCpuWeight(ProgramGroup group, int weight);
+
+  // Charge [microseconds] of CPU time to all groups in [group_mask].
+  void AddCpuTime(uword group_mask, uint64 microseconds);
+
+  // The largest virtual time of the groups in [group_mask], or 0 if the mask
+  // is empty.
+  uint64 VirtualTime(uword group_mask);
+
  private:
   char const* group_names_[kNumberOfGroups];
   uword used_group_mask_;
+
+  // Guards the updates of [virtual_times_].
+  Spinlock spinlock_;
+  int cpu_weights_[kNumberOfGroups];
+  uint64 virtual_times_[kNumberOfGroups];
 };
 
 }  // namespace dartino
@@ -5,12 +5,17 @@
 #ifndef SRC_VM_REMEMBERED_SET_H_
 #define SRC_VM_REMEMBERED_SET_H_
 
+#include "src/vm/object.h"
+#include "src/vm/object_memory.h"
+
 namespace dartino {
 
-// TODO(erikcorry): Implement remembered set.
+// The remembered set is kept in the card table of the old space. Inserting
+// an object dirties the card holding its header, so the next scavenge visits
+// the object.
 class RememberedSet {
  public:
-  inline void Insert(HeapObject* h) {}
+  inline void Insert(HeapObject* h) { ObjectMemory::DirtyCard(h->address()); }
 };
 
 }  // namespace dartino
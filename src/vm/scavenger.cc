@@ -0,0 +1,464 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/vm/scavenger.h"
+
+#include <string.h>
+
+#include "src/vm/heap.h"
+#include "src/vm/object.h"
+#include "src/vm/process.h"
+
+namespace dartino {
+
+// The visitor of one scavenging thread. It owns a copy buffer in the to-space
+// for each age, and one in the old space, and scans the objects it copies
+// into them unless it shares them with other threads.
+class ScavengeWorker : public PointerVisitor {
+ public:
+  explicit ScavengeWorker(ParallelScavenger* scavenger)
+      : scavenger_(scavenger),
+        from_(scavenger->from_),
+        to_(scavenger->to_),
+        old_(scavenger->old_),
+        threshold_(scavenger->policy_->threshold()),
+        found_young_pointer_(false),
+        promoted_live_bytes_(0) {
+    memset(survived_, 0, sizeof(survived_));
+    memset(survived_young_, 0, sizeof(survived_young_));
+  }
+
+  virtual void VisitClass(Object** p) {}
+
+  virtual void Visit(Object** p) { VisitBlock(p, p + 1); }
+
+  virtual void VisitBlock(Object** start, Object** end) {
+    for (Object** p = start; p < end; p++) {
+      Object* object = *p;
+      if (!object->IsHeapObject()) continue;
+      if (!from_->Includes(reinterpret_cast<uword>(object))) {
+        // Optimization that mostly triggers on large arrays of 'null'.
+        while (p < end - 1 && p[1] == object) p++;
+        continue;
+      }
+      HeapObject* target = Forward(reinterpret_cast<HeapObject*>(object));
+      *p = target;
+      if (to_->Includes(target->address())) found_young_pointer_ = true;
+    }
+  }
+
+  void Run();
+
+  // Gives back the unused parts of the buffers. Called once all threads are
+  // done.
+  void Finish();
+
+  int promoted_live_bytes() const { return promoted_live_bytes_; }
+
+  // The bytes of the survivors by their new age.
+  int survived(int age) const { return survived_[age]; }
+
+  // The bytes of each pretenuring kind that survived their first scavenge.
+  int survived_young(int kind) const { return survived_young_[kind]; }
+
+ private:
+  static const int kBufferSize = 16 * KB;
+  // Larger objects are promoted, and allocated directly in the old space.
+  // Fresh process stacks are smaller, so they are aged like other objects
+  // instead of being promoted the first time they survive.
+  static const int kMaximumBufferedSize = kBufferSize / 4;
+  static_assert(Stack::kSize + Process::kInitialStackLength * kPointerSize <=
+                    kMaximumBufferedSize,
+                "initial stacks are promoted");
+
+  // The objects in [scan, top) have been copied, but not scanned yet.
+  struct Buffer {
+    Buffer() : scan(0), top(0), limit(0) {}
+    uword scan;
+    uword top;
+    uword limit;
+  };
+
+  typedef ParallelScavenger::Region Region;
+
+  HeapObject* Forward(HeapObject* object);
+
+  uword AllocateYoung(int age, int size);
+  uword AllocateOld(int size, bool* in_buffer);
+  void RetireYoung(int age);
+  void RetireOld();
+
+  void ScanCopiedObjects();
+  // Returns false if there was nothing to scan in the to-space buffers.
+  bool ScanYoungBuffers();
+  void ScanRegion(const Region& region);
+
+  // Publishes the objects that have been copied but not scanned yet, except
+  // for one region to go on with.
+  void ShareWork();
+  void MoveToRegions(Buffer* buffer, bool promoted);
+  void ScanPromotedObject(HeapObject* object);
+  void ScanRememberedObject(HeapObject* object);
+
+  ParallelScavenger* const scavenger_;
+  SemiSpace* const from_;
+  SemiSpace* const to_;
+  OldSpace* const old_;
+  const int threshold_;
+  // Indexed by age. The survivors of age [threshold_] are promoted.
+  Buffer young_buffers_[TenuringPolicy::kMaximumThreshold];
+  Buffer old_buffer_;
+  // Copied objects that are no longer in a buffer, but not scanned yet.
+  Vector<Region> regions_;
+  bool found_young_pointer_;
+  int promoted_live_bytes_;
+  int survived_[TenuringPolicy::kMaximumThreshold + 1];
+  int survived_young_[TenuringPolicy::NUMBER_OF_KINDS];
+};
+
+static HeapObject* ForwardingAddress(Object* header) {
+  ASSERT(header->IsSmi());
+  return HeapObject::FromAddress(reinterpret_cast<uword>(header));
+}
+
+HeapObject* ScavengeWorker::Forward(HeapObject* object) {
+  Atomic<Object*>* header = reinterpret_cast<Atomic<Object*>*>(
+      object->address() + HeapObject::kClassOffset);
+  Object* klass = header->load(kAcquire);
+  if (klass->IsSmi()) return ForwardingAddress(klass);
+
+  // The size is computed from the class read above, as another thread can
+  // replace the header with a forwarding address at any time.
+  InstanceFormat format = reinterpret_cast<Class*>(klass)->instance_format();
+  int size = object->SizeForFormat(format);
+  int age = ObjectMemory::GetAge(object->address()) + 1;
+  bool is_large = size > kMaximumBufferedSize;
+  bool promote = is_large || age >= threshold_;
+  bool in_buffer = true;
+  uword location =
+      promote ? AllocateOld(size, &in_buffer) : AllocateYoung(age, size);
+  memcpy(reinterpret_cast<void*>(location),
+         reinterpret_cast<void*>(object->address()), size);
+  HeapObject* target = HeapObject::FromAddress(location);
+  // The copy has a forwarding address if another thread won the race.
+  target->set_class(reinterpret_cast<Class*>(klass));
+  if (format.type() == InstanceFormat::STACK_TYPE) {
+    Stack::cast(target)->UpdateFramePointers(reinterpret_cast<Stack*>(object));
+  }
+
+  Object* forwarding = reinterpret_cast<Object*>(location);
+  if (header->compare_exchange_strong(klass, forwarding)) {
+    if (promote) ObjectMemory::RecordObjectStart(location);
+    if (!in_buffer) {
+      Region region = {location, location + size, true};
+      regions_.PushBack(region);
+    }
+    if (!is_large) survived_[age] += size;
+    if (age == 1) {
+      int kind = TenuringPolicy::KindOf(format.type(), size);
+      if (kind >= 0) survived_young_[kind] += size;
+    }
+    return target;
+  }
+
+  // Another thread copied the object first. The copy is the last allocation
+  // in the buffer, or was allocated on its own.
+  if (!in_buffer) {
+    scavenger_->DeallocateInOldSpace(location, size);
+  } else if (promote) {
+    old_buffer_.top -= size;
+  } else {
+    young_buffers_[age].top -= size;
+  }
+  return ForwardingAddress(klass);
+}
+
+uword ScavengeWorker::AllocateYoung(int age, int size) {
+  Buffer* buffer = &young_buffers_[age];
+  if (buffer->limit - buffer->top < static_cast<uword>(size)) {
+    RetireYoung(age);
+    // The to-space is only allocated in card-sized steps, so the cards of
+    // the buffer only hold survivors of its age.
+    uword start = scavenger_->AllocateInToSpace(kBufferSize);
+    ASSERT(Utils::IsAligned(start, ObjectMemory::kCardSize));
+    ObjectMemory::SetAge(start, start + kBufferSize, age);
+    buffer->scan = buffer->top = start;
+    buffer->limit = start + kBufferSize;
+  }
+  uword result = buffer->top;
+  buffer->top += size;
+  return result;
+}
+
+uword ScavengeWorker::AllocateOld(int size, bool* in_buffer) {
+  Buffer* buffer = &old_buffer_;
+  if (buffer->limit - buffer->top < static_cast<uword>(size)) {
+    if (size > kMaximumBufferedSize) {
+      *in_buffer = false;
+      return scavenger_->AllocateInOldSpace(size);
+    }
+    RetireOld();
+    uword start = scavenger_->AllocateInOldSpace(kBufferSize);
+    buffer->scan = buffer->top = start;
+    buffer->limit = start + kBufferSize;
+  }
+  *in_buffer = true;
+  uword result = buffer->top;
+  buffer->top += size;
+  return result;
+}
+
+void ScavengeWorker::RetireYoung(int age) {
+  Buffer* buffer = &young_buffers_[age];
+  if (buffer->limit == 0) return;
+  MoveToRegions(buffer, false);
+  // The unused cards are given back, so the objects later allocated in them
+  // are not aged. The rest of the last used card is filled and not given
+  // back, or the next buffer could start in the middle of that card.
+  uword end = Utils::RoundUp(buffer->top, ObjectMemory::kCardSize);
+  SemiSpace::Fill(buffer->top, end - buffer->top);
+  scavenger_->DeallocateInToSpace(end, buffer->limit - end);
+  ObjectMemory::SetAge(end, buffer->limit, 0);
+  buffer->scan = buffer->top = buffer->limit = 0;
+}
+
+void ScavengeWorker::RetireOld() {
+  Buffer* buffer = &old_buffer_;
+  MoveToRegions(buffer, true);
+  scavenger_->DeallocateInOldSpace(buffer->top, buffer->limit - buffer->top);
+  buffer->scan = buffer->top = buffer->limit = 0;
+}
+
+void ScavengeWorker::Run() {
+  for (Process* process = scavenger_->TakeProcess(); process != NULL;
+       process = scavenger_->TakeProcess()) {
+    process->IterateRoots(this);
+    ScanCopiedObjects();
+  }
+  int first;
+  for (int count = scavenger_->TakeRememberedSetBatch(&first); count > 0;
+       count = scavenger_->TakeRememberedSetBatch(&first)) {
+    for (int i = first; i < first + count; i++) {
+      ScanRememberedObject(scavenger_->remembered_set_[i]);
+    }
+    ScanCopiedObjects();
+  }
+  Region region;
+  while (scavenger_->TakeRegion(&region)) {
+    ScanRegion(region);
+    ScanCopiedObjects();
+  }
+}
+
+void ScavengeWorker::Finish() {
+  ASSERT(regions_.IsEmpty());
+  for (int age = 1; age < threshold_; age++) RetireYoung(age);
+  RetireOld();
+}
+
+void ScavengeWorker::ScanCopiedObjects() {
+  // The scan pointers are moved past an object before it is scanned, because
+  // scanning it can retire the buffer.
+  while (true) {
+    if (scavenger_->HasWaitingWorkers()) ShareWork();
+    if (ScanYoungBuffers()) continue;
+    if (old_buffer_.scan < old_buffer_.top) {
+      HeapObject* object = HeapObject::FromAddress(old_buffer_.scan);
+      old_buffer_.scan += object->Size();
+      ScanPromotedObject(object);
+    } else if (!regions_.IsEmpty()) {
+      ScanRegion(regions_.PopBack());
+    } else {
+      return;
+    }
+  }
+}
+
+bool ScavengeWorker::ScanYoungBuffers() {
+  bool found_work = false;
+  for (int age = 1; age < threshold_; age++) {
+    Buffer* buffer = &young_buffers_[age];
+    while (buffer->scan < buffer->top) {
+      // Scanning a buffer can keep filling it, so check for waiting threads
+      // on the way.
+      if (scavenger_->HasWaitingWorkers()) return true;
+      HeapObject* object = HeapObject::FromAddress(buffer->scan);
+      buffer->scan += object->Size();
+      object->IteratePointers(this);
+      found_work = true;
+    }
+  }
+  return found_work;
+}
+
+void ScavengeWorker::ScanRegion(const Region& region) {
+  for (uword current = region.start; current < region.end;) {
+    HeapObject* object = HeapObject::FromAddress(current);
+    current += object->Size();
+    if (region.promoted) {
+      ScanPromotedObject(object);
+    } else {
+      object->IteratePointers(this);
+    }
+  }
+}
+
+void ScavengeWorker::ShareWork() {
+  for (int age = 1; age < threshold_; age++) {
+    MoveToRegions(&young_buffers_[age], false);
+  }
+  MoveToRegions(&old_buffer_, true);
+  while (regions_.size() > 1) scavenger_->PublishRegion(regions_.PopBack());
+}
+
+void ScavengeWorker::MoveToRegions(Buffer* buffer, bool promoted) {
+  // The objects in the buffer are completely copied, so they can be scanned
+  // while the buffer keeps being filled.
+  if (buffer->scan < buffer->top) {
+    Region region = {buffer->scan, buffer->top, promoted};
+    regions_.PushBack(region);
+    buffer->scan = buffer->top;
+  }
+}
+
+void ScavengeWorker::ScanPromotedObject(HeapObject* object) {
+  ScanRememberedObject(object);
+  if (old_->is_marking_concurrently() &&
+      ObjectMemory::TrySetMarkBit(object->address())) {
+    promoted_live_bytes_ += object->Size();
+  }
+}
+
+void ScavengeWorker::ScanRememberedObject(HeapObject* object) {
+  found_young_pointer_ = false;
+  object->IteratePointers(this);
+  if (found_young_pointer_) ObjectMemory::DirtyCard(object->address());
+}
+
+ParallelScavenger::ParallelScavenger(SemiSpace* from, SemiSpace* to,
+                                     OldSpace* old, TenuringPolicy* policy)
+    : from_(from),
+      to_(to),
+      old_(old),
+      policy_(policy),
+      mutex_(Platform::CreateMutex()),
+      next_process_(0),
+      next_remembered_(0),
+      workers_(NULL),
+      number_of_workers_(0),
+      monitor_(Platform::CreateMonitor()),
+      idle_workers_(0),
+      waiting_workers_(0) {}
+
+ParallelScavenger::~ParallelScavenger() {
+  ASSERT(shared_regions_.IsEmpty());
+  delete monitor_;
+  delete mutex_;
+}
+
+int ParallelScavenger::NumberOfScavengers(SemiSpace* from) {
+  // Waking up the helpers is not worth it for small new spaces.
+  if (from->Used() < kMinimumParallelSize) return 1;
+  return 1 + GCHelperPool::GlobalInstance()->number_of_threads();
+}
+
+void ParallelScavenger::Scavenge(int number_of_scavengers) {
+  // The remembered set is taken before anything is promoted, as promoting
+  // allocates the free memory that the card walk steps over.
+  old_->TakeRememberedSet(&remembered_set_);
+
+  GCHelperPool* pool = GCHelperPool::GlobalInstance();
+  int number_of_helpers = pool->Reserve(number_of_scavengers - 1);
+  number_of_workers_ = number_of_helpers + 1;
+  workers_ = new ScavengeWorker*[number_of_workers_];
+  for (int i = 0; i < number_of_workers_; i++) {
+    workers_[i] = new ScavengeWorker(this);
+  }
+  pool->Start(this, number_of_helpers);
+  workers_[0]->Run();
+  pool->Join(this);
+
+  int survived[TenuringPolicy::kMaximumThreshold + 1] = {0};
+  int survived_young[TenuringPolicy::NUMBER_OF_KINDS] = {0};
+  for (int i = 0; i < number_of_workers_; i++) {
+    ScavengeWorker* worker = workers_[i];
+    worker->Finish();
+    old_->AddPromotedLiveBytes(worker->promoted_live_bytes());
+    for (int age = 1; age <= TenuringPolicy::kMaximumThreshold; age++) {
+      survived[age] += worker->survived(age);
+    }
+    for (int kind = 0; kind < TenuringPolicy::NUMBER_OF_KINDS; kind++) {
+      survived_young[kind] += worker->survived_young(kind);
+    }
+    delete worker;
+  }
+  delete[] workers_;
+  workers_ = NULL;
+  policy_->Update(from_->Used(), survived, survived_young);
+}
+
+void ParallelScavenger::RunHelper(int index) {
+  workers_[index + 1]->Run();
+}
+
+uword ParallelScavenger::AllocateInToSpace(int size) {
+  ScopedLock locker(mutex_);
+  return to_->Allocate(size);
+}
+
+uword ParallelScavenger::AllocateInOldSpace(int size) {
+  ScopedLock locker(mutex_);
+  return old_->Allocate(size);
+}
+
+void ParallelScavenger::DeallocateInToSpace(uword location, int size) {
+  ScopedLock locker(mutex_);
+  to_->Deallocate(location, size);
+}
+
+void ParallelScavenger::DeallocateInOldSpace(uword location, int size) {
+  ScopedLock locker(mutex_);
+  old_->Deallocate(location, size);
+}
+
+Process* ParallelScavenger::TakeProcess() {
+  int index = next_process_++;
+  if (index >= static_cast<int>(processes_.size())) return NULL;
+  return processes_[index];
+}
+
+int ParallelScavenger::TakeRememberedSetBatch(int* first) {
+  int size = remembered_set_.size();
+  int index = next_remembered_.fetch_add(kRememberedSetBatchSize);
+  if (index >= size) return 0;
+  *first = index;
+  return Utils::Minimum(kRememberedSetBatchSize, size - index);
+}
+
+void ParallelScavenger::PublishRegion(const Region& region) {
+  ScopedMonitorLock locker(monitor_);
+  shared_regions_.PushBack(region);
+  if (waiting_workers_ > 0) monitor_->Notify();
+}
+
+bool ParallelScavenger::TakeRegion(Region* region) {
+  ScopedMonitorLock locker(monitor_);
+  idle_workers_++;
+  while (shared_regions_.IsEmpty()) {
+    // Only threads that are not idle publish work, so the scavenge is done
+    // when all of them are idle.
+    if (idle_workers_ == number_of_workers_) {
+      if (waiting_workers_ > 0) monitor_->NotifyAll();
+      return false;
+    }
+    waiting_workers_++;
+    monitor_->Wait();
+    waiting_workers_--;
+  }
+  idle_workers_--;
+  *region = shared_regions_.PopBack();
+  return true;
+}
+
+}  // namespace dartino
@@ -0,0 +1,108 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#ifndef SRC_VM_SCAVENGER_H_
+#define SRC_VM_SCAVENGER_H_
+
+#include "src/shared/atomic.h"
+#include "src/shared/platform.h"
+#include "src/vm/gc_helper_pool.h"
+#include "src/vm/object_memory.h"
+#include "src/vm/vector.h"
+
+namespace dartino {
+
+class Process;
+class ScavengeWorker;
+class TenuringPolicy;
+
+// Scavenges the new space, on several threads if it is large. The calling
+// thread is helped by the idle threads of the [GCHelperPool]. The process
+// roots and the objects of the remembered set are split between the threads.
+// Each thread copies objects into its own buffers in the to-space and the
+// old space, and installs forwarding addresses with a compare-and-swap, so an
+// object reached by several threads is only copied once. A thread scans the
+// objects it copied, and hands ranges of them to a shared work list while
+// other threads are out of work. The scavenge is done when all threads are
+// out of work.
+//
+// The survivors are promoted when they reach the age given by the tenuring
+// policy, which is updated with the survival rates afterwards. Objects too
+// large for the buffers are promoted when they first survive.
+class ParallelScavenger : public GCHelperTask {
+ public:
+  ParallelScavenger(SemiSpace* from, SemiSpace* to, OldSpace* old,
+                    TenuringPolicy* policy);
+  ~ParallelScavenger();
+
+  // Returns the number of threads to scavenge [from] with.
+  static int NumberOfScavengers(SemiSpace* from);
+
+  void AddProcess(Process* process) { processes_.PushBack(process); }
+
+  // Must be called in a no-allocation-failure scope for the to-space and the
+  // old space, with the sweeping of the old space paused.
+  void Scavenge(int number_of_scavengers);
+
+  virtual void RunHelper(int index);
+
+ private:
+  friend class ScavengeWorker;
+
+  static const int kMinimumParallelSize = 256 * KB;
+  static const int kRememberedSetBatchSize = 64;
+
+  // Copied objects that have not been scanned yet.
+  struct Region {
+    uword start;
+    uword end;
+    bool promoted;
+  };
+
+  // The spaces are shared, so the threads allocate their buffers, and the
+  // objects too large for them, under a lock.
+  uword AllocateInToSpace(int size);
+  uword AllocateInOldSpace(int size);
+  void DeallocateInToSpace(uword location, int size);
+  void DeallocateInOldSpace(uword location, int size);
+
+  // Returns the next process whose roots should be visited, or NULL.
+  Process* TakeProcess();
+
+  // Returns the number of remembered-set objects taken, starting at
+  // [*first].
+  int TakeRememberedSetBatch(int* first);
+
+  // Whether some threads wait for work to be published.
+  bool HasWaitingWorkers() const { return waiting_workers_ > 0; }
+
+  void PublishRegion(const Region& region);
+
+  // Returns false once all threads have run out of work. Blocks while other
+  // threads may still publish work.
+  bool TakeRegion(Region* region);
+
+  SemiSpace* const from_;
+  SemiSpace* const to_;
+  OldSpace* const old_;
+  TenuringPolicy* const policy_;
+  Mutex* const mutex_;
+  Vector<Process*> processes_;
+  Vector<HeapObject*> remembered_set_;
+  Atomic<int> next_process_;
+  Atomic<int> next_remembered_;
+
+  ScavengeWorker** workers_;
+  int number_of_workers_;
+
+  // The work list, guarded by [monitor_].
+  Monitor* const monitor_;
+  Vector<Region> shared_regions_;
+  int idle_workers_;
+  Atomic<int> waiting_workers_;
+};
+
+}  // namespace dartino
+
+#endif  // SRC_VM_SCAVENGER_H_
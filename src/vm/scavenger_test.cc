@@ -0,0 +1,474 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include <string.h>
+
+#include "src/shared/assert.h"
+#include "src/shared/flags.h"
+#include "src/shared/random.h"
+#include "src/shared/test_case.h"
+#include "src/vm/heap.h"
+#include "src/vm/object.h"
+#include "src/vm/object_memory.h"
+#include "src/vm/process.h"
+#include "src/vm/scavenger.h"
+
+namespace dartino {
+
+static const int kYoungObjects = 1000;
+static const int kRoots = 300;
+static const int kRootLength = 16;
+
+class CountingVisitor : public HeapObjectVisitor {
+ public:
+  CountingVisitor() : count_(0) {}
+
+  virtual int Visit(HeapObject* object) {
+    count_++;
+    return object->Size();
+  }
+
+  int count() const { return count_; }
+
+ private:
+  int count_;
+};
+
+static int YoungIndex(int root, int i) {
+  return (root * 7 + i * 13) % kYoungObjects;
+}
+
+TEST_CASE(ParallelScavenger) {
+  RandomXorShift random;
+  Heap program_heap(&random, 4 * KB);
+  Class* meta_class = Class::cast(program_heap.CreateMetaClass());
+  Class* array_class = Class::cast(program_heap.CreateClass(
+      InstanceFormat::array_format(), meta_class, NULL));
+
+  Heap heap(&random, 4 * KB);
+  SemiSpace* from = heap.space();
+  OldSpace* old = heap.old_space();
+  Array* roots[kRoots];
+  {
+    NoAllocationFailureScope from_scope(from);
+    NoAllocationFailureScope old_scope(old);
+
+    // A chain of young arrays, each holding its index.
+    Array* young[kYoungObjects];
+    for (int i = 0; i < kYoungObjects; i++) {
+      young[i] = Array::cast(heap.CreateArray(array_class, 2, Smi::zero()));
+      young[i]->set(0, Smi::FromWord(i));
+      if (i > 0) young[i]->set(1, young[i - 1]);
+    }
+
+    // Old arrays in the remembered set share the young arrays, so the
+    // threads race to copy them.
+    for (int r = 0; r < kRoots; r++) {
+      Array* array = Array::cast(
+          heap.CreateArray(array_class, kRootLength, Smi::zero()));
+      for (int i = 0; i < kRootLength; i++) {
+        array->set(i, young[YoungIndex(r, i)]);
+      }
+      uword address = old->Allocate(array->Size());
+      memcpy(reinterpret_cast<void*>(address),
+             reinterpret_cast<void*>(array->address()), array->Size());
+      roots[r] = Array::cast(HeapObject::FromAddress(address));
+      ObjectMemory::DirtyCard(address);
+    }
+  }
+  old->Flush();
+  from->Flush();
+
+  SemiSpace* to = new SemiSpace(from->Used() / 10);
+  {
+    NoAllocationFailureScope to_scope(to);
+    NoAllocationFailureScope old_scope(old);
+    old->PauseSweeping();
+    TenuringPolicy policy;
+    ParallelScavenger scavenger(from, to, old, &policy);
+    scavenger.Scavenge(4);
+    old->ResumeSweeping();
+  }
+
+  // Every young array was copied once, and its chain is intact.
+  HeapObject* copies[kYoungObjects];
+  memset(copies, 0, sizeof(copies));
+  for (int r = 0; r < kRoots; r++) {
+    bool points_to_young = false;
+    for (int i = 0; i < kRootLength; i++) {
+      int index = YoungIndex(r, i);
+      Array* copy = Array::cast(roots[r]->get(i));
+      EXPECT(!from->Includes(copy->address()));
+      if (copies[index] == NULL) copies[index] = copy;
+      EXPECT_EQ(copies[index], copy);
+      points_to_young |= to->Includes(copy->address());
+      for (int j = index; j > 0; j--) {
+        EXPECT_EQ(j, Smi::cast(copy->get(0))->value());
+        copy = Array::cast(copy->get(1));
+        EXPECT(!from->Includes(copy->address()));
+      }
+    }
+    // The cards of objects still pointing to the new space stay dirty.
+    if (points_to_young) {
+      EXPECT(*ObjectMemory::GetCard(roots[r]->address()) ==
+             ObjectMemory::kDirtyCard);
+    }
+  }
+
+  // The unused parts of the copy buffers were made iterable again.
+  heap.ReplaceSpace(to);
+  CountingVisitor visitor;
+  heap.IterateObjects(&visitor);
+  EXPECT(visitor.count() >= kYoungObjects + kRoots);
+}
+
+TEST_CASE(ParallelScavengerSharesWork) {
+  RandomXorShift random;
+  Heap program_heap(&random, 4 * KB);
+  Class* meta_class = Class::cast(program_heap.CreateMetaClass());
+  Class* array_class = Class::cast(program_heap.CreateClass(
+      InstanceFormat::array_format(), meta_class, NULL));
+
+  Heap heap(&random, 4 * KB);
+  SemiSpace* from = heap.space();
+  OldSpace* old = heap.old_space();
+  Array* root;
+  {
+    NoAllocationFailureScope scope(old);
+    Array* array = Array::cast(heap.CreateArray(array_class, 1, Smi::zero()));
+    uword address = old->Allocate(array->Size());
+    memcpy(reinterpret_cast<void*>(address),
+           reinterpret_cast<void*>(array->address()), array->Size());
+    root = Array::cast(HeapObject::FromAddress(address));
+  }
+
+  // A wide tree behind a single root, so the other threads only get work
+  // that is shared with them.
+  static const int kWidth = 200;
+  static const int kLeaves = 50;
+  {
+    NoAllocationFailureScope scope(from);
+    Array* tree =
+        Array::cast(heap.CreateArray(array_class, kWidth, Smi::zero()));
+    for (int i = 0; i < kWidth; i++) {
+      Array* node =
+          Array::cast(heap.CreateArray(array_class, kLeaves, Smi::zero()));
+      for (int j = 0; j < kLeaves; j++) {
+        Array* leaf =
+            Array::cast(heap.CreateArray(array_class, 1, Smi::zero()));
+        leaf->set(0, Smi::FromWord(i * kLeaves + j));
+        node->set(j, leaf);
+      }
+      tree->set(i, node);
+    }
+    root->set(0, tree);
+  }
+  ObjectMemory::DirtyCard(root->address());
+  old->Flush();
+  from->Flush();
+
+  SemiSpace* to = new SemiSpace(from->Used());
+  {
+    NoAllocationFailureScope to_scope(to);
+    NoAllocationFailureScope old_scope(old);
+    old->PauseSweeping();
+    TenuringPolicy policy;
+    ParallelScavenger scavenger(from, to, old, &policy);
+    scavenger.Scavenge(8);
+    old->ResumeSweeping();
+  }
+
+  Array* tree = Array::cast(root->get(0));
+  EXPECT(to->Includes(tree->address()));
+  for (int i = 0; i < kWidth; i++) {
+    Array* node = Array::cast(tree->get(i));
+    EXPECT(!from->Includes(node->address()));
+    for (int j = 0; j < kLeaves; j++) {
+      Array* leaf = Array::cast(node->get(j));
+      EXPECT(!from->Includes(leaf->address()));
+      EXPECT_EQ(i * kLeaves + j, Smi::cast(leaf->get(0))->value());
+    }
+  }
+  heap.ReplaceSpace(to);
+}
+
+TEST_CASE(ScavengerTenuring) {
+  RandomXorShift random;
+  Heap program_heap(&random, 4 * KB);
+  Class* meta_class = Class::cast(program_heap.CreateMetaClass());
+  Class* array_class = Class::cast(program_heap.CreateClass(
+      InstanceFormat::array_format(), meta_class, NULL));
+
+  Heap heap(&random, 4 * KB);
+  OldSpace* old = heap.old_space();
+  TenuringPolicy* policy = heap.tenuring_policy();
+  Array* root;
+  {
+    NoAllocationFailureScope scope(old);
+    Array* array = Array::cast(heap.CreateArray(array_class, 1, Smi::zero()));
+    uword address = old->Allocate(array->Size());
+    memcpy(reinterpret_cast<void*>(address),
+           reinterpret_cast<void*>(array->address()), array->Size());
+    root = Array::cast(HeapObject::FromAddress(address));
+  }
+  Object* young = heap.CreateArray(array_class, 2, Smi::zero());
+  root->set(0, young);
+  ObjectMemory::DirtyCard(root->address());
+  EXPECT_EQ(0, ObjectMemory::GetAge(HeapObject::cast(young)->address()));
+
+  // The array gets older with every scavenge, until it is promoted.
+  int threshold = policy->threshold();
+  EXPECT(threshold == TenuringPolicy::kMaximumThreshold);
+  for (int age = 1; age <= threshold; age++) {
+    SemiSpace* from = heap.space();
+    {
+      // Garbage, so the array is a small part of the new space.
+      NoAllocationFailureScope scope(from);
+      heap.CreateArray(array_class, 1000, Smi::zero());
+    }
+    from->Flush();
+    SemiSpace* to = new SemiSpace(4 * KB);
+    {
+      NoAllocationFailureScope to_scope(to);
+      NoAllocationFailureScope old_scope(old);
+      old->PauseSweeping();
+      ParallelScavenger scavenger(from, to, old, policy);
+      scavenger.Scavenge(1);
+      old->ResumeSweeping();
+    }
+    heap.ReplaceSpace(to);
+    EXPECT_EQ(threshold, policy->threshold());
+    HeapObject* copy = HeapObject::cast(root->get(0));
+    if (age < threshold) {
+      EXPECT(to->Includes(copy->address()));
+      EXPECT_EQ(age, ObjectMemory::GetAge(copy->address()));
+    } else {
+      EXPECT(old->Includes(copy->address()));
+    }
+  }
+
+  // New objects are not aged, even next to the survivors.
+  Object* object = heap.CreateArray(array_class, 2, Smi::zero());
+  EXPECT_EQ(0, ObjectMemory::GetAge(HeapObject::cast(object)->address()));
+}
+
+TEST_CASE(ScavengerAgesStacks) {
+  RandomXorShift random;
+  Heap program_heap(&random, 4 * KB);
+  Class* meta_class = Class::cast(program_heap.CreateMetaClass());
+  Class* array_class = Class::cast(program_heap.CreateClass(
+      InstanceFormat::array_format(), meta_class, NULL));
+  Class* stack_class = Class::cast(program_heap.CreateClass(
+      InstanceFormat::stack_format(), meta_class, NULL));
+
+  Heap heap(&random, 4 * KB);
+  OldSpace* old = heap.old_space();
+  TenuringPolicy* policy = heap.tenuring_policy();
+  Array* root;
+  {
+    NoAllocationFailureScope scope(old);
+    Array* array = Array::cast(heap.CreateArray(array_class, 1, Smi::zero()));
+    uword address = old->Allocate(array->Size());
+    memcpy(reinterpret_cast<void*>(address),
+           reinterpret_cast<void*>(array->address()), array->Size());
+    root = Array::cast(HeapObject::FromAddress(address));
+  }
+  SemiSpace* from = heap.space();
+  Stack* stack;
+  {
+    NoAllocationFailureScope scope(from);
+    stack = Stack::cast(
+        heap.CreateStack(stack_class, Process::kInitialStackLength));
+  }
+  stack->set(0, NULL);
+  root->set(0, stack);
+  ObjectMemory::DirtyCard(root->address());
+  from->Flush();
+
+  // A fresh process stack survives its first scavenge in the new space.
+  SemiSpace* to = new SemiSpace(16 * KB);
+  {
+    NoAllocationFailureScope to_scope(to);
+    NoAllocationFailureScope old_scope(old);
+    old->PauseSweeping();
+    ParallelScavenger scavenger(from, to, old, policy);
+    scavenger.Scavenge(1);
+    old->ResumeSweeping();
+  }
+  heap.ReplaceSpace(to);
+  HeapObject* copy = HeapObject::cast(root->get(0));
+  EXPECT(to->Includes(copy->address()));
+  EXPECT_EQ(1, ObjectMemory::GetAge(copy->address()));
+  EXPECT(Stack::cast(copy)->length() == Process::kInitialStackLength);
+}
+
+// Scavenges [heap] with a single thread.
+static void Scavenge(Heap* heap) {
+  SemiSpace* from = heap->space();
+  OldSpace* old = heap->old_space();
+  from->Flush();
+  // Sized like the to-space of a program, so it holds several buffers.
+  SemiSpace* to = new SemiSpace(from->Used() / 10);
+  {
+    NoAllocationFailureScope to_scope(to);
+    NoAllocationFailureScope old_scope(old);
+    old->PauseSweeping();
+    ParallelScavenger scavenger(from, to, old, heap->tenuring_policy());
+    scavenger.Scavenge(1);
+    old->ResumeSweeping();
+  }
+  heap->ReplaceSpace(to);
+}
+
+TEST_CASE(ScavengerAgesByCard) {
+  RandomXorShift random;
+  Heap program_heap(&random, 4 * KB);
+  Class* meta_class = Class::cast(program_heap.CreateMetaClass());
+  Class* array_class = Class::cast(program_heap.CreateClass(
+      InstanceFormat::array_format(), meta_class, NULL));
+
+  Heap heap(&random, 4 * KB);
+  OldSpace* old = heap.old_space();
+  Array* root;
+  {
+    NoAllocationFailureScope scope(old);
+    Array* array = Array::cast(heap.CreateArray(array_class, 2, Smi::zero()));
+    uword address = old->Allocate(array->Size());
+    memcpy(reinterpret_cast<void*>(address),
+           reinterpret_cast<void*>(array->address()), array->Size());
+    root = Array::cast(HeapObject::FromAddress(address));
+  }
+
+  // Chains of arrays whose size does not divide the copy buffers, so each
+  // buffer is retired with a partly used last card.
+  static const int kChainLength = 2000;
+  for (int chain = 0; chain < 2; chain++) {
+    Object* previous = Smi::zero();
+    {
+      NoAllocationFailureScope scope(heap.space());
+      for (int i = 0; i < kChainLength; i++) {
+        Array* array =
+            Array::cast(heap.CreateArray(array_class, 3, Smi::zero()));
+        array->set(0, previous);
+        previous = array;
+      }
+      // Garbage, so the survivors are kept in the new space.
+      for (int i = 0; i < 100; i++) {
+        heap.CreateArray(array_class, 1000, Smi::zero());
+      }
+    }
+    root->set(chain, previous);
+    ObjectMemory::DirtyCard(root->address());
+    Scavenge(&heap);
+  }
+
+  // The buffers start on a new card, so the survivors of both ages are aged
+  // correctly.
+  for (int chain = 0; chain < 2; chain++) {
+    Object* object = root->get(chain);
+    int count = 0;
+    while (object->IsHeapObject()) {
+      Array* array = Array::cast(object);
+      EXPECT(heap.space()->Includes(array->address()));
+      EXPECT_EQ(2 - chain, ObjectMemory::GetAge(array->address()));
+      object = array->get(0);
+      count++;
+    }
+    EXPECT_EQ(kChainLength, count);
+  }
+}
+
+TEST_CASE(TenuringPolicy) {
+  TenuringPolicy policy;
+  const int kMaximum = TenuringPolicy::kMaximumThreshold;
+  int survived[kMaximum + 1] = {0};
+  int survived_young[TenuringPolicy::NUMBER_OF_KINDS] = {0};
+
+  // The threshold drops when the survivors would fill the new space, and
+  // grows one step at a time when they fit.
+  survived[1] = 10 * KB;
+  survived[2] = 300 * KB;
+  policy.Update(1 * MB, survived, survived_young);
+  EXPECT_EQ(2, policy.threshold());
+  survived[1] = 300 * KB;
+  policy.Update(1 * MB, survived, survived_young);
+  EXPECT_EQ(1, policy.threshold());
+  survived[1] = 10 * KB;
+  survived[2] = 0;
+  policy.Update(1 * MB, survived, survived_young);
+  EXPECT_EQ(2, policy.threshold());
+  policy.Update(1 * MB, survived, survived_young);
+  EXPECT_EQ(3, policy.threshold());
+
+  // Stacks are pretenured when nearly all of them survive.
+  bool pretenuring = Flags::pretenuring;
+  Flags::pretenuring = true;
+  policy.RecordAllocation(TenuringPolicy::STACKS, 100 * KB);
+  policy.RecordAllocation(TenuringPolicy::LARGE_ARRAYS, 100 * KB);
+  survived_young[TenuringPolicy::STACKS] = 95 * KB;
+  survived_young[TenuringPolicy::LARGE_ARRAYS] = 50 * KB;
+  policy.Update(1 * MB, survived, survived_young);
+  EXPECT(policy.ShouldPretenure(TenuringPolicy::STACKS));
+  EXPECT(!policy.ShouldPretenure(TenuringPolicy::LARGE_ARRAYS));
+  EXPECT(!policy.ShouldPretenure(-1));
+  policy.ResetPretenuring();
+  EXPECT(!policy.ShouldPretenure(TenuringPolicy::STACKS));
+  Flags::pretenuring = pretenuring;
+
+  EXPECT_EQ(TenuringPolicy::STACKS,
+            TenuringPolicy::KindOf(InstanceFormat::STACK_TYPE, 100));
+  EXPECT_EQ(-1, TenuringPolicy::KindOf(InstanceFormat::ARRAY_TYPE, 100));
+  EXPECT_EQ(TenuringPolicy::LARGE_ARRAYS,
+            TenuringPolicy::KindOf(InstanceFormat::ARRAY_TYPE, 4 * KB));
+}
+
+TEST_CASE(HeapSizingPolicy) {
+  HeapSizingPolicy policy;
+  const int kMinimum = HeapSizingPolicy::kMinimumYoungSize;
+
+  // By default the new space is an eighth of the old space.
+  EXPECT_EQ(1 * MB, policy.young_size(8 * MB));
+  policy.RecordScavenge(kMinimum, kMinimum / 2, 100);
+  EXPECT_EQ(1 * MB, policy.young_size(8 * MB));
+
+  // With a pause target, the new space doubles while many objects survive,
+  // and shrinks when the pauses exceed the target.
+  int target_pause_time = Flags::target_pause_time;
+  Flags::target_pause_time = 1;
+  EXPECT(policy.young_size(8 * MB) == kMinimum);
+  policy.RecordScavenge(kMinimum, kMinimum / 2, 100);
+  EXPECT(policy.young_size(8 * MB) == 2 * kMinimum);
+  policy.RecordScavenge(2 * kMinimum, kMinimum / 10, 100);
+  EXPECT(policy.young_size(8 * MB) == 2 * kMinimum);
+  policy.RecordScavenge(2 * kMinimum, kMinimum, 600);
+  EXPECT(policy.young_size(8 * MB) == 2 * kMinimum);
+  policy.RecordScavenge(2 * kMinimum, kMinimum, 3000);
+  EXPECT(policy.young_size(8 * MB) == kMinimum);
+  Flags::target_pause_time = target_pause_time;
+
+  // The flag overrides the adaptive size.
+  int young_generation_size = Flags::young_generation_size;
+  Flags::young_generation_size = 100;
+  EXPECT_EQ(100 * KB, policy.young_size(8 * MB));
+  Flags::young_generation_size = young_generation_size;
+
+  // The old space grows by the live data, within the heap size limits.
+  EXPECT_EQ(1 * MB, policy.OldSpaceBudget(1 * MB));
+  int min_heap_size = Flags::min_heap_size;
+  int max_heap_size = Flags::max_heap_size;
+  Flags::min_heap_size = 4 * KB;
+  EXPECT_EQ(3 * MB, policy.OldSpaceBudget(1 * MB));
+  Flags::max_heap_size = 1536;
+  EXPECT_EQ(512 * KB, policy.OldSpaceBudget(1 * MB));
+
+  // Sizes of 2GB and more do not overflow.
+  Flags::max_heap_size = 4 * MB;
+  EXPECT_EQ(3 * MB, policy.OldSpaceBudget(1 * MB));
+  Flags::min_heap_size = 3 * MB;
+  EXPECT_EQ(INT32_MAX - 1 * MB, policy.OldSpaceBudget(1 * MB));
+  Flags::min_heap_size = min_heap_size;
+  Flags::max_heap_size = max_heap_size;
+}
+
+}  // namespace dartino
@@ -11,6 +11,7 @@
 #include "src/vm/interpreter.h"
 #include "src/vm/links.h"
 #include "src/vm/port.h"
+#include "src/vm/preempter.h"
 #include "src/vm/process.h"
 #include "src/vm/process_queue.h"
 #include "src/vm/session.h"
@@ -21,8 +22,12 @@ namespace dartino {
 // Global instance of scheduler.
 Scheduler* Scheduler::scheduler_ = NULL;
 
-WorkerThread::WorkerThread(Scheduler* scheduler)
-    : scheduler_(scheduler) {}
+WorkerThread::WorkerThread(Scheduler* scheduler, int index)
+    : scheduler_(scheduler),
+      index_(index),
+      process_(NULL),
+      program_(NULL),
+      idle_(false) {}
 
 WorkerThread::~WorkerThread() { }
 
@@ -73,6 +78,36 @@ void InterpretationBarrier::Leave(Process* process) {
   }
 }
 
+// Accepts programs which are not being interpreted by another worker. The
+// program of the dequeued process is claimed by [worker], which is only NULL
+// when the filter is not used for dequeuing.
+class RunnableProcessFilter {
+ public:
+  RunnableProcessFilter(Scheduler* scheduler, WorkerThread* worker)
+      : scheduler_(scheduler), worker_(worker) {}
+
+  bool Accept(Program* program) {
+    return !scheduler_->IsProgramInterpreted(program, worker_);
+  }
+
+  bool Claim(Program* program) {
+    return scheduler_->ClaimProgram(program, worker_);
+  }
+
+  void Unclaim(Program* program) {
+    ASSERT(worker_->program() == program);
+    scheduler_->ReleaseProgram(worker_);
+  }
+
+  uint64 VirtualTime(Program* program) {
+    return scheduler_->ProgramVirtualTime(program);
+  }
+
+ private:
+  Scheduler* const scheduler_;
+  WorkerThread* const worker_;
+};
+
 void Scheduler::Setup() {
   ASSERT(scheduler_ == NULL);
   scheduler_ = new Scheduler();
@@ -82,32 +117,56 @@ void Scheduler::Setup() {
 void Scheduler::TearDown() {
   ASSERT(scheduler_ != NULL);
   scheduler_->shutdown_ = true;
-  scheduler_->NotifyInterpreterThread();
+  scheduler_->NotifyAllInterpreterThreads();
   scheduler_->gc_thread_->StopThread();
   delete scheduler_;
   scheduler_ = NULL;
 }
 
+int Scheduler::ComputeThreadCount() {
+  // Without parallel interpretation, more workers would only wait for the
+  // one interpreting.
+  if (!Flags::parallel_programs) return 1;
+  int count = Flags::worker_threads;
+  if (count <= 0) count = Platform::GetNumberOfHardwareThreads();
+  return count;
+}
+
 Scheduler::Scheduler()
-    : interpreter_is_paused_(false),
+    : thread_count_(ComputeThreadCount()),
+      thread_ids_(new ThreadIdentifier[thread_count_]),
+      threads_(new WorkerThread*[thread_count_]),
+      interpreter_count_(Flags::parallel_programs ? thread_count_ : 1),
+      paused_interpreters_(0),
+      ready_queues_(interpreter_count_ > 1 ? thread_count_ : 0),
       pause_monitor_(Platform::CreateMonitor()),
       pause_(false),
       shutdown_(false),
       idle_monitor_(Platform::CreateMonitor()),
-      interpreter_semaphore_(1),
-      gc_thread_(new GCThread()) {
-  for (int i = 0; i < kThreadCount; i++) {
-    WorkerThread* worker = new WorkerThread(this);
-    threads_[i] = worker;
-    thread_ids_[i] = Thread::Run(WorkerThread::RunThread, worker);
+      idle_workers_(0),
+      worker_wakeups_(0),
+      interpreter_semaphore_(interpreter_count_),
+      gc_thread_(new GCThread()),
+      debugging_interpreters_(0) {
+  if (Flags::scheduler_latency) SchedulerLatency::SetEnabled(true);
+
+  // Create all workers before starting any of them, since running workers
+  // look at each other.
+  for (int i = 0; i < thread_count_; i++) {
+    threads_[i] = new WorkerThread(this, i);
+  }
+  for (int i = 0; i < thread_count_; i++) {
+    thread_ids_[i] = Thread::Run(WorkerThread::RunThread, threads_[i]);
   }
 }
 
 Scheduler::~Scheduler() {
-  for (int i = 0; i < kThreadCount; i++) {
+  for (int i = 0; i < thread_count_; i++) {
     thread_ids_[i].Join();
     delete threads_[i];
   }
+  delete[] threads_;
+  delete[] thread_ids_;
 
   delete idle_monitor_;
   delete pause_monitor_;
@@ -139,6 +198,7 @@ void Scheduler::UnscheduleProgram(Program* program) {
 
   ASSERT(program->scheduler() == this);
   programs_.Remove(program);
+  ready_queues_.RemoveProgram(program);
   program->set_scheduler(NULL);
   program->program_state()->ChangeState(
       ProgramState::kDone, ProgramState::kPendingDeletion);
@@ -159,7 +219,7 @@ void Scheduler::StopProgramInternal(Program* program,
     program_state->ChangeState(ProgramState::kRunning, stop_state);
 
     if (!from_paused_interpreter) PauseInterpreterLoop();
-    ready_queue_.PauseAllProcessesOfProgram(program);
+    ready_queues_.PauseAllProcessesOfProgram(program);
     if (!from_paused_interpreter) ResumeInterpreterLoop();
   }
 }
@@ -210,8 +270,16 @@ void Scheduler::ResumeGcThread() {
   gc_thread_->Resume();
 }
 
-void Scheduler::PreemptionTick() {
-  interpretation_barrier_.PreemptProcess();
+bool Scheduler::PreemptionTick() {
+  if (!HasReadyProcess()) return false;
+  PreemptAllWorkers();
+  return true;
+}
+
+void Scheduler::PreemptAllWorkers() {
+  for (int i = 0; i < thread_count_; i++) {
+    threads_[i]->interpretation_barrier()->PreemptProcess();
+  }
 }
 
 void Scheduler::FinishedGC(Program* program, int count) {
@@ -224,6 +292,20 @@ void Scheduler::FinishedGC(Program* program, int count) {
   }
 }
 
+void Scheduler::TriggerConcurrentMarking(Program* program) {
+  ASSERT(gc_thread_ != NULL);
+  // The counter part of this is in [FinishedGC].
+  program->program_state()->Retain();
+  gc_thread_->TriggerConcurrentMarking(program);
+}
+
+void Scheduler::TriggerConcurrentSweeping(Program* program) {
+  ASSERT(gc_thread_ != NULL);
+  // The counter part of this is in [FinishedGC].
+  program->program_state()->Retain();
+  gc_thread_->TriggerConcurrentSweeping(program);
+}
+
 void Scheduler::EnqueueProcessOnSchedulerWorkerThread(
     Process* interpreting_process, Process* process) {
   process->program()->program_state()->IncreaseProcessCount();
@@ -231,7 +313,7 @@ void Scheduler::EnqueueProcessOnSchedulerWorkerThread(
     UNREACHABLE();
   }
 
-  EnqueueProcess(process);
+  EnqueueProcess(process, WorkerInterpreting(interpreting_process));
 }
 
 void Scheduler::ResumeProcess(Process* process) {
@@ -299,8 +381,64 @@ bool Scheduler::EnqueueProcess(Process* process, Port* port) {
   return true;
 }
 
-bool Scheduler::DequeueProcess(Process** process) {
-  return ready_queue_.TryDequeue(process);
+bool Scheduler::DequeueProcess(Process** process, WorkerThread* worker) {
+  RunnableProcessFilter filter(this, worker);
+  // Only the workers with queues of their own take turns with the global
+  // queue.
+  uint64 now =
+      ready_queues_.has_worker_queues() ? Platform::GetMicroseconds() : 0;
+  return ready_queues_.TryDequeue(process, worker->index(), now, &filter);
+}
+
+bool Scheduler::HasReadyProcess() {
+  return !ready_queues_.IsEmpty();
+}
+
+bool Scheduler::HasRunnableProcess() {
+  if (interpreter_count_ == 1) return HasReadyProcess();
+  RunnableProcessFilter filter(this, NULL);
+  return ready_queues_.HasEntry(&filter);
+}
+
+WorkerThread* Scheduler::WorkerInterpreting(Process* process) {
+  if (process == NULL) return NULL;
+  for (int i = 0; i < thread_count_; i++) {
+    WorkerThread* worker = threads_[i];
+    if (worker->process() == process) return worker;
+  }
+  return NULL;
+}
+
+bool Scheduler::IsProgramInterpreted(Program* program, WorkerThread* worker) {
+  // With a single interpreter, the [interpreter_semaphore_] already ensures
+  // that no two processes are interpreted at the same time.
+  if (interpreter_count_ == 1) return false;
+  WorkerThread* interpreter = program->interpreter();
+  return interpreter != NULL && interpreter != worker;
+}
+
+bool Scheduler::ClaimProgram(Program* program, WorkerThread* worker) {
+  ASSERT(worker->program() == NULL);
+  if (interpreter_count_ > 1) {
+    if (!program->TryClaimInterpreter(worker)) return false;
+    // The program may otherwise be deleted as soon as its last process
+    // terminates, before the worker releases it.
+    program->program_state()->Retain();
+  }
+  worker->set_program(program);
+  return true;
+}
+
+void Scheduler::ReleaseProgram(WorkerThread* worker) {
+  Program* program = worker->program();
+  worker->set_program(NULL);
+  if (interpreter_count_ == 1) return;
+  program->ReleaseInterpreter(worker);
+  ProgramState* state = program->program_state();
+  if (state->Release()) {
+    state->ChangeState(ProgramState::kRunning, ProgramState::kDone);
+    program->NotifyExitListener();
+  }
 }
 
 void Scheduler::DeleteTerminatedProcess(Process* process, Signal::Kind kind) {
@@ -325,14 +463,15 @@ void Scheduler::DeleteTerminatedProcess(Process* process, Signal::Kind kind) {
   }
 }
 
-void Scheduler::RescheduleProcess(Process* process, bool terminate) {
+void Scheduler::RescheduleProcess(Process* process, bool terminate,
+                                  WorkerThread* worker) {
   ASSERT(process->state() == Process::kRunning);
   if (terminate) {
     process->ChangeState(Process::kRunning, Process::kWaitingForChildren);
     DeleteTerminatedProcess(process, Signal::kTerminated);
   } else {
     process->ChangeState(Process::kRunning, Process::kEnqueuing);
-    EnqueueProcess(process);
+    EnqueueProcess(process, worker);
   }
 }
 
@@ -353,7 +492,7 @@ bool Scheduler::RunInterpreterLoop(WorkerThread* worker) {
     // (and there is work to do).
     while (!pause_ && !shutdown_) {
       Process* process = NULL;
-      if (!DequeueProcess(&process)) break;
+      if (!DequeueProcess(&process, worker)) break;
 
       while (process != NULL && !shutdown_ && !pause_) {
         process = InterpretProcess(process, worker);
@@ -362,6 +501,7 @@ bool Scheduler::RunInterpreterLoop(WorkerThread* worker) {
         process->ChangeState(Process::kRunning, Process::kEnqueuing);
         EnqueueProcess(process);
       }
+      ReleaseProgram(worker);
     }
 
     if (shutdown_) break;
@@ -370,7 +510,7 @@ bool Scheduler::RunInterpreterLoop(WorkerThread* worker) {
       // Take lock to be sure StopProgram is waiting.
       {
         ScopedMonitorLock locker(pause_monitor_);
-        interpreter_is_paused_ = true;
+        paused_interpreters_++;
         pause_monitor_->NotifyAll();
       }
       {
@@ -379,17 +519,14 @@ bool Scheduler::RunInterpreterLoop(WorkerThread* worker) {
       }
       {
         ScopedMonitorLock locker(pause_monitor_);
-        interpreter_is_paused_ = false;
+        paused_interpreters_--;
         pause_monitor_->NotifyAll();
       }
       continue;
     }
 
     // Sleep until there is something new to execute.
-    ScopedMonitorLock scoped_lock(idle_monitor_);
-    while (ready_queue_.IsEmpty() && !pause_ && !shutdown_) {
-      idle_monitor_->Wait();
-    }
+    WaitForWork(worker);
     if (shutdown_) break;
   }
 
@@ -398,18 +535,18 @@ bool Scheduler::RunInterpreterLoop(WorkerThread* worker) {
 
 void Scheduler::PauseInterpreterLoop() {
   pause_ = true;
-  NotifyInterpreterThread();
+  NotifyAllInterpreterThreads();
 
   while (true) {
-    interpretation_barrier_.PreemptProcess();
-    if (interpreter_is_paused_) break;
+    PreemptAllWorkers();
+    if (paused_interpreters_ == interpreter_count_) break;
     pause_monitor_->Wait();
   }
 }
 
 void Scheduler::ResumeInterpreterLoop() {
   pause_ = false;
-  NotifyInterpreterThread();
+  NotifyAllInterpreterThreads();
 }
 
 Process* Scheduler::InterpretProcess(Process* process, WorkerThread* worker) {
@@ -425,25 +562,37 @@ Process* Scheduler::InterpretProcess(Process* process, WorkerThread* worker) {
     return NULL;
   }
 
-  dispatch_table_.ResetBreakpoints(
-      process->debug_info(), process->program()->breakpoints());
+  bool debugging = ResetBreakpoints(process);
 
-  interpretation_barrier_.Enter(process);
+  InterpretationBarrier* barrier = worker->interpretation_barrier();
+  barrier->Enter(process);
 
   // Mark the process as owned by the current thread while interpreting.
   Thread::SetProcess(process);
+  worker->set_process(process);
   Interpreter interpreter(process);
 
   // Warning: These two lines should not be moved, since the code further down
   // will potentially push the process on a queue which is accessed by other
   // threads, which would create a race.
   process->heap()->set_random(process->random());
+  uint64 start = Platform::GetMicroseconds();
+  if (process->ready_since_ != 0) {
+    RecordLatency(process, SchedulerLatency::kReadyToRunning,
+                  start - process->ready_since_);
+    process->ready_since_ = 0;
+  }
   interpreter.Run();
+  uint64 slice = Platform::GetMicroseconds() - start;
+  AddCpuTime(process->program(), slice);
+  RecordLatency(process, SchedulerLatency::kSlice, slice);
   process->heap()->set_random(NULL);
 
+  worker->set_process(NULL);
   Thread::SetProcess(NULL);
 
-  interpretation_barrier_.Leave(process);
+  barrier->Leave(process);
+  if (debugging) ReleaseBreakpoints();
 
   if (interpreter.IsYielded()) {
     process->ChangeState(Process::kRunning, Process::kYielding);
@@ -451,7 +600,7 @@ Process* Scheduler::InterpretProcess(Process* process, WorkerThread* worker) {
       process->ChangeState(Process::kYielding, Process::kSleeping);
     } else {
       process->ChangeState(Process::kYielding, Process::kEnqueuing);
-      EnqueueProcess(process);
+      EnqueueProcess(process, worker);
     }
     return NULL;
   }
@@ -471,25 +620,38 @@ Process* Scheduler::InterpretProcess(Process* process, WorkerThread* worker) {
     // process, consider returning that process.
     bool terminate = result.ShouldTerminate();
 
+    // This worker may only continue with processes of the program it is
+    // currently interpreting.
+    if (target->program() != process->program()) {
+      bool enqueue = target->ChangeState(Process::kSleeping,
+                                         Process::kEnqueuing);
+      port->Unlock();
+      if (enqueue) EnqueueSafe(target);
+      RescheduleProcess(process, terminate, worker);
+      return NULL;
+    }
+
     if (target->ChangeState(Process::kSleeping, Process::kRunning)) {
       port->Unlock();
-      RescheduleProcess(process, terminate);
+      RescheduleProcess(process, terminate, worker);
       return target;
     } else {
-      if (ready_queue_.TryDequeueEntry(target)) {
+      ProcessQueue* queue = target->ready_queue();
+      if (queue != NULL && queue->TryDequeueEntry(target)) {
         port->Unlock();
         ASSERT(target->state() == Process::kRunning);
-        RescheduleProcess(process, terminate);
+        RescheduleProcess(process, terminate, worker);
         return target;
       }
     }
     port->Unlock();
-    RescheduleProcess(process, terminate);
+    RescheduleProcess(process, terminate, worker);
     return NULL;
   }
 
   if (interpreter.IsInterrupted()) {
-    // No need to notify threads, as 'this' is now available.
+    // The process used up its time slice, so it takes its turn behind the
+    // processes made ready elsewhere.
     process->ChangeState(Process::kRunning, Process::kEnqueuing);
     EnqueueProcess(process);
     return NULL;
@@ -666,6 +828,7 @@ void Scheduler::HandleEventResult(
 
 void WorkerThread::ThreadEnter() {
   Thread::SetupOSSignals();
+  Thread::ApplyCpuAffinity(Thread::kFirstWorkerAffinityIndex + index_);
   scheduler_->pause_monitor_->Lock();
   scheduler_->pause_monitor_->NotifyAll();
   scheduler_->pause_monitor_->Unlock();
@@ -678,20 +841,110 @@ void WorkerThread::ThreadExit() {
   Thread::TeardownOSSignals();
 }
 
+void Scheduler::WaitForWork(WorkerThread* worker) {
+  worker->idle_ = true;
+  idle_workers_++;
+
+  // Check for work again after announcing that we are idle. A concurrent
+  // enqueue either finds this worker idle or its process is found here.
+  if (HasRunnableProcess() || pause_ || shutdown_) {
+    if (worker->idle_.exchange(false)) {
+      idle_workers_--;
+      return;
+    }
+    // Somebody else claimed this worker and is about to unpark it.
+  }
+  worker->parker_.Park();
+}
+
+bool Scheduler::WakeIdleWorker(WorkerThread* worker) {
+  if (!worker->idle_ || !worker->idle_.exchange(false)) return false;
+  idle_workers_--;
+  worker_wakeups_.fetch_add(1, kRelaxed);
+  worker->parker_.Unpark();
+  return true;
+}
+
 void Scheduler::NotifyInterpreterThread() {
+  // This is on the hot path of every enqueue, so don't touch the workers
+  // unless one of them is sleeping.
+  if (idle_workers_ == 0) return;
+  for (int i = 0; i < thread_count_; i++) {
+    if (WakeIdleWorker(threads_[i])) return;
+  }
+}
+
+void Scheduler::NotifyAllInterpreterThreads() {
+  for (int i = 0; i < thread_count_; i++) {
+    WakeIdleWorker(threads_[i]);
+  }
   Monitor* monitor = idle_monitor_;
   monitor->Lock();
-  monitor->Notify();
+  monitor->NotifyAll();
   monitor->Unlock();
 }
 
-void Scheduler::EnqueueProcess(Process* process) {
+void Scheduler::EnqueueProcess(Process* process, WorkerThread* worker) {
   ASSERT(process->state() == Process::kEnqueuing);
 
-  if (ready_queue_.Enqueue(process)) {
-    // If the queue was empty, we'll notify the interpreter thread.
+  // Read the program before enqueuing, as [process] may have been run and
+  // deleted by another worker by the time [Enqueue] returns.
+  Program* program = process->program();
+  if (worker != NULL) {
+    ready_queues_.Enqueue(process, worker->index());
+    Preempter::ProcessEnqueued();
+    // The worker will pick up the process once it is done with its current
+    // one, so only wake up idle workers if they could run it right away.
+    if (interpreter_count_ > 1 && !IsProgramInterpreted(program)) {
+      NotifyInterpreterThread();
+    }
+    return;
+  }
+
+  bool was_empty = ready_queues_.Enqueue(process, ReadyQueues::kGlobalQueue);
+  Preempter::ProcessEnqueued();
+  if (was_empty) {
+    // An idle worker may be waiting for a process of this program.
     NotifyInterpreterThread();
+  } else if (interpreter_count_ > 1 && !IsProgramInterpreted(program)) {
+    // The queue might only contain processes of programs which are being
+    // interpreted, in which case idle workers are waiting for this one.
+    NotifyInterpreterThread();
+  }
+}
+
+bool Scheduler::ResetBreakpoints(Process* process) {
+  if (interpreter_count_ == 1) {
+    dispatch_table_.ResetBreakpoints(
+        process->debug_info(), process->program()->breakpoints());
+    return false;
+  }
+
+  // The bytecode dispatch table is shared by all workers, and breakpoints are
+  // ignored by processes that are not being debugged. While another worker
+  // interprets a debugged process we only add breakpoints, as clearing them
+  // could remove ones it needs. Once no debugged process is interpreted, the
+  // table is reset so that stale breakpoints do not slow down other processes.
+  ScopedSpinlock locker(&dispatch_table_lock_);
+  if (!process->is_debugging()) {
+    if (debugging_interpreters_ == 0) dispatch_table_.ClearAllBreakpoints();
+    return false;
+  }
+  if (debugging_interpreters_ == 0) {
+    dispatch_table_.ResetBreakpoints(
+        process->debug_info(), process->program()->breakpoints());
+  } else {
+    dispatch_table_.AddBreakpoints(
+        process->debug_info(), process->program()->breakpoints());
   }
+  debugging_interpreters_++;
+  return true;
+}
+
+void Scheduler::ReleaseBreakpoints() {
+  ScopedSpinlock locker(&dispatch_table_lock_);
+  ASSERT(debugging_interpreters_ > 0);
+  debugging_interpreters_--;
 }
 
 void Scheduler::EnqueueSafe(Process* process) {
@@ -711,7 +964,7 @@ void Scheduler::EnqueueSafe(Process* process) {
       state->AddPausedProcess(process);
     }
   } else {
-    EnqueueProcess(process);
+    EnqueueProcess(process, WorkerInterpreting(Thread::GetProcess()));
   }
 }
 
@@ -721,7 +974,7 @@ void Scheduler::FreezeProgram(Program* program) {
     pause_monitor_->Wait();
   }
   program_state->ChangeState(ProgramState::kRunning, ProgramState::kFrozen);
-  ready_queue_.PauseAllProcessesOfProgram(program);
+  ready_queues_.PauseAllProcessesOfProgram(program);
 }
 
 void Scheduler::UnFreezeProgram(Program* program) {
@@ -798,6 +1051,48 @@ void Scheduler::UnFreezeProgramGroup(ProgramGroup group) {
   }
 }
 
+void Scheduler::SetProgramCpuWeight(Program* program, int weight) {
+  program->set_cpu_weight(weight);
+}
+
+void Scheduler::SetProgramGroupCpuWeight(ProgramGroup group, int weight) {
+  ScopedMonitorLock pause_locker(pause_monitor_);
+  program_groups_.SetCpuWeight(group, weight);
+}
+
+uint64 Scheduler::ProgramVirtualTime(Program* program) {
+  uint64 time = program->virtual_time();
+  uword group_mask = program->group_mask();
+  if (group_mask == 0) return time;
+  return Utils::Maximum(time, program_groups_.VirtualTime(group_mask));
+}
+
+void Scheduler::RecordLatency(Process* process, SchedulerLatency::Kind kind,
+                              uint64 microseconds) {
+  if (!SchedulerLatency::IsEnabled()) return;
+
+  SchedulerLatency* latency = process->latency_;
+  if (latency == NULL) {
+    latency = new SchedulerLatency();
+    process->latency_ = latency;
+  }
+  latency->histograms[kind].Record(microseconds);
+
+  Program* program = process->program();
+  latency = program->latency();
+  if (latency == NULL) {
+    latency = new SchedulerLatency();
+    program->set_latency(latency);
+  }
+  latency->histograms[kind].Record(microseconds);
+}
+
+void Scheduler::AddCpuTime(Program* program, uint64 microseconds) {
+  program->AddCpuTime(microseconds);
+  uword group_mask = program->group_mask();
+  if (group_mask != 0) program_groups_.AddCpuTime(group_mask, microseconds);
+}
+
 void* WorkerThread::RunThread(void* data) {
   WorkerThread* state = reinterpret_cast<WorkerThread*>(data);
   state->RunInThread();
@@ -9,6 +9,8 @@
 
 #include "src/vm/dispatch_table.h"
 #include "src/vm/signal.h"
+#include "src/vm/parker.h"
+#include "src/vm/spinlock.h"
 #include "src/vm/thread.h"
 #include "src/vm/process_queue.h"
 #include "src/vm/program.h"
@@ -23,21 +25,6 @@ class Port;
 class Process;
 class Scheduler;
 
-class WorkerThread {
- public:
-  static void* RunThread(void* data);
-
-  explicit WorkerThread(Scheduler* scheduler);
-  ~WorkerThread();
-
- private:
-  void RunInThread();
-  void ThreadEnter();
-  void ThreadExit();
-
-  Scheduler* scheduler_;
-};
-
 class ProcessVisitor {
  public:
   virtual ~ProcessVisitor() {}
@@ -70,6 +57,47 @@ class InterpretationBarrier {
   Atomic<Process*> current_process;
 };
 
+class WorkerThread {
+ public:
+  static void* RunThread(void* data);
+
+  WorkerThread(Scheduler* scheduler, int index);
+  ~WorkerThread();
+
+  int index() const { return index_; }
+
+  InterpretationBarrier* interpretation_barrier() {
+    return &interpretation_barrier_;
+  }
+
+  // The process this worker is currently interpreting, if any.
+  Process* process() const { return process_; }
+  void set_process(Process* process) { process_ = process; }
+
+  // The program whose processes this worker is currently interpreting. Only
+  // used by the worker itself; other workers look at [Program::interpreter].
+  Program* program() const { return program_; }
+  void set_program(Program* program) { program_ = program; }
+
+ private:
+  friend class Scheduler;
+
+  void RunInThread();
+  void ThreadEnter();
+  void ThreadExit();
+
+  Scheduler* scheduler_;
+  const int index_;
+  InterpretationBarrier interpretation_barrier_;
+  Atomic<Process*> process_;
+  Program* program_;
+
+  // Whether the worker is parked, or about to park, waiting for work. Whoever
+  // resets it to false must unpark the worker.
+  Atomic<bool> idle_;
+  Parker parker_;
+};
+
 class Scheduler {
  public:
   enum ProcessInterruptionEvent {
@@ -103,10 +131,21 @@ class Scheduler {
   void PauseGcThread();
   void ResumeGcThread();
 
-  void PreemptionTick();
+  // Preempt all interpreting processes if there are processes waiting to run.
+  // Returns false if there were none, in which case the ticks can be
+  // suspended until the next process is enqueued.
+  bool PreemptionTick();
+
+  // Returns whether any ready queue has a process. Notice that by the return
+  // of the call, the result may already be outdated.
+  bool HasReadyProcess();
 
   void FinishedGC(Program* program, int count);
 
+  // Let the GC thread mark the shared heap of [program] concurrently.
+  void TriggerConcurrentMarking(Program* program);
+  void TriggerConcurrentSweeping(Program* program);
+
   // This method should only be called from a thread which is currently
   // interpreting a process.
   void EnqueueProcessOnSchedulerWorkerThread(Process* interpreting_process,
@@ -137,20 +176,51 @@ class Scheduler {
   void FreezeProgramGroup(ProgramGroup group);
   void UnFreezeProgramGroup(ProgramGroup group);
 
+  // Set the relative share of CPU time of a program or of all programs in a
+  // group together. A program in groups is limited by the group which has
+  // used up most of its share.
+  void SetProgramCpuWeight(Program* program, int weight);
+  void SetProgramGroupCpuWeight(ProgramGroup group, int weight);
+
+  int thread_count() const { return thread_count_; }
+
+  // The number of workers waiting for work, and the number of times one of
+  // them has been woken up.
+  int idle_worker_count() const { return idle_workers_; }
+  uword worker_wakeups() const { return worker_wakeups_; }
+
  private:
   friend class Dartino;
   friend class WorkerThread;
+  friend class RunnableProcessFilter;
 
   // Global scheduler instance.
   static Scheduler* scheduler_;
 
-  // Worker threads
-  static const int kThreadCount = 4;
-  ThreadIdentifier thread_ids_[kThreadCount];
-  WorkerThread* threads_[kThreadCount];
-
-  Atomic<bool> interpreter_is_paused_;
-  ProcessQueue ready_queue_;
+  // Worker threads. There is one per interpreter: a single one, unless
+  // -Xparallel_programs is given, in which case there is one per hardware
+  // thread unless -Xworker_threads says otherwise.
+  const int thread_count_;
+  ThreadIdentifier* thread_ids_;
+  WorkerThread** threads_;
+
+  static int ComputeThreadCount();
+
+  // The number of worker threads allowed to interpret at the same time. This is
+  // 1 unless -Xparallel_programs is given, which lets separate programs run in
+  // parallel. A program is always interpreted by one worker at a time: its
+  // heap, lookup cache and GC are not thread safe.
+  const int interpreter_count_;
+
+  // The number of interpreting worker threads which are currently paused.
+  // Guarded by [pause_monitor_].
+  int paused_interpreters_;
+
+  // The global queue, and a queue per worker when several workers interpret.
+  // A worker's queue holds the processes it made ready. The global queue
+  // holds those made ready outside of the workers, and preempted ones, which
+  // take turns with the processes made ready elsewhere.
+  ReadyQueues ready_queues_;
   ProgramList programs_;
   ProgramGroups program_groups_;
 
@@ -158,13 +228,20 @@ class Scheduler {
   Atomic<bool> pause_;
   Atomic<bool> shutdown_;
 
-  InterpretationBarrier interpretation_barrier_;
-
+  // Used by paused workers to wait for the interpreter loop to resume.
   Monitor* idle_monitor_;
+  // The number of workers parked waiting for work.
+  Atomic<int> idle_workers_;
+  Atomic<uword> worker_wakeups_;
   Semaphore interpreter_semaphore_;
   GCThread* gc_thread_;
 
   DispatchTable dispatch_table_;
+  Spinlock dispatch_table_lock_;
+  // The number of workers interpreting a process that is being debugged,
+  // guarded by [dispatch_table_lock_]. Only used when interpreting in
+  // parallel.
+  int debugging_interpreters_;
 
   void StopProgramInternal(Program* program,
                            ProgramState::State stop_state,
@@ -175,10 +252,14 @@ class Scheduler {
   // Exit the program for the given process with the given exit code.
   void ExitWith(Process* process, int exit_code, Signal::Kind kind);
 
-  void RescheduleProcess(Process* process, bool terminate);
+  void RescheduleProcess(Process* process, bool terminate,
+                         WorkerThread* worker);
 
   bool RunInterpreterLoop(WorkerThread* worker);
 
+  // Preempt the processes currently being interpreted by all workers.
+  void PreemptAllWorkers();
+
   // Caller must hold [pause_monitor_].
   void PauseInterpreterLoop();
   // Caller must hold [pause_monitor_].
@@ -187,10 +268,58 @@ class Scheduler {
   // Interpret [process] as worker [worker]. Returns the next Process that
   // should be run.
   Process* InterpretProcess(Process* process, WorkerThread* worker);
+  // Wake up one idle worker, if there is one.
   void NotifyInterpreterThread();
-
-  void EnqueueProcess(Process* process);
-  bool DequeueProcess(Process** process);
+  // Wake up all idle and paused workers.
+  void NotifyAllInterpreterThreads();
+
+  // Park [worker] until there is work to do or the interpreter loop is paused
+  // or shut down.
+  void WaitForWork(WorkerThread* worker);
+  // Unpark [worker] if it is idle. Returns false if it was not.
+  bool WakeIdleWorker(WorkerThread* worker);
+
+  // Enqueue [process] on the ready queue of [worker], or on the global ready
+  // queue if [worker] is NULL or there is a single interpreter.
+  void EnqueueProcess(Process* process, WorkerThread* worker = NULL);
+
+  // Dequeue a process whose program is not being interpreted by another
+  // worker and mark its program as being interpreted by [worker]. Processes
+  // are taken from the queue of [worker], then from the global queue and
+  // finally stolen from the queues of the other workers. The global queue
+  // goes first if [worker] has not looked at it for a while. Within each
+  // queue, the program furthest behind its share of CPU time goes first.
+  bool DequeueProcess(Process** process, WorkerThread* worker);
+  bool HasRunnableProcess();
+
+  // Returns the worker interpreting [process], or NULL.
+  WorkerThread* WorkerInterpreting(Process* process);
+
+  // Returns whether another worker than [worker] interprets [program].
+  bool IsProgramInterpreted(Program* program, WorkerThread* worker = NULL);
+
+  // A program's heap and lookup cache are not thread safe, so at most one
+  // worker may interpret processes of a given program at any time. Makes
+  // [worker] interpret [program], and returns false if another worker already
+  // does. The claim also keeps the program alive until it is released.
+  bool ClaimProgram(Program* program, WorkerThread* worker);
+  void ReleaseProgram(WorkerThread* worker);
+
+  // Installs the breakpoints of [process] in the dispatch table before it is
+  // interpreted. Returns true if [ReleaseBreakpoints] must be called once
+  // [process] is no longer interpreted.
+  bool ResetBreakpoints(Process* process);
+  void ReleaseBreakpoints();
+
+  // The virtual time of [program] for fair-share scheduling, taking the
+  // groups of the program into account.
+  uint64 ProgramVirtualTime(Program* program);
+  void AddCpuTime(Program* program, uint64 microseconds);
+
+  // Record a latency of [process] and its program, if latencies are enabled.
+  // Must be called by the worker interpreting [process].
+  void RecordLatency(Process* process, SchedulerLatency::Kind kind,
+                     uint64 microseconds);
 
   // The [process] will be enqueued on any thread. In case the program is paused
   // the process will be enqueued once the program is resumed.
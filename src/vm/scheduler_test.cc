@@ -0,0 +1,83 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/shared/assert.h"
+#include "src/shared/flags.h"
+#include "src/shared/platform.h"
+#include "src/shared/test_case.h"
+
+#include "src/vm/preempter.h"
+#include "src/vm/process.h"
+#include "src/vm/program.h"
+#include "src/vm/scheduler.h"
+#include "src/vm/signal.h"
+#include "src/vm/thread.h"
+
+namespace dartino {
+
+// Replaces the global scheduler by one set up with the current flags.
+static void RestartScheduler() {
+  Preempter::TearDown();
+  Scheduler::TearDown();
+  Scheduler::Setup();
+  Preempter::Setup();
+}
+
+TEST_CASE(SchedulerSizesWorkerPool) {
+  bool parallel_programs = Flags::parallel_programs;
+  int worker_threads = Flags::worker_threads;
+
+  // A single interpreter needs a single worker, whatever -Xworker_threads
+  // says.
+  Flags::parallel_programs = false;
+  Flags::worker_threads = 3;
+  RestartScheduler();
+  EXPECT_EQ(1, Scheduler::GlobalInstance()->thread_count());
+
+  Flags::parallel_programs = true;
+  RestartScheduler();
+  EXPECT_EQ(3, Scheduler::GlobalInstance()->thread_count());
+
+  Flags::worker_threads = 0;
+  RestartScheduler();
+  EXPECT_EQ(Platform::GetNumberOfHardwareThreads(),
+            Scheduler::GlobalInstance()->thread_count());
+
+  Flags::parallel_programs = parallel_programs;
+  Flags::worker_threads = worker_threads;
+  RestartScheduler();
+}
+
+TEST_CASE(SchedulerWakesOneIdleWorker) {
+  bool parallel_programs = Flags::parallel_programs;
+  int worker_threads = Flags::worker_threads;
+  Flags::parallel_programs = true;
+  Flags::worker_threads = 4;
+  RestartScheduler();
+  Scheduler* scheduler = Scheduler::GlobalInstance();
+  while (scheduler->idle_worker_count() < scheduler->thread_count()) {
+    Thread::YieldCurrentThread();
+  }
+
+  // The process is killed before it is interpreted, by the one worker woken
+  // up by its enqueue.
+  Program* program = new Program(Program::kBuiltViaSession);
+  program->Initialize();
+  program->set_static_fields(program->empty_array());
+  Process* process = program->SpawnProcess(NULL);
+  process->SendSignal(
+      new Signal(process->process_handle(), Signal::kShouldKill));
+  uword wakeups = scheduler->worker_wakeups();
+  int exitcode = 0;
+  SimpleProgramRunner runner;
+  runner.Run(1, &exitcode, &program, 0, NULL, &process);
+  EXPECT_EQ(1, static_cast<int>(scheduler->worker_wakeups() - wakeups));
+  delete program;
+
+  Flags::parallel_programs = parallel_programs;
+  Flags::worker_threads = worker_threads;
+  RestartScheduler();
+}
+
+}  // namespace dartino
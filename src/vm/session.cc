@@ -727,6 +727,8 @@ void Session::PauseExecution() {
   ASSERT(state_->IsScheduled() && !state_->IsPaused());
   Scheduler* scheduler = program()->scheduler();
   scheduler->StopProgram(program(), ProgramState::kSession);
+  // The session may change objects behind the back of the write barrier.
+  program()->AbortConcurrentMarking();
 }
 
 // Caller thread must have a lock on main_thread_monitor_, ie,
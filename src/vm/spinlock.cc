@@ -0,0 +1,86 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/vm/spinlock.h"
+
+#if defined(DARTINO_TARGET_OS_LINUX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "src/vm/thread.h"
+
+namespace dartino {
+
+Atomic<uword> Spinlock::acquisitions_(0);
+Atomic<uword> Spinlock::contended_(0);
+Atomic<uword> Spinlock::parked_(0);
+
+// Tells the CPU that we are in a spin-wait loop.
+static inline void CpuRelax() {
+#if defined(DARTINO_TARGET_IA32) || defined(DARTINO_TARGET_X64)
+#if defined(_MSC_VER)
+  YieldProcessor();
+#else
+  asm volatile("pause");
+#endif
+#elif defined(DARTINO_TARGET_ARM)
+  asm volatile("yield");
+#endif
+}
+
+void Spinlock::LockSlow() {
+  if (Flags::lock_statistics) contended_.fetch_add(1, kRelaxed);
+
+  // Spin, backing off exponentially between attempts. Only try to take the
+  // lock when it looks free, so waiters don't steal the cache line from the
+  // holder.
+  for (int round = 0; round < kSpinRounds; round++) {
+    for (int i = 0; i < (1 << round); i++) CpuRelax();
+    int expected = kUnlocked;
+    if (state_.load(kRelaxed) == kUnlocked &&
+        state_.compare_exchange_weak(expected, kLocked, kAcquire, kRelaxed)) {
+      return;
+    }
+  }
+
+  // Park until the lock is released. Once a thread has parked, the lock stays
+  // marked as having waiters until it is taken by a parked thread, so [Unlock]
+  // errs on the side of waking up a thread.
+  if (Flags::lock_statistics) parked_.fetch_add(1, kRelaxed);
+  while (state_.exchange(kLockedWithWaiters, kAcquire) != kUnlocked) {
+    Park();
+  }
+}
+
+#if defined(DARTINO_TARGET_OS_LINUX)
+
+void Spinlock::Park() {
+  int* address = reinterpret_cast<int*>(&state_);
+  syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, kLockedWithWaiters, NULL,
+          NULL, 0);
+}
+
+void Spinlock::Wake() {
+  int* address = reinterpret_cast<int*>(&state_);
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+#else  // defined(DARTINO_TARGET_OS_LINUX)
+
+// Without futexes parked threads just keep yielding their timeslice.
+void Spinlock::Park() { Thread::YieldCurrentThread(); }
+
+void Spinlock::Wake() {}
+
+#endif  // defined(DARTINO_TARGET_OS_LINUX)
+
+void Spinlock::GetStatistics(Statistics* statistics) {
+  statistics->acquisitions = acquisitions_.load(kRelaxed);
+  statistics->contended = contended_.load(kRelaxed);
+  statistics->parked = parked_.load(kRelaxed);
+}
+
+}  // namespace dartino
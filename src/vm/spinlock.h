@@ -6,26 +6,66 @@
 #define SRC_VM_SPINLOCK_H_
 
 #include "src/shared/atomic.h"
+#include "src/shared/flags.h"
+#include "src/shared/globals.h"
 
 namespace dartino {
 
 // Please limit the use of spinlocks (e.g. reduce critical region to absolute
 // minimum, only if a normal mutex is a bottleneck).
+//
+// An uncontended [Lock] is a single compare-and-swap. A contended [Lock] spins
+// with exponential backoff for a short while and then parks the thread (on a
+// futex where available), so a preempted lock holder doesn't make the waiting
+// threads burn their timeslices.
 class Spinlock {
  public:
-  Spinlock() : is_locked_(false) {}
+  // The statistics are shared by all threads, so they are only counted when
+  // running with -Xlock_statistics.
+  struct Statistics {
+    uword acquisitions;
+    // Acquisitions that found the lock taken.
+    uword contended;
+    // Contended acquisitions that had to park the thread.
+    uword parked;
+  };
 
-  bool IsLocked() const { return is_locked_; }
+  Spinlock() : state_(kUnlocked) {}
+
+  bool IsLocked() const { return state_ != kUnlocked; }
 
   void Lock() {
-    while (is_locked_.exchange(true, kAcquire)) {
+    int expected = kUnlocked;
+    if (!state_.compare_exchange_strong(expected, kLocked, kAcquire,
+                                        kRelaxed)) {
+      LockSlow();
     }
+    if (Flags::lock_statistics) acquisitions_.fetch_add(1, kRelaxed);
+  }
+
+  void Unlock() {
+    if (state_.exchange(kUnlocked, kRelease) == kLockedWithWaiters) Wake();
   }
 
-  void Unlock() { is_locked_.store(false, kRelease); }
+  // Returns the counts accumulated by all spinlocks.
+  static void GetStatistics(Statistics* statistics);
 
  private:
-  Atomic<bool> is_locked_;
+  enum { kUnlocked = 0, kLocked = 1, kLockedWithWaiters = 2 };
+
+  // Number of backoff rounds before parking. The n'th round pauses the CPU
+  // 2^n times.
+  static const int kSpinRounds = 10;
+
+  void LockSlow();
+  void Park();
+  void Wake();
+
+  static Atomic<uword> acquisitions_;
+  static Atomic<uword> contended_;
+  static Atomic<uword> parked_;
+
+  Atomic<int> state_;
 };
 
 class ScopedSpinlock {
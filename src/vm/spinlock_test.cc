@@ -0,0 +1,78 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/shared/assert.h"
+#include "src/shared/test_case.h"
+
+#include "src/vm/spinlock.h"
+#include "src/vm/thread.h"
+
+namespace dartino {
+
+static const int kThreadCount = 4;
+static const int kIterations = 100000;
+
+struct SpinlockTestData {
+  Spinlock lock;
+  int counter;
+};
+
+static void* IncrementCounter(void* arg) {
+  SpinlockTestData* data = reinterpret_cast<SpinlockTestData*>(arg);
+  for (int i = 0; i < kIterations; i++) {
+    ScopedSpinlock locker(&data->lock);
+    data->counter++;
+  }
+  return NULL;
+}
+
+TEST_CASE(Spinlock) {
+  Spinlock lock;
+  EXPECT(!lock.IsLocked());
+  lock.Lock();
+  EXPECT(lock.IsLocked());
+  lock.Unlock();
+  EXPECT(!lock.IsLocked());
+}
+
+// Runs several threads that increment a counter under the same lock, so
+// contended acquisitions go through the spinning and parking paths.
+TEST_CASE(SpinlockContended) {
+  bool lock_statistics = Flags::lock_statistics;
+  Flags::lock_statistics = true;
+  SpinlockTestData data;
+  data.counter = 0;
+  Spinlock::Statistics before;
+  Spinlock::GetStatistics(&before);
+
+  // Hold the lock until one of the threads has found it taken, so at least
+  // one acquisition is contended however the threads are scheduled.
+  data.lock.Lock();
+  ThreadIdentifier threads[kThreadCount];
+  for (int i = 0; i < kThreadCount; i++) {
+    threads[i] = Thread::Run(IncrementCounter, &data);
+  }
+  Spinlock::Statistics during;
+  do {
+    Thread::YieldCurrentThread();
+    Spinlock::GetStatistics(&during);
+  } while (during.contended == before.contended);
+  data.lock.Unlock();
+  for (int i = 0; i < kThreadCount; i++) {
+    threads[i].Join();
+  }
+
+  EXPECT_EQ(kThreadCount * kIterations, data.counter);
+  EXPECT(!data.lock.IsLocked());
+
+  Spinlock::Statistics after;
+  Spinlock::GetStatistics(&after);
+  EXPECT(after.acquisitions - before.acquisitions >
+         static_cast<uword>(kThreadCount * kIterations));
+  EXPECT(after.contended > before.contended);
+  EXPECT(after.parked <= after.contended);
+  Flags::lock_statistics = lock_statistics;
+}
+
+}  // namespace dartino
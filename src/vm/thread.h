@@ -49,6 +49,21 @@ class Thread {
   typedef void* (*RunSignature)(void*);
   static ThreadIdentifier Run(RunSignature run, void* data = NULL);
 
+  // Give up the rest of the calling thread's timeslice.
+  static void YieldCurrentThread();
+
+  // Indices of the VM threads for [ApplyCpuAffinity].
+  enum {
+    kEventHandlerAffinityIndex = 0,
+    kGCThreadAffinityIndex = 1,
+    kFirstWorkerAffinityIndex = 2,
+  };
+
+  // Pin the calling thread to one of the CPUs listed in -Xcpu_affinity. The
+  // CPUs are handed out round-robin by [index]. Does nothing if no CPUs are
+  // listed or if the platform doesn't support thread affinity.
+  static void ApplyCpuAffinity(int index);
+
  private:
   DISALLOW_ALLOCATION();
 };
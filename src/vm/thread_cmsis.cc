@@ -53,6 +53,12 @@ void Thread::TeardownOSSignals() {
   // Platform doesn't have signals.
 }
 
+void Thread::YieldCurrentThread() { osThreadYield(); }
+
+void Thread::ApplyCpuAffinity(int index) {
+  // Thread affinity is not supported on this platform.
+}
+
 ThreadIdentifier Thread::Run(RunSignature run, void* data) {
   char* name = reinterpret_cast<char*>(malloc(strlen(base_name) + 5));
 
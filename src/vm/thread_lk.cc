@@ -38,6 +38,12 @@ void Thread::TeardownOSSignals() {
   // Platform doesn't have signals.
 }
 
+void Thread::YieldCurrentThread() { thread_yield(); }
+
+void Thread::ApplyCpuAffinity(int index) {
+  // Thread affinity is not supported on this platform.
+}
+
 ThreadIdentifier Thread::Run(RunSignature run, void* data) {
   // TODO(herhut): lk threads have int return values.
   thread_t* thread =
@@ -7,9 +7,12 @@
 #include "src/vm/thread.h"  // NOLINT we don't include thread_posix.h.
 
 #include <errno.h>
+#include <sched.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/time.h>
 
+#include "src/shared/flags.h"
 #include "src/shared/platform.h"
 #include "src/shared/utils.h"
 
@@ -66,6 +69,8 @@ void Thread::TeardownOSSignals() {
   }
 }
 
+void Thread::YieldCurrentThread() { sched_yield(); }
+
 ThreadIdentifier Thread::Run(RunSignature run, void* data) {
   pthread_t thread;
   int result = pthread_create(&thread, NULL, run, data);
@@ -80,6 +85,62 @@ ThreadIdentifier Thread::Run(RunSignature run, void* data) {
   return ThreadIdentifier(thread);
 }
 
+#if defined(DARTINO_TARGET_OS_LINUX)
+
+// Returns the [index]'th CPU (modulo the number of CPUs) of [list], which is a
+// comma separated list of CPU numbers and ranges, e.g. "2,3,8-11". Returns -1
+// if the list is malformed.
+static int CpuFromAffinityList(const char* list, int index) {
+  int cpus[CPU_SETSIZE];
+  int count = 0;
+  const char* current = list;
+  while (*current != '\0') {
+    char* end;
+    long first = strtol(current, &end, 10);  // NOLINT
+    if (end == current || first < 0) return -1;
+    long last = first;  // NOLINT
+    if (*end == '-') {
+      current = end + 1;
+      last = strtol(current, &end, 10);
+      if (end == current || last < first) return -1;
+    }
+    if (last >= CPU_SETSIZE) return -1;
+    for (long cpu = first; cpu <= last; cpu++) {  // NOLINT
+      if (count < CPU_SETSIZE) cpus[count++] = cpu;
+    }
+    if (*end == ',') {
+      end++;
+    } else if (*end != '\0') {
+      return -1;
+    }
+    current = end;
+  }
+  if (count == 0) return -1;
+  return cpus[index % count];
+}
+
+void Thread::ApplyCpuAffinity(int index) {
+  const char* list = Flags::cpu_affinity;
+  if (list == NULL) return;
+  int cpu = CpuFromAffinityList(list, index);
+  if (cpu < 0) FATAL1("Invalid CPU list for -Xcpu_affinity: %s\n", list);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (result != 0) {
+    Print::Error("Failed to pin thread to CPU %d (error %d)\n", cpu, result);
+  }
+}
+
+#else  // defined(DARTINO_TARGET_OS_LINUX)
+
+void Thread::ApplyCpuAffinity(int index) {
+  // Mac OS only supports affinity hints, which we don't use.
+}
+
+#endif  // defined(DARTINO_TARGET_OS_LINUX)
+
 }  // namespace dartino
 
 #endif  // defined(DARTINO_TARGET_OS_POSIX)
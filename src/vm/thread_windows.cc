@@ -38,6 +38,12 @@ void Thread::TeardownOSSignals() {
   // Platform doesn't have signals.
 }
 
+void Thread::YieldCurrentThread() { SwitchToThread(); }
+
+void Thread::ApplyCpuAffinity(int index) {
+  // Thread affinity is not supported on this platform.
+}
+
 ThreadIdentifier Thread::Run(RunSignature run, void* data) {
   HANDLE thread = CreateThread(NULL, kDartinoStackSize,
                                reinterpret_cast<LPTHREAD_START_ROUTINE>(run),
@@ -0,0 +1,262 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#ifndef SRC_VM_TIMER_WHEEL_H_
+#define SRC_VM_TIMER_WHEEL_H_
+
+#include "src/shared/assert.h"
+#include "src/shared/globals.h"
+#include "src/shared/utils.h"
+#include "src/vm/hash_map.h"
+
+namespace dartino {
+
+// A hashed hierarchical timer wheel keyed by value. Deadlines are measured
+// in ticks. Inserting, moving and removing a timer are O(1), and expired
+// timers are collected a slot at a time when the wheel advances.
+//
+// The root level has one slot per tick for the next 256 ticks. Each of the
+// four outer levels has 64 slots that each cover the whole range of the
+// level below. A slot of an outer level is cascaded into the lower levels
+// when the time reaches its first tick. Timers further away than 2^32 ticks
+// are kept in the outermost level until they come into range.
+template <typename V>
+class TimerWheel {
+ public:
+  static const int kRootBits = 8;
+  static const int kRootSize = 1 << kRootBits;
+  static const int kLevelBits = 6;
+  static const int kLevelSize = 1 << kLevelBits;
+  static const int kLevels = 4;
+  static const int64 kMaxRange = static_cast<int64>(1)
+                                 << (kRootBits + kLevels * kLevelBits);
+
+  // [now] is the most recent tick; timers at or before it expire at once.
+  explicit TimerWheel(int64 now) : base_(now + 1), size_(0), pending_(0) {
+    Clear(&expired_);
+    for (int i = 0; i < kRootSize; i++) Clear(&root_[i]);
+    for (int level = 0; level < kLevels; level++) {
+      for (int i = 0; i < kLevelSize; i++) Clear(&levels_[level][i]);
+    }
+  }
+
+  ~TimerWheel() {
+    DeleteAll(&expired_);
+    for (int i = 0; i < kRootSize; i++) DeleteAll(&root_[i]);
+    for (int level = 0; level < kLevels; level++) {
+      for (int i = 0; i < kLevelSize; i++) DeleteAll(&levels_[level][i]);
+    }
+  }
+
+  bool IsEmpty() const { return size_ == 0; }
+  int size() const { return size_; }
+
+  bool ContainsValue(const V& value) {
+    return index_.Find(value) != index_.End();
+  }
+
+  // Set the deadline of the timer for [value], adding the timer if there is
+  // none. Returns true if the timer was added.
+  bool InsertOrChangeDeadline(int64 deadline, const V& value) {
+    auto it = index_.Find(value);
+    Timer* timer;
+    bool added = it == index_.End();
+    if (added) {
+      timer = new Timer();
+      timer->value = value;
+      index_[value] = timer;
+      size_++;
+    } else {
+      timer = it->second;
+      Remove(timer);
+    }
+    timer->deadline = deadline;
+    Place(timer);
+    return added;
+  }
+
+  bool RemoveByValue(const V& value) {
+    auto it = index_.Find(value);
+    if (it == index_.End()) return false;
+    Timer* timer = it->second;
+    index_.Erase(it);
+    Remove(timer);
+    delete timer;
+    size_--;
+    return true;
+  }
+
+  // Move the time to [now] and collect the timers that expire on the way.
+  // The time jumps straight to the next tick at which a root slot is due or
+  // an outer slot is cascaded, so empty slots cost nothing at any level.
+  void Advance(int64 now) {
+    while (base_ <= now) {
+      int64 next = NextPendingTick();
+      if (next > now) {
+        base_ = now + 1;
+        return;
+      }
+      ASSERT(next >= base_);
+      base_ = next;
+      int index = base_ & (kRootSize - 1);
+      if (index == 0) Cascade();
+      Timer* slot = &root_[index];
+      base_++;
+      while (!IsEmpty(slot)) {
+        Timer* timer = slot->next;
+        Remove(timer);
+        Place(timer);
+      }
+    }
+  }
+
+  bool HasExpired() const { return expired_.next != &expired_; }
+
+  // Remove one of the expired timers and return its value.
+  V RemoveExpired() {
+    ASSERT(HasExpired());
+    Timer* timer = expired_.next;
+    V value = timer->value;
+    RemoveByValue(value);
+    return value;
+  }
+
+  // Returns a tick at or before the earliest deadline in the wheel, or
+  // INT64_MAX if the wheel is empty. The tick is exact for timers due before
+  // the root level wraps around; for later timers it is the tick at which
+  // they are cascaded, after which the next call is more precise.
+  int64 NextDeadline() const {
+    if (HasExpired()) return base_ - 1;
+    return NextPendingTick();
+  }
+
+ private:
+  struct Timer {
+    int64 deadline;
+    V value;
+    // Whether the timer is in the root or outer levels and not expired.
+    bool pending;
+    Timer* previous;
+    Timer* next;
+  };
+
+  // The next tick to process.
+  int64 base_;
+  int size_;
+  // The number of timers in the root and outer levels.
+  int pending_;
+
+  // Each slot is a circular list with a sentinel.
+  Timer expired_;
+  Timer root_[kRootSize];
+  Timer levels_[kLevels][kLevelSize];
+
+  HashMap<V, Timer*> index_;
+
+  static int Shift(int level) { return kRootBits + level * kLevelBits; }
+
+  // Returns the first tick at or after [base_] at which a root slot is due
+  // or an outer slot is cascaded, or INT64_MAX if no timer is pending.
+  int64 NextPendingTick() const {
+    if (pending_ == 0) return INT64_MAX;
+
+    int current = base_ & (kRootSize - 1);
+    int64 root_start = base_ - current;
+    for (int i = current; i < kRootSize; i++) {
+      if (!IsEmpty(&root_[i])) return root_start + i;
+    }
+
+    int64 result = INT64_MAX;
+    for (int i = 0; i < current; i++) {
+      if (!IsEmpty(&root_[i])) {
+        result = root_start + kRootSize + i;
+        break;
+      }
+    }
+    for (int level = 0; level < kLevels; level++) {
+      int shift = Shift(level);
+      int64 start = base_ >> shift;
+      int index = start & (kLevelSize - 1);
+      // The current slot is still to be cascaded if [base_] is its first
+      // tick.
+      int first = (base_ & ((static_cast<int64>(1) << shift) - 1)) == 0 ? 0 : 1;
+      for (int distance = first; distance <= kLevelSize; distance++) {
+        if (!IsEmpty(&levels_[level][(index + distance) &
+                                     (kLevelSize - 1)])) {
+          result = Utils::Minimum(result, (start + distance) << shift);
+          break;
+        }
+      }
+    }
+    return result;
+  }
+
+  static void Clear(Timer* slot) { slot->previous = slot->next = slot; }
+  static bool IsEmpty(const Timer* slot) { return slot->next == slot; }
+
+  static void DeleteAll(Timer* slot) {
+    while (!IsEmpty(slot)) {
+      Timer* timer = slot->next;
+      Unlink(timer);
+      delete timer;
+    }
+  }
+
+  static void Link(Timer* slot, Timer* timer) {
+    timer->next = slot;
+    timer->previous = slot->previous;
+    slot->previous->next = timer;
+    slot->previous = timer;
+  }
+
+  static void Unlink(Timer* timer) {
+    timer->previous->next = timer->next;
+    timer->next->previous = timer->previous;
+  }
+
+  void Remove(Timer* timer) {
+    if (timer->pending) pending_--;
+    Unlink(timer);
+  }
+
+  void Place(Timer* timer) {
+    int64 deadline = timer->deadline;
+    timer->pending = deadline >= base_;
+    if (!timer->pending) {
+      Link(&expired_, timer);
+      return;
+    }
+    pending_++;
+    int64 delta = deadline - base_;
+    if (delta < kRootSize) {
+      Link(&root_[deadline & (kRootSize - 1)], timer);
+      return;
+    }
+    if (delta >= kMaxRange) deadline = base_ + kMaxRange - 1;
+    int level = 0;
+    while ((deadline - base_) >= (static_cast<int64>(1) << Shift(level + 1))) {
+      level++;
+    }
+    int index = (deadline >> Shift(level)) & (kLevelSize - 1);
+    Link(&levels_[level][index], timer);
+  }
+
+  // Re-place the timers of the outer level slots that start at [base_].
+  void Cascade() {
+    for (int level = 0; level < kLevels; level++) {
+      int index = (base_ >> Shift(level)) & (kLevelSize - 1);
+      Timer* slot = &levels_[level][index];
+      while (!IsEmpty(slot)) {
+        Timer* timer = slot->next;
+        Remove(timer);
+        Place(timer);
+      }
+      if (index != 0) break;
+    }
+  }
+};
+
+}  // namespace dartino
+
+#endif  // SRC_VM_TIMER_WHEEL_H_
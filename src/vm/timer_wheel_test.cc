@@ -0,0 +1,120 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+#include "src/shared/assert.h"
+#include "src/shared/test_case.h"
+
+#include "src/vm/timer_wheel.h"
+
+namespace dartino {
+
+// Advance [wheel] to [now] and return the sum of the expired values.
+static word AdvanceAndSum(TimerWheel<word>* wheel, int64 now) {
+  wheel->Advance(now);
+  word sum = 0;
+  while (wheel->HasExpired()) sum += wheel->RemoveExpired();
+  return sum;
+}
+
+TEST_CASE(TIMER_WHEEL__EXPIRE_IN_ORDER) {
+  TimerWheel<word> wheel(0);
+  for (word i = 1; i <= 100; i++) {
+    EXPECT(wheel.InsertOrChangeDeadline(i * 3, i));
+  }
+  EXPECT_EQ(100, wheel.size());
+  for (word i = 1; i <= 100; i++) {
+    EXPECT(wheel.NextDeadline() <= i * 3);
+    EXPECT_EQ(0, AdvanceAndSum(&wheel, i * 3 - 1));
+    EXPECT(wheel.ContainsValue(i));
+    EXPECT_EQ(i, AdvanceAndSum(&wheel, i * 3));
+    EXPECT(!wheel.ContainsValue(i));
+  }
+  EXPECT(wheel.IsEmpty());
+  EXPECT_EQ(INT64_MAX, wheel.NextDeadline());
+}
+
+TEST_CASE(TIMER_WHEEL__BATCHED_EXPIRY) {
+  TimerWheel<word> wheel(1000);
+  word expected = 0;
+  for (word i = 1; i <= 50; i++) {
+    wheel.InsertOrChangeDeadline(1000 + i * 97, i);
+    expected += i;
+  }
+  EXPECT_EQ(expected, AdvanceAndSum(&wheel, 1000 + 50 * 97));
+  EXPECT(wheel.IsEmpty());
+}
+
+TEST_CASE(TIMER_WHEEL__CHANGE_AND_REMOVE) {
+  TimerWheel<word> wheel(0);
+  EXPECT(wheel.InsertOrChangeDeadline(10, 1));
+  EXPECT(wheel.InsertOrChangeDeadline(20, 2));
+  EXPECT(!wheel.InsertOrChangeDeadline(30, 1));
+  EXPECT_EQ(2, wheel.size());
+  EXPECT_EQ(20, wheel.NextDeadline());
+
+  EXPECT(wheel.RemoveByValue(2));
+  EXPECT(!wheel.RemoveByValue(2));
+  EXPECT_EQ(0, AdvanceAndSum(&wheel, 29));
+  EXPECT_EQ(1, AdvanceAndSum(&wheel, 30));
+  EXPECT(wheel.IsEmpty());
+}
+
+TEST_CASE(TIMER_WHEEL__PAST_DEADLINES) {
+  TimerWheel<word> wheel(500);
+  wheel.InsertOrChangeDeadline(400, 1);
+  wheel.InsertOrChangeDeadline(500, 2);
+  EXPECT(wheel.HasExpired());
+  EXPECT(wheel.NextDeadline() <= 500);
+  EXPECT_EQ(3, AdvanceAndSum(&wheel, 500));
+
+  // Moving a pending timer into the past expires it.
+  wheel.InsertOrChangeDeadline(600, 3);
+  wheel.InsertOrChangeDeadline(450, 3);
+  EXPECT_EQ(3, AdvanceAndSum(&wheel, 500));
+  EXPECT(wheel.IsEmpty());
+}
+
+TEST_CASE(TIMER_WHEEL__CASCADE) {
+  const int64 kDeadlines[] = {
+      255, 256, 257, 1000, 16383, 16384, 16385, 100000, 1 << 20,
+      (1 << 20) + 1, 123456789, static_cast<int64>(1) << 32,
+      (static_cast<int64>(1) << 33) + 7,
+  };
+  const int kCount = sizeof(kDeadlines) / sizeof(kDeadlines[0]);
+
+  TimerWheel<word> wheel(0);
+  for (int i = 0; i < kCount; i++) {
+    wheel.InsertOrChangeDeadline(kDeadlines[i], i);
+  }
+  for (int i = 0; i < kCount; i++) {
+    int64 deadline = kDeadlines[i];
+    // The next deadline is a lower bound that converges to the deadline.
+    int64 next;
+    while ((next = wheel.NextDeadline()) < deadline) {
+      EXPECT(next > 0);
+      EXPECT_EQ(0, AdvanceAndSum(&wheel, next));
+    }
+    EXPECT_EQ(deadline, next);
+    EXPECT_EQ(0, AdvanceAndSum(&wheel, deadline - 1));
+    EXPECT_EQ(i, AdvanceAndSum(&wheel, deadline));
+  }
+  EXPECT(wheel.IsEmpty());
+}
+
+TEST_CASE(TIMER_WHEEL__LARGE_JUMPS) {
+  TimerWheel<word> wheel(0);
+  wheel.InsertOrChangeDeadline(70000, 1);
+  wheel.InsertOrChangeDeadline(70001, 2);
+  EXPECT_EQ(0, AdvanceAndSum(&wheel, 69999));
+  EXPECT_EQ(70000, wheel.NextDeadline());
+  EXPECT_EQ(3, AdvanceAndSum(&wheel, 80000));
+
+  // Timers added after a jump are relative to the new time.
+  wheel.InsertOrChangeDeadline(80100, 3);
+  EXPECT_EQ(80100, wheel.NextDeadline());
+  EXPECT_EQ(3, AdvanceAndSum(&wheel, 90000));
+  EXPECT(wheel.IsEmpty());
+}
+
+}  // namespace dartino
@@ -67,6 +67,8 @@
         'heap_validator.h',
         'intrinsics.cc',
         'intrinsics.h',
+        'latency_histogram.cc',
+        'latency_histogram.h',
         'links.cc',
         'links.h',
         'log_print_interceptor.cc',
@@ -74,6 +76,8 @@
         'lookup_cache.cc',
         'lookup_cache.h',
         'mailbox.h',
+        'mark_sweep.cc',
+        'mark_sweep.h',
         'message_mailbox.h',
         'message_mailbox.cc',
         'multi_hashset.h',
@@ -91,6 +95,8 @@
         'object_memory_mark_sweep.cc',
         'object_memory.h',
         'pair.h',
+        'parker.cc',
+        'parker.h',
         'port.cc',
         'port.h',
         'priority_heap.h',
@@ -108,6 +114,8 @@
         'program_info_block.cc',
         'program_info_block.h',
         'remembered_set.h',
+        'scavenger.cc',
+        'scavenger.h',
         'scheduler.cc',
         'scheduler.h',
         'selector_row.cc',
@@ -122,6 +130,9 @@
         'snapshot.h',
         'sort.h',
         'sort.cc',
+        'spinlock.cc',
+        'spinlock.h',
+        'timer_wheel.h',
         'unicode.cc',
         'unicode.h',
         'vector.cc',
@@ -167,6 +178,8 @@
       ],
       'sources': [
         '<(INTERMEDIATE_DIR)/generated<(asm_file_extension)',
+        'blocking_call_pool.cc',
+        'blocking_call_pool.h',
         'event_handler.h',
         'event_handler.cc',
         'event_handler_posix.cc',
@@ -175,6 +188,8 @@
         'event_handler_windows.cc',
         'event_handler_lk.cc',
         'event_handler_cmsis.cc',
+        'io_uring_linux.cc',
+        'io_uring_linux.h',
         'ffi.cc',
         'ffi_disabled.cc',
         'ffi_static.cc',
@@ -183,6 +198,8 @@
         'ffi_macos.cc',
         'ffi_posix.cc',
         'ffi_windows.cc',
+        'gc_helper_pool.cc',
+        'gc_helper_pool.h',
         'interpreter.cc',
         'interpreter.h',
         'native_interpreter.h',
@@ -344,12 +361,22 @@
       'sources': [
         # TODO(ahe): Add header (.h) files.
         'double_list_tests.cc',
+        'event_handler_linux_test.cc',
         'hash_table_test.cc',
+        'io_uring_linux_test.cc',
+        'latency_histogram_test.cc',
+        'mark_sweep_test.cc',
         'object_map_test.cc',
         'object_memory_test.cc',
         'object_test.cc',
+        'parker_test.cc',
         'platform_test.cc',
         'priority_heap_test.cc',
+        'process_queue_test.cc',
+        'scavenger_test.cc',
+        'scheduler_test.cc',
+        'spinlock_test.cc',
+        'timer_wheel_test.cc',
         'vector_test.cc',
       ],
     },
@@ -0,0 +1,98 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+import 'dart:dartino.ffi';
+import 'dart:dartino';
+import "package:expect/expect.dart";
+
+main() {
+  // We assume that there is a ffi_test_library library build.
+  var libPath = ForeignLibrary.bundleLibraryName('ffi_test_library');
+  ForeignLibrary fl = new ForeignLibrary.fromName(libPath);
+
+  testICall(fl);
+  testVCall(fl);
+  testPCall(fl);
+  testLCall();
+  testBlockingCallDoesNotStallOtherProcesses();
+}
+
+testICall(ForeignLibrary fl) {
+  Expect.equals(0, fl.lookup('ifun0').detached.icall$0());
+  Expect.equals(1, fl.lookup('ifun1').detached.icall$1(1));
+  Expect.equals(-2, fl.lookup('ifun2').detached.icall$2(-1, -1));
+  Expect.equals(3, fl.lookup('ifun3').detached.icall$3(1, 1, 1));
+  Expect.equals(4, fl.lookup('ifun4').detached.icall$4(1, 1, 1, 1));
+  Expect.equals(5, fl.lookup('ifun5').detached.icall$5(1, 1, 1, 1, 1));
+  Expect.equals(6, fl.lookup('ifun6').detached.icall$6(1, 1, 1, 1, 1, 1));
+  Expect.equals(
+      7, fl.lookup('ifun7').detached.icall$7(1, 1, 1, 1, 1, 1, 1));
+  Expect.equals(-1, fl.lookup('ifun1').detached.icall$1(4294967295));
+
+  // The errno set by the foreign function is visible after the call.
+  var icall1EINTR = fl.lookup('ifun1EINTR').detached;
+  Expect.equals(-1, icall1EINTR.icall$1(1));
+  Expect.equals(4, Foreign.errno);
+  Expect.equals(1, icall1EINTR.icall$1Retry(1));
+}
+
+testVCall(ForeignLibrary fl) {
+  var getcount = fl.lookup('getcount').detached;
+  Expect.equals(null, fl.lookup('vfun0').detached.vcall$0());
+  Expect.equals(0, getcount.icall$0());
+  Expect.equals(null, fl.lookup('vfun3').detached.vcall$3(1, 1, 1));
+  Expect.equals(3, getcount.icall$0());
+  Expect.equals(null, fl.lookup('vfun6').detached.vcall$6(1, 1, 1, 1, 1, 1));
+  Expect.equals(6, getcount.icall$0());
+}
+
+testPCall(ForeignLibrary fl) {
+  ForeignPointer pointer = fl.lookup('pfun0').detached.pcall$0();
+  var memory = new ForeignMemory.fromAddress(pointer.address, 16);
+  Expect.equals(1, memory.getInt32(0));
+  Expect.equals(4, memory.getInt32(12));
+  memory.free();
+}
+
+testLCall() {
+  // lseek on an invalid file descriptor fails with EBADF.
+  var lseek = ForeignLibrary.main.lookup('lseek').detached;
+  Expect.equals(-1, lseek.Lcall$wLw(-1, 1 << 40, 0));
+  Expect.equals(9, Foreign.errno);
+}
+
+testBlockingCallDoesNotStallOtherProcesses() {
+  var libc = ForeignLibrary.main;
+  var fds = new ForeignMemory.allocated(8);
+  Expect.equals(0, libc.lookup('pipe').icall$1(fds));
+  int readFd = fds.getInt32(0);
+  int writeFd = fds.getInt32(4);
+  fds.free();
+
+  var channel = new Channel();
+  var port = new Port(channel);
+  Process.spawnDetached(() {
+    // Block on the blocking call pool until the other process writes to the
+    // pipe. If the read stalled the other processes, nothing would ever be
+    // written and the test would time out.
+    port.send(0);
+    var buffer = new ForeignMemory.allocated(1);
+    int read = ForeignLibrary.main.lookup('read').detached
+        .icall$3(readFd, buffer, 1);
+    port.send(read == 1 ? buffer.getUint8(0) : -1);
+    buffer.free();
+  });
+  Expect.equals(0, channel.receive());
+  Process.spawnDetached(() {
+    var buffer = new ForeignMemory.allocated(1);
+    buffer.setUint8(0, 42);
+    ForeignLibrary.main.lookup('write').icall$3(writeFd, buffer, 1);
+    buffer.free();
+  });
+  Expect.equals(42, channel.receive());
+
+  var close = libc.lookup('close');
+  close.icall$1(readFd);
+  close.icall$1(writeFd);
+}
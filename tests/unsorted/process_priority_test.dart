@@ -0,0 +1,32 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+import 'dart:dartino';
+
+import 'package:expect/expect.dart';
+
+main() {
+  Expect.equals(Process.normalPriority, Process.current.priority);
+
+  var channel = new Channel();
+  var port = new Port(channel);
+
+  Process.spawnDetached(() {
+    port.send(Process.current.priority);
+  }, priority: Process.highPriority);
+  Expect.equals(Process.highPriority, channel.receive());
+
+  Expect.isTrue(Process.current.setPriority(Process.lowPriority));
+  Expect.equals(Process.lowPriority, Process.current.priority);
+
+  // Spawned processes inherit the priority of their parent.
+  Process.spawnDetached(() {
+    port.send(Process.current.priority);
+  });
+  Expect.equals(Process.lowPriority, channel.receive());
+
+  Expect.throws(() => Process.current.setPriority(3), (e) => e is RangeError);
+  Expect.throws(() => Process.spawnDetached(() {}, priority: -1),
+                (e) => e is RangeError);
+}
@@ -0,0 +1,30 @@
+// Copyright (c) 2016, the Dartino project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE.md file.
+
+// DartinoOptions=-Xtime_slice=5
+
+import 'dart:dartino';
+
+import 'package:expect/expect.dart';
+
+// How long the spinning process keeps the interpreter busy.
+const int SPIN_MILLISECONDS = 2000;
+
+main() {
+  var channel = new Channel();
+  var port = new Port(channel);
+  Stopwatch watch = new Stopwatch()..start();
+  Process.spawnDetached(() {
+    Stopwatch spin = new Stopwatch()..start();
+    port.send('spinning');
+    while (spin.elapsedMilliseconds < SPIN_MILLISECONDS) {}
+    port.send('done');
+  });
+
+  // The main process can only receive the first message once the spinning
+  // process is preempted at the end of its time slice.
+  Expect.equals('spinning', channel.receive());
+  Expect.isTrue(watch.elapsedMilliseconds < SPIN_MILLISECONDS ~/ 2);
+  Expect.equals('done', channel.receive());
+}